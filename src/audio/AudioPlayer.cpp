@@ -16,6 +16,7 @@
  */
 
 #include "AudioPlayer.h"
+#include "AudioRingBuffer.h"
 
 #include <QDebug>
 
@@ -32,14 +33,21 @@
 
 extern "C"
 {
+#include <libavutil/avutil.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/frame.h>
+#include <libavutil/mathematics.h>
 #include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
 }
 
 
 AudioPlayer::AudioPlayer(QObject *parent)
     : QObject(parent),
       m_isDeviceOpened(false), m_isPlaying(false),
-      m_deviceID(0), m_deviceEnabled(false)
+      m_deviceID(0), m_deviceEnabled(false), m_deviceBufferSamples(0),
+      m_swr(0), m_inputRate(0), m_outputRate(0), m_outputFrameSize(0),
+      m_starved(false), m_videoClock(AV_NOPTS_VALUE)
 {
     if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_TIMER))
     {
@@ -60,15 +68,43 @@ AudioPlayer::AudioPlayer(QObject *parent)
 AudioPlayer::~AudioPlayer()
 {
     stop();
+    swr_free(&m_swr);
     SDL_Quit();
 }
 
-/*
-void AudioPlayer::SDL_AudioCallback(void*  userdata, quint8 *stream, int len)
+void AudioPlayer::audioCallback(void *userdata, quint8 *stream, int len)
+{
+    static_cast<AudioPlayer *>(userdata)->fillBuffer(stream, len);
+}
+
+void AudioPlayer::fillBuffer(quint8 *stream, int len)
 {
+    /* Runs on the SDL audio thread; the ring is not replaced while the device is open */
+    AudioRingBuffer *ring = m_ring.data();
+    if (!ring)
+    {
+        memset(stream, 0, len);
+        return;
+    }
+
+    int excess = ring->available() - bytesForDuration(maximumLatency * 1000);
+    if (excess > 0)
+    {
+        excess -= excess % m_outputFrameSize;
+        m_droppedBytes.fetchAndAddRelaxed(ring->skip(excess));
+    }
 
+    int read = ring->read(reinterpret_cast<char *>(stream), len);
+    if (read < len)
+    {
+        memset(stream + read, 0, len - read);
+        if (!m_starved)
+            m_underruns.ref();
+        m_starved = true;
+    }
+    else
+        m_starved = false;
 }
-*/
 
 void AudioPlayer::play()
 {
@@ -83,10 +119,20 @@ void AudioPlayer::stop()
 {
     if (m_isDeviceOpened)
     {
+        QMutexLocker locker(&m_producerLock);
+
+        /* Closing the device waits for the callback, so the ring is ours afterwards */
         SDL_CloseAudioDevice(m_deviceID);
         m_isDeviceOpened = false;
         m_isPlaying = false;
+
+        logStatistics();
+        if (m_ring)
+            m_ring->clear();
     }
+
+    QMutexLocker locker(&m_clockLock);
+    m_videoClock = AV_NOPTS_VALUE;
 }
 
 void AudioPlayer::setAudioFormat(enum AVSampleFormat fmt, int channelsNum, int sampleRate)
@@ -96,76 +142,171 @@ void AudioPlayer::setAudioFormat(enum AVSampleFormat fmt, int channelsNum, int s
 
     AudioPlayer::stop();
 
+    if (channelsNum <= 0 || sampleRate <= 0)
+        return;
+
     SDL_AudioSpec spec;
-    SDL_AudioFormat sdlFmt;
+    SDL_AudioSpec obtained;
 
     SDL_memset(&spec, 0, sizeof(spec));
 
+    /* Always play packed float; libswresample converts whatever the stream carries,
+     * planar formats included, and the device may pick its own rate and channels */
     spec.freq = sampleRate;
     spec.channels = channelsNum;
-    spec.samples = 8192;
-    spec.callback = NULL;
+    spec.format = AUDIO_F32SYS;
+    spec.samples = 1024;
+    spec.callback = audioCallback;
+    spec.userdata = this;
+
+    m_deviceID = SDL_OpenAudioDevice(NULL, 0, &spec, &obtained,
+                                     SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
 
-    switch(fmt)
+    if (m_deviceID == 0)
     {
-    case AV_SAMPLE_FMT_U8:
-        sdlFmt = AUDIO_U8;
-        break;
-
-    case AV_SAMPLE_FMT_S16:
-        sdlFmt = AUDIO_S16SYS;
-        break;
-
-    case AV_SAMPLE_FMT_S32:
-        sdlFmt = AUDIO_S32SYS;
-        break;
-
-    case AV_SAMPLE_FMT_FLT:
-        sdlFmt = AUDIO_F32SYS;
-        break;
-
-    case AV_SAMPLE_FMT_FLTP:
-        /*
-        Planar formats are not supported by SDL (2.0.4 and older),
-        so we use only single plane and play one channel as a workaround
-        */
-        sdlFmt = AUDIO_F32SYS;
-        spec.channels = 1;
-        break;
-
-    default:
-        qDebug() << "AudioPlayer: sample format " << av_get_sample_fmt_name(fmt) << " is not supported by SDL";
+        qDebug() << "AudioPlayer: failed to open audio device - " << SDL_GetError();
         return;
     }
 
-    spec.format = sdlFmt;
+    QMutexLocker locker(&m_producerLock);
 
-    m_deviceID = SDL_OpenAudioDevice(NULL, 0, &spec, NULL, 0);
+    swr_free(&m_swr);
+    m_swr = swr_alloc_set_opts(0,
+                               av_get_default_channel_layout(obtained.channels), AV_SAMPLE_FMT_FLT, obtained.freq,
+                               av_get_default_channel_layout(channelsNum), fmt, sampleRate,
+                               0, 0);
 
-    if (m_deviceID == 0)
+    if (!m_swr || swr_init(m_swr) < 0)
     {
-        qDebug() << "AudioPlayer: failed to open audio device - " << SDL_GetError();
+        qDebug() << "AudioPlayer: cannot convert sample format " << av_get_sample_fmt_name(fmt);
+        swr_free(&m_swr);
+        SDL_CloseAudioDevice(m_deviceID);
         return;
     }
 
-    m_isDeviceOpened = true;
+    m_inputRate = sampleRate;
+    m_outputRate = obtained.freq;
+    m_outputFrameSize = obtained.channels * int(sizeof(float));
+    m_deviceBufferSamples = obtained.samples;
+    /* Twice the maximum latency, so that a burst arriving just before the callback trims
+     * the queue is not lost */
+    m_ring.reset(new AudioRingBuffer(bytesForDuration(2 * maximumLatency * 1000)));
+    m_convertBuffer.clear();
+    m_starved = false;
 
+    m_isDeviceOpened = true;
 }
 
-void AudioPlayer::feedSamples(void *data, int samplesNum, int bytesNum)
+void AudioPlayer::feedFrame(AVFrame *frame, qint64 pts)
 {
-    if (!m_isDeviceOpened)
-        return;
+    QMutexLocker locker(&m_producerLock);
 
-    //qDebug() << "AudioPlayer: got " << samplesNum << " samples, " << bytesNum << " bytes, time elapsed: " << m_sampleClock.elapsed() << "ms";
+    if (!m_isDeviceOpened || !m_swr || frame->nb_samples <= 0)
+        return;
 
+    qint64 queued = av_rescale(m_ring->available() / m_outputFrameSize + m_deviceBufferSamples, 1000000, m_outputRate);
+    m_queueHistogram.record(queued / 1000);
 
-    int ret = SDL_QueueAudio(m_deviceID, data, bytesNum);
+    /* A positive error means audio is running late, so fewer samples are produced */
+    qint64 error = syncError(pts, queued);
+    if (error == (qint64)AV_NOPTS_VALUE)
+        error = queued - targetLatency * 1000;
 
-    if (ret < 0)
+    int samples = frame->nb_samples;
+    if (qAbs(error) > 10000)
     {
-        qDebug() << "AudioPlayer: SDL_QueueAudio() failed - " << SDL_GetError();
+        int limit = samples * maximumCompensation / 100;
+        int wanted = qBound(samples - limit, samples - int(av_rescale(error, m_inputRate, 1000000)), samples + limit);
+        if (wanted != samples)
+            swr_set_compensation(m_swr, (wanted - samples) * m_outputRate / m_inputRate,
+                                 wanted * m_outputRate / m_inputRate);
     }
 
+    int outSamples = swr_get_out_samples(m_swr, samples);
+    if (outSamples <= 0)
+        return;
+
+    if (m_convertBuffer.size() < outSamples * m_outputFrameSize)
+        m_convertBuffer.resize(outSamples * m_outputFrameSize);
+
+    uint8_t *out = reinterpret_cast<uint8_t *>(m_convertBuffer.data());
+    int converted = swr_convert(m_swr, &out, outSamples, (const uint8_t **)frame->extended_data, samples);
+    if (converted <= 0)
+        return;
+
+    int bytes = converted * m_outputFrameSize;
+    int room = m_ring->freeSpace() / m_outputFrameSize * m_outputFrameSize;
+    int written = m_ring->write(m_convertBuffer.constData(), qMin(bytes, room));
+    if (written < bytes)
+        m_droppedBytes.fetchAndAddRelaxed(bytes - written);
+}
+
+void AudioPlayer::setVideoClock(qint64 pts)
+{
+    QMutexLocker locker(&m_clockLock);
+    m_videoClock = pts;
+    m_videoClockTimer.start();
+}
+
+qint64 AudioPlayer::syncError(qint64 pts, qint64 queued)
+{
+    if (pts == (qint64)AV_NOPTS_VALUE)
+        return AV_NOPTS_VALUE;
+
+    QMutexLocker locker(&m_clockLock);
+
+    /* A stale clock means video is paused or stalled; don't chase it */
+    if (m_videoClock == (qint64)AV_NOPTS_VALUE || m_videoClockTimer.elapsed() > 1000)
+        return AV_NOPTS_VALUE;
+
+    /* These samples play once everything already queued has played; by then the
+     * video clock will have moved on by the same amount */
+    qint64 error = m_videoClock + m_videoClockTimer.nsecsElapsed() / 1000 + queued - pts;
+
+    /* Until RTCP reports map both streams to a common clock their timestamps are
+     * unrelated, which shows up as an absurd difference */
+    if (qAbs(error) > 2000000)
+        return AV_NOPTS_VALUE;
+
+    return error;
+}
+
+int AudioPlayer::bytesForDuration(qint64 usecs) const
+{
+    return int(av_rescale(usecs, m_outputRate, 1000000)) * m_outputFrameSize;
 }
 
+int AudioPlayer::queuedDuration() const
+{
+    QMutexLocker locker(&m_producerLock);
+
+    if (!m_isDeviceOpened || !m_ring)
+        return 0;
+
+    return int(av_rescale(m_ring->available() / m_outputFrameSize + m_deviceBufferSamples, 1000, m_outputRate));
+}
+
+int AudioPlayer::droppedDuration() const
+{
+    QMutexLocker locker(&m_producerLock);
+
+    if (!m_outputRate)
+        return 0;
+
+    return int(av_rescale(m_droppedBytes.load() / m_outputFrameSize, 1000, m_outputRate));
+}
+
+// Calling this method should be protected by m_producerLock
+void AudioPlayer::logStatistics()
+{
+    if (m_queueHistogram.count())
+    {
+        qDebug() << "AudioPlayer: queued audio" << m_queueHistogram.summary()
+                 << "underruns:" << m_underruns.load()
+                 << "dropped:" << av_rescale(m_droppedBytes.load() / m_outputFrameSize, 1000, m_outputRate) << "ms";
+    }
+
+    m_queueHistogram.clear();
+    m_underruns.store(0);
+    m_droppedBytes.store(0);
+}
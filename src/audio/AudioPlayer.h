@@ -18,13 +18,30 @@
 #ifndef AUDIOPLAYER_H
 #define AUDIOPLAYER_H
 
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
 #include <QObject>
+#include <QScopedPointer>
+#include "utils/LatencyHistogram.h"
 
 extern "C"
 {
 #include <libavutil/samplefmt.h>
 }
 
+struct AVFrame;
+struct SwrContext;
+class AudioRingBuffer;
+
+/* Plays the audio of one live stream.
+ *
+ * Decoded frames are converted with libswresample to the format the device was opened
+ * with and put into a ring buffer that the SDL audio callback drains. The amount queued
+ * is held near a target latency, and when the video clock is known the audio is also
+ * nudged towards it, by stretching or squeezing the resampled output a few percent at
+ * most; the queue is cut back to a maximum latency if it ever grows past it. */
+
 class AudioPlayer : public QObject
 {
     Q_OBJECT
@@ -35,19 +52,60 @@ public:
 
     bool isDeviceEnabled() const { return m_deviceEnabled; }
 
+    /* Duration of audio queued ahead of the speaker, in msecs */
+    int queuedDuration() const;
+    int underrunCount() const { return m_underruns.load(); }
+    int droppedDuration() const;
+
 public slots:
     void play();
     void stop();
     void setAudioFormat(enum AVSampleFormat fmt, int channelsNum, int sampleRate);
-    void feedSamples(void *data, int samplesNum, int bytesNum);
+
+    /* Called on the thread decoding the stream, which is the only producer; the frame is
+     * only used for the duration of the call. pts is in microseconds, or AV_NOPTS_VALUE. */
+    void feedFrame(struct AVFrame *frame, qint64 pts);
+
+    /* Presentation time in microseconds of the video frame just displayed, on the same
+     * clock as the audio pts */
+    void setVideoClock(qint64 pts);
 
 private:
+    static const int targetLatency = 150;
+    static const int maximumLatency = 500;
+    static const int maximumCompensation = 5;
 
     bool m_isDeviceOpened;
     bool m_isPlaying;
     int m_deviceID;
     bool m_deviceEnabled;
+    int m_deviceBufferSamples;
+
+    /* Protects the producer side: the resampler, the write end of the ring and the
+     * statistics below */
+    mutable QMutex m_producerLock;
+    SwrContext *m_swr;
+    int m_inputRate;
+    int m_outputRate;
+    int m_outputFrameSize;
+    QByteArray m_convertBuffer;
+    QScopedPointer<AudioRingBuffer> m_ring;
+    LatencyHistogram m_queueHistogram;
+
+    QAtomicInt m_underruns;
+    QAtomicInt m_droppedBytes;
+    /* Only used by the audio callback */
+    bool m_starved;
+
+    QMutex m_clockLock;
+    qint64 m_videoClock;
+    QElapsedTimer m_videoClockTimer;
+
+    static void audioCallback(void *userdata, quint8 *stream, int len);
+    void fillBuffer(quint8 *stream, int len);
+    int bytesForDuration(qint64 usecs) const;
+    qint64 syncError(qint64 pts, qint64 queued);
+    void logStatistics();
 };
 
 #endif
-
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AudioRingBuffer.h"
+#include <string.h>
+
+AudioRingBuffer::AudioRingBuffer(int capacity)
+    : m_readPos(0), m_writePos(0)
+{
+    Q_ASSERT(capacity > 0 && capacity <= (1 << 30));
+
+    int size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    m_buffer.resize(size);
+    m_mask = quint32(size - 1);
+}
+
+int AudioRingBuffer::available() const
+{
+    quint32 writePos = quint32(m_writePos.loadAcquire());
+    quint32 readPos = quint32(m_readPos.loadAcquire());
+    return int(writePos - readPos);
+}
+
+int AudioRingBuffer::write(const char *data, int size)
+{
+    quint32 writePos = quint32(m_writePos.load());
+    quint32 readPos = quint32(m_readPos.loadAcquire());
+
+    size = qMin(size, capacity() - int(writePos - readPos));
+    if (size <= 0)
+        return 0;
+
+    quint32 offset = writePos & m_mask;
+    int first = qMin(size, capacity() - int(offset));
+    memcpy(m_buffer.data() + offset, data, first);
+    memcpy(m_buffer.data(), data + first, size - first);
+
+    m_writePos.storeRelease(int(writePos + quint32(size)));
+    return size;
+}
+
+int AudioRingBuffer::read(char *data, int size)
+{
+    quint32 readPos = quint32(m_readPos.load());
+    quint32 writePos = quint32(m_writePos.loadAcquire());
+
+    size = qMin(size, int(writePos - readPos));
+    if (size <= 0)
+        return 0;
+
+    quint32 offset = readPos & m_mask;
+    int first = qMin(size, capacity() - int(offset));
+    memcpy(data, m_buffer.constData() + offset, first);
+    memcpy(data + first, m_buffer.constData(), size - first);
+
+    m_readPos.storeRelease(int(readPos + quint32(size)));
+    return size;
+}
+
+int AudioRingBuffer::skip(int size)
+{
+    quint32 readPos = quint32(m_readPos.load());
+    quint32 writePos = quint32(m_writePos.loadAcquire());
+
+    size = qMin(size, int(writePos - readPos));
+    if (size <= 0)
+        return 0;
+
+    m_readPos.storeRelease(int(readPos + quint32(size)));
+    return size;
+}
+
+void AudioRingBuffer::clear()
+{
+    m_readPos.storeRelease(0);
+    m_writePos.storeRelease(0);
+}
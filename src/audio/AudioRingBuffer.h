@@ -0,0 +1,58 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIORINGBUFFER_H
+#define AUDIORINGBUFFER_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+
+/* Single-producer, single-consumer byte ring buffer.
+ *
+ * write() may only be called from one thread and read()/skip() from one other thread at
+ * a time; neither blocks. The read and write positions only ever grow (wrapping around
+ * the integer range) and are published with acquire/release ordering, so each side sees
+ * the data the other side has finished with. clear() may only be called while neither
+ * side is active. */
+
+class AudioRingBuffer
+{
+    Q_DISABLE_COPY(AudioRingBuffer)
+
+public:
+    /* The capacity is rounded up to a power of two */
+    explicit AudioRingBuffer(int capacity);
+
+    int capacity() const { return m_buffer.size(); }
+    int available() const;
+    int freeSpace() const { return capacity() - available(); }
+
+    /* Returns the number of bytes actually written or read */
+    int write(const char *data, int size);
+    int read(char *data, int size);
+    int skip(int size);
+
+    void clear();
+
+private:
+    QByteArray m_buffer;
+    quint32 m_mask;
+    QAtomicInt m_readPos;
+    QAtomicInt m_writePos;
+};
+
+#endif // AUDIORINGBUFFER_H
@@ -20,7 +20,8 @@
 #include "server/DVRServer.h"
 
 DVRCameraData::DVRCameraData(int id, DVRServer *server)
-    : m_id(id), m_server(server), m_disabled(false), m_ptzProtocol(DVRCamera::UnknownProtocol)
+    : m_id(id), m_server(server), m_disabled(false), m_ptzProtocol(DVRCamera::UnknownProtocol),
+      m_substreamMode(false)
 {
 }
 
@@ -55,6 +56,15 @@ void DVRCameraData::setPtzProtocol(qint8 ptzProtocol)
     emit changed();
 }
 
+void DVRCameraData::setSubstreamMode(bool substreamMode)
+{
+    if (m_substreamMode == substreamMode)
+        return;
+
+    m_substreamMode = substreamMode;
+    emit changed();
+}
+
 int DVRCameraData::id() const
 {
     return m_id;
@@ -79,3 +89,8 @@ qint8 DVRCameraData::ptzProtocol() const
 {
     return m_ptzProtocol;
 }
+
+bool DVRCameraData::substreamMode() const
+{
+    return m_substreamMode;
+}
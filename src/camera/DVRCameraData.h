@@ -44,6 +44,11 @@ public:
     qint8 ptzProtocol() const;
     void setPtzProtocol(qint8 ptzProtocol);
 
+    /* Whether the server streams the device's substream for live view; a setting of the
+     * device on the server, shared by every viewer */
+    bool substreamMode() const;
+    void setSubstreamMode(bool substreamMode);
+
 signals:
     void changed();
 
@@ -53,6 +58,7 @@ private:
     QString m_displayName;
     bool m_disabled;
     qint8 m_ptzProtocol;
+    bool m_substreamMode;
 
 };
 
@@ -50,6 +50,10 @@ bool DVRCameraXMLReader::readCamera(DVRCamera *camera, QXmlStreamReader &xmlStre
             if (!ok)
                 camera->data().setDisabled(false);
         }
+        else if (xmlStreamReader.name() == QLatin1String("substream_mode"))
+        {
+            camera->data().setSubstreamMode(xmlStreamReader.readElementText().toInt() != 0);
+        }
         else
             xmlStreamReader.skipCurrentElement();
     }
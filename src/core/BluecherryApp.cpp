@@ -17,11 +17,13 @@
 
 #include "BluecherryApp.h"
 #include "LiveViewManager.h"
+#include "core/LiveBandwidthController.h"
 #include "audio/AudioPlayer.h"
 #include "core/VaapiHWAccel.h"
 #include "core/UpdateChecker.h"
 #include "ui/MainWindow.h"
 #include "event/EventDownloadManager.h"
+#include "event/EventCache.h"
 #include "event/ThumbnailManager.h"
 #include "network/MediaDownloadManager.h"
 #include "server/DVRServer.h"
@@ -60,7 +62,7 @@ BluecherryApp::BluecherryApp()
 #if defined (Q_OS_LINUX)
       vaapi(0),
 #endif
-      globalRate(new TransferRateCalculator(this)), m_updateChecker(0),
+      globalRate(new TransferRateCalculator(this)), m_eventCache(0), m_updateChecker(0),
       m_livePaused(false), m_inPauseQuery(false),
       m_screensaverInhibited(false), m_screensaveValue(0)
 {
@@ -89,6 +91,8 @@ BluecherryApp::BluecherryApp()
 #endif
     QSslConfiguration::setDefaultConfiguration(sslConfig);
 
+    connect(this, SIGNAL(settingsChanged()), liveView->bandwidthController(), SLOT(updateSettings()));
+
     clearTempFiles();
     loadServers();
     if (shouldAddLocalServer())
@@ -116,6 +120,9 @@ BluecherryApp::BluecherryApp()
     m_eventDownloadManager = new EventDownloadManager(this);
     connect(m_serverRepository, SIGNAL(serverRemoved(DVRServer*)), m_eventDownloadManager, SLOT(serverRemoved(DVRServer*)));
 
+    m_eventCache = new EventCache(m_serverRepository, this);
+    connect(this, SIGNAL(settingsChanged()), m_eventCache, SLOT(updateSettings()));
+
     registerVideoPlayerFactory();
 
     connect(qApp, SIGNAL(commitDataRequest(QSessionManager&)), this, SLOT(commitDataRequest(QSessionManager&)));
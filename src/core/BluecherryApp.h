@@ -35,6 +35,7 @@ class QSslError;
 class QSslConfiguration;
 class QTimer;
 class LiveViewManager;
+class EventCache;
 class EventDownloadManager;
 class MediaDownloadManager;
 class ThumbnailManager;
@@ -74,6 +75,7 @@ public:
     DVRServerRepository * serverRepository() const { return m_serverRepository; }
     MediaDownloadManager * mediaDownloadManager() const { return m_mediaDownloadManager; }
     EventDownloadManager * eventDownloadManager() const { return m_eventDownloadManager; }
+    EventCache * eventCache() const { return m_eventCache; }
     ThumbnailManager * thumbnailManager() const { return m_thumbnailManager; }
     VideoPlayerFactory * videoPlayerFactory() const { return m_videoPlayerFactory.data(); }
 
@@ -122,6 +124,7 @@ private:
     DVRServerRepository *m_serverRepository;
     MediaDownloadManager *m_mediaDownloadManager;
     EventDownloadManager *m_eventDownloadManager;
+    EventCache *m_eventCache;
     ThumbnailManager *m_thumbnailManager;
     UpdateChecker *m_updateChecker;
     QScopedPointer<VideoPlayerFactory> m_videoPlayerFactory;
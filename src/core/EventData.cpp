@@ -276,11 +276,16 @@ static inline void durationWord(QString &s, int n, const char *w)
 
 QString EventData::uiDuration() const
 {
-    if (inProgress())
+    return uiDuration(durationInSeconds());
+}
+
+QString EventData::uiDuration(int durationInSeconds)
+{
+    if (durationInSeconds < 0)
         return QApplication::translate("EventData", "In progress");
 
     QString re;
-    int d = qMax(1, durationInSeconds()), count = 0;
+    int d = qMax(1, durationInSeconds), count = 0;
 
     if (d >= (60*60*24))
     {
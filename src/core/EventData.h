@@ -155,11 +155,13 @@ public:
     DVRCamera * locationCamera() const;
 
     static QString uiLocation(DVRServer *server, int locationId);
+    static QString uiDuration(int durationInSeconds);
 
     QString baseFileName() const;
 
 };
 
+Q_DECLARE_METATYPE(EventData)
 Q_DECLARE_METATYPE(EventData *)
 
 #endif // EVENTDATA_H
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FisheyeView.h"
+#include <QStringList>
+#include <math.h>
+
+FisheyeView::FisheyeView()
+    : m_mode(Off), m_pan(0), m_tilt(45), m_fov(90)
+{
+}
+
+FisheyeView::FisheyeView(Mode mode, double pan, double tilt, double fov)
+    : m_mode(mode), m_pan(0), m_tilt(45), m_fov(90)
+{
+    setPan(pan);
+    setTilt(tilt);
+    setFov(fov);
+}
+
+void FisheyeView::setPan(double pan)
+{
+    m_pan = fmod(pan, 360);
+    if (m_pan < 0)
+        m_pan += 360;
+}
+
+void FisheyeView::setTilt(double tilt)
+{
+    m_tilt = qBound(0.0, tilt, 90.0);
+}
+
+void FisheyeView::setFov(double fov)
+{
+    m_fov = qBound(20.0, fov, 120.0);
+}
+
+bool FisheyeView::operator==(const FisheyeView &other) const
+{
+    return m_mode == other.m_mode && m_pan == other.m_pan && m_tilt == other.m_tilt && m_fov == other.m_fov;
+}
+
+QString FisheyeView::toString() const
+{
+    return QString::fromLatin1("%1,%2,%3,%4").arg(int(m_mode)).arg(m_pan).arg(m_tilt).arg(m_fov);
+}
+
+FisheyeView FisheyeView::fromString(const QString &string)
+{
+    QStringList values = string.split(QLatin1Char(','));
+    if (values.size() != 4)
+        return FisheyeView();
+
+    int mode = values[0].toInt();
+    if (mode < Off || mode > VirtualPtz)
+        return FisheyeView();
+
+    return FisheyeView(Mode(mode), values[1].toDouble(), values[2].toDouble(), values[3].toDouble());
+}
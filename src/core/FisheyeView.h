@@ -0,0 +1,67 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FISHEYE_VIEW_H
+#define FISHEYE_VIEW_H
+
+#include <QString>
+
+/* How the image of a 360° fisheye camera is dewarped for display. Angles are in degrees;
+ * tilt is measured from the lens axis, so 0 looks straight down from a ceiling mount and
+ * 90 at the horizon. */
+
+class FisheyeView
+{
+public:
+    enum Mode
+    {
+        Off,
+        Panorama,
+        QuadView,
+        VirtualPtz
+    };
+
+    FisheyeView();
+    explicit FisheyeView(Mode mode, double pan = 0, double tilt = 45, double fov = 90);
+
+    Mode mode() const { return m_mode; }
+    bool isEnabled() const { return m_mode != Off; }
+    /* Direction of the view around the lens axis; the left edge for Panorama */
+    double pan() const { return m_pan; }
+    void setPan(double pan);
+    /* Only used by VirtualPtz */
+    double tilt() const { return m_tilt; }
+    void setTilt(double tilt);
+    double fov() const { return m_fov; }
+    void setFov(double fov);
+
+    bool operator==(const FisheyeView &other) const;
+    bool operator!=(const FisheyeView &other) const { return !(*this == other); }
+
+    /* For settings */
+    QString toString() const;
+    static FisheyeView fromString(const QString &string);
+
+private:
+    Mode m_mode;
+    double m_pan;
+    double m_tilt;
+    double m_fov;
+
+};
+
+#endif // FISHEYE_VIEW_H
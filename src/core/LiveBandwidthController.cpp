@@ -0,0 +1,202 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LiveBandwidthController.h"
+#include "core/BluecherryApp.h"
+#include "core/LiveStream.h"
+#include "core/LiveViewManager.h"
+#include <QSet>
+#include <QSettings>
+#include <QDebug>
+
+/* Interval between decisions */
+static const int updateInterval = 2000;
+/* A stream keeps its level at least this long after a switch */
+static const qint64 minimumDwellTime = 10000;
+/* Number of consecutive intervals a condition must hold before acting on it */
+static const int upgradeHoldTicks = 2;
+static const int downgradeHoldTicks = 2;
+/* CPU usage (fraction of all cores) above which streams are stepped down, and below which
+ * they may be stepped up again */
+static const qreal highCpuUsage = 0.85;
+static const qreal lowCpuUsage = 0.6;
+/* Rendered tile heights at which the main stream and the substream are worth their cost */
+static const int mainStreamMinHeight = 400;
+static const int subStreamMinHeight = 160;
+
+LiveBandwidthController::LiveBandwidthController(QObject *parent)
+    : QObject(parent), m_rateLimit(0)
+{
+    m_clock.start();
+
+    m_timer.setInterval(updateInterval);
+    connect(&m_timer, SIGNAL(timeout()), SLOT(update()));
+    m_timer.start();
+
+    updateSettings();
+}
+
+void LiveBandwidthController::updateSettings()
+{
+    QSettings settings;
+    /* Stored in kilobytes per second; 0 means no limit */
+    m_rateLimit = settings.value(QLatin1String("ui/liveview/adaptiveBandwidthLimit"), 0).toUInt() * 1024;
+}
+
+void LiveBandwidthController::setTileSize(QObject *tile, LiveStream *stream, const QSize &size)
+{
+    if (!stream || size.isEmpty())
+    {
+        removeTile(tile);
+        return;
+    }
+
+    if (!m_tiles.contains(tile))
+        connect(tile, SIGNAL(destroyed(QObject*)), SLOT(tileDestroyed(QObject*)));
+
+    Tile &t = m_tiles[tile];
+    t.stream = stream;
+    t.size = size;
+}
+
+void LiveBandwidthController::removeTile(QObject *tile)
+{
+    if (m_tiles.remove(tile))
+        disconnect(tile, SIGNAL(destroyed(QObject*)), this, SLOT(tileDestroyed(QObject*)));
+}
+
+void LiveBandwidthController::tileDestroyed(QObject *tile)
+{
+    m_tiles.remove(tile);
+}
+
+QHash<LiveStream*, QSize> LiveBandwidthController::streamTileSizes() const
+{
+    QHash<LiveStream*, QSize> result;
+    for (QHash<QObject*, Tile>::const_iterator it = m_tiles.constBegin(); it != m_tiles.constEnd(); ++it)
+    {
+        QSize &size = result[it->stream];
+        size = size.expandedTo(it->size);
+    }
+
+    return result;
+}
+
+int LiveBandwidthController::preferredLevel(const QSize &tileSize) const
+{
+    if (tileSize.height() >= mainStreamMinHeight)
+        return LiveViewManager::MainStreamLevel;
+    if (tileSize.height() >= subStreamMinHeight)
+        return LiveViewManager::SubStreamLevel;
+    return LiveViewManager::KeyframeLevel;
+}
+
+bool LiveBandwidthController::switchLevel(LiveStream *stream, int level)
+{
+    if (level < LiveViewManager::MainStreamLevel || level > LiveViewManager::KeyframeLevel
+            || level == stream->adaptiveLevel())
+        return false;
+
+    qDebug() << "LiveBandwidthController: switching stream" << stream << "from level"
+             << stream->adaptiveLevel() << "to" << level;
+
+    stream->setAdaptiveLevel(level);
+
+    StreamState &state = m_states[stream];
+    state.lastSwitch = m_clock.elapsed();
+    state.upgradeTicks = state.downgradeTicks = 0;
+    return true;
+}
+
+void LiveBandwidthController::update()
+{
+    qreal cpu = m_cpuUsage.sample();
+    unsigned rate = bcApp->globalRate->currentRate();
+
+    bool overloaded = cpu > highCpuUsage || (m_rateLimit && rate > m_rateLimit);
+    bool headroom = cpu < lowCpuUsage && (!m_rateLimit || rate < m_rateLimit / 4 * 3);
+
+    qint64 now = m_clock.elapsed();
+    QHash<LiveStream*, QSize> sizes = streamTileSizes();
+
+    LiveStream *overloadCandidate = 0;
+    int overloadCandidateArea = 0;
+
+    QSet<LiveStream*> adaptiveStreams;
+    foreach (LiveStream *stream, bcApp->liveView->streams())
+    {
+        if (stream->bandwidthMode() != LiveViewManager::AdaptiveBandwidth || stream->state() < LiveStream::Connecting)
+            continue;
+
+        adaptiveStreams.insert(stream);
+        StreamState &state = m_states[stream];
+
+        int current = stream->adaptiveLevel();
+        QSize size = sizes.value(stream);
+        int preferred = preferredLevel(size);
+        bool dwelling = state.lastSwitch && now - state.lastSwitch < minimumDwellTime;
+
+        if (preferred > current)
+        {
+            /* The tile shrank; no need to keep paying for the current level */
+            state.upgradeTicks = 0;
+            if (++state.downgradeTicks >= downgradeHoldTicks && !dwelling)
+            {
+                switchLevel(stream, preferred);
+                continue;
+            }
+        }
+        else if (preferred < current)
+        {
+            /* The tile is larger than the level justifies; step up one level at a time,
+             * and only while there is headroom */
+            state.downgradeTicks = 0;
+            state.upgradeTicks = (headroom && !overloaded) ? state.upgradeTicks + 1 : 0;
+            if (state.upgradeTicks >= upgradeHoldTicks && !dwelling)
+            {
+                switchLevel(stream, current - 1);
+                continue;
+            }
+        }
+        else
+        {
+            state.upgradeTicks = state.downgradeTicks = 0;
+        }
+
+        /* Under pressure, give up quality on the smallest tile first; it is where the
+         * extra detail is least visible */
+        int area = size.width() * size.height();
+        if (overloaded && !dwelling && current < LiveViewManager::KeyframeLevel
+                && (!overloadCandidate || area < overloadCandidateArea))
+        {
+            overloadCandidate = stream;
+            overloadCandidateArea = area;
+        }
+    }
+
+    /* Forget streams that went away or left adaptive mode */
+    for (QHash<LiveStream*, StreamState>::iterator it = m_states.begin(); it != m_states.end(); )
+    {
+        if (adaptiveStreams.contains(it.key()))
+            ++it;
+        else
+            it = m_states.erase(it);
+    }
+
+    if (overloadCandidate)
+        switchLevel(overloadCandidate, overloadCandidate->adaptiveLevel() + 1);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIVEBANDWIDTHCONTROLLER_H
+#define LIVEBANDWIDTHCONTROLLER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QHash>
+#include <QSize>
+#include <QTimer>
+#include "utils/CpuUsage.h"
+
+class LiveStream;
+
+/* Picks main stream, substream or keyframe-only delivery for every live stream that is in
+ * LiveViewManager::AdaptiveBandwidth mode.
+ *
+ * The preferred level of a stream follows the largest tile currently showing it. Once per
+ * interval the controller also looks at client CPU usage and the total rate measured by
+ * bcApp->globalRate; under pressure it steps one stream down at a time, and it only steps a
+ * stream back up after the headroom has held for several intervals. Every stream keeps a
+ * level for a minimum time after a switch, so short spikes and window resizes don't cause
+ * flapping.
+ *
+ * Levels are only a request: the substream of an RTSP camera is a setting on the server,
+ * which streams switch only when the user allowed it (RtspStream::updateSubstream). */
+
+class LiveBandwidthController : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LiveBandwidthController(QObject *parent = 0);
+
+    /* Size of a tile showing the stream. A stream may be shown by several tiles at once;
+     * an empty size removes the tile. */
+    void setTileSize(QObject *tile, LiveStream *stream, const QSize &size);
+    void removeTile(QObject *tile);
+
+    qreal cpuUsage() const { return m_cpuUsage.lastSample(); }
+
+public slots:
+    void updateSettings();
+
+private slots:
+    void update();
+    void tileDestroyed(QObject *tile);
+
+private:
+    struct Tile
+    {
+        LiveStream *stream;
+        QSize size;
+    };
+
+    struct StreamState
+    {
+        StreamState() : upgradeTicks(0), downgradeTicks(0), lastSwitch(0) { }
+
+        int upgradeTicks;
+        int downgradeTicks;
+        qint64 lastSwitch;
+    };
+
+    QTimer m_timer;
+    CpuUsage m_cpuUsage;
+    QElapsedTimer m_clock;
+    QHash<QObject*, Tile> m_tiles;
+    QHash<LiveStream*, StreamState> m_states;
+    unsigned m_rateLimit;
+
+    QHash<LiveStream*, QSize> streamTileSizes() const;
+    int preferredLevel(const QSize &tileSize) const;
+    bool switchLevel(LiveStream *stream, int level);
+};
+
+#endif // LIVEBANDWIDTHCONTROLLER_H
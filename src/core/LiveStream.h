@@ -18,8 +18,11 @@
 #ifndef LIVESTREAM_H
 #define LIVESTREAM_H
 
+#include "FisheyeView.h"
+#include <QBitArray>
 #include <QImage>
 #include <QObject>
+#include <QRectF>
 #include <QSize>
 
 class LiveStream : public QObject
@@ -31,6 +34,7 @@ class LiveStream : public QObject
     Q_PROPERTY(bool paused READ isPaused WRITE setPaused NOTIFY pausedChanged)
     Q_PROPERTY(int bandwidthMode READ bandwidthMode WRITE setBandwidthMode NOTIFY bandwidthModeChanged)
     Q_PROPERTY(float receivedFps READ receivedFps CONSTANT)
+    Q_PROPERTY(int latency READ latency CONSTANT)
     Q_PROPERTY(QSize streamSize READ streamSize NOTIFY streamSizeChanged)
     Q_PROPERTY(State state READ state NOTIFY stateChanged)
     Q_PROPERTY(QString errdesc READ errorMessage CONSTANT)
@@ -53,24 +57,48 @@ public:
     explicit LiveStream(QObject *parent = 0);
     
     virtual int bandwidthMode() const = 0;
+    /* LiveViewManager::StreamLevel in use while in adaptive bandwidth mode */
+    virtual int adaptiveLevel() const = 0;
     virtual bool hwAccelStatus() const = 0;
 
     virtual State state() const = 0;
     virtual QString errorMessage() const = 0;
 
     virtual QImage currentFrame() const = 0;
+    /* Also returns the part of the stream the frame shows, relative to the stream size */
+    virtual QImage currentFrame(QRectF *crop) const = 0;
     virtual QSize streamSize() const = 0;
+    /* Cells of RtspMotionDetector's grid with motion in the current frame, row by row;
+     * empty when the stream doesn't detect motion */
+    virtual QBitArray motionCells() const = 0;
 
     virtual float receivedFps() const = 0;
+    /* Camera-to-screen latency of recent frames in msecs, or -1 if the stream does not
+     * carry capture times */
+    virtual int latency() const = 0;
 
     virtual bool isPaused() const = 0;
     virtual bool isConnected() const  = 0;
 
     virtual bool hasAudio() const = 0;
     virtual bool isAudioEnabled() const  = 0;
+    /* Seconds of recent video buffered locally that rewind() can replay */
+    virtual int rewindAvailable() const = 0;
+    virtual bool isRewinding() const = 0;
+    /* Recording to local files, see RtspStreamRecorder */
+    virtual bool isRecording() const = 0;
     virtual void setFrameSizeHint(int width, int height) = 0;
+    /* Digital zoom: only this part of the stream, relative to its size, needs to be in the
+     * frames. Streams that can't crop while decoding keep delivering whole frames. */
+    virtual void setCropRect(const QRectF &rect) = 0;
+    /* Applies to every tile showing the stream; streams that can't dewarp ignore it */
+    virtual void setFisheyeView(const FisheyeView &view) = 0;
+    /* Set while a tile showing this stream has keyboard focus */
+    virtual void setFocused(bool focused) = 0;
     virtual void ref() = 0;
     virtual void unref() = 0;
+    /* Shown by more than one tile; cropping and dewarping don't apply then */
+    virtual bool isShared() const = 0;
 
 public slots:
     virtual void start() = 0;
@@ -80,8 +108,13 @@ public slots:
     virtual void togglePaused() { setPaused(!isPaused()); }
     virtual void setOnline(bool online) = 0;
     virtual void setBandwidthMode(int bandwidthMode) = 0;
+    virtual void setAdaptiveLevel(int level) = 0;
     virtual void enableAudio(bool enable) = 0;
     virtual void enableHWAccel(bool hwAccel) = 0;
+    virtual void rewind(int seconds) = 0;
+    virtual void resumeLive() = 0;
+    virtual void startRecording() = 0;
+    virtual void stopRecording() = 0;
 
 signals:
     void stateChanged(int newState);
@@ -94,6 +127,8 @@ signals:
     void streamSizeChanged(const QSize &size);
     void updated();
     void audioChanged();
+    void rewindingChanged(bool rewinding);
+    void recordingChanged(bool recording);
 
     
 };
@@ -16,14 +16,72 @@
  */
 
 #include "LiveViewManager.h"
+#include "core/BluecherryApp.h"
+#include "core/LiveBandwidthController.h"
 #include "core/LiveStream.h"
+#include "network/LiveStreamGateway.h"
+#include "rtsp-stream/RtspRecordingWriter.h"
+#include "utils/ImageDecodePool.h"
 #include <QAction>
+#include <QThread>
 
 LiveViewManager::LiveViewManager(QObject *parent)
-    : QObject(parent), m_bandwidthMode(FullBandwidth)
+    : QObject(parent), m_bandwidthMode(FullBandwidth), m_decodePool(new ImageDecodePool),
+      m_bandwidthController(new LiveBandwidthController(this)),
+      m_recordingThread(0), m_recordingWriter(0), m_gatewayThread(0), m_streamGateway(0)
 {
 }
 
+LiveViewManager::~LiveViewManager()
+{
+    if (m_recordingThread)
+    {
+        /* Complete the files of recordings still running */
+        QMetaObject::invokeMethod(m_recordingWriter, "finishAll", Qt::BlockingQueuedConnection);
+        m_recordingThread->quit();
+        m_recordingThread->wait();
+    }
+
+    if (m_gatewayThread)
+    {
+        m_gatewayThread->quit();
+        m_gatewayThread->wait();
+    }
+}
+
+RtspRecordingWriter *LiveViewManager::recordingWriter()
+{
+    if (!m_recordingWriter)
+    {
+        m_recordingThread = new QThread(this);
+        m_recordingWriter = new RtspRecordingWriter;
+        m_recordingWriter->moveToThread(m_recordingThread);
+
+        connect(m_recordingThread, SIGNAL(started()), m_recordingWriter, SLOT(start()));
+        connect(m_recordingThread, SIGNAL(finished()), m_recordingWriter, SLOT(deleteLater()));
+        m_recordingThread->start(QThread::LowPriority);
+    }
+
+    return m_recordingWriter;
+}
+
+LiveStreamGateway *LiveViewManager::streamGateway()
+{
+    if (!m_streamGateway)
+    {
+        m_gatewayThread = new QThread(this);
+        m_streamGateway = new LiveStreamGateway;
+        m_streamGateway->moveToThread(m_gatewayThread);
+
+        connect(m_gatewayThread, SIGNAL(started()), m_streamGateway, SLOT(updateSettings()));
+        connect(m_gatewayThread, SIGNAL(finished()), m_streamGateway, SLOT(deleteLater()));
+        connect(bcApp, SIGNAL(settingsChanged()), m_streamGateway, SLOT(updateSettings()));
+        m_gatewayThread->start();
+    }
+
+    return m_streamGateway;
+}
+
 void LiveViewManager::switchAudio(LiveStream *stream)
 {
     //disable audio on all streams except passed as argument
@@ -80,6 +138,7 @@ QList<QAction*> LiveViewManager::bandwidthActions(int cv, QObject *target,
 {
     QList<QAction*> re;
     re << createAction(tr("Full Bandwidth"), FullBandwidth, cv, target, slot)
-       << createAction(tr("Low Bandwidth"), LowBandwidth, cv, target, slot);
+       << createAction(tr("Low Bandwidth"), LowBandwidth, cv, target, slot)
+       << createAction(tr("Adaptive Bandwidth"), AdaptiveBandwidth, cv, target, slot);
     return re;
 }
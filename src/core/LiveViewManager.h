@@ -19,9 +19,15 @@
 #define LIVEVIEWMANAGER_H
 
 #include <QObject>
+#include <QScopedPointer>
 
+class ImageDecodePool;
+class LiveBandwidthController;
 class LiveStream;
+class LiveStreamGateway;
 class QAction;
+class QThread;
+class RtspRecordingWriter;
 
 class LiveViewManager : public QObject
 {
@@ -34,13 +40,31 @@ public:
     enum BandwidthMode
     {
         FullBandwidth,
-        LowBandwidth
+        LowBandwidth,
+        AdaptiveBandwidth
+    };
+
+    /* Delivery level picked by LiveBandwidthController for streams in AdaptiveBandwidth mode */
+    enum StreamLevel
+    {
+        MainStreamLevel,
+        SubStreamLevel,
+        KeyframeLevel
     };
 
     explicit LiveViewManager(QObject *parent = 0);
+    virtual ~LiveViewManager();
 
     QList<LiveStream *> streams() const;
 
+    /* Pool used for decoding MJPEG frames; see ImageDecodePool */
+    ImageDecodePool *decodePool() const { return m_decodePool.data(); }
+    LiveBandwidthController *bandwidthController() const { return m_bandwidthController; }
+    /* Thread writing local recordings, started on first use */
+    RtspRecordingWriter *recordingWriter();
+    /* Thread re-serving live streams to local players, started on first use */
+    LiveStreamGateway *streamGateway();
+
     BandwidthMode bandwidthMode() const { return m_bandwidthMode; }
 
     QList<QAction*> bandwidthActions(int currentMode, QObject *target, const char *slot) const;
@@ -55,6 +79,12 @@ signals:
 private:
     QList<LiveStream*> m_streams;
     BandwidthMode m_bandwidthMode;
+    QScopedPointer<ImageDecodePool> m_decodePool;
+    LiveBandwidthController *m_bandwidthController;
+    QThread *m_recordingThread;
+    RtspRecordingWriter *m_recordingWriter;
+    QThread *m_gatewayThread;
+    LiveStreamGateway *m_streamGateway;
 
     friend class RtspStream;
     friend class MJpegStream;
@@ -18,6 +18,8 @@
 #include "BluecherryApp.h"
 #include "MJpegStream.h"
 #include "LiveViewManager.h"
+#include "LoggableUrl.h"
+#include "utils/ImageDecodePool.h"
 #include "utils/ImageDecodeTask.h"
 #include "audio/AudioPlayer.h"
 #include <QNetworkAccessManager>
@@ -25,20 +27,23 @@
 #include <QNetworkReply>
 #include <QDebug>
 #include <QImage>
-#include <QThreadPool>
 #include <QTimer>
 #include <QDateTime>
 
 MJpegStream::MJpegStream(DVRCamera *camera, QObject *parent)
     : LiveStream(parent), m_camera(camera), m_httpReply(0), m_currentFrameNo(0), m_latestFrameNo(0), m_fpsRecvTs(0), m_fpsRecvNo(0),
-      m_decodeTask(0), m_lastActivity(0), m_receivedFps(0), m_nam(0), m_httpBodyLength(0), m_state(NotConnected),
-      m_parserState(ParserBoundary), m_autoStart(false), m_paused(false), m_interval(1)
+      m_decodeTask(0), m_receivedFps(0), m_decodeLatency(0), m_droppedFrames(0), m_nam(0),
+      m_httpBodyLength(0), m_state(NotConnected), m_parserState(ParserBoundary), m_autoStart(false), m_paused(false),
+      m_focused(false), m_interval(1), m_bandwidthMode(LiveViewManager::FullBandwidth), m_adaptiveLevel(LiveViewManager::MainStreamLevel)
 {
     Q_ASSERT(m_camera);
     //connect(m_camera.data(), SIGNAL(destroyed(QObject*)), this, SLOT(deleteLater()));
 
     bcApp->liveView->addStream(this);
     connect(&m_activityTimer, SIGNAL(timeout()), SLOT(checkActivity()));
+
+    m_retryTimer.setSingleShot(true);
+    connect(&m_retryTimer, SIGNAL(timeout()), SLOT(start()));
 }
 
 MJpegStream::~MJpegStream()
@@ -85,7 +90,7 @@ void MJpegStream::setError(const QString &message)
     setState(Error);
     stop();
 
-    QTimer::singleShot(15000, this, SLOT(start()));
+    m_retryTimer.start(m_backoff.nextDelay());
 }
 
 void MJpegStream::start()
@@ -132,11 +137,14 @@ void MJpegStream::start()
     connect(m_httpReply, SIGNAL(finished()), SLOT(requestError()));
     connect(m_httpReply, SIGNAL(readyRead()), SLOT(readable()));
 
-    m_activityTimer.start(30000);
+    m_lastActivity.start();
+    m_activityTimer.start(activityCheckInterval);
 }
 
 void MJpegStream::stop()
 {
+    logLatency();
+
     if (m_httpReply)
     {
         m_httpReply->disconnect(this);
@@ -163,9 +171,22 @@ void MJpegStream::stop()
     }
 
     m_activityTimer.stop();
+    m_retryTimer.stop();
     m_fpsRecvTs = 0;
     m_fpsRecvNo = 0;
     m_receivedFps = 0;
+    m_decodeLatency = 0;
+}
+
+void MJpegStream::logLatency()
+{
+    if (!m_decodeLatency)
+        return;
+
+    /* Same layout as the latency stages that RTSP streams log when they stop */
+    qDebug() << "MJpegStream: latency for" << LoggableUrl(url());
+    qDebug() << "     decode" << m_decodeLatency << "ms average";
+    qDebug() << "     dropped frames" << m_droppedFrames;
 }
 
 void MJpegStream::setOnline(bool online)
@@ -199,13 +220,40 @@ void MJpegStream::setBandwidthMode(int value)
         return;
 
     m_bandwidthMode = (LiveViewManager::BandwidthMode)value;
-    //TODO:
-    m_interval = m_bandwidthMode == LiveViewManager::FullBandwidth
-            ? 1
-            : 8;
-
     emit bandwidthModeChanged(value);
 
+    updateInterval();
+}
+
+void MJpegStream::setAdaptiveLevel(int level)
+{
+    if (level == m_adaptiveLevel)
+        return;
+
+    m_adaptiveLevel = (LiveViewManager::StreamLevel)level;
+    if (m_bandwidthMode == LiveViewManager::AdaptiveBandwidth)
+        updateInterval();
+}
+
+void MJpegStream::updateInterval()
+{
+    qint8 interval = 1;
+    if (m_bandwidthMode == LiveViewManager::LowBandwidth)
+        interval = 8;
+    else if (m_bandwidthMode == LiveViewManager::AdaptiveBandwidth)
+    {
+        /* MJPEG has no substream; a lower frame rate is the closest equivalent */
+        if (m_adaptiveLevel == LiveViewManager::SubStreamLevel)
+            interval = 2;
+        else if (m_adaptiveLevel == LiveViewManager::KeyframeLevel)
+            interval = 8;
+    }
+
+    if (interval == m_interval)
+        return;
+
+    m_interval = interval;
+
     if (state() >= Connecting)
     {
         stop();
@@ -282,7 +330,7 @@ void MJpegStream::readable()
     if (!m_httpReply)
         return;
 
-    m_lastActivity = QDateTime::currentDateTime().toTime_t();
+    m_lastActivity.restart();
 
     if (m_httpBoundary.isNull())
     {
@@ -447,7 +495,7 @@ bool MJpegStream::parseBuffer()
 
 void MJpegStream::checkActivity()
 {
-    if (QDateTime::currentDateTime().toTime_t() - m_lastActivity > 30)
+    if (m_lastActivity.elapsed() > activityTimeout)
         setError(QLatin1String("Stream timeout"));
 }
 
@@ -461,15 +509,23 @@ void MJpegStream::requestError()
 
 void MJpegStream::decodeFrame(const QByteArray &data)
 {
-    /* This will cancel the task if it hasn't started yet; in-progress or completed tasks will still
-     * deliver a result */
-    if (m_decodeTask)
-        m_decodeTask->cancel();
+    ImageDecodePool *pool = bcApp->liveView->decodePool();
+
+    /* A frame that is still waiting for a thread is stale now; take it out of the pool so it
+     * is never decoded. In-progress or completed tasks will still deliver a result. */
+    if (m_decodeTask && pool->drop(m_decodeTask))
+        ++m_droppedFrames;
 
     m_decodeTask = new ImageDecodeTask(this, "decodeFrameResult", ++m_latestFrameNo);
     m_decodeTask->setData(data);
 
-    QThreadPool::globalInstance()->start(m_decodeTask);
+    ImageDecodePool::Priority priority = ImageDecodePool::NormalPriority;
+    if (m_focused)
+        priority = ImageDecodePool::FocusedPriority;
+    else if (m_interval != 1)
+        priority = ImageDecodePool::BackgroundPriority;
+
+    pool->start(m_decodeTask, priority);
 
     quint64 now = QDateTime::currentMSecsSinceEpoch();
     if (now - m_fpsRecvTs >= 1500)
@@ -491,6 +547,10 @@ void MJpegStream::decodeFrameResult(ThreadTask *task)
     if (decodeTask->result().isNull() || decodeTask->imageId <= m_currentFrameNo)
         return;
 
+    /* Exponential moving average, roughly over the last 16 frames */
+    float latency = float(decodeTask->elapsed());
+    m_decodeLatency = m_decodeLatency ? m_decodeLatency + (latency - m_decodeLatency) / 16 : latency;
+
     bool sizeChanged = decodeTask->result().size() != m_currentFrame.size();
     m_currentFrame = decodeTask->result();
     m_currentFrameNo = decodeTask->imageId;
@@ -500,5 +560,8 @@ void MJpegStream::decodeFrameResult(ThreadTask *task)
     emit updated();
 
     if (m_state == Buffering)
+    {
         setState(Streaming);
+        m_backoff.connected();
+    }
 }
@@ -18,6 +18,7 @@
 #ifndef MJPEGSTREAM_H
 #define MJPEGSTREAM_H
 
+#include <QElapsedTimer>
 #include <QObject>
 #include <QUrl>
 #include <QPixmap>
@@ -25,6 +26,7 @@
 #include "camera/DVRCamera.h"
 #include "core/LiveViewManager.h"
 #include "core/LiveStream.h"
+#include "utils/ReconnectBackoff.h"
 
 class QNetworkAccessManager;
 class QNetworkReply;
@@ -43,24 +45,39 @@ public:
     QUrl url() const;
 
     int bandwidthMode() const { return m_bandwidthMode; }
+    int adaptiveLevel() const { return m_adaptiveLevel; }
     bool hwAccelStatus() const { return false; }
 
     State state() const { return m_state; }
     QString errorMessage() const { return m_errorMessage; }
 
     QImage currentFrame() const { return m_currentFrame; }
+    QImage currentFrame(QRectF *crop) const { *crop = QRectF(0, 0, 1, 1); return m_currentFrame; }
     QSize streamSize() const { return m_currentFrame.size(); }
+    QBitArray motionCells() const { return QBitArray(); }
 
     float receivedFps() const { return m_receivedFps; }
+    int latency() const { return -1; }
+    /* Average time from receiving a frame to having it decoded, in milliseconds */
+    float decodeLatency() const { return m_decodeLatency; }
+    /* Frames skipped because a newer one arrived before decoding started */
+    quint64 droppedFrames() const { return m_droppedFrames; }
 
     bool isPaused() const { return m_paused; }
     bool isConnected() const { return state() > Connecting; }
 
     bool hasAudio() const { return false; }
     bool isAudioEnabled() const { return false; }
+    int rewindAvailable() const { return 0; }
+    bool isRewinding() const { return false; }
+    bool isRecording() const { return false; }
     void setFrameSizeHint(int width, int height) { return; }
+    void setCropRect(const QRectF &rect) { Q_UNUSED(rect); }
+    void setFisheyeView(const FisheyeView &view) { Q_UNUSED(view); }
+    void setFocused(bool focused) { m_focused = focused; }
     void ref() {}
     void unref() {}
+    bool isShared() const { return false; }
 
 public slots:
     void start();
@@ -70,8 +87,13 @@ public slots:
     void togglePaused() { setPaused(!isPaused()); }
     void setOnline(bool online);
     void setBandwidthMode(int bandwidthMode);
+    void setAdaptiveLevel(int level);
     void enableAudio(bool);
     void enableHWAccel(bool hwAccel) {}
+    void rewind(int seconds) { Q_UNUSED(seconds); }
+    void resumeLive() {}
+    void startRecording() {}
+    void stopRecording() {}
 
 private slots:
     void readable();
@@ -89,9 +111,16 @@ private:
     quint64 m_currentFrameNo, m_latestFrameNo;
     quint64 m_fpsRecvTs, m_fpsRecvNo;
     ImageDecodeTask *m_decodeTask;
+    static const int activityCheckInterval = 5000;
+    static const int activityTimeout = 30000;
+
     QTimer m_activityTimer;
-    uint m_lastActivity;
+    QElapsedTimer m_lastActivity;
+    QTimer m_retryTimer;
+    ReconnectBackoff m_backoff;
     float m_receivedFps;
+    float m_decodeLatency;
+    quint64 m_droppedFrames;
 
     QNetworkAccessManager *m_nam;
 
@@ -102,12 +131,15 @@ private:
         ParserHeaders,
         ParserBody
     } m_parserState;
-    bool m_autoStart, m_paused;
+    bool m_autoStart, m_paused, m_focused;
     qint8 m_interval;
     LiveViewManager::BandwidthMode m_bandwidthMode;
+    LiveViewManager::StreamLevel m_adaptiveLevel;
 
     void setState(State newState);
+    void logLatency();
     void setError(const QString &message);
+    void updateInterval();
 
     bool processHeaders();
     bool parseBuffer();
@@ -27,7 +27,7 @@
 #include <QNetworkCookie>
 
 ServerRequestManager::ServerRequestManager(DVRServer *s)
-    : QObject(s), server(s), m_loginReply(0), m_switchSubstreamReply(0), m_status(DVRServer::Offline)
+    : QObject(s), server(s), m_loginReply(0), m_status(DVRServer::Offline)
 {
 }
 
@@ -98,12 +98,14 @@ QNetworkReply *ServerRequestManager::sendRequest(const QUrl &relativeUrl)
 
 void ServerRequestManager::switchSubstream(int device_id, bool substream_enabled)
 {
-    if (m_switchSubstreamReply)
+    /* Only the latest request for a device matters; requests for other devices are
+     * independent and must not be aborted */
+    QNetworkReply *previous = m_switchSubstreamReplies.take(device_id);
+    if (previous)
     {
-        m_switchSubstreamReply->disconnect(this);
-        m_switchSubstreamReply->abort();
-        m_switchSubstreamReply->deleteLater();
-        m_switchSubstreamReply = 0;
+        previous->disconnect(this);
+        previous->abort();
+        previous->deleteLater();
     }
 
     QNetworkRequest req = buildRequest(QUrl(QLatin1String("/ajax/update.php")));
@@ -115,19 +117,27 @@ void ServerRequestManager::switchSubstream(int device_id, bool substream_enabled
     queryData.addQueryItem(QLatin1String("id"), QString::number(device_id));
     queryData.addQueryItem(QLatin1String("substream_mode"), QString::number(substream_enabled ? 1 : 0));
 
-    m_switchSubstreamReply = bcApp->nam->post(req, queryData.encodedQuery());
-    m_switchSubstreamReply->ignoreSslErrors();
-    connect(m_switchSubstreamReply, SIGNAL(finished()), SLOT(switchSubstreamReplyReady()));
+    QNetworkReply *reply = bcApp->nam->post(req, queryData.encodedQuery());
+    reply->ignoreSslErrors();
+    reply->setProperty("deviceId", device_id);
+    reply->setProperty("substreamEnabled", substream_enabled);
+    connect(reply, SIGNAL(finished()), SLOT(switchSubstreamReplyReady()));
+
+    m_switchSubstreamReplies.insert(device_id, reply);
 }
 
 void ServerRequestManager::switchSubstreamReplyReady()
 {
-    if (!m_switchSubstreamReply || sender() != m_switchSubstreamReply)
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    if (!reply)
+        return;
+
+    int deviceId = reply->property("deviceId").toInt();
+    if (m_switchSubstreamReplies.value(deviceId) != reply)
         return;
 
-    QNetworkReply *reply = m_switchSubstreamReply;
-    m_switchSubstreamReply->deleteLater();
-    m_switchSubstreamReply = 0;
+    m_switchSubstreamReplies.remove(deviceId);
+    reply->deleteLater();
 
     if (reply->error() != QNetworkReply::NoError)
     {
@@ -137,6 +147,8 @@ void ServerRequestManager::switchSubstreamReplyReady()
 
     QByteArray data = reply->readAll();
     qDebug() << data;
+
+    emit substreamSwitched(deviceId, reply->property("substreamEnabled").toBool());
 }
 
 void ServerRequestManager::login(const QString &username, const QString &password)
@@ -19,6 +19,7 @@
 #define SERVERREQUESTMANAGER_H
 
 #include "server/DVRServer.h"
+#include <QHash>
 #include <QObject>
 #include <QNetworkRequest>
 #include <QNetworkReply>
@@ -54,6 +55,7 @@ signals:
     void disconnected();
     void statusChanged(int status);
     void onlineChanged(bool online);
+    void substreamSwitched(int deviceId, bool substreamEnabled);
 
 public slots:
     void logout();
@@ -65,7 +67,7 @@ private slots:
 private:
     QString m_errorMessage;
     QNetworkReply *m_loginReply;
-    QNetworkReply *m_switchSubstreamReply;
+    QHash<int, QNetworkReply*> m_switchSubstreamReplies;
     DVRServer::Status m_status;
 
     void setStatus(DVRServer::Status status, const QString &errorMessage = QString());
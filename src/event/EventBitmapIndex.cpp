@@ -0,0 +1,167 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EventBitmapIndex.h"
+#include "EventStore.h"
+
+static void growTo(QBitArray &bits, int size)
+{
+    /* Grow geometrically, as slots are mostly appended one at a time */
+    if (size > bits.size())
+        bits.resize(qMax(size, bits.size() + bits.size() / 2));
+}
+
+qint64 EventBitmapIndex::dayOf(qint64 msecs)
+{
+    qint64 day = msecs / MSecsPerDay;
+    if (msecs % MSecsPerDay < 0)
+        --day;
+    return day;
+}
+
+void EventBitmapIndex::setSlot(QVector<QBitArray> &bitmaps, int index, int slot)
+{
+    if (index < 0)
+        return;
+    if (index >= bitmaps.size())
+        bitmaps.resize(index + 1);
+
+    QBitArray &bits = bitmaps[index];
+    growTo(bits, slot + 1);
+    bits.setBit(slot);
+}
+
+void EventBitmapIndex::clearSlot(QVector<QBitArray> &bitmaps, int index, int slot)
+{
+    if (index < 0 || index >= bitmaps.size())
+        return;
+
+    QBitArray &bits = bitmaps[index];
+    if (slot < bits.size())
+        bits.clearBit(slot);
+}
+
+void EventBitmapIndex::insert(int slot, int level, int type, int source, qint64 startTime)
+{
+    Q_ASSERT(slot >= 0);
+
+    setSlot(m_levels, level, slot);
+    setSlot(m_types, type + 1, slot);
+    setSlot(m_sources, source, slot);
+
+    if (startTime == EventStore::NoTime)
+        return;
+
+    DaySlots &day = m_days[dayOf(startTime)];
+    if (day.count == 0)
+    {
+        day.base = slot;
+        day.bits = QBitArray();
+    }
+    else if (slot < day.base)
+    {
+        /* Move the base down, leaving some room for further reused slots */
+        int base = qMax(0, slot - day.bits.size() / 2);
+        int shift = day.base - base;
+        QBitArray bits(day.bits.size() + shift);
+        for (int i = 0; i < day.bits.size(); ++i)
+        {
+            if (day.bits.testBit(i))
+                bits.setBit(i + shift);
+        }
+
+        day.base = base;
+        day.bits = bits;
+    }
+
+    growTo(day.bits, slot - day.base + 1);
+    day.bits.setBit(slot - day.base);
+    ++day.count;
+}
+
+void EventBitmapIndex::remove(int slot, int level, int type, int source, qint64 startTime)
+{
+    clearSlot(m_levels, level, slot);
+    clearSlot(m_types, type + 1, slot);
+    clearSlot(m_sources, source, slot);
+
+    if (startTime == EventStore::NoTime)
+        return;
+
+    QMap<qint64, DaySlots>::Iterator it = m_days.find(dayOf(startTime));
+    if (it == m_days.end())
+        return;
+
+    int bit = slot - it->base;
+    if (bit < 0 || bit >= it->bits.size() || !it->bits.testBit(bit))
+        return;
+
+    it->bits.clearBit(bit);
+    if (--it->count == 0)
+        m_days.erase(it);
+}
+
+void EventBitmapIndex::clear()
+{
+    m_levels.clear();
+    m_types.clear();
+    m_sources.clear();
+    m_days.clear();
+}
+
+QBitArray EventBitmapIndex::startedWithin(qint64 from, qint64 to, const QVector<qint64> &startTimes) const
+{
+    QBitArray result(startTimes.size());
+    if (from > to)
+        return result;
+
+    qint64 lastDay = dayOf(to);
+    for (QMap<qint64, DaySlots>::ConstIterator it = m_days.lowerBound(dayOf(from));
+         it != m_days.constEnd() && it.key() <= lastDay; ++it)
+    {
+        bool whole = it.key() * MSecsPerDay >= from && (it.key() + 1) * MSecsPerDay - 1 <= to;
+
+        for (int i = 0; i < it->bits.size(); ++i)
+        {
+            if (!it->bits.testBit(i))
+                continue;
+
+            int slot = it->base + i;
+            if (whole || (startTimes[slot] >= from && startTimes[slot] <= to))
+                result.setBit(slot);
+        }
+    }
+
+    return result;
+}
+
+qint64 EventBitmapIndex::memoryUsage() const
+{
+    qint64 bits = 0;
+    foreach (const QBitArray &bitmap, m_levels)
+        bits += bitmap.size();
+    foreach (const QBitArray &bitmap, m_types)
+        bits += bitmap.size();
+    foreach (const QBitArray &bitmap, m_sources)
+        bits += bitmap.size();
+
+    qint64 bytes = bits / 8;
+    for (QMap<qint64, DaySlots>::ConstIterator it = m_days.constBegin(); it != m_days.constEnd(); ++it)
+        bytes += it->bits.size() / 8 + sizeof(DaySlots) + sizeof(qint64);
+
+    return bytes;
+}
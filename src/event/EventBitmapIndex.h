@@ -0,0 +1,73 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENTBITMAPINDEX_H
+#define EVENTBITMAPINDEX_H
+
+#include <QBitArray>
+#include <QMap>
+#include <QVector>
+
+/* Bitmaps over EventStore slots, one per level, type, source and day, so that
+ * a filter becomes a few bitwise operations instead of a test of every event.
+ * Bitmaps only grow as far as the highest slot they hold; missing bits are clear.
+ *
+ * Days are UTC and usually hold a narrow band of slots, so each one keeps its
+ * own base slot rather than a bitmap over the whole store. */
+class EventBitmapIndex
+{
+public:
+    enum { MSecsPerDay = 86400000 };
+
+    static qint64 dayOf(qint64 msecs);
+
+    /* level and type are the EventLevel and EventType values; startTime may be
+     * EventStore::NoTime, which is kept out of every day */
+    void insert(int slot, int level, int type, int source, qint64 startTime);
+    void remove(int slot, int level, int type, int source, qint64 startTime);
+    void clear();
+
+    QBitArray levelSlots(int level) const { return m_levels.value(level); }
+    QBitArray typeSlots(int type) const { return m_types.value(type + 1); }
+    QBitArray sourceSlots(int source) const { return m_sources.value(source); }
+
+    /* Slots starting within [from, to]. Days wholly inside the range are taken
+     * as they are; the days at either end are checked against startTimes. */
+    QBitArray startedWithin(qint64 from, qint64 to, const QVector<qint64> &startTimes) const;
+
+    qint64 memoryUsage() const;
+
+private:
+    struct DaySlots
+    {
+        int base;
+        int count;
+        QBitArray bits;
+
+        DaySlots() : base(0), count(0) { }
+    };
+
+    QVector<QBitArray> m_levels;
+    QVector<QBitArray> m_types;
+    QVector<QBitArray> m_sources;
+    QMap<qint64, DaySlots> m_days;
+
+    static void setSlot(QVector<QBitArray> &bitmaps, int index, int slot);
+    static void clearSlot(QVector<QBitArray> &bitmaps, int index, int slot);
+};
+
+#endif // EVENTBITMAPINDEX_H
@@ -0,0 +1,659 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EventCache.h"
+#include "core/EventData.h"
+#include "server/DVRServer.h"
+#include "server/DVRServerConfiguration.h"
+#include "server/DVRServerRepository.h"
+#include "utils/FileUtils.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDesktopServices>
+#include <QDir>
+#include <QFileInfo>
+#include <QSet>
+#include <QSettings>
+#include <QDebug>
+#include <algorithm>
+#include <string.h>
+
+static const char cacheMagic[4] = { 'B', 'C', 'E', 'V' };
+static const quint32 cacheVersion = 1;
+
+/* Events this recent may still be added or changed by the server, so they aren't covered */
+static const uint cacheSettleSeconds = 5 * 60;
+
+struct EventCacheHeader
+{
+    char magic[4];
+    quint32 version;
+    quint32 recordSize;
+    quint32 reserved;
+};
+
+/* Native byte order; the cache never leaves the machine */
+struct EventCacheRecord
+{
+    qint64 eventId;
+    qint64 mediaId;
+    qint64 startTime; /* Milliseconds since the epoch */
+    qint32 duration;
+    qint32 locationId;
+    qint16 tzOffsetMins;
+    quint8 level;
+    qint8 type;
+    quint32 reserved;
+};
+
+static void toRecord(const EventData &event, EventCacheRecord *record)
+{
+    memset(record, 0, sizeof(*record));
+    record->eventId = event.eventId();
+    record->mediaId = event.mediaId();
+    record->startTime = event.localStartDate().toMSecsSinceEpoch();
+    record->duration = event.durationInSeconds();
+    record->locationId = event.locationId();
+    record->tzOffsetMins = event.serverDateTzOffsetMins();
+    record->level = quint8(event.level().level);
+    record->type = qint8(event.type().type);
+}
+
+static QSharedPointer<EventData> fromRecord(DVRServer *server, const EventCacheRecord &record)
+{
+    QSharedPointer<EventData> event(new EventData(server));
+    event->setEventId(record.eventId);
+    event->setMediaId(record.mediaId);
+    event->setUtcStartDate(QDateTime::fromMSecsSinceEpoch(record.startTime, Qt::UTC));
+    event->setDurationInSeconds(record.duration);
+    event->setLocationId(record.locationId);
+    event->setServerDateTzOffsetMins(record.tzOffsetMins);
+    event->setLevel(EventLevel(EventLevel::Level(record.level)));
+    event->setType(EventType(EventType::Type(record.type)));
+    return event;
+}
+
+namespace
+{
+
+class RecordTimeLessThan
+{
+public:
+    explicit RecordTimeLessThan(const EventCacheRecord *records) : m_records(records) { }
+
+    bool operator()(int a, int b) const
+    {
+        if (m_records[a].startTime != m_records[b].startTime)
+            return m_records[a].startTime < m_records[b].startTime;
+        return m_records[a].eventId < m_records[b].eventId;
+    }
+
+private:
+    const EventCacheRecord *m_records;
+};
+
+}
+
+ServerEventCache::ServerEventCache(const QString &path)
+    : m_path(path), m_map(0), m_recordCount(0)
+{
+}
+
+ServerEventCache::~ServerEventCache()
+{
+    close();
+}
+
+QString ServerEventCache::coveragePath() const
+{
+    return m_path + QLatin1String("/coverage.dat");
+}
+
+bool ServerEventCache::open()
+{
+    if (isOpen())
+        return true;
+
+    QDir().mkpath(m_path);
+    m_file.setFileName(m_path + QLatin1String("/events.dat"));
+    if (!m_file.open(QIODevice::ReadWrite))
+    {
+        qWarning() << "EventCache: cannot open" << m_file.fileName() << m_file.errorString();
+        return false;
+    }
+
+    if (!validateHeader())
+    {
+        if (m_file.size() > 0)
+            qDebug() << "EventCache: discarding incompatible cache" << m_file.fileName();
+
+        QFile::remove(coveragePath());
+        if (!m_file.resize(0) || !writeHeader())
+        {
+            qWarning() << "EventCache: cannot write" << m_file.fileName() << m_file.errorString();
+            m_file.close();
+            return false;
+        }
+    }
+
+    /* Drop a record that was only partly written */
+    qint64 dataSize = m_file.size() - sizeof(EventCacheHeader);
+    m_recordCount = int(dataSize / sizeof(EventCacheRecord));
+    if (dataSize % sizeof(EventCacheRecord))
+        m_file.resize(sizeof(EventCacheHeader) + qint64(m_recordCount) * sizeof(EventCacheRecord));
+
+    mapFile();
+    buildIndex();
+    loadCoverage();
+    return true;
+}
+
+void ServerEventCache::close()
+{
+    unmapFile();
+    m_file.close();
+    m_recordCount = 0;
+    m_timeIndex.clear();
+    m_idIndex.clear();
+    m_coverage = RangeMap();
+}
+
+void ServerEventCache::remove()
+{
+    close();
+    QFile::remove(m_path + QLatin1String("/events.dat"));
+    QFile::remove(coveragePath());
+    QDir().rmdir(m_path);
+}
+
+qint64 ServerEventCache::fileSize() const
+{
+    if (isOpen())
+        return m_file.size();
+    return QFileInfo(m_path + QLatin1String("/events.dat")).size();
+}
+
+bool ServerEventCache::writeHeader()
+{
+    EventCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, cacheMagic, sizeof(header.magic));
+    header.version = cacheVersion;
+    header.recordSize = sizeof(EventCacheRecord);
+
+    return m_file.seek(0) && m_file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == sizeof(header);
+}
+
+bool ServerEventCache::validateHeader()
+{
+    EventCacheHeader header;
+    if (!m_file.seek(0) || m_file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header))
+        return false;
+
+    return memcmp(header.magic, cacheMagic, sizeof(header.magic)) == 0 && header.version == cacheVersion
+            && header.recordSize == sizeof(EventCacheRecord);
+}
+
+bool ServerEventCache::mapFile()
+{
+    unmapFile();
+    if (!m_recordCount)
+        return true;
+
+    m_map = m_file.map(0, m_file.size());
+    if (m_map)
+        return true;
+
+    /* Some filesystems can't be mapped; read the file instead */
+    m_file.seek(0);
+    m_buffer = m_file.readAll();
+    return m_buffer.size() == m_file.size();
+}
+
+void ServerEventCache::unmapFile()
+{
+    if (m_map)
+        m_file.unmap(m_map);
+    m_map = 0;
+    m_buffer.clear();
+}
+
+const EventCacheRecord *ServerEventCache::records() const
+{
+    const uchar *data = m_map ? m_map : reinterpret_cast<const uchar *>(m_buffer.constData());
+    if (!data)
+        return 0;
+    return reinterpret_cast<const EventCacheRecord *>(data + sizeof(EventCacheHeader));
+}
+
+void ServerEventCache::buildIndex()
+{
+    m_timeIndex.clear();
+    m_idIndex.clear();
+    indexRecords(0);
+}
+
+/* Adds records from first on to the indexes, replacing older records of the same events */
+void ServerEventCache::indexRecords(int first)
+{
+    const EventCacheRecord *data = records();
+    if (!data || first >= m_recordCount)
+        return;
+
+    QSet<int> superseded;
+    for (int i = first; i < m_recordCount; ++i)
+    {
+        QHash<qint64, int>::iterator it = m_idIndex.find(data[i].eventId);
+        if (it != m_idIndex.end())
+        {
+            superseded.insert(*it);
+            *it = i;
+        }
+        else
+            m_idIndex.insert(data[i].eventId, i);
+    }
+
+    if (!superseded.isEmpty())
+    {
+        QVector<int> kept;
+        kept.reserve(m_timeIndex.size());
+        foreach (int record, m_timeIndex)
+        {
+            if (!superseded.contains(record))
+                kept.append(record);
+        }
+        m_timeIndex = kept;
+    }
+
+    int merged = m_timeIndex.size();
+    for (int i = first; i < m_recordCount; ++i)
+    {
+        if (!superseded.contains(i))
+            m_timeIndex.append(i);
+    }
+
+    RecordTimeLessThan lessThan(data);
+    std::sort(m_timeIndex.begin() + merged, m_timeIndex.end(), lessThan);
+    std::inplace_merge(m_timeIndex.begin(), m_timeIndex.begin() + merged, m_timeIndex.end(), lessThan);
+}
+
+int ServerEventCache::lowerBound(qint64 startTime) const
+{
+    const EventCacheRecord *data = records();
+    int low = 0, high = m_timeIndex.size();
+
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (data[m_timeIndex[middle]].startTime < startTime)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+QList<QSharedPointer<EventData> > ServerEventCache::events(DVRServer *server, uint from, uint to) const
+{
+    QList<QSharedPointer<EventData> > result;
+    const EventCacheRecord *data = records();
+    if (!data || to < from)
+        return result;
+
+    qint64 end = qint64(to) * 1000 + 999;
+    for (int i = lowerBound(qint64(from) * 1000); i < m_timeIndex.size(); ++i)
+    {
+        const EventCacheRecord &record = data[m_timeIndex[i]];
+        if (record.startTime > end)
+            break;
+        result.append(fromRecord(server, record));
+    }
+
+    return result;
+}
+
+Range ServerEventCache::missingRange(uint from, uint to)
+{
+    if (to < from)
+        return Range::invalid();
+
+    return m_coverage.nextMissingRange(Range::fromStartEnd(from, to));
+}
+
+bool ServerEventCache::append(const QList<QSharedPointer<EventData> > &events)
+{
+    if (!isOpen())
+        return false;
+
+    const EventCacheRecord *data = records();
+    QByteArray buffer;
+
+    foreach (const QSharedPointer<EventData> &event, events)
+    {
+        if (event->inProgress() || !event->localStartDate().isValid())
+            continue;
+
+        EventCacheRecord record;
+        toRecord(*event, &record);
+
+        /* Unchanged events are already there */
+        int existing = m_idIndex.value(record.eventId, -1);
+        if (existing >= 0 && memcmp(&data[existing], &record, sizeof(record)) == 0)
+            continue;
+
+        buffer.append(reinterpret_cast<const char *>(&record), sizeof(record));
+    }
+
+    if (buffer.isEmpty())
+        return true;
+
+    int first = m_recordCount;
+    unmapFile();
+
+    qint64 end = sizeof(EventCacheHeader) + qint64(m_recordCount) * sizeof(EventCacheRecord);
+    if (!m_file.seek(end) || m_file.write(buffer) != buffer.size() || !m_file.flush())
+    {
+        qWarning() << "EventCache: cannot write" << m_file.fileName() << m_file.errorString();
+        m_file.resize(end);
+        mapFile();
+        return false;
+    }
+
+    m_recordCount += buffer.size() / int(sizeof(EventCacheRecord));
+    mapFile();
+    indexRecords(first);
+    return true;
+}
+
+void ServerEventCache::addCoverage(uint from, uint to)
+{
+    if (!isOpen() || to < from)
+        return;
+
+    m_coverage.insert(Range::fromStartEnd(from, to));
+    saveCoverage();
+}
+
+void ServerEventCache::addFetchCoverage(uint from, uint to, const QList<uint> &inProgressStarts, uint oldestReceived,
+                                        bool limited)
+{
+    uint end = qMin(to, QDateTime::currentDateTime().toTime_t() - cacheSettleSeconds);
+    uint oldest = qMin(end, oldestReceived);
+
+    foreach (uint eventStart, inProgressStarts)
+    {
+        if (eventStart > 0)
+            end = qMin(end, eventStart - 1);
+    }
+
+    if (limited)
+        from = qMax(from, oldest + 1);
+
+    addCoverage(from, end);
+}
+
+void ServerEventCache::loadCoverage()
+{
+    m_coverage = RangeMap();
+
+    QFile file(coveragePath());
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&file);
+    quint32 version, count;
+    stream >> version >> count;
+    if (version != cacheVersion)
+        return;
+
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+    {
+        quint32 start, end;
+        stream >> start >> end;
+        if (stream.status() == QDataStream::Ok && end >= start)
+            m_coverage.insert(Range::fromStartEnd(start, end));
+    }
+}
+
+void ServerEventCache::saveCoverage()
+{
+    QString tmpPath = coveragePath() + QLatin1String(".tmp");
+    QFile file(tmpPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning() << "EventCache: cannot write" << tmpPath << file.errorString();
+        return;
+    }
+
+    QList<Range> ranges = m_coverage.ranges();
+
+    QDataStream stream(&file);
+    stream << cacheVersion << quint32(ranges.size());
+    foreach (const Range &range, ranges)
+        stream << quint32(range.start()) << quint32(range.end());
+    file.close();
+
+    QFile::remove(coveragePath());
+    QFile::rename(tmpPath, coveragePath());
+}
+
+void ServerEventCache::evict(qint64 maxSize)
+{
+    if (!isOpen())
+        return;
+
+    int live = m_timeIndex.size();
+    qint64 recordsSize = qint64(live) * sizeof(EventCacheRecord);
+
+    if (fileSize() <= maxSize)
+    {
+        /* Still compact once superseded records outnumber the live ones */
+        if (m_recordCount - live > live && m_recordCount > 1024)
+        {
+            QVector<int> all = m_timeIndex;
+            rewrite(all);
+        }
+        return;
+    }
+
+    /* Leave room to grow, so that eviction doesn't happen on every append */
+    qint64 target = qMax(qint64(0), maxSize * 3 / 4 - qint64(sizeof(EventCacheHeader)));
+    int keep = int(qMin(recordsSize, target) / sizeof(EventCacheRecord));
+
+    QVector<int> kept = m_timeIndex.mid(live - keep);
+    qint64 cutoff = keep ? records()[kept.first()].startTime / 1000 : -1;
+
+    QList<Range> ranges = m_coverage.ranges();
+    m_coverage = RangeMap();
+    if (cutoff >= 0)
+    {
+        foreach (const Range &range, ranges)
+        {
+            if (range.end() < cutoff)
+                continue;
+            m_coverage.insert(Range::fromStartEnd(qMax(uint(cutoff), range.start()), range.end()));
+        }
+    }
+    saveCoverage();
+
+    qDebug() << "EventCache: evicting" << (live - keep) << "events from" << m_path;
+    rewrite(kept);
+}
+
+/* Writes the given records, in order, to a new file which then replaces the current one */
+bool ServerEventCache::rewrite(const QVector<int> &keep)
+{
+    QString fileName = m_file.fileName();
+    QFile file(fileName + QLatin1String(".tmp"));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning() << "EventCache: cannot write" << file.fileName() << file.errorString();
+        return false;
+    }
+
+    EventCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, cacheMagic, sizeof(header.magic));
+    header.version = cacheVersion;
+    header.recordSize = sizeof(EventCacheRecord);
+
+    QByteArray buffer;
+    buffer.reserve(sizeof(header) + keep.size() * sizeof(EventCacheRecord));
+    buffer.append(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    const EventCacheRecord *data = records();
+    foreach (int record, keep)
+        buffer.append(reinterpret_cast<const char *>(&data[record]), sizeof(EventCacheRecord));
+
+    bool ok = file.write(buffer) == buffer.size();
+    file.close();
+    if (!ok)
+    {
+        file.remove();
+        return false;
+    }
+
+    unmapFile();
+    m_file.close();
+    QFile::remove(fileName);
+    QFile::rename(file.fileName(), fileName);
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadWrite))
+    {
+        qWarning() << "EventCache: cannot open" << fileName << m_file.errorString();
+        close();
+        return false;
+    }
+
+    m_recordCount = keep.size();
+    mapFile();
+    buildIndex();
+    return true;
+}
+
+EventCache::EventCache(DVRServerRepository *serverRepository, QObject *parent)
+    : QObject(parent), m_serverRepository(serverRepository), m_maxSize(0)
+{
+    Q_ASSERT(m_serverRepository);
+
+    m_directory = QDesktopServices::storageLocation(QDesktopServices::CacheLocation) + QLatin1String("/events");
+
+    foreach (DVRServer *server, m_serverRepository->servers())
+        connect(server, SIGNAL(serverRemoved(DVRServer*)), SLOT(serverRemoved(DVRServer*)));
+    connect(m_serverRepository, SIGNAL(serverAdded(DVRServer*)), SLOT(serverAdded(DVRServer*)));
+
+    updateSettings();
+}
+
+EventCache::~EventCache()
+{
+    qDeleteAll(m_caches);
+}
+
+void EventCache::updateSettings()
+{
+    QSettings settings;
+    m_maxSize = qint64(settings.value(QLatin1String("ui/events/cacheSize"), 64).toInt()) * 1024 * 1024;
+
+    if (!isEnabled())
+    {
+        qDeleteAll(m_caches);
+        m_caches.clear();
+    }
+
+    foreach (ServerEventCache *cache, m_caches)
+        cache->evict(m_maxSize);
+
+    removeStaleCaches();
+}
+
+/* Each configured server and account gets its own cache: two entries for the same address
+ * are removed separately, and accounts may be allowed to see different cameras */
+QString EventCache::serverCachePath(DVRServer *server) const
+{
+    const DVRServerConfiguration &configuration = server->configuration();
+    QString key = QString::fromLatin1("%1_%2@%3_%4").arg(configuration.id()).arg(configuration.username())
+            .arg(configuration.hostname()).arg(configuration.port());
+    return m_directory + QLatin1Char('/') + sanitizeFilename(key);
+}
+
+ServerEventCache *EventCache::serverCache(DVRServer *server)
+{
+    if (!isEnabled() || !server)
+        return 0;
+
+    QString path = serverCachePath(server);
+
+    ServerEventCache *cache = m_caches.value(path);
+    if (!cache)
+    {
+        cache = new ServerEventCache(path);
+        if (!cache->open())
+        {
+            delete cache;
+            return 0;
+        }
+        m_caches.insert(path, cache);
+    }
+
+    return cache;
+}
+
+void EventCache::serverAdded(DVRServer *server)
+{
+    connect(server, SIGNAL(serverRemoved(DVRServer*)), SLOT(serverRemoved(DVRServer*)));
+}
+
+/* The server was deleted by the user, so its events won't be needed again */
+void EventCache::serverRemoved(DVRServer *server)
+{
+    QString path = serverCachePath(server);
+
+    ServerEventCache *cache = m_caches.take(path);
+    if (!cache)
+        cache = new ServerEventCache(path);
+
+    cache->remove();
+    delete cache;
+}
+
+/* Deletes the caches of servers that are no longer configured, or all of them when
+ * caching is disabled */
+void EventCache::removeStaleCaches()
+{
+    QSet<QString> used;
+    if (isEnabled())
+    {
+        foreach (DVRServer *server, m_serverRepository->servers())
+            used.insert(QFileInfo(serverCachePath(server)).fileName());
+    }
+
+    QDir directory(m_directory);
+    foreach (const QString &name, directory.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        if (used.contains(name))
+            continue;
+
+        QString path = m_directory + QLatin1Char('/') + name;
+        delete m_caches.take(path);
+
+        ServerEventCache cache(path);
+        cache.remove();
+    }
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENTCACHE_H
+#define EVENTCACHE_H
+
+#include "utils/RangeMap.h"
+#include <QFile>
+#include <QHash>
+#include <QObject>
+#include <QSharedPointer>
+#include <QVector>
+
+class DVRServer;
+class DVRServerRepository;
+class EventData;
+struct EventCacheRecord;
+
+/* Completed events of one server, kept on disk.
+ *
+ * Events are appended as fixed-size records to a single file, which is mapped into
+ * memory for reading; a newer record for the same ID supersedes the older one. The
+ * file is indexed by start time and ID when opened. Alongside it, the time ranges
+ * that are known to be complete (fully fetched, with no events still in progress)
+ * are kept, so that only the rest has to be asked from the server.
+ *
+ * Times are in seconds since the epoch, as in event queries. */
+class ServerEventCache
+{
+public:
+    explicit ServerEventCache(const QString &path);
+    ~ServerEventCache();
+
+    QString path() const { return m_path; }
+
+    bool open();
+    void close();
+    bool isOpen() const { return m_file.isOpen(); }
+    /* Closes the cache and deletes its files */
+    void remove();
+
+    int size() const { return m_timeIndex.size(); }
+    qint64 fileSize() const;
+
+    /* Events starting within [from, to], oldest first */
+    QList<QSharedPointer<EventData> > events(DVRServer *server, uint from, uint to) const;
+    /* The first part of [from, to] that isn't covered; invalid if all of it is */
+    Range missingRange(uint from, uint to);
+
+    /* Adds the completed events; events in progress are skipped */
+    bool append(const QList<QSharedPointer<EventData> > &events);
+    void addCoverage(uint from, uint to);
+    /* Covers what a completed fetch of [from, to] settles. The last few minutes, and
+     * everything after the start of an event still in progress, may still change. If a
+     * limit cut the fetch short, only the events after the oldest one received are known. */
+    void addFetchCoverage(uint from, uint to, const QList<uint> &inProgressStarts, uint oldestReceived, bool limited);
+
+    /* Drops the oldest events, and the coverage before them, until the file fits */
+    void evict(qint64 maxSize);
+
+private:
+    QString m_path;
+    QFile m_file;
+    uchar *m_map;
+    QByteArray m_buffer; /* Used instead when the file can't be mapped */
+    int m_recordCount;
+
+    /* Live records, by start time and by ID */
+    QVector<int> m_timeIndex;
+    QHash<qint64, int> m_idIndex;
+    RangeMap m_coverage;
+
+    QString coveragePath() const;
+
+    const EventCacheRecord *records() const;
+    int lowerBound(qint64 startTime) const;
+    bool mapFile();
+    void unmapFile();
+    bool writeHeader();
+    bool validateHeader();
+    void buildIndex();
+    void indexRecords(int first);
+
+    void loadCoverage();
+    void saveCoverage();
+
+    bool rewrite(const QVector<int> &records);
+};
+
+/* The event caches of all servers, in the user's cache directory.
+ *
+ * Caches are keyed by the configured server and its account, so they survive
+ * reconnections and restarts. Caches of servers that are no longer configured are
+ * deleted. */
+class EventCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit EventCache(DVRServerRepository *serverRepository, QObject *parent = 0);
+    virtual ~EventCache();
+
+    bool isEnabled() const { return m_maxSize > 0; }
+    /* Maximum file size for each server */
+    qint64 maxSize() const { return m_maxSize; }
+
+    /* The open cache of server, or 0 if caching is disabled or the cache can't be opened */
+    ServerEventCache *serverCache(DVRServer *server);
+
+public slots:
+    void updateSettings();
+
+private slots:
+    void serverAdded(DVRServer *server);
+    void serverRemoved(DVRServer *server);
+
+private:
+    DVRServerRepository *m_serverRepository;
+    QString m_directory;
+    qint64 m_maxSize;
+    /* Open caches by path */
+    QHash<QString, ServerEventCache *> m_caches;
+
+    QString serverCachePath(DVRServer *server) const;
+    void removeStaleCaches();
+};
+
+#endif // EVENTCACHE_H
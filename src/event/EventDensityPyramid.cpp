@@ -0,0 +1,165 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EventDensityPyramid.h"
+#include "event/EventStore.h"
+
+/* A day */
+const qint64 EventDensityPyramid::MaxEventMSecs = Q_INT64_C(24) * 60 * 60 * 1000;
+
+EventDensityPyramid::Bucket::Bucket()
+{
+    for (int i = 0; i < SeverityCount; ++i)
+        counts[i] = 0;
+}
+
+int EventDensityPyramid::Bucket::count() const
+{
+    int result = 0;
+    for (int i = 0; i < SeverityCount; ++i)
+        result += counts[i];
+    return result;
+}
+
+EventLevel EventDensityPyramid::Bucket::maxLevel() const
+{
+    for (int i = SeverityCount - 1; i > EventLevel::Minimum; --i)
+    {
+        if (counts[i])
+            return EventLevel(EventLevel::Level(i));
+    }
+
+    return EventLevel(EventLevel::Minimum);
+}
+
+EventDensityPyramid::EventDensityPyramid()
+    : m_firstLevel(0), m_lastLevel(-1)
+{
+}
+
+bool EventDensityPyramid::isEmpty() const
+{
+    return !hasLevel(m_lastLevel) || m_levels[m_lastLevel].isEmpty();
+}
+
+void EventDensityPyramid::clear()
+{
+    for (int level = 0; level < LevelCount; ++level)
+        m_levels[level].clear();
+}
+
+bool EventDensityPyramid::setLevels(int first, int last)
+{
+    first = qBound(0, first, int(LevelCount));
+    last = qBound(-1, last, LevelCount - 1);
+    if (first > last)
+    {
+        first = 0;
+        last = -1;
+    }
+
+    if (first == m_firstLevel && last == m_lastLevel)
+        return false;
+
+    bool added = first <= last && (first < m_firstLevel || last > m_lastLevel || m_firstLevel > m_lastLevel);
+    m_firstLevel = first;
+    m_lastLevel = last;
+
+    for (int level = 0; level < LevelCount; ++level)
+    {
+        if (added || !hasLevel(level))
+            m_levels[level].clear();
+    }
+
+    return added;
+}
+
+qint64 EventDensityPyramid::bucketIndex(int level, qint64 msecs)
+{
+    qint64 size = bucketMSecs(level);
+    /* Round towards negative infinity, for times before the epoch */
+    if (msecs >= 0)
+        return msecs / size;
+    return -((-msecs - 1) / size) - 1;
+}
+
+int EventDensityPyramid::levelForResolution(double msecsPerPixel)
+{
+    if (msecsPerPixel * 2 < bucketMSecs(0))
+        return -1;
+
+    for (int level = 0; level < LevelCount; ++level)
+    {
+        if (bucketMSecs(level) >= msecsPerPixel)
+            return level;
+    }
+
+    return LevelCount - 1;
+}
+
+const EventDensityPyramid::Bucket *EventDensityPyramid::bucket(int level, qint64 index) const
+{
+    Q_ASSERT(level >= 0 && level < LevelCount);
+    if (!hasLevel(level))
+        return 0;
+
+    QHash<qint64, Bucket>::ConstIterator it = m_levels[level].constFind(index);
+    if (it == m_levels[level].constEnd())
+        return 0;
+    return &*it;
+}
+
+void EventDensityPyramid::insert(qint64 startTime, qint64 endTime, EventLevel level)
+{
+    add(startTime, endTime, level, 1);
+}
+
+void EventDensityPyramid::remove(qint64 startTime, qint64 endTime, EventLevel level)
+{
+    add(startTime, endTime, level, -1);
+}
+
+void EventDensityPyramid::add(qint64 startTime, qint64 endTime, EventLevel level, int delta)
+{
+    if (startTime == EventStore::NoTime)
+        return;
+
+    int severity = qBound(0, int(level.level), SeverityCount - 1);
+    endTime = qBound(startTime, endTime, startTime + MaxEventMSecs);
+
+    for (int n = m_firstLevel; n <= m_lastLevel; ++n)
+    {
+        QHash<qint64, Bucket> &buckets = m_levels[n];
+        qint64 last = bucketIndex(n, endTime);
+        for (qint64 index = bucketIndex(n, startTime); index <= last; ++index)
+        {
+            if (delta > 0)
+            {
+                ++buckets[index].counts[severity];
+                continue;
+            }
+
+            QHash<qint64, Bucket>::Iterator it = buckets.find(index);
+            Q_ASSERT(it != buckets.end() && it->counts[severity] > 0);
+            if (it == buckets.end() || !it->counts[severity])
+                continue;
+
+            if (!--it->counts[severity] && it->isEmpty())
+                buckets.erase(it);
+        }
+    }
+}
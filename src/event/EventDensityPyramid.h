@@ -0,0 +1,96 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENTDENSITYPYRAMID_H
+#define EVENTDENSITYPYRAMID_H
+
+#include "core/EventData.h"
+#include <QHash>
+
+/* Event density of one timeline row at power-of-two time granularities, for
+ * drawing rows that hold far more events than pixels.
+ *
+ * Level n divides time into buckets of 2^(MinShift + n) seconds, and counts for
+ * each bucket the events overlapping it, by severity. Only buckets holding events
+ * are stored. Counts are kept up to date as events come and go, so the highest
+ * severity of a bucket stays exact after removals.
+ *
+ * Only the levels set with setLevels are kept, which is none at first; the owner
+ * picks those its view can show, as finer levels cost far more buckets. Events
+ * are counted for at most MaxEventMSecs, so a bogus duration can't create
+ * millions of buckets. */
+class EventDensityPyramid
+{
+public:
+    enum
+    {
+        MinShift = 6, /* 64 seconds */
+        MaxShift = 24, /* About 194 days */
+        LevelCount = MaxShift - MinShift + 1,
+        SeverityCount = EventLevel::Critical + 1
+    };
+
+    static const qint64 MaxEventMSecs;
+
+    struct Bucket
+    {
+        quint32 counts[SeverityCount];
+
+        Bucket();
+
+        int count() const;
+        EventLevel maxLevel() const;
+        bool isEmpty() const { return count() == 0; }
+    };
+
+    EventDensityPyramid();
+
+    bool isEmpty() const;
+    void clear();
+
+    int firstLevel() const { return m_firstLevel; }
+    int lastLevel() const { return m_lastLevel; }
+    bool hasLevel(int level) const { return level >= m_firstLevel && level <= m_lastLevel; }
+
+    /* Keeps levels first to last, or none if first is greater. Levels that are no
+     * longer needed are dropped; when a level is added, the pyramid is cleared and
+     * true returned, and all events have to be inserted again. */
+    bool setLevels(int first, int last);
+
+    /* Times in milliseconds since the epoch; events without a valid start time are ignored */
+    void insert(qint64 startTime, qint64 endTime, EventLevel level);
+    void remove(qint64 startTime, qint64 endTime, EventLevel level);
+
+    static qint64 bucketMSecs(int level) { return Q_INT64_C(1000) << (MinShift + level); }
+    static qint64 bucketIndex(int level, qint64 msecs);
+
+    /* The finest level with buckets at least msecsPerPixel wide, or -1 when buckets
+     * of the finest level would be wider than two pixels */
+    static int levelForResolution(double msecsPerPixel);
+
+    /* The bucket, or 0 if it holds no events or the level isn't kept */
+    const Bucket *bucket(int level, qint64 index) const;
+
+private:
+    QHash<qint64, Bucket> m_levels[LevelCount];
+    int m_firstLevel;
+    int m_lastLevel;
+
+    void add(qint64 startTime, qint64 endTime, EventLevel level, int delta);
+};
+
+#endif // EVENTDENSITYPYRAMID_H
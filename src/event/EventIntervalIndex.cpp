@@ -0,0 +1,277 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EventIntervalIndex.h"
+#include <QBitArray>
+#include <algorithm>
+
+EventIntervalIndex::EventIntervalIndex()
+    : m_maxEndsValid(0)
+{
+}
+
+void EventIntervalIndex::clear()
+{
+    m_entries.clear();
+    m_maxEnds.clear();
+    m_maxEndsValid = 0;
+}
+
+EventIntervalIndex::Entry EventIntervalIndex::makeEntry(const EventRef &event)
+{
+    Entry entry;
+    entry.start = event.startTime();
+    entry.end = event.endTime();
+    entry.event = event;
+    entry.level = quint8(event.level().level);
+    return entry;
+}
+
+bool EventIntervalIndex::entryLessThan(const Entry &a, const Entry &b)
+{
+    return a.start < b.start;
+}
+
+int EventIntervalIndex::lowerBound(qint64 start) const
+{
+    const Entry *entries = m_entries.constData();
+    int low = 0, high = m_entries.size();
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if (entries[mid].start < start)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+int EventIntervalIndex::upperBound(qint64 start) const
+{
+    const Entry *entries = m_entries.constData();
+    int low = 0, high = m_entries.size();
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if (entries[mid].start <= start)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+qint64 EventIntervalIndex::minStartTime() const
+{
+    /* Events without a valid time sort first */
+    int i = upperBound(EventStore::NoTime);
+    return i < m_entries.size() ? m_entries[i].start : EventStore::NoTime;
+}
+
+qint64 EventIntervalIndex::maxEndTime() const
+{
+    if (m_entries.isEmpty())
+        return EventStore::NoTime;
+
+    updateMaxEnds();
+    return m_maxEnds.last();
+}
+
+int EventIntervalIndex::indexOf(const EventRef &event) const
+{
+    const Entry *entries = m_entries.constData();
+    int n = m_entries.size();
+
+    qint64 start = event.startTime();
+    for (int i = lowerBound(start); i < n && entries[i].start == start; ++i)
+    {
+        if (entries[i].event == event)
+            return i;
+    }
+
+    /* The start time may have changed since the event was indexed */
+    for (int i = 0; i < n; ++i)
+    {
+        if (entries[i].event == event)
+            return i;
+    }
+
+    return -1;
+}
+
+void EventIntervalIndex::insert(const EventRef &event)
+{
+    Entry entry = makeEntry(event);
+    int position = upperBound(entry.start);
+    m_entries.insert(position, entry);
+    invalidateFrom(position);
+}
+
+void EventIntervalIndex::insert(const QVector<EventRef> &events)
+{
+    if (events.isEmpty())
+        return;
+
+    if (events.size() == 1)
+    {
+        insert(events.first());
+        return;
+    }
+
+    QVector<Entry> added;
+    added.reserve(events.size());
+    foreach (const EventRef &event, events)
+        added.append(makeEntry(event));
+    qStableSort(added.begin(), added.end(), entryLessThan);
+
+    /* Entries before the first added one stay where they are; std::merge keeps
+     * existing entries ahead of added ones with the same start time. */
+    int first = upperBound(added.first().start);
+    QVector<Entry> merged(m_entries.size() + added.size());
+    Entry *out = std::copy(m_entries.constBegin(), m_entries.constBegin() + first, merged.begin());
+    std::merge(m_entries.constBegin() + first, m_entries.constEnd(), added.constBegin(), added.constEnd(),
+               out, entryLessThan);
+
+    m_entries = merged;
+    invalidateFrom(first);
+}
+
+bool EventIntervalIndex::remove(const EventRef &event)
+{
+    int position = indexOf(event);
+    if (position < 0)
+        return false;
+
+    removeAt(position);
+    return true;
+}
+
+bool EventIntervalIndex::update(const EventRef &event)
+{
+    int position = indexOf(event);
+    if (position < 0)
+        return false;
+
+    Entry entry = makeEntry(event);
+    if (entry.start == m_entries[position].start)
+    {
+        m_entries[position] = entry;
+        invalidateFrom(position);
+    }
+    else
+    {
+        removeAt(position);
+        insert(event);
+    }
+
+    return true;
+}
+
+void EventIntervalIndex::removeAt(int position)
+{
+    m_entries.remove(position);
+    invalidateFrom(position);
+}
+
+int EventIntervalIndex::remove(const QVector<EventRef> &events)
+{
+    QVector<int> positions;
+    positions.reserve(events.size());
+    foreach (const EventRef &event, events)
+    {
+        int position = indexOf(event);
+        if (position >= 0)
+            positions.append(position);
+    }
+
+    removeAt(positions);
+    return positions.size();
+}
+
+/* Marks the positions, then moves the entries that stay down over the gaps once */
+void EventIntervalIndex::removeAt(const QVector<int> &positions)
+{
+    if (positions.isEmpty())
+        return;
+
+    int n = m_entries.size();
+    QBitArray removed(n);
+    int first = n;
+    foreach (int position, positions)
+    {
+        removed.setBit(position);
+        first = qMin(first, position);
+    }
+
+    Entry *entries = m_entries.data();
+    int kept = first;
+    for (int i = first; i < n; ++i)
+    {
+        if (!removed.testBit(i))
+            entries[kept++] = entries[i];
+    }
+
+    m_entries.resize(kept);
+    invalidateFrom(first);
+}
+
+void EventIntervalIndex::invalidateFrom(int position)
+{
+    m_maxEndsValid = qMin(m_maxEndsValid, position);
+}
+
+void EventIntervalIndex::updateMaxEnds() const
+{
+    int n = m_entries.size();
+    if (m_maxEndsValid >= n && m_maxEnds.size() == n)
+        return;
+
+    m_maxEnds.resize(n);
+
+    const Entry *entries = m_entries.constData();
+    qint64 *maxEnds = m_maxEnds.data();
+    qint64 maxEnd = (m_maxEndsValid > 0) ? maxEnds[m_maxEndsValid - 1] : EventStore::NoTime;
+    for (int i = m_maxEndsValid; i < n; ++i)
+    {
+        maxEnd = qMax(maxEnd, entries[i].end);
+        maxEnds[i] = maxEnd;
+    }
+
+    m_maxEndsValid = n;
+}
+
+void EventIntervalIndex::findOverlapping(qint64 from, qint64 to, int *first, int *last) const
+{
+    updateMaxEnds();
+
+    /* The running maximum is sorted, so the first entry that reaches from can be
+     * found by binary search; nothing before it can overlap the span. */
+    const qint64 *maxEnds = m_maxEnds.constData();
+    int low = 0, high = m_entries.size();
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if (maxEnds[mid] < from)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    *first = low;
+    *last = qMax(low, upperBound(to));
+}
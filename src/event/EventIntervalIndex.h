@@ -0,0 +1,94 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENTINTERVALINDEX_H
+#define EVENTINTERVALINDEX_H
+
+#include "event/EventStore.h"
+#include <QVector>
+
+/* Events of one timeline row, ordered by start time.
+ *
+ * Alongside the order, the running maximum of end times is kept, so the events
+ * overlapping a span are found by binary search even when a few long events
+ * cover many short ones. The running maximum is brought up to date lazily, from
+ * the first position changed since it was last needed.
+ *
+ * Times and level are cached when an event is inserted; call update() when they
+ * change. */
+class EventIntervalIndex
+{
+public:
+    EventIntervalIndex();
+
+    int size() const { return m_entries.size(); }
+    bool isEmpty() const { return m_entries.isEmpty(); }
+    void clear();
+
+    EventRef at(int i) const { return m_entries[i].event; }
+    qint64 startTime(int i) const { return m_entries[i].start; }
+    qint64 endTime(int i) const { return m_entries[i].end; }
+    EventLevel level(int i) const { return EventLevel(EventLevel::Level(m_entries[i].level)); }
+
+    /* Earliest start and latest end of the events with a valid time, or EventStore::NoTime */
+    qint64 minStartTime() const;
+    qint64 maxEndTime() const;
+
+    int indexOf(const EventRef &event) const;
+    bool contains(const EventRef &event) const { return indexOf(event) >= 0; }
+
+    /* Events with the same start time are kept in the order they were inserted */
+    void insert(const EventRef &event);
+    /* Sorts and merges the events in one pass, instead of inserting them one by one */
+    void insert(const QVector<EventRef> &events);
+    bool remove(const EventRef &event);
+    void removeAt(int position);
+    /* Removes the events in one pass over the index, instead of shifting it once per
+     * event; returns how many were found */
+    int remove(const QVector<EventRef> &events);
+    void removeAt(const QVector<int> &positions);
+    /* Moves the event to match its current times; false if it isn't in the index */
+    bool update(const EventRef &event);
+
+    /* Positions [*first, *last) holding every event that overlaps [from, to]. Events
+     * in between that end before from may be included, and have to be skipped. */
+    void findOverlapping(qint64 from, qint64 to, int *first, int *last) const;
+
+private:
+    struct Entry
+    {
+        qint64 start;
+        qint64 end;
+        EventRef event;
+        quint8 level;
+    };
+
+    QVector<Entry> m_entries;
+    /* m_maxEnds[i] is the latest end of entries [0, i]; valid below m_maxEndsValid */
+    mutable QVector<qint64> m_maxEnds;
+    mutable int m_maxEndsValid;
+
+    static Entry makeEntry(const EventRef &event);
+    static bool entryLessThan(const Entry &a, const Entry &b);
+
+    int lowerBound(qint64 start) const;
+    int upperBound(qint64 start) const;
+    void invalidateFrom(int position);
+    void updateMaxEnds() const;
+};
+
+#endif // EVENTINTERVALINDEX_H
@@ -18,6 +18,7 @@
 #include "core/EventData.h"
 #include "utils/DateTimeUtils.h"
 #include "EventParser.h"
+#include <QDateTime>
 #include <QDebug>
 #include <QLatin1String>
 #include <QXmlStreamReader>
@@ -27,117 +28,281 @@
 
 QList<QSharedPointer<EventData> > EventParser::parseEvents(DVRServer *server, const QByteArray &input)
 {
-    QXmlStreamReader reader(input);
+    EventParser parser(server);
+    parser.addData(input);
+    parser.finish();
+
+    if (parser.hasError())
+    {
+        qWarning() << "EventData::parseEvents error:" << parser.errorString();
+    }
+
+    return parser.takeEvents();
+}
+
+EventParser::EventParser(DVRServer *server)
+    : m_server(server), m_inFeed(false), m_element(OtherElement), m_startMSecs(-1)
+{
+}
+
+EventParser::~EventParser()
+{
+}
+
+void EventParser::addData(const QByteArray &data)
+{
+    if (hasError())
+        return;
+
+    m_reader.addData(data);
+    parse();
+}
+
+QList<QSharedPointer<EventData> > EventParser::takeEvents()
+{
     QList<QSharedPointer<EventData> > re;
+    re.swap(m_events);
+    return re;
+}
 
-    if (!reader.hasError() && reader.readNextStartElement())
+void EventParser::finish()
+{
+    if (m_reader.error() == QXmlStreamReader::PrematureEndOfDocumentError)
     {
-        if (reader.name() == QLatin1String("feed"))
-        {
-            while (reader.readNext() != QXmlStreamReader::Invalid)
-            {
-                if (reader.tokenType() == QXmlStreamReader::EndDocument)
-                    break;
-                if (reader.tokenType() != QXmlStreamReader::StartElement)
-                    continue;
-
-                if (reader.name() == QLatin1String("entry"))
-                {
-                    EventData *ev = parseEntry(server, reader);
-                    if (ev)
-                        re.append(QSharedPointer<EventData>(ev));
-                }
-            }
-        }
-        else
-            reader.raiseError(QLatin1String("Invalid feed format"));
+        /* Pretend the feed ended here, which makes the error permanent */
+        m_reader.raiseError(m_inFeed ? QLatin1String("Unexpected end of feed") : QLatin1String("Invalid feed format"));
     }
 
-    if (reader.hasError())
+    /* As with complete feeds, the part of an entry read before an error is kept */
+    if (m_entry)
+        m_events.append(QSharedPointer<EventData>(m_entry.take()));
+}
+
+/* Waiting for more data isn't an error */
+bool EventParser::hasError() const
+{
+    return m_reader.hasError() && m_reader.error() != QXmlStreamReader::PrematureEndOfDocumentError;
+}
+
+/* Element names are told apart by length first; the feed has only a few that matter */
+EventParser::Element EventParser::element(const QStringRef &name)
+{
+    switch (name.size())
     {
-        qWarning() << "EventData::parseEvents error:" << reader.errorString();
+    case 2:
+        if (name == QLatin1String("id"))
+            return IdElement;
+        break;
+    case 4:
+        if (name == QLatin1String("feed"))
+            return FeedElement;
+        break;
+    case 5:
+        if (name == QLatin1String("entry"))
+            return EntryElement;
+        break;
+    case 7:
+        if (name == QLatin1String("updated"))
+            return UpdatedElement;
+        if (name == QLatin1String("content"))
+            return ContentElement;
+        break;
+    case 8:
+        if (name == QLatin1String("category"))
+            return CategoryElement;
+        break;
+    case 9:
+        if (name == QLatin1String("published"))
+            return PublishedElement;
+        break;
     }
 
-    return re;
+    return OtherElement;
 }
 
-EventData * EventParser::parseEntry(DVRServer *server, QXmlStreamReader &reader)
+/* A feed repeats the same few terms for every camera, so each is split and converted only
+ * the first time it is seen */
+const EventParser::Category & EventParser::category(const QStringRef &term)
 {
-    Q_ASSERT(reader.isStartElement() && reader.name() == QLatin1String("entry"));
+    uint hash = qHash(term);
+    for (QMultiHash<uint, int>::const_iterator it = m_categoryIndex.constFind(hash);
+         it != m_categoryIndex.constEnd() && it.key() == hash; ++it)
+    {
+        if (m_categories[*it].term == term)
+            return m_categories[*it];
+    }
 
-    EventData *data = new EventData(server);
+    Category c;
+    c.term = term.toString();
+    c.valid = false;
+    c.locationId = -1;
 
-    while (reader.readNext() != QXmlStreamReader::Invalid)
+    int levelPos = term.indexOf(QLatin1Char('/'));
+    int typePos = levelPos < 0 ? -1 : term.indexOf(QLatin1Char('/'), levelPos + 1);
+    if (typePos >= 0 && term.indexOf(QLatin1Char('/'), typePos + 1) < 0)
     {
-        if (reader.tokenType() == QXmlStreamReader::EndElement)
+        c.valid = true;
+        c.locationId = term.left(levelPos).toInt();
+        c.level = term.mid(levelPos + 1, typePos - levelPos - 1).toString();
+        c.type = term.mid(typePos + 1).toString();
+    }
+
+    m_categoryIndex.insert(hash, m_categories.size());
+    m_categories.append(c);
+    return m_categories.last();
+}
+
+/* Works token by token, so that it can stop wherever the data added so far ends and pick
+ * up from there when more arrives */
+void EventParser::parse()
+{
+    while (!m_reader.atEnd())
+    {
+        switch (m_reader.readNext())
         {
-            if (reader.name() == QLatin1String("entry"))
-                break;
+        case QXmlStreamReader::StartElement:
+            startElement();
+            break;
+        case QXmlStreamReader::Characters:
+            if (m_element == PublishedElement || m_element == UpdatedElement)
+                m_text += m_reader.text();
+            break;
+        case QXmlStreamReader::EndElement:
+            endElement();
+            break;
+        default:
+            break;
         }
-        if (reader.tokenType() != QXmlStreamReader::StartElement)
-            continue;
 
-        if (reader.name() == QLatin1String("id"))
-        {
-            bool ok = false;
-            qint64 id = reader.attributes().value(QLatin1String("raw")).toString().toLongLong(&ok);
-            if (!ok || id < 0)
-            {
-                reader.raiseError(QLatin1String("Invalid format for id element"));
-                continue;
-            }
+        if (m_reader.hasError())
+            break;
+    }
 
-            data->setEventId(id);
-        }
-        else if (reader.name() == QLatin1String("published"))
+    if (hasError() && m_entry)
+        m_events.append(QSharedPointer<EventData>(m_entry.take()));
+}
+
+void EventParser::startElement()
+{
+    m_element = element(m_reader.name());
+    m_text.resize(0);
+
+    if (!m_inFeed)
+    {
+        if (m_element == FeedElement)
+            m_inFeed = true;
+        else
+            m_reader.raiseError(QLatin1String("Invalid feed format"));
+        return;
+    }
+
+    if (m_element == EntryElement)
+    {
+        if (m_entry)
+            m_reader.raiseError(QLatin1String("Unexpected <entry> element"));
+        else
         {
-            qint16 dateTzOffsetMins;
-            data->setUtcStartDate(isoToDateTime(reader.readElementText(), &dateTzOffsetMins));
-            data->setServerDateTzOffsetMins(dateTzOffsetMins);
+            m_entry.reset(new EventData(m_server));
+            m_startMSecs = -1;
         }
-        else if (reader.name() == QLatin1String("updated"))
+        return;
+    }
+
+    if (!m_entry)
+        return;
+
+    switch (m_element)
+    {
+    case IdElement:
+    {
+        bool ok = false;
+        qint64 id = m_reader.attributes().value(QLatin1String("raw")).toLongLong(&ok);
+        if (!ok || id < 0)
         {
-            QString d = reader.readElementText();
-            if (d.isEmpty())
-                data->setInProgress();
-            else
-                data->setDurationInSeconds(data->localStartDate().secsTo(isoToDateTime(d)));
+            m_reader.raiseError(QLatin1String("Invalid format for id element"));
+            return;
         }
-        else if (reader.name() == QLatin1String("content"))
+
+        m_entry->setEventId(id);
+        break;
+    }
+    case ContentElement:
+    {
+        QXmlStreamAttributes attr = m_reader.attributes();
+        if (attr.hasAttribute(QLatin1String("media_id")))
         {
             bool ok = false;
-            QXmlStreamAttributes attr = reader.attributes();
-            if (attr.hasAttribute(QLatin1String("media_id")))
-            {
-                data->setMediaId(attr.value(QLatin1String("media_id")).toString().toLongLong(&ok));
-                if (!ok)
-                    data->setMediaId(-1);
-            }
+            m_entry->setMediaId(attr.value(QLatin1String("media_id")).toLongLong(&ok));
+            if (!ok)
+                m_entry->setMediaId(-1);
         }
-        else if (reader.name() == QLatin1String("category"))
+        break;
+    }
+    case CategoryElement:
+    {
+        QXmlStreamAttributes attrib = m_reader.attributes();
+        if (attrib.value(QLatin1String("scheme")) == QLatin1String("http://www.bluecherrydvr.com/atom.html"))
         {
-            QXmlStreamAttributes attrib = reader.attributes();
-            if (attrib.value(QLatin1String("scheme")) == QLatin1String("http://www.bluecherrydvr.com/atom.html"))
+            const Category &c = category(attrib.value(QLatin1String("term")));
+            if (!c.valid)
             {
-                QStringRef category = attrib.value(QLatin1String("term"));
-                QStringList cd = category.toString().split(QLatin1Char('/'));
-                if (cd.size() != 3)
-                {
-                    reader.raiseError(QLatin1String("Invalid format for category element"));
-                    continue;
-                }
-
-                data->setLocationId(cd[0].toInt());
-                data->setLevel(cd[1]);
-                data->setType(cd[2]);
+                m_reader.raiseError(QLatin1String("Invalid format for category element"));
+                return;
             }
+
+            m_entry->setLocationId(c.locationId);
+            m_entry->setLevel(c.level);
+            m_entry->setType(c.type);
         }
-        else if (reader.name() == QLatin1String("entry"))
-            reader.raiseError(QLatin1String("Unexpected <entry> element"));
+        break;
     }
+    default:
+        break;
+    }
+}
 
-    if (!reader.hasError() && (data->eventId() < 0 || !data->localStartDate().isValid()))
-        reader.raiseError(QLatin1String("Missing required elements for entry"));
+void EventParser::endElement()
+{
+    Element ended = m_element;
+    m_element = OtherElement;
+
+    if (!m_entry)
+        return;
+
+    if (ended == PublishedElement)
+    {
+        qint16 dateTzOffsetMins = 0;
+        qint64 msecs;
+        if (parseIsoDateTime(QStringRef(&m_text), &msecs, &dateTzOffsetMins))
+        {
+            m_startMSecs = msecs;
+            m_entry->setUtcStartDate(QDateTime::fromMSecsSinceEpoch(msecs, Qt::UTC));
+        }
+        else
+        {
+            m_entry->setUtcStartDate(isoToDateTime(m_text, &dateTzOffsetMins));
+            m_startMSecs = m_entry->localStartDate().isValid() ? m_entry->localStartDate().toMSecsSinceEpoch() : -1;
+        }
+        m_entry->setServerDateTzOffsetMins(dateTzOffsetMins);
+    }
+    else if (ended == UpdatedElement)
+    {
+        qint64 msecs;
+        if (m_text.isEmpty())
+            m_entry->setInProgress();
+        else if (m_startMSecs >= 0 && parseIsoDateTime(QStringRef(&m_text), &msecs))
+            m_entry->setDurationInSeconds(int((msecs - m_startMSecs) / 1000));
+        else
+            m_entry->setDurationInSeconds(m_entry->localStartDate().secsTo(isoToDateTime(m_text)));
+    }
+    else if (element(m_reader.name()) == EntryElement)
+        finishEntry();
+}
+
+void EventParser::finishEntry()
+{
+    if (m_entry->eventId() < 0 || !m_entry->localStartDate().isValid())
+        m_reader.raiseError(QLatin1String("Missing required elements for entry"));
 
-    return data;
+    m_events.append(QSharedPointer<EventData>(m_entry.take()));
 }
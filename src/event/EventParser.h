@@ -19,19 +19,78 @@
 #define EVENTPARSER_H
 
 #include <QList>
+#include <QMultiHash>
+#include <QScopedPointer>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+#include <QXmlStreamReader>
+#include "core/EventData.h"
 
 class DVRServer;
-class EventData;
-class QXmlStreamReader;
+
+/* Parses the Atom feed of events. Data can be added as it arrives, and the events
+ * completed so far taken out between chunks, so that a large feed never has to be held
+ * in memory as a whole. */
 
 class EventParser
 {
 public:
     static QList<QSharedPointer<EventData> > parseEvents(DVRServer *server, const QByteArray &input);
 
+    explicit EventParser(DVRServer *server);
+    ~EventParser();
+
+    void addData(const QByteArray &data);
+    QList<QSharedPointer<EventData> > takeEvents();
+    /* Call once all data was added; a truncated feed is an error */
+    void finish();
+
+    bool hasError() const;
+    QString errorString() const { return m_reader.errorString(); }
+
 private:
-    static EventData * parseEntry(DVRServer *server, QXmlStreamReader &reader);
+    enum Element
+    {
+        OtherElement,
+        FeedElement,
+        EntryElement,
+        IdElement,
+        PublishedElement,
+        UpdatedElement,
+        ContentElement,
+        CategoryElement
+    };
+
+    /* A category term such as "5/info/continuous", decoded once per feed */
+    struct Category
+    {
+        QString term;
+        bool valid;
+        int locationId;
+        EventLevel level;
+        EventType type;
+    };
+
+    DVRServer *m_server;
+    QXmlStreamReader m_reader;
+    bool m_inFeed;
+    /* Entry being parsed, and text of its current element */
+    QScopedPointer<EventData> m_entry;
+    Element m_element;
+    QString m_text;
+    /* Start of m_entry in msecs since the epoch, or -1 */
+    qint64 m_startMSecs;
+    QList<QSharedPointer<EventData> > m_events;
+    QVector<Category> m_categories;
+    QMultiHash<uint, int> m_categoryIndex;
 
+    static Element element(const QStringRef &name);
+    const Category & category(const QStringRef &term);
+    void parse();
+    void startElement();
+    void endElement();
+    void finishEntry();
 };
 
 #endif // EVENTPARSER_H
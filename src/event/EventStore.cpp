@@ -0,0 +1,213 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EventStore.h"
+#include "camera/DVRCamera.h"
+#include "server/DVRServer.h"
+#include "server/DVRServerConfiguration.h"
+
+const qint64 EventStore::NoTime = Q_INT64_C(-0x7fffffffffffffff) - 1;
+
+QDateTime EventRef::localStartDate() const
+{
+    qint64 start = startTime();
+    if (start == EventStore::NoTime)
+        return QDateTime();
+    return QDateTime::fromMSecsSinceEpoch(start);
+}
+
+QDateTime EventRef::localEndDate() const
+{
+    qint64 end = endTime();
+    if (end == EventStore::NoTime)
+        return QDateTime();
+    return QDateTime::fromMSecsSinceEpoch(end);
+}
+
+QString EventRef::uiServer() const
+{
+    if (server())
+        return server()->configuration().displayName();
+    else
+        return QString();
+}
+
+DVRCamera * EventRef::locationCamera() const
+{
+    if (server())
+        return server()->getCamera(locationId());
+    else
+        return 0;
+}
+
+EventStore::EventStore()
+{
+}
+
+int EventStore::insert(const EventData &event)
+{
+    int slot;
+    if (!m_freeSlots.isEmpty())
+    {
+        slot = m_freeSlots.last();
+        m_freeSlots.removeLast();
+    }
+    else
+    {
+        slot = m_eventIds.size();
+        m_eventIds.append(-1);
+        m_mediaIds.append(-1);
+        m_startTimes.append(NoTime);
+        m_durations.append(0);
+        m_sourceIndexes.append(0);
+        m_tzOffsets.append(0);
+        m_levels.append(0);
+        m_types.append(-1);
+    }
+
+    write(slot, event);
+    return slot;
+}
+
+void EventStore::update(int slot, const EventData &event)
+{
+    Q_ASSERT(slot >= 0 && slot < m_eventIds.size());
+    unindex(slot);
+    write(slot, event);
+}
+
+void EventStore::remove(int slot)
+{
+    Q_ASSERT(slot >= 0 && slot < m_eventIds.size());
+
+    unindex(slot);
+    if (slot == m_eventIds.size() - 1)
+    {
+        m_eventIds.removeLast();
+        m_mediaIds.removeLast();
+        m_startTimes.removeLast();
+        m_durations.removeLast();
+        m_sourceIndexes.removeLast();
+        m_tzOffsets.removeLast();
+        m_levels.removeLast();
+        m_types.removeLast();
+    }
+    else
+    {
+        m_eventIds[slot] = -1;
+        m_freeSlots.append(slot);
+    }
+
+    if (size() == 0)
+        clear();
+}
+
+void EventStore::clear()
+{
+    m_eventIds.clear();
+    m_mediaIds.clear();
+    m_startTimes.clear();
+    m_durations.clear();
+    m_sourceIndexes.clear();
+    m_tzOffsets.clear();
+    m_levels.clear();
+    m_types.clear();
+    m_freeSlots.clear();
+    m_bitmaps.clear();
+
+    /* The source table is kept; it only grows with the number of cameras */
+}
+
+bool EventStore::matches(int slot, const EventData &event) const
+{
+    QDateTime start = event.localStartDate();
+
+    return m_durations[slot] == event.durationInSeconds() && m_mediaIds[slot] == event.mediaId()
+            && m_levels[slot] == quint8(event.level().level) && m_types[slot] == qint8(event.type().type)
+            && locationId(slot) == event.locationId() && m_tzOffsets[slot] == event.serverDateTzOffsetMins()
+            && m_startTimes[slot] == (start.isValid() ? start.toMSecsSinceEpoch() : NoTime);
+}
+
+EventData EventStore::eventData(int slot) const
+{
+    EventData event(server(slot));
+    event.setEventId(m_eventIds[slot]);
+    event.setMediaId(m_mediaIds[slot]);
+    if (m_startTimes[slot] != NoTime)
+        event.setUtcStartDate(QDateTime::fromMSecsSinceEpoch(m_startTimes[slot], Qt::UTC));
+    event.setDurationInSeconds(m_durations[slot]);
+    event.setLocationId(locationId(slot));
+    event.setLevel(level(slot));
+    event.setType(type(slot));
+    event.setServerDateTzOffsetMins(m_tzOffsets[slot]);
+    return event;
+}
+
+qint64 EventStore::memoryUsage() const
+{
+    qint64 perSlot = sizeof(qint64) * 3 + sizeof(qint32) + sizeof(quint16) + sizeof(qint16)
+            + sizeof(quint8) + sizeof(qint8);
+
+    return perSlot * m_eventIds.capacity() + sizeof(int) * m_freeSlots.capacity()
+            + sizeof(Source) * m_sources.capacity() + m_bitmaps.memoryUsage();
+}
+
+quint16 EventStore::internSource(DVRServer *server, int locationId)
+{
+    QPair<DVRServer *, int> key(server, locationId);
+
+    QHash<QPair<DVRServer *, int>, quint16>::ConstIterator it = m_sourcesMap.constFind(key);
+    if (it != m_sourcesMap.constEnd())
+    {
+        /* A new server may have been allocated where a deleted one was */
+        if (m_sources[*it].server.data() != server)
+            m_sources[*it].server = server;
+        return *it;
+    }
+
+    Q_ASSERT(m_sources.size() <= 0xffff);
+
+    Source source;
+    source.server = server;
+    source.locationId = locationId;
+    m_sources.append(source);
+
+    quint16 index = quint16(m_sources.size() - 1);
+    m_sourcesMap.insert(key, index);
+    return index;
+}
+
+void EventStore::write(int slot, const EventData &event)
+{
+    QDateTime start = event.localStartDate();
+
+    m_eventIds[slot] = event.eventId();
+    m_mediaIds[slot] = event.mediaId();
+    m_startTimes[slot] = start.isValid() ? start.toMSecsSinceEpoch() : NoTime;
+    m_durations[slot] = event.durationInSeconds();
+    m_sourceIndexes[slot] = internSource(event.server(), event.locationId());
+    m_tzOffsets[slot] = event.serverDateTzOffsetMins();
+    m_levels[slot] = quint8(event.level().level);
+    m_types[slot] = qint8(event.type().type);
+
+    m_bitmaps.insert(slot, m_levels[slot], m_types[slot], m_sourceIndexes[slot], m_startTimes[slot]);
+}
+
+void EventStore::unindex(int slot)
+{
+    m_bitmaps.remove(slot, m_levels[slot], m_types[slot], m_sourceIndexes[slot], m_startTimes[slot]);
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENTSTORE_H
+#define EVENTSTORE_H
+
+#include "core/EventData.h"
+#include "event/EventBitmapIndex.h"
+#include <QHash>
+#include <QPair>
+#include <QPointer>
+#include <QVector>
+
+class EventStore;
+
+/* Lightweight handle to an event held by an EventStore. It stays valid until the
+ * event is removed from the store; the slot may then be reused by another event. */
+class EventRef
+{
+public:
+    EventRef() : m_store(0), m_slot(-1) { }
+    EventRef(const EventStore *store, int slot) : m_store(store), m_slot(slot) { }
+
+    bool isValid() const { return m_store && m_slot >= 0; }
+    const EventStore *store() const { return m_store; }
+    int slot() const { return m_slot; }
+
+    bool operator==(const EventRef &o) const { return m_store == o.m_store && m_slot == o.m_slot; }
+    bool operator!=(const EventRef &o) const { return !(*this == o); }
+
+    qint64 eventId() const;
+    qint64 mediaId() const;
+    bool hasMedia() const { return mediaId() >= 0; }
+
+    /* Start in milliseconds since the epoch, UTC */
+    qint64 startTime() const;
+    qint64 endTime() const;
+    QDateTime localStartDate() const;
+    QDateTime localEndDate() const;
+
+    int durationInSeconds() const;
+    bool hasDuration() const { return durationInSeconds() > 0; }
+    bool inProgress() const { return durationInSeconds() < 0; }
+
+    DVRServer *server() const;
+    int locationId() const;
+    bool isSystem() const { return locationId() < 0; }
+    bool isCamera() const { return locationId() >= 0; }
+
+    EventLevel level() const;
+    EventType type() const;
+    qint16 serverDateTzOffsetMins() const;
+
+    QColor uiColor(bool graphical = true) const { return level().uiColor(graphical); }
+    QString uiLevel() const { return level().uiString(); }
+    QString uiType() const { return type().uiString(); }
+    QString uiDuration() const { return EventData::uiDuration(durationInSeconds()); }
+    QString uiServer() const;
+    QString uiLocation() const { return EventData::uiLocation(server(), locationId()); }
+
+    DVRCamera *locationCamera() const;
+
+    EventData toEventData() const;
+
+private:
+    const EventStore *m_store;
+    int m_slot;
+};
+
+Q_DECLARE_METATYPE(EventRef)
+
+inline uint qHash(const EventRef &ref)
+{
+    return qHash(quintptr(ref.store())) ^ uint(ref.slot());
+}
+
+/* Struct-of-arrays storage for events. Each event takes a slot across a set of
+ * contiguous columns: times as epoch milliseconds, level and type as bytes, and
+ * the server and location interned into a small source table. This costs about
+ * 34 bytes per event, instead of a shared EventData with its two QDateTimes.
+ *
+ * Slots are stable, so handles can be kept while other events come and go;
+ * removed slots are recycled by later inserts. Level, type, source and day
+ * bitmaps over the slots are kept up to date for filtering. */
+class EventStore
+{
+public:
+    /* Start time of events that have no valid date */
+    static const qint64 NoTime;
+
+    EventStore();
+
+    int size() const { return m_eventIds.size() - m_freeSlots.size(); }
+    int slotCount() const { return m_eventIds.size(); }
+    bool isEmpty() const { return size() == 0; }
+
+    int insert(const EventData &event);
+    void update(int slot, const EventData &event);
+    void remove(int slot);
+    void clear();
+
+    /* True if the slot holds the same values as event, ignoring the server */
+    bool matches(int slot, const EventData &event) const;
+
+    EventRef ref(int slot) const { return EventRef(this, slot); }
+    EventData eventData(int slot) const;
+
+    qint64 eventId(int slot) const { return m_eventIds[slot]; }
+    qint64 mediaId(int slot) const { return m_mediaIds[slot]; }
+    qint64 startTime(int slot) const { return m_startTimes[slot]; }
+    int durationInSeconds(int slot) const { return m_durations[slot]; }
+    DVRServer *server(int slot) const { return m_sources[m_sourceIndexes[slot]].server.data(); }
+    int locationId(int slot) const { return m_sources[m_sourceIndexes[slot]].locationId; }
+    EventLevel level(int slot) const { return EventLevel(EventLevel::Level(m_levels[slot])); }
+    EventType type(int slot) const { return EventType(EventType::Type(m_types[slot])); }
+    qint16 serverDateTzOffsetMins(int slot) const { return m_tzOffsets[slot]; }
+
+    /* Distinct server and location pairs, shared by the events of each camera */
+    int sourceCount() const { return m_sources.size(); }
+    int sourceIndex(int slot) const { return m_sourceIndexes[slot]; }
+    DVRServer *sourceServer(int index) const { return m_sources[index].server.data(); }
+    int sourceLocationId(int index) const { return m_sources[index].locationId; }
+
+    const EventBitmapIndex &bitmaps() const { return m_bitmaps; }
+    /* Slots of events starting within [from, to], in epoch milliseconds */
+    QBitArray slotsStartedWithin(qint64 from, qint64 to) const
+    {
+        return m_bitmaps.startedWithin(from, to, m_startTimes);
+    }
+
+    /* Approximate heap usage of the columns, for diagnostics */
+    qint64 memoryUsage() const;
+
+private:
+    struct Source
+    {
+        QPointer<DVRServer> server;
+        int locationId;
+    };
+
+    QVector<qint64> m_eventIds;
+    QVector<qint64> m_mediaIds;
+    QVector<qint64> m_startTimes;
+    QVector<qint32> m_durations;
+    QVector<quint16> m_sourceIndexes;
+    QVector<qint16> m_tzOffsets;
+    QVector<quint8> m_levels;
+    QVector<qint8> m_types;
+
+    QVector<Source> m_sources;
+    QHash<QPair<DVRServer *, int>, quint16> m_sourcesMap;
+
+    QVector<int> m_freeSlots;
+    EventBitmapIndex m_bitmaps;
+
+    quint16 internSource(DVRServer *server, int locationId);
+    void write(int slot, const EventData &event);
+    void unindex(int slot);
+};
+
+inline qint64 EventRef::eventId() const { return m_store->eventId(m_slot); }
+inline qint64 EventRef::mediaId() const { return m_store->mediaId(m_slot); }
+inline qint64 EventRef::startTime() const { return m_store->startTime(m_slot); }
+inline int EventRef::durationInSeconds() const { return m_store->durationInSeconds(m_slot); }
+inline DVRServer *EventRef::server() const { return m_store->server(m_slot); }
+inline int EventRef::locationId() const { return m_store->locationId(m_slot); }
+inline EventLevel EventRef::level() const { return m_store->level(m_slot); }
+inline EventType EventRef::type() const { return m_store->type(m_slot); }
+inline qint16 EventRef::serverDateTzOffsetMins() const { return m_store->serverDateTzOffsetMins(m_slot); }
+inline EventData EventRef::toEventData() const { return m_store->eventData(m_slot); }
+
+inline qint64 EventRef::endTime() const
+{
+    qint64 start = startTime();
+    if (start == EventStore::NoTime)
+        return start;
+    return start + qint64(qMax(0, durationInSeconds())) * 1000;
+}
+
+#endif // EVENTSTORE_H
@@ -20,14 +20,17 @@
 #include "event/EventParser.h"
 #include "server/DVRServer.h"
 #include "core/EventData.h"
-#include <QFuture>
-#include <QFutureWatcher>
+#include <QDebug>
 #include <QNetworkReply>
 #include <QNetworkRequest>
-#include <QtConcurrent/QtConcurrent>
+
+/* How often parsed events are passed on while a reply arrives. The first batch goes out
+ * as soon as it is parsed. */
+static const int batchInterval = 250;
 
 EventsLoader::EventsLoader(DVRServer *server, QObject *parent)
-    : QObject(parent), m_server(server), m_limit(-1), m_lastId(-1)
+    : QObject(parent), m_server(server), m_limit(-1), m_lastId(-1), m_parser(new EventParser(server)),
+      m_eventCount(0)
 {
 }
 
@@ -40,7 +43,7 @@ void EventsLoader::setLimit(int limit)
     m_limit = limit;
 }
 
-void EventsLoader::setLastId(int lastId)
+void EventsLoader::setLastId(qint64 lastId)
 {
     m_lastId = lastId;
 }
@@ -59,7 +62,7 @@ void EventsLoader::loadEvents()
 {
     if (!m_server || !m_server.data()->isOnline())
     {
-        emit eventsLoaded(m_server.data(), false, QList<QSharedPointer<EventData> >());
+        emit eventsLoaded(m_server.data(), false);
         deleteLater();
         return;
     }
@@ -74,9 +77,60 @@ void EventsLoader::loadEvents()
         url.addQueryItem(QLatin1String("afterId"), QString::number(m_lastId));
 
     QNetworkReply *reply = m_server.data()->sendRequest(url);
+    connect(reply, SIGNAL(readyRead()), SLOT(serverDataAvailable()));
     connect(reply, SIGNAL(finished()), SLOT(serverRequestFinished()));
 }
 
+bool EventsLoader::isReplyOk(QNetworkReply *reply) const
+{
+    if (reply->error() != QNetworkReply::NoError)
+        return false;
+
+    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    return statusCode >= 200 && statusCode < 300;
+}
+
+/* Parses each chunk as it arrives, rather than buffering the whole feed */
+void EventsLoader::serverDataAvailable()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    Q_ASSERT(reply);
+
+    /* Errors are reported once the reply is finished */
+    if (!m_server || !isReplyOk(reply))
+        return;
+
+    addReplyData(reply->readAll());
+}
+
+void EventsLoader::addReplyData(const QByteArray &data)
+{
+    parseData(data);
+
+    if (!m_batch.isEmpty() && (!m_batchTimer.isValid() || m_batchTimer.elapsed() >= batchInterval))
+        emitBatch();
+}
+
+void EventsLoader::parseData(const QByteArray &data)
+{
+    m_parser->addData(data);
+    takeParsedEvents();
+}
+
+void EventsLoader::takeParsedEvents()
+{
+    QList<QSharedPointer<EventData> > events = m_parser->takeEvents();
+    m_eventCount += events.size();
+    m_batch += events;
+}
+
+void EventsLoader::emitBatch()
+{
+    emit eventsParsed(m_server.data(), m_batch);
+    m_batch.clear();
+    m_batchTimer.start();
+}
+
 void EventsLoader::serverRequestFinished()
 {
     QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
@@ -94,7 +148,7 @@ void EventsLoader::serverRequestFinished()
     {
         qWarning() << "Event request error:" << reply->errorString();
         /* TODO: Handle errors properly */
-        emit eventsLoaded(m_server.data(), false, QList<QSharedPointer<EventData> >());
+        emit eventsLoaded(m_server.data(), false);
         deleteLater();
         return;
     }
@@ -103,40 +157,21 @@ void EventsLoader::serverRequestFinished()
     if (statusCode < 200 || statusCode >= 300)
     {
         qWarning() << "Event request error: HTTP code" << statusCode;
-        emit eventsLoaded(m_server.data(), false, QList<QSharedPointer<EventData> >());
+        emit eventsLoaded(m_server.data(), false);
         deleteLater();
         return;
     }
 
-    QByteArray data = reply->readAll();
-    // qDebug() << "EventsLoader: Received reply from server: " << data;
-
-    QFuture<QList<QSharedPointer<EventData> > > future
-            = QtConcurrent::run(&EventParser::parseEvents, m_server.data(), data);
-
-    QFutureWatcher<QList<QSharedPointer<EventData> > > *qfw
-            = new QFutureWatcher<QList<QSharedPointer<EventData> > >(this);
-    connect(qfw, SIGNAL(finished()), SLOT(eventParseFinished()));
-    qfw->setFuture(future);
-}
-
-void EventsLoader::eventParseFinished()
-{
-    Q_ASSERT(sender() && sender()->inherits("QFutureWatcherBase"));
-    QFutureWatcher<QList<QSharedPointer<EventData> > > *qfw
-            = static_cast<QFutureWatcher<QList<QSharedPointer<EventData> > >*>(sender());
-    qfw->deleteLater();
-
-    if (!m_server)
-    {
-        emit eventsLoaded(m_server.data(), false, QList<QSharedPointer<EventData> >());
-        deleteLater();
-        return; // ignore data from removed servers
-    }
+    parseData(reply->readAll());
+    m_parser->finish();
+    takeParsedEvents();
+    if (m_parser->hasError())
+        qWarning() << "EventsLoader: event feed error:" << m_parser->errorString();
 
-    QList<QSharedPointer<EventData> > events = qfw->result();
-    qDebug() << "EventsLoader: Parsed event data into" << events.size() << "events";
+    qDebug() << "EventsLoader: Parsed event data into" << m_eventCount << "events";
 
-    emit eventsLoaded(m_server.data(), true, events);
+    if (!m_batch.isEmpty())
+        emitBatch();
+    emit eventsLoaded(m_server.data(), true);
     deleteLater();
 }
@@ -19,10 +19,14 @@
 #define EVENTSLOADER_H
 
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QObject>
+#include <QScopedPointer>
 #include "server/DVRServer.h"
 
 class EventData;
+class EventParser;
+class QNetworkReply;
 
 class EventsLoader : public QObject
 {
@@ -37,24 +41,39 @@ public:
     void setLimit(int limit);
     void setStartTime(const QDateTime &startTime);
     void setEndTime(const QDateTime &endTime);
-    void setLastId(int lastId);
+    /* Only asks for events with a higher ID */
+    void setLastId(qint64 lastId);
 
     void loadEvents();
+    /* Parses data of the reply as it arrives, passing on a batch when one is due */
+    void addReplyData(const QByteArray &data);
 
 signals:
-    void eventsLoaded(DVRServer *server, bool ok, const QList<QSharedPointer<EventData> > &events);
+    /* Events parsed so far, in batches while the reply arrives. The events are not kept;
+     * every event of the reply is in exactly one batch. */
+    void eventsParsed(DVRServer *server, const QList<QSharedPointer<EventData> > &events);
+    /* Once the reply is complete, after its last batch */
+    void eventsLoaded(DVRServer *server, bool ok);
 
 private slots:
+    void serverDataAvailable();
     void serverRequestFinished();
-    void eventParseFinished();
 
 private:
     QWeakPointer<DVRServer> m_server;
     int m_limit;
     QDateTime m_startTime;
     QDateTime m_endTime;
-    int m_lastId;
+    qint64 m_lastId;
+    QScopedPointer<EventParser> m_parser;
+    QList<QSharedPointer<EventData> > m_batch;
+    int m_eventCount;
+    QElapsedTimer m_batchTimer;
 
+    bool isReplyOk(QNetworkReply *reply) const;
+    void parseData(const QByteArray &data);
+    void takeParsedEvents();
+    void emitBatch();
 };
 
 #endif // EVENTSLOADER_H
@@ -18,14 +18,20 @@
 #include "EventsUpdater.h"
 #include "server/DVRServer.h"
 #include "server/DVRServerRepository.h"
+#include "event/EventCache.h"
 #include "event/EventsLoader.h"
+#include "core/BluecherryApp.h"
+#include "core/EventData.h"
+#include <QDebug>
+#include <QMap>
 
 EventsUpdater::EventsUpdater(DVRServerRepository *serverRepository, QObject *parent) :
-        QObject(parent), m_serverRepository(serverRepository), m_limit(-1)
+        QObject(parent), m_serverRepository(serverRepository), m_limit(-1), m_generation(0)
 {
     Q_ASSERT(m_serverRepository);
 
     connect(m_serverRepository, SIGNAL(serverAdded(DVRServer*)), SLOT(serverAdded(DVRServer*)));
+    connect(m_serverRepository, SIGNAL(serverAboutToBeRemoved(DVRServer*)), SLOT(resetServer(DVRServer*)));
     connect(&m_updateTimer, SIGNAL(timeout()), SLOT(updateServers()));
 
     foreach (DVRServer *s, m_serverRepository->servers())
@@ -45,6 +51,20 @@ void EventsUpdater::serverAdded(DVRServer *server)
 {
     //connect(server, SIGNAL(loginSuccessful(DVRServer*)), SLOT(updateServer(DVRServer*)));
     //updateServer(server);
+
+    /* Models drop the events of disconnected servers, so start over on reconnection */
+    connect(server, SIGNAL(disconnected(DVRServer*)), SLOT(resetServer(DVRServer*)));
+}
+
+void EventsUpdater::resetServer(DVRServer *server)
+{
+    m_serverEvents.remove(server);
+}
+
+void EventsUpdater::resetServers()
+{
+    m_generation++;
+    m_serverEvents.clear();
 }
 
 void EventsUpdater::setUpdateInterval(int miliseconds)
@@ -61,12 +81,14 @@ void EventsUpdater::setUpdateInterval(int miliseconds)
 void EventsUpdater::setLimit(int limit)
 {
     m_limit = limit;
+    resetServers();
 }
 
 void EventsUpdater::setDay(const QDate &date)
 {
     m_startTime = QDateTime(date, QTime(0, 0));
     m_endTime = QDateTime(date, QTime(23, 59, 59, 999));
+    resetServers();
 
     //updateServers();
 }
@@ -75,6 +97,7 @@ void EventsUpdater::setTimeRange(const QDateTime &from, const QDateTime &to)
 {
     m_startTime = from;
     m_endTime = to;
+    resetServers();
 }
 
 void EventsUpdater::updateServers()
@@ -88,29 +111,254 @@ void EventsUpdater::updateServer(DVRServer *server)
     if (!server->isOnline() || m_updatingServers.contains(server))
         return;
 
+    ServerEvents &serverEvents = m_serverEvents[server];
+    if (serverEvents.cachedOnly)
+        return;
+    if (!serverEvents.valid)
+    {
+        serverEvents.lastId = 0;
+        serverEvents.inProgress.clear();
+        serverEvents.count = 0;
+        if (loadCachedEvents(server, &serverEvents))
+            return;
+    }
+
     m_updatingServers.insert(server);
     if (m_updatingServers.size() == 1)
         emit loadingStarted();
 
     EventsLoader *eventsLoader = new EventsLoader(server);
-    connect(eventsLoader, SIGNAL(eventsLoaded(DVRServer*,bool,QList<QSharedPointer<EventData> >)),
-            this, SLOT(eventsLoaded(DVRServer*,bool,QList<QSharedPointer<EventData> >)));
+    connect(eventsLoader, SIGNAL(eventsParsed(DVRServer*,QList<QSharedPointer<EventData> >)),
+            this, SLOT(eventsParsed(DVRServer*,QList<QSharedPointer<EventData> >)));
+    connect(eventsLoader, SIGNAL(eventsLoaded(DVRServer*,bool)),
+            this, SLOT(eventsLoaded(DVRServer*,bool)));
+
+    serverEvents.delta = serverEvents.valid;
+    serverEvents.generation = m_generation;
+    serverEvents.requestLastId = serverEvents.lastId;
+    serverEvents.received = 0;
+    serverEvents.oldestStart = queryEnd();
+    serverEvents.cacheComplete = true;
 
     eventsLoader->setLimit(m_limit);
-    eventsLoader->setStartTime(m_startTime);
+    if (!serverEvents.delta && serverEvents.fetchStart > queryStart())
+        eventsLoader->setStartTime(QDateTime::fromTime_t(serverEvents.fetchStart));
+    else
+        eventsLoader->setStartTime(m_startTime);
     eventsLoader->setEndTime(m_endTime);
+    if (serverEvents.delta)
+        eventsLoader->setLastId(deltaAfterId(serverEvents));
     eventsLoader->loadEvents();
 }
 
-void EventsUpdater::eventsLoaded(DVRServer *server, bool ok
-                                 ,const QList<QSharedPointer<EventData> > &events)
+/* The highest ID seen, or just below the oldest event still in progress, which the server
+ * has probably updated since */
+qint64 EventsUpdater::deltaAfterId(const ServerEvents &serverEvents) const
 {
-    if (!server)
+    qint64 lastId = serverEvents.lastId;
+    for (QHash<qint64, uint>::const_iterator it = serverEvents.inProgress.constBegin();
+         it != serverEvents.inProgress.constEnd(); ++it)
+        lastId = qMin(lastId, it.key() - 1);
+
+    return lastId;
+}
+
+/* Remembers what the next incremental update, and the cache coverage of a full fetch,
+ * need to know of delivered events */
+void EventsUpdater::trackEvents(ServerEvents *serverEvents, const QList<QSharedPointer<EventData> > &events) const
+{
+    foreach (const QSharedPointer<EventData> &event, events)
+    {
+        qint64 eventId = event->eventId();
+        uint eventStart = event->localStartDate().toTime_t();
+
+        if (!serverEvents->valid || eventId > serverEvents->requestLastId)
+            serverEvents->count++;
+        serverEvents->lastId = qMax(serverEvents->lastId, eventId);
+
+        if (event->inProgress())
+            serverEvents->inProgress.insert(eventId, eventStart);
+        else
+            serverEvents->inProgress.remove(eventId);
+
+        serverEvents->received++;
+        serverEvents->oldestStart = qMin(serverEvents->oldestStart, eventStart);
+    }
+}
+
+void EventsUpdater::trimToLimit(QList<QSharedPointer<EventData> > *events) const
+{
+    if (m_limit <= 0 || events->size() <= m_limit)
         return;
 
-    if (ok)
+    QMap<qint64, QSharedPointer<EventData> > byId;
+    foreach (const QSharedPointer<EventData> &event, *events)
+        byId.insert(event->eventId(), event);
+
+    while (byId.size() > m_limit)
+        byId.erase(byId.begin());
+
+    QList<QSharedPointer<EventData> > kept;
+    foreach (const QSharedPointer<EventData> &event, *events)
+    {
+        if (byId.contains(event->eventId()))
+            kept.append(event);
+    }
+    *events = kept;
+}
+
+uint EventsUpdater::queryStart() const
+{
+    return m_startTime.isNull() ? 0 : m_startTime.toTime_t();
+}
+
+uint EventsUpdater::queryEnd() const
+{
+    return m_endTime.isNull() ? QDateTime::currentDateTime().toTime_t() : m_endTime.toTime_t();
+}
+
+ServerEventCache *EventsUpdater::serverCache(DVRServer *server) const
+{
+    if (!bcApp->eventCache())
+        return 0;
+    return bcApp->eventCache()->serverCache(server);
+}
+
+/* Takes what the cache has for the query. Returns true if that is everything, and no fetch
+ * is needed; otherwise the fetch starts where the cached part ends. */
+bool EventsUpdater::loadCachedEvents(DVRServer *server, ServerEvents *serverEvents)
+{
+    serverEvents->fetchStart = queryStart();
+
+    ServerEventCache *cache = serverCache(server);
+    if (!cache)
+        return false;
+
+    uint start = queryStart(), end = queryEnd();
+    Range missing = cache->missingRange(start, end);
+
+    if (!missing.isValid())
+    {
+        QList<QSharedPointer<EventData> > events = cache->events(server, start, end);
+        trimToLimit(&events);
+        trackEvents(serverEvents, events);
+        serverEvents->valid = true;
+        serverEvents->cachedOnly = true;
+        serverEvents->generation = m_generation;
+
+        qDebug() << "EventsUpdater: answered from the cache with" << events.size() << "events";
+        serverEvents->shown = true;
         emit serverEventsAvailable(server, events);
+        return true;
+    }
+
+    /* With a limit, the cached part and the fetch together could deliver more events than
+     * the limit allows, so a limited query is fetched whole */
+    if (missing.start() > start && m_limit <= 0)
+    {
+        QList<QSharedPointer<EventData> > cached = cache->events(server, start, missing.start() - 1);
+        serverEvents->fetchStart = missing.start();
+        trackEvents(serverEvents, cached);
+
+        if (!cached.isEmpty())
+            deliverEvents(server, serverEvents, cached);
+    }
+
+    return false;
+}
+
+/* Marks the part of the query that a completed full fetch settles as covered by the cache */
+void EventsUpdater::addCacheCoverage(DVRServer *server, const ServerEvents &serverEvents)
+{
+    ServerEventCache *cache = serverCache(server);
+    if (!cache)
+        return;
+
+    /* With the limit reached, only the most recent events were sent */
+    bool limited = m_limit > 0 && serverEvents.received >= m_limit;
+    cache->addFetchCoverage(serverEvents.fetchStart, queryEnd(), serverEvents.inProgress.values(),
+                            serverEvents.oldestStart, limited);
+    cache->evict(bcApp->eventCache()->maxSize());
+}
+
+/* Passes on part of a full fetch. The first part of a query replaces the rows of the
+ * previous one, which would otherwise stay mixed in until the fetch completes. */
+void EventsUpdater::deliverEvents(DVRServer *server, ServerEvents *serverEvents,
+                                  const QList<QSharedPointer<EventData> > &events)
+{
+    if (serverEvents->shown)
+    {
+        emit serverEventsAdded(server, events);
+        return;
+    }
+
+    serverEvents->shown = true;
+    emit serverEventsAvailable(server, events);
+}
+
+
+/* Events are passed on as they are parsed, and only what later updates need is kept.
+ * Completed events also go into the cache. */
+void EventsUpdater::eventsParsed(DVRServer *server, const QList<QSharedPointer<EventData> > &events)
+{
+    QHash<DVRServer *, ServerEvents>::iterator it = m_serverEvents.find(server);
+    if (it == m_serverEvents.end() || it->generation != m_generation)
+        return;
+
+    ServerEventCache *cache = serverCache(server);
+    if (cache && !cache->append(events))
+        it->cacheComplete = false;
+
+    trackEvents(&*it, events);
+    if (it->delta)
+        emit serverEventsAdded(server, events);
+    else
+        deliverEvents(server, &*it, events);
+}
+
+void EventsUpdater::eventsLoaded(DVRServer *server, bool ok)
+{
+    if (!server)
+        return;
+
+    QHash<DVRServer *, ServerEvents>::iterator it = m_serverEvents.find(server);
+    bool current = it != m_serverEvents.end() && it->generation == m_generation;
+
+    if (ok && current)
+    {
+        if (it->delta && m_limit > 0 && (it->received >= m_limit || it->count > m_limit))
+        {
+            /* The answer may have been cut short, leaving a gap, or pushed older events
+             * past the limit; fetch everything again, replacing the rows */
+            qDebug() << "EventsUpdater: too many changes for an incremental update";
+            it->valid = false;
+            it->shown = false;
+            current = false;
+        }
+        else if (!it->delta)
+        {
+            if (it->cacheComplete)
+                addCacheCoverage(server, *it);
+            it->valid = true;
+
+            /* Nothing was delivered, but the previous query's rows must still go */
+            if (!it->shown)
+            {
+                it->shown = true;
+                emit serverEventsAvailable(server, QList<QSharedPointer<EventData> >());
+            }
+        }
+    }
+    else if (current && !it->delta)
+    {
+        /* The next attempt replaces whatever part of the events was delivered */
+        it->shown = false;
+    }
 
     if (m_updatingServers.remove(server) && m_updatingServers.isEmpty())
         emit loadingFinished();
+
+    /* The query changed while this was loading */
+    if (ok && !current)
+        updateServer(server);
 }
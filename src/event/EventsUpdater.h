@@ -19,13 +19,27 @@
 #define EVENTS_UPDATER_H
 
 #include <QDateTime>
+#include <QHash>
 #include <QObject>
 #include <QSet>
+#include <QSharedPointer>
 #include <QTimer>
 
 class DVRServer;
 class DVRServerRepository;
 class EventData;
+class ServerEventCache;
+
+/* Keeps the events of each server up to date.
+ *
+ * The first update of a server fetches the whole time range. Later ones only ask for
+ * events after the highest ID seen, reaching back far enough to pick up the end of events
+ * that were still in progress, and pass on what the answer brought; the models skip
+ * events that didn't change. Events are delivered in batches as they are parsed, and
+ * are not kept here: only what the next incremental update needs is remembered.
+ *
+ * Completed events are kept in the event cache. A full fetch only asks for the part of the
+ * time range that the cache can't answer, and none at all if it can answer everything. */
 
 class EventsUpdater : public QObject
 {
@@ -51,20 +65,75 @@ signals:
     void loadingFinished();
 
     void serverEventsAvailable(DVRServer *server, const QList<QSharedPointer<EventData> > &events);
+    /* New or changed events, to be merged with those delivered before. The first events
+     * of a new query come as serverEventsAvailable, so that rows of the previous query
+     * are dropped. */
+    void serverEventsAdded(DVRServer *server, const QList<QSharedPointer<EventData> > &events);
 
 private slots:
     void serverAdded(DVRServer *server);
-    void eventsLoaded(DVRServer *server, bool ok, const QList<QSharedPointer<EventData> > &events);
+    void resetServer(DVRServer *server);
+    void eventsParsed(DVRServer *server, const QList<QSharedPointer<EventData> > &events);
+    void eventsLoaded(DVRServer *server, bool ok);
 
 private:
+    struct ServerEvents
+    {
+        /* Highest ID delivered for the current query, and the start times of the events
+         * that were still in progress, by ID */
+        qint64 lastId;
+        QHash<qint64, uint> inProgress;
+        /* Events delivered for the current query */
+        int count;
+        /* Whether all events of the current query were delivered */
+        bool valid;
+        /* The pending request only asks for changes, and was made for m_generation */
+        bool delta;
+        int generation;
+        /* The highest ID before the pending request, events it received, and the oldest
+         * start among them */
+        qint64 requestLastId;
+        int received;
+        uint oldestStart;
+        /* Whether every event the pending full fetch received went into the cache */
+        bool cacheComplete;
+        /* The pending full fetch starts after the part of the query taken from the cache */
+        uint fetchStart;
+        /* The whole query was answered by the cache, so nothing is left to update */
+        bool cachedOnly;
+        /* The server's rows in the models belong to this query. Until they do, the first
+         * events delivered replace the rows of the previous query instead of adding to them. */
+        bool shown;
+
+        ServerEvents()
+            : lastId(0), count(0), valid(false), delta(false), generation(0), requestLastId(0), received(0),
+              oldestStart(0), cacheComplete(false), fetchStart(0), cachedOnly(false), shown(false)
+        {
+        }
+    };
+
     DVRServerRepository *m_serverRepository;
     QSet<DVRServer *> m_updatingServers;
+    QHash<DVRServer *, ServerEvents> m_serverEvents;
 
     QTimer m_updateTimer;
     int m_limit;
     QDateTime m_startTime;
     QDateTime m_endTime;
+    /* Changes with the query, so answers to earlier queries are recognized */
+    int m_generation;
+
+    void resetServers();
+    qint64 deltaAfterId(const ServerEvents &serverEvents) const;
+    void trackEvents(ServerEvents *serverEvents, const QList<QSharedPointer<EventData> > &events) const;
+    void trimToLimit(QList<QSharedPointer<EventData> > *events) const;
 
+    uint queryStart() const;
+    uint queryEnd() const;
+    ServerEventCache *serverCache(DVRServer *server) const;
+    bool loadCachedEvents(DVRServer *server, ServerEvents *serverEvents);
+    void addCacheCoverage(DVRServer *server, const ServerEvents &serverEvents);
+    void deliverEvents(DVRServer *server, ServerEvents *serverEvents, const QList<QSharedPointer<EventData> > &events);
 };
 
 #endif // EVENTS_UPDATER_H
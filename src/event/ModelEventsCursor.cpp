@@ -35,7 +35,13 @@ EventData * ModelEventsCursor::current() const
         return 0;
 
     QModelIndex currentIndex = m_model->index(m_index, 0, QModelIndex());
-    return currentIndex.data(EventsModel::EventDataPtr).value<EventData*>();
+    QVariant event = currentIndex.data(EventsModel::EventDataRole);
+    if (!event.isValid())
+        return 0;
+
+    /* Events are copied out of the model's store; keep the copy for the caller */
+    m_current = event.value<EventData>();
+    return &m_current;
 }
 
 int ModelEventsCursor::nextIndex(int currentIndex) const
@@ -65,14 +71,14 @@ bool ModelEventsCursor::acceptIndex(int index) const
         return false;
 
     QModelIndex modelIndex = m_model->index(index, 0, QModelIndex());
-    EventData *event = modelIndex.data(EventsModel::EventDataPtr).value<EventData*>();
-    if (!event)
+    EventRef event = modelIndex.data(EventsModel::EventRefRole).value<EventRef>();
+    if (!event.isValid())
         return false;
 
     if (!m_cameraFilter)
         return true;
 
-    return event->locationCamera() == m_cameraFilter.data();
+    return event.locationCamera() == m_cameraFilter.data();
 }
 
 void ModelEventsCursor::invalidateIndexCache()
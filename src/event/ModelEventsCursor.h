@@ -3,6 +3,7 @@
 
 #include "event/EventsCursor.h"
 #include "camera/DVRCamera.h"
+#include "core/EventData.h"
 #include <QModelIndex>
 
 class QAbstractItemModel;
@@ -47,6 +48,7 @@ private:
     int m_index;
     int m_cachedNextIndex;
     int m_cachedPreviousIndex;
+    mutable EventData m_current;
 
     bool invert() const;
     int nextIndex(int currentIndex) const;
@@ -0,0 +1,413 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LiveStreamGateway.h"
+#include "rtsp-stream/RtspStreamPublisher.h"
+#include "rtsp-stream/RtspStreamRemuxer.h"
+#include <QDebug>
+#include <QSettings>
+#include <QStringList>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUrl>
+#include <QUrlQuery>
+
+extern "C" {
+#   include "libavcodec/avcodec.h"
+#   include "libavformat/avformat.h"
+}
+
+static const int ioBufferSize = 64 * 1024;
+
+struct LiveStreamGateway::Client
+{
+    QTcpSocket *socket;
+    QString path;
+    QSharedPointer<RtspStreamPublisher> publisher;
+    RtspStreamRemuxer muxer;
+    /* Generation of the parameters the muxer was opened with, -1 until then */
+    int generation;
+};
+
+LiveStreamGateway::LiveStreamGateway(QObject *parent)
+    : QObject(parent), m_server(0), m_port(0)
+{
+    m_timer = new QTimer(this);
+    m_timer->setInterval(writeInterval);
+    connect(m_timer, SIGNAL(timeout()), SLOT(writeAll()));
+}
+
+LiveStreamGateway::~LiveStreamGateway()
+{
+    removeAllClients();
+}
+
+QString LiveStreamGateway::streamPath(int serverId, int cameraId)
+{
+    return QString::fromLatin1("/live/%1/%2.ts").arg(serverId).arg(cameraId);
+}
+
+void LiveStreamGateway::addPublisher(const QString &path, const QSharedPointer<RtspStreamPublisher> &publisher)
+{
+    QMutexLocker locker(&m_publishersLock);
+    m_publishers.insert(path, publisher);
+}
+
+void LiveStreamGateway::removePublisher(const QString &path)
+{
+    QMutexLocker locker(&m_publishersLock);
+    m_publishers.remove(path);
+}
+
+QSharedPointer<RtspStreamPublisher> LiveStreamGateway::publisher(const QString &path)
+{
+    QMutexLocker locker(&m_publishersLock);
+    return m_publishers.value(path);
+}
+
+void LiveStreamGateway::updateSettings()
+{
+    QSettings settings;
+    quint16 port = settings.value(QLatin1String("ui/liveview/gatewayPort"), 0).toUInt();
+
+    QHostAddress address(settings.value(QLatin1String("ui/liveview/gatewayAddress")).toString().trimmed());
+    if (address.isNull())
+        address = QHostAddress::LocalHost;
+
+    m_allowedSubnets.clear();
+    QStringList subnets = settings.value(QLatin1String("ui/liveview/gatewayAllowedSubnets")).toString()
+            .split(QLatin1Char(','), QString::SkipEmptyParts);
+    foreach (const QString &subnet, subnets)
+    {
+        QPair<QHostAddress, int> parsed = QHostAddress::parseSubnet(subnet.trimmed());
+        if (parsed.first.isNull())
+            qDebug() << "LiveStreamGateway: ignoring invalid subnet" << subnet;
+        else
+            m_allowedSubnets.append(parsed);
+    }
+
+    /* Changes to access only apply to new requests; players already let in stay */
+    m_token = settings.value(QLatin1String("ui/liveview/gatewayToken")).toString();
+
+    if (port == m_port && address == m_address && (m_server || !port))
+        return;
+
+    removeAllClients();
+    delete m_server;
+    m_server = 0;
+    m_port = port;
+    m_address = address;
+
+    if (!port)
+        return;
+
+    m_server = new QTcpServer(this);
+    connect(m_server, SIGNAL(newConnection()), SLOT(newConnection()));
+    if (!m_server->listen(address, port))
+    {
+        qDebug() << "LiveStreamGateway: cannot listen on" << address.toString() << "port" << port
+                 << m_server->errorString();
+        delete m_server;
+        m_server = 0;
+        return;
+    }
+
+    qDebug() << "LiveStreamGateway: serving live streams on" << address.toString() << "port" << port;
+}
+
+bool LiveStreamGateway::isAllowed(const QHostAddress &peer) const
+{
+    bool isIPv4;
+    QHostAddress address(peer.toIPv4Address(&isIPv4));
+    if (!isIPv4)
+        address = peer;
+
+    if (address.isInSubnet(QHostAddress::LocalHost, 8) || address == QHostAddress::LocalHostIPv6)
+        return true;
+
+    typedef QPair<QHostAddress, int> Subnet;
+    foreach (const Subnet &subnet, m_allowedSubnets)
+    {
+        if (address.isInSubnet(subnet))
+            return true;
+    }
+
+    return false;
+}
+
+void LiveStreamGateway::newConnection()
+{
+    while (m_server && m_server->hasPendingConnections())
+    {
+        QTcpSocket *socket = m_server->nextPendingConnection();
+
+        if (!isAllowed(socket->peerAddress()))
+        {
+            qDebug() << "LiveStreamGateway: refusing" << socket->peerAddress().toString();
+            sendError(socket, "403 Forbidden");
+            continue;
+        }
+
+        if (m_clients.size() >= maxClients)
+        {
+            sendError(socket, "503 Service Unavailable");
+            continue;
+        }
+
+        /* Nothing but the request line is used; don't let a client fill our memory */
+        socket->setReadBufferSize(maxRequestSize);
+        connect(socket, SIGNAL(readyRead()), SLOT(readRequest()));
+        connect(socket, SIGNAL(disconnected()), SLOT(clientDisconnected()));
+    }
+}
+
+void LiveStreamGateway::readRequest()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket)
+        return;
+
+    if (!socket->canReadLine())
+    {
+        if (socket->bytesAvailable() >= maxRequestSize)
+            sendError(socket, "400 Bad Request");
+        return;
+    }
+
+    disconnect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+
+    QStringList request = QString::fromLatin1(socket->readLine().trimmed()).split(QLatin1Char(' '));
+    if (request.size() < 2 || request[0] != QLatin1String("GET"))
+    {
+        sendError(socket, "400 Bad Request");
+        return;
+    }
+
+    QUrl url(request[1]);
+    if (!m_token.isEmpty() && QUrlQuery(url).queryItemValue(QLatin1String("token")) != m_token)
+    {
+        sendError(socket, "403 Forbidden");
+        return;
+    }
+
+    startClient(socket, url.path());
+}
+
+void LiveStreamGateway::startClient(QTcpSocket *socket, const QString &path)
+{
+    QSharedPointer<RtspStreamPublisher> streamPublisher = publisher(path);
+    if (!streamPublisher)
+    {
+        sendError(socket, "404 Not Found");
+        return;
+    }
+
+    if (m_clients.size() >= maxClients)
+    {
+        sendError(socket, "503 Service Unavailable");
+        return;
+    }
+
+    socket->write("HTTP/1.0 200 OK\r\n"
+                  "Content-Type: video/mp2t\r\n"
+                  "Cache-Control: no-cache\r\n"
+                  "Connection: close\r\n\r\n");
+
+    Client *client = new Client;
+    client->socket = socket;
+    client->path = path;
+    client->publisher = streamPublisher;
+    client->generation = -1;
+    m_clients.append(client);
+
+    streamPublisher->setActive(true);
+    if (!m_timer->isActive())
+        m_timer->start();
+
+    qDebug() << "LiveStreamGateway: serving" << path << "to" << socket->peerAddress().toString()
+             << socket->peerPort();
+}
+
+void LiveStreamGateway::writeAll()
+{
+    QHash<RtspStreamPublisher *, QList<Client *> > clientsByPublisher;
+
+    foreach (Client *client, m_clients)
+    {
+        /* The stream was closed or replaced; its clients have nothing more coming */
+        if (publisher(client->path) != client->publisher)
+        {
+            removeClient(client);
+            continue;
+        }
+
+        clientsByPublisher[client->publisher.data()].append(client);
+    }
+
+    QHash<RtspStreamPublisher *, QList<Client *> >::const_iterator it;
+    for (it = clientsByPublisher.constBegin(); it != clientsByPublisher.constEnd(); ++it)
+    {
+        QList<AVPacket *> packets;
+        int generation = it.key()->takePending(packets);
+
+        if (!packets.isEmpty())
+        {
+            foreach (Client *client, it.value())
+                writePackets(client, packets, generation);
+        }
+
+        foreach (AVPacket *packet, packets)
+            av_packet_free(&packet);
+    }
+
+    foreach (Client *client, m_clients)
+    {
+        if (client->socket->bytesToWrite() > maxClientBacklog)
+        {
+            qDebug() << "LiveStreamGateway: disconnecting slow client of" << client->path;
+            removeClient(client);
+        }
+    }
+}
+
+void LiveStreamGateway::writePackets(Client *client, const QList<AVPacket *> &packets, int generation)
+{
+    if (client->generation >= 0 && client->generation != generation)
+    {
+        /* Players cope badly with the codec changing mid-stream; let them reconnect */
+        qDebug() << "LiveStreamGateway: stream parameters of" << client->path << "changed";
+        removeClient(client);
+        return;
+    }
+
+    foreach (AVPacket *packet, packets)
+    {
+        if (!client->muxer.isOpen())
+        {
+            /* Clients start on a keyframe */
+            if (packet->stream_index != RtspStreamRemuxer::VideoStream || !(packet->flags & AV_PKT_FLAG_KEY))
+                continue;
+
+            if (!openMuxer(client) || client->generation != generation)
+            {
+                removeClient(client);
+                return;
+            }
+        }
+
+        AVPacket *copy = av_packet_clone(packet);
+        if (!copy)
+            continue;
+        client->muxer.write(copy);
+        av_packet_free(&copy);
+    }
+
+    client->muxer.flush();
+}
+
+bool LiveStreamGateway::openMuxer(Client *client)
+{
+    AVCodecParameters *codecpar[RtspStreamRemuxer::StreamCount];
+    AVRational timeBase[RtspStreamRemuxer::StreamCount] = { { 0, 1 }, { 0, 1 } };
+
+    client->generation = client->publisher->copyStreams(codecpar, timeBase);
+    bool ok = client->muxer.open("mpegts", codecpar, timeBase, 0, client, writeCallback, 0, ioBufferSize);
+
+    for (int i = 0; i < RtspStreamRemuxer::StreamCount; ++i)
+        avcodec_parameters_free(&codecpar[i]);
+
+    return ok;
+}
+
+void LiveStreamGateway::removeClient(Client *client)
+{
+    if (!m_clients.removeOne(client))
+        return;
+
+    client->muxer.close();
+
+    bool publisherUsed = false;
+    foreach (Client *other, m_clients)
+    {
+        if (other->publisher == client->publisher)
+        {
+            publisherUsed = true;
+            break;
+        }
+    }
+
+    if (!publisherUsed)
+        client->publisher->setActive(false);
+
+    client->socket->disconnect(this);
+    client->socket->abort();
+    client->socket->deleteLater();
+    delete client;
+
+    if (m_clients.isEmpty())
+        m_timer->stop();
+}
+
+void LiveStreamGateway::removeAllClients()
+{
+    while (!m_clients.isEmpty())
+        removeClient(m_clients.first());
+}
+
+void LiveStreamGateway::clientDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket)
+        return;
+
+    foreach (Client *client, m_clients)
+    {
+        if (client->socket == socket)
+        {
+            removeClient(client);
+            return;
+        }
+    }
+
+    /* Disconnected before its request was answered */
+    socket->deleteLater();
+}
+
+void LiveStreamGateway::sendError(QTcpSocket *socket, const char *status)
+{
+    socket->disconnect(this);
+    socket->write("HTTP/1.0 ");
+    socket->write(status);
+    socket->write("\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+
+    connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    socket->disconnectFromHost();
+    if (socket->state() == QAbstractSocket::UnconnectedState)
+        socket->deleteLater();
+}
+
+int LiveStreamGateway::writeCallback(void *opaque, uint8_t *buf, int size)
+{
+    Client *client = static_cast<Client *>(opaque);
+
+    qint64 written = client->socket->write(reinterpret_cast<const char *>(buf), size);
+    if (written < 0)
+        return AVERROR(EIO);
+
+    return int(written);
+}
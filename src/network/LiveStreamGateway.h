@@ -0,0 +1,106 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIVESTREAMGATEWAY_H
+#define LIVESTREAMGATEWAY_H
+
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QSharedPointer>
+#include <stdint.h>
+
+struct AVPacket;
+class QTcpServer;
+class QTcpSocket;
+class QTimer;
+class RtspStreamPublisher;
+
+/* HTTP endpoint re-serving the live streams this client already receives, so other
+ * players on the machine or the site can watch a camera without another connection to
+ * the server.
+ *
+ * Streams are served as MPEG-TS at /live/<server id>/<camera id>.ts, remuxed from the
+ * received packets without decoding. Every client has its own muxer starting on a
+ * keyframe; what the socket hasn't sent yet is that client's queue, and clients letting it
+ * grow past maxClientBacklog are disconnected rather than slowing anyone else down.
+ *
+ * Lives on its own thread, see LiveViewManager::streamGateway(). The port is read from
+ * ui/liveview/gatewayPort; 0 disables the gateway. It listens on
+ * ui/liveview/gatewayAddress, localhost unless set. Players on this machine are always
+ * let in. Other machines are only let in from the subnets listed in
+ * ui/liveview/gatewayAllowedSubnets, such as "192.168.1.0/24, 10.0.0.0/8". When
+ * ui/liveview/gatewayToken is set, every request must carry it as ?token=<token>. */
+
+class LiveStreamGateway : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LiveStreamGateway(QObject *parent = 0);
+    virtual ~LiveStreamGateway();
+
+    static QString streamPath(int serverId, int cameraId);
+
+    /* Thread-safe */
+    void addPublisher(const QString &path, const QSharedPointer<RtspStreamPublisher> &publisher);
+    void removePublisher(const QString &path);
+
+public slots:
+    void updateSettings();
+
+private slots:
+    void newConnection();
+    void readRequest();
+    void clientDisconnected();
+    void writeAll();
+
+private:
+    struct Client;
+
+    static const int maxClients = 32;
+    static const int maxRequestSize = 4096;
+    static const int maxClientBacklog = 4 * 1024 * 1024;
+    static const int writeInterval = 20;
+
+    QMutex m_publishersLock;
+    QHash<QString, QSharedPointer<RtspStreamPublisher> > m_publishers;
+
+    QTcpServer *m_server;
+    QTimer *m_timer;
+    quint16 m_port;
+    QHostAddress m_address;
+    QList<QPair<QHostAddress, int> > m_allowedSubnets;
+    QString m_token;
+    QList<Client *> m_clients;
+
+    QSharedPointer<RtspStreamPublisher> publisher(const QString &path);
+    bool isAllowed(const QHostAddress &peer) const;
+    void startClient(QTcpSocket *socket, const QString &path);
+    void writePackets(Client *client, const QList<AVPacket *> &packets, int generation);
+    bool openMuxer(Client *client);
+    void removeClient(Client *client);
+    void removeAllClients();
+    void sendError(QTcpSocket *socket, const char *status);
+
+    static int writeCallback(void *opaque, uint8_t *buf, int size);
+};
+
+#endif // LIVESTREAMGATEWAY_H
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RtspDecodeEffort.h"
+#include <QtGlobal>
+#include <QtMath>
+
+extern "C" {
+#   include "libavcodec/avcodec.h"
+}
+
+/* Lower effort only once the scale is this much below a threshold */
+static const double hysteresis = 0.85;
+
+RtspDecodeEffort::Level RtspDecodeEffort::levelForScale(double scale)
+{
+    if (scale > 0.5)
+        return FullEffort;
+    if (scale > 0.25)
+        return ReducedEffort;
+    return MinimalEffort;
+}
+
+RtspDecodeEffort::Level RtspDecodeEffort::level(int codedWidth, int codedHeight, int displayWidth, int displayHeight,
+                                                Level current)
+{
+    if (codedWidth <= 0 || codedHeight <= 0 || displayWidth <= 0 || displayHeight <= 0)
+        return FullEffort;
+
+    double scale = qMax(double(displayWidth) / codedWidth, double(displayHeight) / codedHeight);
+    Level result = levelForScale(scale);
+
+    if (result > current)
+        result = Level(qMax(int(current), int(levelForScale(scale / hysteresis))));
+
+    return result;
+}
+
+int RtspDecodeEffort::lowresForSize(const AVCodec *codec, int codedWidth, int codedHeight, int displayWidth,
+                                    int displayHeight)
+{
+    int factor = 0;
+    while (factor < codec->max_lowres
+           && (codedWidth >> (factor + 1)) >= displayWidth
+           && (codedHeight >> (factor + 1)) >= displayHeight)
+        factor++;
+
+    return factor;
+}
+
+int RtspDecodeEffort::lowres(const AVCodec *codec, int codedWidth, int codedHeight, int displayWidth, int displayHeight,
+                             int current)
+{
+    if (!codec || codec->max_lowres <= 0 || displayWidth <= 0 || displayHeight <= 0)
+        return 0;
+
+    int result = lowresForSize(codec, codedWidth, codedHeight, displayWidth, displayHeight);
+
+    /* As with the level, only lower the resolution once the tile is clearly smaller */
+    if (result > current)
+        result = qMax(current, lowresForSize(codec, codedWidth, codedHeight, qCeil(displayWidth / hysteresis),
+                                             qCeil(displayHeight / hysteresis)));
+
+    return result;
+}
+
+void RtspDecodeEffort::apply(AVCodecContext *context, Level level)
+{
+    switch (level)
+    {
+    case FullEffort:
+        context->skip_loop_filter = AVDISCARD_DEFAULT;
+        context->skip_frame = AVDISCARD_DEFAULT;
+        break;
+    case ReducedEffort:
+        context->skip_loop_filter = AVDISCARD_NONKEY;
+        context->skip_frame = AVDISCARD_DEFAULT;
+        break;
+    case MinimalEffort:
+        context->skip_loop_filter = AVDISCARD_ALL;
+        context->skip_frame = AVDISCARD_NONREF;
+        break;
+    }
+}
+
+const char *RtspDecodeEffort::name(Level level)
+{
+    switch (level)
+    {
+    case FullEffort:
+        return "full";
+    case ReducedEffort:
+        return "reduced";
+    case MinimalEffort:
+        return "minimal";
+    }
+
+    return "unknown";
+}
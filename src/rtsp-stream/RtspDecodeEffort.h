@@ -0,0 +1,65 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RTSP_DECODE_EFFORT_H
+#define RTSP_DECODE_EFFORT_H
+
+struct AVCodec;
+struct AVCodecContext;
+
+/* How much work the video decoder puts into a stream shown much smaller than its coded size.
+ *
+ * ReducedEffort only runs the loop filter on keyframes. Most camera streams have no
+ * B-frames, so this is what saves work on them: deblocking is a large part of decoding
+ * H.264. It also drifts, because later frames are predicted from pictures that weren't
+ * filtered as the encoder's were. Blocking builds up over the GOP and is cleared by the
+ * next keyframe; shown at half size or less, the downscaling hides most of it.
+ *
+ * MinimalEffort also skips the loop filter on keyframes, and drops frames nothing is
+ * predicted from (B-frames, in streams that have them), which costs frame rate but
+ * doesn't drift further.
+ *
+ * Decoders that support it additionally decode at a lower resolution (lowres), never
+ * below the size shown.
+ *
+ * Effort and resolution are raised as soon as the displayed size grows, but only lowered
+ * once the size is clearly below a threshold. A tile resized around one therefore doesn't
+ * flip between levels, or reopen the decoder at every keyframe. */
+
+class RtspDecodeEffort
+{
+public:
+    enum Level
+    {
+        FullEffort,
+        ReducedEffort,
+        MinimalEffort
+    };
+
+    /* A display size of -1 means the stream is shown at its full size */
+    static Level level(int codedWidth, int codedHeight, int displayWidth, int displayHeight, Level current);
+    static int lowres(const AVCodec *codec, int codedWidth, int codedHeight, int displayWidth, int displayHeight,
+                      int current);
+    static void apply(AVCodecContext *context, Level level);
+    static const char *name(Level level);
+
+private:
+    static Level levelForScale(double scale);
+    static int lowresForSize(const AVCodec *codec, int codedWidth, int codedHeight, int displayWidth, int displayHeight);
+};
+
+#endif // RTSP_DECODE_EFFORT_H
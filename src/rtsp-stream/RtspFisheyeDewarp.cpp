@@ -0,0 +1,440 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RtspFisheyeDewarp.h"
+#include <QCache>
+#include <QMutex>
+#include <QtConcurrent/QtConcurrent>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+extern "C" {
+#   include "libavutil/common.h"
+#   include "libavutil/pixdesc.h"
+}
+
+/* Half the field of view of the lens, in radians */
+static const double lensHalfFov = M_PI / 2;
+/* Panorama rows stop short of the center of the circle, where there is nothing to unroll */
+static const double panoramaInnerRadius = 0.15;
+static const double quadViewTilt = 55;
+static const double quadViewFov = 90;
+/* In KB; a full HD output takes about 24 MB */
+static const int tableCacheSize = 128 * 1024;
+/* Tables are built for angles rounded to this, in degrees; finer steps don't move any
+ * sample by a visible amount */
+static const double viewAngleStep = 0.25;
+
+struct DewarpTableKey
+{
+    FisheyeView view;
+    int format;
+    int srcWidth;
+    int srcHeight;
+    int dstWidth;
+    int dstHeight;
+
+    bool operator==(const DewarpTableKey &other) const
+    {
+        return view == other.view && format == other.format && srcWidth == other.srcWidth
+                && srcHeight == other.srcHeight && dstWidth == other.dstWidth && dstHeight == other.dstHeight;
+    }
+};
+
+static uint qHash(const DewarpTableKey &key)
+{
+    return qHash(key.view.toString()) ^ uint(key.format << 24) ^ uint(key.srcWidth * 31 + key.srcHeight)
+            ^ uint((key.dstWidth * 37 + key.dstHeight) << 8);
+}
+
+static double roundAngle(double angle)
+{
+    return floor(angle / viewAngleStep + 0.5) * viewAngleStep;
+}
+
+static FisheyeView tableView(const FisheyeView &view)
+{
+    return FisheyeView(view.mode(), roundAngle(view.pan()), roundAngle(view.tilt()), roundAngle(view.fov()));
+}
+
+/* Direction, as angles from the lens axis and around it, of a pixel of a perspective view */
+static void perspectiveRay(const FisheyeView &view, double width, double height, double x, double y,
+                           double *theta, double *phi)
+{
+    double focal = (width / 2) / tan(view.fov() * M_PI / 360);
+    double cx = x - width / 2;
+    double cy = y - height / 2;
+    double tilt = view.tilt() * M_PI / 180;
+
+    /* The view's right, down and forward axes are (-1, 0, 0), (0, -cos t, sin t) and
+     * (0, sin t, cos t): up in the view points away from the lens axis */
+    double dx = -cx;
+    double dy = -cy * cos(tilt) + focal * sin(tilt);
+    double dz = cy * sin(tilt) + focal * cos(tilt);
+
+    *theta = acos(dz / sqrt(dx * dx + dy * dy + dz * dz));
+    *phi = atan2(dy, dx) + view.pan() * M_PI / 180;
+}
+
+RtspFisheyeDewarp::RtspFisheyeDewarp()
+    : m_format(AV_PIX_FMT_NONE), m_srcWidth(0), m_srcHeight(0), m_dstWidth(0), m_dstHeight(0), m_building(false)
+{
+}
+
+bool RtspFisheyeDewarp::isSupportedFormat(AVPixelFormat format)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    if (!desc || desc->nb_components != 3 || !(desc->flags & AV_PIX_FMT_FLAG_PLANAR))
+        return false;
+    if (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_PAL))
+        return false;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        if (desc->comp[i].plane != i || desc->comp[i].depth != 8 || desc->comp[i].step != 1)
+            return false;
+    }
+
+    return true;
+}
+
+QSize RtspFisheyeDewarp::defaultSize(FisheyeView::Mode mode, int srcWidth, int srcHeight)
+{
+    int diameter = qMin(srcWidth, srcHeight) & ~1;
+
+    switch (mode)
+    {
+    case FisheyeView::Panorama:
+        return QSize(diameter * 2, (diameter / 2) & ~1);
+    case FisheyeView::QuadView:
+        return QSize(diameter, (diameter * 3 / 4) & ~1);
+    case FisheyeView::VirtualPtz:
+        return QSize((diameter * 2 / 3) & ~1, (diameter / 2) & ~1);
+    default:
+        return QSize(srcWidth, srcHeight);
+    }
+}
+
+bool RtspFisheyeDewarp::mapPoint(const FisheyeView &view, int srcWidth, int srcHeight, int dstWidth, int dstHeight,
+                                 double x, double y, double *srcX, double *srcY)
+{
+    double theta = 0;
+    double phi = 0;
+
+    switch (view.mode())
+    {
+    case FisheyeView::Off:
+        *srcX = x * srcWidth / dstWidth;
+        *srcY = y * srcHeight / dstHeight;
+        return true;
+    case FisheyeView::Panorama:
+        /* Top row at the edge of the circle, so that up is away from the lens axis */
+        phi = (view.pan() + 360 * x / dstWidth) * M_PI / 180;
+        theta = lensHalfFov * (1 - (1 - panoramaInnerRadius) * y / dstHeight);
+        break;
+    case FisheyeView::QuadView:
+    {
+        /* Four views around the lens, clockwise from the top left */
+        double width = dstWidth / 2.0;
+        double height = dstHeight / 2.0;
+        int column = x < width ? 0 : 1;
+        int row = y < height ? 0 : 1;
+        int index = row ? 3 - column : column;
+
+        FisheyeView quadrant(FisheyeView::VirtualPtz, view.pan() + 90 * index, quadViewTilt, quadViewFov);
+        perspectiveRay(quadrant, width, height, x - column * width, y - row * height, &theta, &phi);
+        break;
+    }
+    case FisheyeView::VirtualPtz:
+        perspectiveRay(view, dstWidth, dstHeight, x, y, &theta, &phi);
+        break;
+    }
+
+    if (theta > lensHalfFov)
+        return false;
+
+    double radius = qMin(srcWidth, srcHeight) / 2.0;
+    double distance = radius * theta / lensHalfFov;
+    *srcX = srcWidth / 2.0 + distance * cos(phi);
+    *srcY = srcHeight / 2.0 + distance * sin(phi);
+    return true;
+}
+
+void RtspFisheyeDewarp::setGeometry(const FisheyeView &view, AVPixelFormat format, int srcWidth, int srcHeight,
+                                    int dstWidth, int dstHeight)
+{
+    FisheyeView wanted = tableView(view);
+
+    bool sameGeometry = m_tables && format == m_format && srcWidth == m_srcWidth && srcHeight == m_srcHeight
+            && dstWidth == m_dstWidth && dstHeight == m_dstHeight;
+    if (!sameGeometry)
+    {
+        /* The current tables don't fit the new frames, so there is nothing to show meanwhile */
+        m_building = false;
+        m_buildResult = QFuture<QSharedPointer<const Tables> >();
+        m_view = wanted;
+        m_format = format;
+        m_srcWidth = srcWidth;
+        m_srcHeight = srcHeight;
+        m_dstWidth = dstWidth;
+        m_dstHeight = dstHeight;
+        m_tables = cachedTables(wanted, format, srcWidth, srcHeight, dstWidth, dstHeight);
+        return;
+    }
+
+    if (m_building && m_buildResult.isFinished())
+    {
+        m_building = false;
+        QSharedPointer<const Tables> tables = m_buildResult.result();
+        m_buildResult = QFuture<QSharedPointer<const Tables> >();
+        if (tables)
+        {
+            m_tables = tables;
+            m_view = m_buildView;
+            /* Views passed over while steering are used once; only the one it settled on
+             * is worth a place in the cache */
+            if (m_buildView == wanted)
+                tableCache(m_buildView, format, srcWidth, srcHeight, dstWidth, dstHeight, tables);
+        }
+    }
+
+    if (wanted == m_view)
+        return;
+
+    QSharedPointer<const Tables> cached = tableCache(wanted, format, srcWidth, srcHeight, dstWidth, dstHeight);
+    if (cached)
+    {
+        m_tables = cached;
+        m_view = wanted;
+        return;
+    }
+
+    /* Steering a virtual PTZ asks for a new view with every mouse move. Frames keep using
+     * the current tables while the next ones are built off this thread, and the views
+     * passed over meanwhile are never built. */
+    if (!m_building)
+    {
+        m_building = true;
+        m_buildView = wanted;
+        m_buildResult = QtConcurrent::run(&RtspFisheyeDewarp::buildTablesForSizes, wanted, format,
+                                          QSize(srcWidth, srcHeight), QSize(dstWidth, dstHeight));
+    }
+}
+
+QSharedPointer<const RtspFisheyeDewarp::Tables> RtspFisheyeDewarp::cachedTables(const FisheyeView &view,
+                                                                                 AVPixelFormat format,
+                                                                                 int srcWidth, int srcHeight,
+                                                                                 int dstWidth, int dstHeight)
+{
+    QSharedPointer<const Tables> tables = tableCache(view, format, srcWidth, srcHeight, dstWidth, dstHeight);
+    if (tables)
+        return tables;
+
+    /* Built outside the lock; another thread asking for the same tables meanwhile builds
+     * them too, which is wasteful but harmless */
+    tables = buildTables(view, format, srcWidth, srcHeight, dstWidth, dstHeight);
+    if (tables)
+        tableCache(view, format, srcWidth, srcHeight, dstWidth, dstHeight, tables);
+    return tables;
+}
+
+QSharedPointer<const RtspFisheyeDewarp::Tables> RtspFisheyeDewarp::tableCache(const FisheyeView &view,
+                                                                               AVPixelFormat format,
+                                                                               int srcWidth, int srcHeight,
+                                                                               int dstWidth, int dstHeight,
+                                                                               const QSharedPointer<const Tables> &insert)
+{
+    static QMutex mutex;
+    static QCache<DewarpTableKey, QSharedPointer<const Tables> > cache(tableCacheSize);
+
+    DewarpTableKey key = { view, format, srcWidth, srcHeight, dstWidth, dstHeight };
+    QMutexLocker locker(&mutex);
+
+    if (!insert)
+    {
+        QSharedPointer<const Tables> *cached = cache.object(key);
+        return cached ? *cached : QSharedPointer<const Tables>();
+    }
+
+    int cost = 0;
+    for (int i = 0; i < 3; ++i)
+        cost += insert->planes[i].taps.size() * int(sizeof(Tap)) / 1024;
+
+    cache.insert(key, new QSharedPointer<const Tables>(insert), qMax(cost, 1));
+    return insert;
+}
+
+QSharedPointer<const RtspFisheyeDewarp::Tables> RtspFisheyeDewarp::buildTables(const FisheyeView &view,
+                                                                                AVPixelFormat format,
+                                                                                int srcWidth, int srcHeight,
+                                                                                int dstWidth, int dstHeight)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    if (!isSupportedFormat(format) || srcWidth < 16 || srcHeight < 16 || dstWidth <= 0 || dstHeight <= 0)
+        return QSharedPointer<const Tables>();
+
+    Tables *tables = new Tables;
+    tables->chromaShiftY = desc->log2_chroma_h;
+
+    bool fullRange = format == AV_PIX_FMT_YUVJ420P || format == AV_PIX_FMT_YUVJ422P
+            || format == AV_PIX_FMT_YUVJ444P || format == AV_PIX_FMT_YUVJ440P;
+    tables->fill[0] = fullRange ? 0 : 16;
+    tables->fill[1] = tables->fill[2] = 128;
+
+    buildTable(&tables->planes[0], view, srcWidth, srcHeight, dstWidth, dstHeight, 0, 0);
+    buildTable(&tables->planes[1], view, srcWidth, srcHeight, dstWidth, dstHeight,
+               desc->log2_chroma_w, desc->log2_chroma_h);
+    tables->planes[2] = tables->planes[1];
+
+    return QSharedPointer<const Tables>(tables);
+}
+
+QSharedPointer<const RtspFisheyeDewarp::Tables> RtspFisheyeDewarp::buildTablesForSizes(const FisheyeView &view,
+                                                                                        AVPixelFormat format,
+                                                                                        const QSize &srcSize,
+                                                                                        const QSize &dstSize)
+{
+    return buildTables(view, format, srcSize.width(), srcSize.height(), dstSize.width(), dstSize.height());
+}
+
+void RtspFisheyeDewarp::buildTable(Table *table, const FisheyeView &view, int srcWidth, int srcHeight,
+                                   int dstWidth, int dstHeight, int shiftX, int shiftY)
+{
+    int srcPlaneWidth = AV_CEIL_RSHIFT(srcWidth, shiftX);
+    int srcPlaneHeight = AV_CEIL_RSHIFT(srcHeight, shiftY);
+
+    table->width = AV_CEIL_RSHIFT(dstWidth, shiftX);
+    table->height = AV_CEIL_RSHIFT(dstHeight, shiftY);
+    table->taps.resize(table->width * table->height);
+
+    Tap *tap = table->taps.data();
+    for (int y = 0; y < table->height; ++y)
+    {
+        for (int x = 0; x < table->width; ++x, ++tap)
+        {
+            double srcX, srcY;
+            if (!mapPoint(view, srcWidth, srcHeight, dstWidth, dstHeight,
+                          (x + 0.5) * (1 << shiftX), (y + 0.5) * (1 << shiftY), &srcX, &srcY))
+            {
+                Tap outside = { 0, 0, 0, 0, 0 };
+                *tap = outside;
+                continue;
+            }
+
+            /* To the plane, with samples at integer positions */
+            srcX = srcX / (1 << shiftX) - 0.5;
+            srcY = srcY / (1 << shiftY) - 0.5;
+
+            int left = qBound(0, int(floor(srcX)), srcPlaneWidth - 2);
+            int top = qBound(0, int(floor(srcY)), srcPlaneHeight - 2);
+            int fx = qBound(0, qRound((srcX - left) * 256), 255);
+            int fy = qBound(0, qRound((srcY - top) * 256), 255);
+
+            Tap inside = { quint16(left), quint16(top), quint8(fx), quint8(fy), 1 };
+            *tap = inside;
+        }
+    }
+}
+
+void RtspFisheyeDewarp::remapRows(const uint8_t * const src[3], const int srcStride[3], uint8_t * const dst[3],
+                                  const int dstStride[3], int firstRow, int lastRow) const
+{
+    if (!m_tables)
+        return;
+
+    const Tables &tables = *m_tables;
+    remapPlane(tables.planes[0], src[0], srcStride[0], dst[0], dstStride[0], firstRow, lastRow, tables.fill[0]);
+
+    int chromaFirst = firstRow >> tables.chromaShiftY;
+    int chromaLast = lastRow >= tables.planes[0].height ? tables.planes[1].height : lastRow >> tables.chromaShiftY;
+    for (int i = 1; i < 3; ++i)
+        remapPlane(tables.planes[i], src[i], srcStride[i], dst[i], dstStride[i], chromaFirst, chromaLast, tables.fill[i]);
+}
+
+void RtspFisheyeDewarp::remapPlane(const Table &table, const uint8_t *src, int srcStride, uint8_t *dst, int dstStride,
+                                   int firstRow, int lastRow, quint8 fill)
+{
+    for (int y = firstRow; y < lastRow; ++y)
+    {
+        const Tap *tap = table.taps.constData() + y * table.width;
+        uint8_t *out = dst + y * dstStride;
+        int x = 0;
+
+#ifdef __SSE2__
+        /* Loads are scattered, so they stay scalar; the weighting is done eight pixels at a
+         * time, with the same rounding as the scalar loop below */
+        const __m128i full = _mm_set1_epi16(256);
+        const __m128i rounding = _mm_set1_epi16(128);
+
+        for (; x + 8 <= table.width; x += 8)
+        {
+            quint16 a[8], b[8], c[8], d[8], wx[8], wy[8];
+
+            for (int i = 0; i < 8; ++i)
+            {
+                const Tap &t = tap[x + i];
+                if (t.inside)
+                {
+                    const uint8_t *p = src + t.y * srcStride + t.x;
+                    a[i] = p[0];
+                    b[i] = p[1];
+                    c[i] = p[srcStride];
+                    d[i] = p[srcStride + 1];
+                }
+                else
+                    a[i] = b[i] = c[i] = d[i] = fill;
+                wx[i] = t.fx;
+                wy[i] = t.fy;
+            }
+
+            __m128i fx = _mm_loadu_si128((const __m128i *)wx);
+            __m128i fy = _mm_loadu_si128((const __m128i *)wy);
+            __m128i ifx = _mm_sub_epi16(full, fx);
+            __m128i ify = _mm_sub_epi16(full, fy);
+
+            __m128i top = _mm_add_epi16(_mm_mullo_epi16(_mm_loadu_si128((const __m128i *)a), ifx),
+                                        _mm_mullo_epi16(_mm_loadu_si128((const __m128i *)b), fx));
+            __m128i bottom = _mm_add_epi16(_mm_mullo_epi16(_mm_loadu_si128((const __m128i *)c), ifx),
+                                           _mm_mullo_epi16(_mm_loadu_si128((const __m128i *)d), fx));
+            top = _mm_srli_epi16(_mm_add_epi16(top, rounding), 8);
+            bottom = _mm_srli_epi16(_mm_add_epi16(bottom, rounding), 8);
+
+            __m128i value = _mm_add_epi16(_mm_mullo_epi16(top, ify), _mm_mullo_epi16(bottom, fy));
+            value = _mm_srli_epi16(_mm_add_epi16(value, rounding), 8);
+            _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(value, value));
+        }
+#endif
+
+        for (; x < table.width; ++x)
+        {
+            const Tap &t = tap[x];
+            if (!t.inside)
+            {
+                out[x] = fill;
+                continue;
+            }
+
+            const uint8_t *p = src + t.y * srcStride + t.x;
+            int top = (p[0] * (256 - t.fx) + p[1] * t.fx + 128) >> 8;
+            int bottom = (p[srcStride] * (256 - t.fx) + p[srcStride + 1] * t.fx + 128) >> 8;
+            out[x] = uint8_t((top * (256 - t.fy) + bottom * t.fy + 128) >> 8);
+        }
+    }
+}
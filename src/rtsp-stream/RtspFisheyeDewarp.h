@@ -0,0 +1,125 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RTSP_FISHEYE_DEWARP_H
+#define RTSP_FISHEYE_DEWARP_H
+
+#include "core/FisheyeView.h"
+#include <QFuture>
+#include <QSharedPointer>
+#include <QSize>
+#include <QVector>
+
+extern "C" {
+#   include "libavutil/pixfmt.h"
+}
+
+/* Remaps the circular image of a fisheye lens to flat views, one plane of planar 8-bit YUV
+ * at a time.
+ *
+ * The source position of every output pixel is computed once into a lookup table; tables
+ * are shared through a cache keyed by view and geometry, so several streams with the same
+ * geometry, or switching back to an earlier view, don't compute them again. Angles are
+ * rounded to a quarter degree for the tables. When only the view changes, new tables are
+ * built in the background and the previous ones stay in use until they are ready. Sampling is
+ * bilinear, eight pixels at a time with SSE2. remapRows() can be called for disjoint row
+ * ranges from several threads at once.
+ *
+ * The lens is assumed to be equidistant with a 180° field of view, its circle centered in
+ * the image and touching its shorter sides. */
+
+class RtspFisheyeDewarp
+{
+public:
+    RtspFisheyeDewarp();
+
+    /* Planar formats with 8-bit components in separate planes; other formats have to be
+     * converted first */
+    static bool isSupportedFormat(AVPixelFormat format);
+    /* Output size when the display size isn't known */
+    static QSize defaultSize(FisheyeView::Mode mode, int srcWidth, int srcHeight);
+
+    /* Source position, in pixels, for an output position; false outside the lens circle */
+    static bool mapPoint(const FisheyeView &view, int srcWidth, int srcHeight, int dstWidth, int dstHeight,
+                         double x, double y, double *srcX, double *srcY);
+
+    /* Call for every frame; a view change may take effect a few frames later */
+    void setGeometry(const FisheyeView &view, AVPixelFormat format, int srcWidth, int srcHeight,
+                     int dstWidth, int dstHeight);
+    bool isValid() const { return !m_tables.isNull(); }
+    /* View the tables in use were built for, with rounded angles */
+    FisheyeView view() const { return m_view; }
+
+    /* Remaps luma rows [firstRow, lastRow) and the chroma rows that go with them */
+    void remapRows(const uint8_t * const src[3], const int srcStride[3], uint8_t * const dst[3], const int dstStride[3],
+                   int firstRow, int lastRow) const;
+
+private:
+    struct Tap
+    {
+        quint16 x;
+        quint16 y;
+        quint8 fx;
+        quint8 fy;
+        quint16 inside;
+    };
+
+    struct Table
+    {
+        int width;
+        int height;
+        QVector<Tap> taps;
+    };
+
+    struct Tables
+    {
+        Table planes[3];
+        int chromaShiftY;
+        quint8 fill[3];
+    };
+
+    QSharedPointer<const Tables> m_tables;
+    FisheyeView m_view;
+    AVPixelFormat m_format;
+    int m_srcWidth;
+    int m_srcHeight;
+    int m_dstWidth;
+    int m_dstHeight;
+
+    /* Tables for m_buildView, being built for the current geometry */
+    bool m_building;
+    FisheyeView m_buildView;
+    QFuture<QSharedPointer<const Tables> > m_buildResult;
+
+    /* Looks tables up, or adds them when insert is set */
+    static QSharedPointer<const Tables> tableCache(const FisheyeView &view, AVPixelFormat format, int srcWidth,
+                                                   int srcHeight, int dstWidth, int dstHeight,
+                                                   const QSharedPointer<const Tables> &insert = QSharedPointer<const Tables>());
+    static QSharedPointer<const Tables> cachedTables(const FisheyeView &view, AVPixelFormat format, int srcWidth,
+                                                     int srcHeight, int dstWidth, int dstHeight);
+    static QSharedPointer<const Tables> buildTables(const FisheyeView &view, AVPixelFormat format, int srcWidth,
+                                                    int srcHeight, int dstWidth, int dstHeight);
+    /* For QtConcurrent::run, which takes at most five arguments */
+    static QSharedPointer<const Tables> buildTablesForSizes(const FisheyeView &view, AVPixelFormat format,
+                                                            const QSize &srcSize, const QSize &dstSize);
+    static void buildTable(Table *table, const FisheyeView &view, int srcWidth, int srcHeight, int dstWidth,
+                           int dstHeight, int shiftX, int shiftY);
+    static void remapPlane(const Table &table, const uint8_t *src, int srcStride, uint8_t *dst, int dstStride,
+                           int firstRow, int lastRow, quint8 fill);
+};
+
+#endif // RTSP_FISHEYE_DEWARP_H
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RtspMotionDetector.h"
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+extern "C" {
+#   include "libavutil/frame.h"
+#   include "libavutil/pixdesc.h"
+}
+
+/* Samples averaged per thumbnail pixel, in each direction */
+static const int samplesPerPixel = 4;
+
+RtspMotionDetector::RtspMotionDetector()
+    : m_width(0), m_height(0), m_threshold(20), m_frames(0)
+{
+}
+
+void RtspMotionDetector::setThreshold(int threshold)
+{
+    m_threshold = qBound(1, threshold, 255);
+}
+
+void RtspMotionDetector::reset()
+{
+    m_frames = 0;
+}
+
+QBitArray RtspMotionDetector::process(const AVFrame *frame)
+{
+    if (!sampleThumbnail(frame))
+    {
+        reset();
+        return QBitArray();
+    }
+
+    if (m_frames++ == 0)
+        memcpy(m_background, m_thumbnail, sizeof(m_background));
+
+    updateBackground();
+
+    if (m_frames <= warmupFrames)
+        return QBitArray();
+
+    return movingCells();
+}
+
+/* Averages a 4x4 spread of samples for each pixel; cheaper than reading every pixel of a
+ * large frame, and enough to keep sensor noise out */
+bool RtspMotionDetector::sampleThumbnail(const AVFrame *frame)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL))
+            || desc->comp[0].depth != 8 || desc->comp[0].step != 1 || !frame->data[0])
+        return false;
+
+    if (frame->width < thumbnailWidth || frame->height < thumbnailHeight)
+        return false;
+
+    if (frame->width != m_width || frame->height != m_height)
+    {
+        m_width = frame->width;
+        m_height = frame->height;
+        m_sampleColumns.resize(thumbnailWidth * samplesPerPixel);
+        m_sampleRows.resize(thumbnailHeight * samplesPerPixel);
+
+        for (int i = 0; i < m_sampleColumns.size(); ++i)
+            m_sampleColumns[i] = int((2 * i + 1) * qint64(m_width) / (2 * m_sampleColumns.size()));
+        for (int i = 0; i < m_sampleRows.size(); ++i)
+            m_sampleRows[i] = int((2 * i + 1) * qint64(m_height) / (2 * m_sampleRows.size()));
+        m_frames = 0;
+    }
+
+    const int *columns = m_sampleColumns.constData();
+    const int *rows = m_sampleRows.constData();
+    quint8 *out = m_thumbnail;
+
+    for (int y = 0; y < thumbnailHeight; ++y)
+    {
+        const uint8_t *lines[samplesPerPixel];
+        for (int i = 0; i < samplesPerPixel; ++i)
+            lines[i] = frame->data[0] + rows[y * samplesPerPixel + i] * frame->linesize[0];
+
+        for (int x = 0; x < thumbnailWidth; ++x)
+        {
+            const int *column = columns + x * samplesPerPixel;
+            int sum = 8;
+            for (int i = 0; i < samplesPerPixel; ++i)
+                sum += lines[i][column[0]] + lines[i][column[1]] + lines[i][column[2]] + lines[i][column[3]];
+            *out++ = quint8(sum >> 4);
+        }
+    }
+
+    return true;
+}
+
+/* Marks pixels that differ from the background, then moves the background one level
+ * towards the current thumbnail */
+void RtspMotionDetector::updateBackground()
+{
+    const int size = thumbnailWidth * thumbnailHeight;
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i threshold = _mm_set1_epi8(char(m_threshold));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i current = _mm_loadu_si128((const __m128i *)(m_thumbnail + i));
+        __m128i background = _mm_loadu_si128((const __m128i *)(m_background + i));
+
+        __m128i above = _mm_subs_epu8(current, background);
+        __m128i below = _mm_subs_epu8(background, current);
+        __m128i difference = _mm_or_si128(above, below);
+
+        /* 0xff where the difference exceeds the threshold */
+        __m128i still = _mm_cmpeq_epi8(_mm_subs_epu8(difference, threshold), zero);
+        _mm_storeu_si128((__m128i *)(m_moving + i), _mm_andnot_si128(still, _mm_set1_epi8(char(0xff))));
+
+        background = _mm_add_epi8(background, _mm_min_epu8(above, one));
+        background = _mm_sub_epi8(background, _mm_min_epu8(below, one));
+        _mm_storeu_si128((__m128i *)(m_background + i), background);
+    }
+#endif
+
+    for (; i < size; ++i)
+    {
+        int difference = int(m_thumbnail[i]) - int(m_background[i]);
+        m_moving[i] = qAbs(difference) > m_threshold ? 0xff : 0;
+
+        if (difference > 0)
+            m_background[i]++;
+        else if (difference < 0)
+            m_background[i]--;
+    }
+}
+
+QBitArray RtspMotionDetector::movingCells() const
+{
+    const int cellWidth = thumbnailWidth / gridColumns;
+    const int cellHeight = thumbnailHeight / gridRows;
+    int counts[gridColumns * gridRows];
+    memset(counts, 0, sizeof(counts));
+
+    for (int y = 0; y < thumbnailHeight; ++y)
+    {
+        const quint8 *row = m_moving + y * thumbnailWidth;
+        int *cellRow = counts + (y / cellHeight) * gridColumns;
+        for (int x = 0; x < thumbnailWidth; ++x)
+            cellRow[x / cellWidth] += row[x] & 1;
+    }
+
+    QBitArray cells(gridColumns * gridRows);
+    for (int i = 0; i < gridColumns * gridRows; ++i)
+    {
+        if (counts[i] >= cellMovingPixels)
+            cells.setBit(i);
+    }
+
+    return cells;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RTSP_MOTION_DETECTOR_H
+#define RTSP_MOTION_DETECTOR_H
+
+#include <QBitArray>
+#include <QVector>
+
+struct AVFrame;
+
+/* Finds motion in decoded frames, to flag live tiles without waiting for server events.
+ *
+ * Works on a small luma thumbnail sampled straight from the YUV planes, compared against
+ * a background that follows the scene by one level per frame (an approximate running
+ * median, so that lighting drifts and noise don't count as motion). Differencing and the
+ * background update are done sixteen pixels at a time with SSE2. Motion is reported per
+ * cell of a coarse grid, so that each tile can apply its own mask. */
+
+class RtspMotionDetector
+{
+public:
+    static const int gridColumns = 16;
+    static const int gridRows = 12;
+    static const int thumbnailWidth = 64;
+    static const int thumbnailHeight = 48;
+
+    RtspMotionDetector();
+
+    /* Luma difference from the background that counts as motion */
+    void setThreshold(int threshold);
+    void reset();
+
+    /* Bit row * gridColumns + column is set for cells with motion; empty for frames
+     * without a luma plane and while the background settles */
+    QBitArray process(const AVFrame *frame);
+
+private:
+    /* Moving thumbnail pixels that make a cell count as moving, out of 16 */
+    static const int cellMovingPixels = 3;
+    static const int warmupFrames = 2;
+
+    quint8 m_thumbnail[thumbnailWidth * thumbnailHeight];
+    quint8 m_background[thumbnailWidth * thumbnailHeight];
+    quint8 m_moving[thumbnailWidth * thumbnailHeight];
+    /* Luma offsets of the samples averaged into each thumbnail pixel, for m_width x m_height */
+    QVector<int> m_sampleColumns;
+    QVector<int> m_sampleRows;
+    int m_width;
+    int m_height;
+    int m_threshold;
+    int m_frames;
+
+    bool sampleThumbnail(const AVFrame *frame);
+    void updateBackground();
+    QBitArray movingCells() const;
+};
+
+#endif // RTSP_MOTION_DETECTOR_H
@@ -0,0 +1,238 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RtspPacketRing.h"
+#include <string.h>
+
+extern "C" {
+#   include "libavcodec/avcodec.h"
+#   include "libavutil/mathematics.h"
+}
+
+QAtomicInt RtspPacketRing::s_totalBytes(0);
+QAtomicInt RtspPacketRing::s_memoryLimit(256 * 1024 * 1024);
+
+static bool sameStream(const AVCodecParameters *a, const AVCodecParameters *b)
+{
+    if (a->codec_id != b->codec_id || a->width != b->width || a->height != b->height
+            || a->format != b->format || a->extradata_size != b->extradata_size)
+        return false;
+
+    return !a->extradata_size || !memcmp(a->extradata, b->extradata, a->extradata_size);
+}
+
+RtspPacketRing::RtspPacketRing()
+    : m_codecpar(0), m_writer(0), m_duration(0), m_bytes(0)
+{
+    m_timeBase.num = 1;
+    m_timeBase.den = 90000;
+}
+
+RtspPacketRing::~RtspPacketRing()
+{
+    clear();
+    avcodec_parameters_free(&m_codecpar);
+}
+
+void RtspPacketRing::setDuration(int seconds)
+{
+    QMutexLocker locker(&m_lock);
+
+    m_duration = qint64(qMax(seconds, 0)) * AV_TIME_BASE;
+    if (!m_duration)
+        dropFront(m_packets.size());
+    else
+        trim();
+}
+
+int RtspPacketRing::duration() const
+{
+    QMutexLocker locker(&m_lock);
+    return int(m_duration / AV_TIME_BASE);
+}
+
+void RtspPacketRing::setMemoryLimit(int bytes)
+{
+    s_memoryLimit.store(qMax(bytes, 0));
+}
+
+void RtspPacketRing::setStream(const void *writer, const AVCodecParameters *codecpar, AVRational timeBase)
+{
+    QMutexLocker locker(&m_lock);
+
+    m_writer = writer;
+
+    if (m_codecpar && sameStream(m_codecpar, codecpar) && !av_cmp_q(m_timeBase, timeBase))
+        return;
+
+    dropFront(m_packets.size());
+
+    if (!m_codecpar)
+        m_codecpar = avcodec_parameters_alloc();
+    avcodec_parameters_copy(m_codecpar, codecpar);
+    m_timeBase = timeBase;
+}
+
+void RtspPacketRing::append(const void *writer, const AVPacket *packet)
+{
+    QMutexLocker locker(&m_lock);
+
+    if (!m_duration || writer != m_writer || !m_codecpar)
+        return;
+
+    /* Anything read back must start with a keyframe */
+    if (m_packets.isEmpty() && !(packet->flags & AV_PKT_FLAG_KEY))
+        return;
+
+    if (packetTime(packet) == (qint64)AV_NOPTS_VALUE)
+        return;
+
+    AVPacket *copy = av_packet_alloc();
+    if (!copy || av_packet_ref(copy, packet) < 0)
+    {
+        av_packet_free(&copy);
+        return;
+    }
+
+    m_packets.enqueue(copy);
+    m_bytes += copy->size;
+    s_totalBytes.fetchAndAddRelaxed(copy->size);
+
+    trim();
+}
+
+void RtspPacketRing::clear()
+{
+    QMutexLocker locker(&m_lock);
+    dropFront(m_packets.size());
+}
+
+qint64 RtspPacketRing::packetTime(const AVPacket *packet) const
+{
+    int64_t pts = packet->pts != (int64_t)AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    if (pts == (int64_t)AV_NOPTS_VALUE)
+        return AV_NOPTS_VALUE;
+
+    return av_rescale_q(pts, m_timeBase, AV_TIME_BASE_Q);
+}
+
+// Calling this method should be protected by m_lock
+void RtspPacketRing::trim()
+{
+    for (;;)
+    {
+        int next = nextKeyframe(1);
+        if (next < 0)
+            break;
+
+        /* Drop the oldest group while the rest still covers the duration, or while all
+         * rings together are over the limit */
+        qint64 newest = packetTime(m_packets.last());
+        bool expired = newest - packetTime(m_packets.at(next)) >= m_duration;
+        bool overLimit = s_totalBytes.load() > s_memoryLimit.load();
+        if (!expired && !overLimit)
+            break;
+
+        dropFront(next);
+    }
+}
+
+// Calling this method should be protected by m_lock
+void RtspPacketRing::dropFront(int count)
+{
+    for (int i = 0; i < count && !m_packets.isEmpty(); ++i)
+    {
+        AVPacket *packet = m_packets.dequeue();
+        m_bytes -= packet->size;
+        s_totalBytes.fetchAndAddRelaxed(-packet->size);
+        av_packet_free(&packet);
+    }
+}
+
+// Calling this method should be protected by m_lock
+int RtspPacketRing::nextKeyframe(int from) const
+{
+    for (int i = from; i < m_packets.size(); ++i)
+    {
+        if (m_packets.at(i)->flags & AV_PKT_FLAG_KEY)
+            return i;
+    }
+
+    return -1;
+}
+
+qint64 RtspPacketRing::bufferedDuration() const
+{
+    QMutexLocker locker(&m_lock);
+
+    if (m_packets.isEmpty())
+        return 0;
+
+    return packetTime(m_packets.last()) - packetTime(m_packets.first());
+}
+
+int RtspPacketRing::bufferedBytes() const
+{
+    QMutexLocker locker(&m_lock);
+    return m_bytes;
+}
+
+AVCodecParameters *RtspPacketRing::copyCodecParameters() const
+{
+    QMutexLocker locker(&m_lock);
+
+    if (!m_codecpar)
+        return 0;
+
+    AVCodecParameters *codecpar = avcodec_parameters_alloc();
+    if (codecpar)
+        avcodec_parameters_copy(codecpar, m_codecpar);
+    return codecpar;
+}
+
+AVRational RtspPacketRing::timeBase() const
+{
+    QMutexLocker locker(&m_lock);
+    return m_timeBase;
+}
+
+QList<AVPacket *> RtspPacketRing::packetsFrom(qint64 offset) const
+{
+    QMutexLocker locker(&m_lock);
+
+    if (m_packets.isEmpty())
+        return QList<AVPacket *>();
+
+    qint64 target = packetTime(m_packets.last()) - offset;
+    int start = 0;
+    for (int i = nextKeyframe(1); i > 0 && packetTime(m_packets.at(i)) <= target; i = nextKeyframe(i + 1))
+        start = i;
+
+    QList<AVPacket *> packets;
+    for (int i = start; i < m_packets.size(); ++i)
+    {
+        AVPacket *packet = av_packet_alloc();
+        if (!packet || av_packet_ref(packet, m_packets.at(i)) < 0)
+        {
+            av_packet_free(&packet);
+            break;
+        }
+        packets.append(packet);
+    }
+
+    return packets;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RTSP_PACKET_RING_H
+#define RTSP_PACKET_RING_H
+
+#include <QAtomicInt>
+#include <QList>
+#include <QMutex>
+#include <QQueue>
+
+extern "C" {
+#   include "libavutil/rational.h"
+}
+
+struct AVCodecParameters;
+struct AVPacket;
+
+/* Bounded ring of the compressed video packets of one camera, for rewinding live view.
+ *
+ * The stream worker appends every video packet it reads; the ring keeps references to
+ * them, so it costs about bitrate x duration of memory. Packets are dropped a whole group
+ * of pictures at a time, so the oldest packet is always a keyframe and anything read from
+ * the ring can be decoded on its own. Besides its own duration, every ring is bound by a
+ * memory limit shared by all rings; when it is exceeded the ring being written drops its
+ * oldest groups, but never the one still being received.
+ *
+ * Writers identify themselves, so that while a reconnection briefly runs two workers for
+ * the same camera only the one that described the stream last is recorded. All methods
+ * are thread-safe. */
+
+class RtspPacketRing
+{
+    Q_DISABLE_COPY(RtspPacketRing)
+
+public:
+    RtspPacketRing();
+    ~RtspPacketRing();
+
+    /* In seconds; 0 disables the ring */
+    void setDuration(int seconds);
+    int duration() const;
+
+    /* Starts recording a stream; the buffered packets are dropped if the stream differs
+     * from the one recorded so far */
+    void setStream(const void *writer, const AVCodecParameters *codecpar, AVRational timeBase);
+    void append(const void *writer, const AVPacket *packet);
+    void clear();
+
+    /* Span of the buffered packets, in microseconds */
+    qint64 bufferedDuration() const;
+    int bufferedBytes() const;
+
+    /* Copy of the stream parameters; free with avcodec_parameters_free() */
+    AVCodecParameters *copyCodecParameters() const;
+    AVRational timeBase() const;
+
+    /* New references to the packets starting at the last keyframe that is at least offset
+     * microseconds older than the newest packet, or at the oldest keyframe. Free each with
+     * av_packet_free(). */
+    QList<AVPacket *> packetsFrom(qint64 offset) const;
+
+    /* Shared by all rings, in bytes */
+    static void setMemoryLimit(int bytes);
+    static int totalBytes() { return s_totalBytes.load(); }
+
+private:
+    mutable QMutex m_lock;
+    QQueue<AVPacket *> m_packets;
+    AVCodecParameters *m_codecpar;
+    AVRational m_timeBase;
+    const void *m_writer;
+    qint64 m_duration;
+    int m_bytes;
+
+    static QAtomicInt s_totalBytes;
+    static QAtomicInt s_memoryLimit;
+
+    /* Position of a packet in microseconds */
+    qint64 packetTime(const AVPacket *packet) const;
+    void trim();
+    void dropFront(int count);
+    int nextKeyframe(int from) const;
+};
+
+#endif // RTSP_PACKET_RING_H
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RTSP_PACKET_SINK_H
+#define RTSP_PACKET_SINK_H
+
+struct AVFormatContext;
+struct AVPacket;
+
+/* Receives the compressed packets a RtspStreamWorker reads, on the worker thread.
+ *
+ * Implementations must return quickly, typically by taking a reference to the packet
+ * for another thread. A worker calls setStreams() before its first append(); writers are
+ * identified so that, while a reconnection briefly runs two workers for a stream, a sink
+ * can ignore the one it was not set up by last. */
+
+class RtspPacketSink
+{
+public:
+    virtual ~RtspPacketSink() {}
+
+    virtual void setStreams(const void *writer, AVFormatContext *input, int videoStreamIndex, int audioStreamIndex) = 0;
+    virtual void append(const void *writer, const AVPacket *packet) = 0;
+};
+
+#endif // RTSP_PACKET_SINK_H
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RtspRecordingWriter.h"
+#include "RtspStreamRecorder.h"
+#include <QTimer>
+
+RtspRecordingWriter::RtspRecordingWriter(QObject *parent)
+    : QObject(parent), m_timer(0)
+{
+}
+
+RtspRecordingWriter::~RtspRecordingWriter()
+{
+}
+
+void RtspRecordingWriter::start()
+{
+    /* Created here so that the timer lives on the writer thread */
+    m_timer = new QTimer(this);
+    m_timer->setInterval(writeInterval);
+    connect(m_timer, SIGNAL(timeout()), SLOT(writeAll()));
+    m_timer->start();
+}
+
+void RtspRecordingWriter::addRecorder(const QSharedPointer<RtspStreamRecorder> &recorder)
+{
+    QMutexLocker locker(&m_recordersLock);
+    m_recorders.append(recorder);
+}
+
+void RtspRecordingWriter::writeAll()
+{
+    QList<QSharedPointer<RtspStreamRecorder> > recorders;
+    {
+        QMutexLocker locker(&m_recordersLock);
+        recorders = m_recorders;
+    }
+
+    QList<QSharedPointer<RtspStreamRecorder> > finished;
+    foreach (const QSharedPointer<RtspStreamRecorder> &recorder, recorders)
+    {
+        if (!recorder->writePending())
+            finished.append(recorder);
+    }
+
+    if (finished.isEmpty())
+        return;
+
+    QMutexLocker locker(&m_recordersLock);
+    foreach (const QSharedPointer<RtspStreamRecorder> &recorder, finished)
+        m_recorders.removeOne(recorder);
+}
+
+void RtspRecordingWriter::finishAll()
+{
+    {
+        QMutexLocker locker(&m_recordersLock);
+        foreach (const QSharedPointer<RtspStreamRecorder> &recorder, m_recorders)
+            recorder->stop();
+    }
+
+    writeAll();
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RTSP_RECORDING_WRITER_H
+#define RTSP_RECORDING_WRITER_H
+
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QSharedPointer>
+
+class QTimer;
+class RtspStreamRecorder;
+
+/* Background thread writing every local recording.
+ *
+ * One thread serves all recorders: it wakes up twice a second and writes out what each
+ * of them collected since, so many simultaneous recordings cost a few large writes rather
+ * than a write per packet, and never block the stream workers. */
+
+class RtspRecordingWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RtspRecordingWriter(QObject *parent = 0);
+    virtual ~RtspRecordingWriter();
+
+    /* Thread-safe; the recorder is kept until it is stopped and fully written */
+    void addRecorder(const QSharedPointer<RtspStreamRecorder> &recorder);
+
+public slots:
+    void start();
+    void writeAll();
+    /* Stops and completes every recording */
+    void finishAll();
+
+private:
+    static const int writeInterval = 500;
+
+    QMutex m_recordersLock;
+    QList<QSharedPointer<RtspStreamRecorder> > m_recorders;
+    QTimer *m_timer;
+};
+
+#endif // RTSP_RECORDING_WRITER_H
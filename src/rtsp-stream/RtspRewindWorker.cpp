@@ -0,0 +1,193 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RtspRewindWorker.h"
+#include "RtspPacketRing.h"
+#include "RtspStreamFrame.h"
+#include "RtspStreamFrameFormatter.h"
+#include "RtspStreamFrameQueue.h"
+#include <QDebug>
+#include <QThread>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/mathematics.h>
+}
+
+RtspRewindWorker::RtspRewindWorker(const QSharedPointer<RtspPacketRing> &ring,
+                                   QSharedPointer<RtspStreamFrameQueue> &shared_queue,
+                                   qint64 offset, QObject *parent)
+    : QObject(parent), m_ring(ring), m_frameQueue(new RtspStreamFrameQueue(RtspStreamFrameQueue::Paced, 6)), m_offset(offset),
+      m_cancelFlag(false), m_frameWidthHint(-1), m_frameHeightHint(-1),
+      m_codecpar(0), m_codecCtx(0), m_frame(0)
+{
+    shared_queue = m_frameQueue;
+}
+
+RtspRewindWorker::~RtspRewindWorker()
+{
+    av_frame_free(&m_frame);
+    avcodec_free_context(&m_codecCtx);
+    avcodec_parameters_free(&m_codecpar);
+}
+
+void RtspRewindWorker::stop()
+{
+    m_cancelFlag = true;
+}
+
+void RtspRewindWorker::setFrameSizeHint(int width, int height)
+{
+    m_frameWidthHint = width;
+    m_frameHeightHint = height;
+}
+
+void RtspRewindWorker::setCropRect(const QRectF &rect)
+{
+    QMutexLocker locker(&m_viewLock);
+    m_cropRect = rect;
+}
+
+QRectF RtspRewindWorker::cropRect()
+{
+    QMutexLocker locker(&m_viewLock);
+    return m_cropRect;
+}
+
+void RtspRewindWorker::setFisheyeView(const FisheyeView &view)
+{
+    QMutexLocker locker(&m_viewLock);
+    m_fisheyeView = view;
+}
+
+void RtspRewindWorker::run()
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+
+    if (openDecoder())
+        play();
+
+    emit finished();
+    deleteLater();
+}
+
+bool RtspRewindWorker::openDecoder()
+{
+    m_codecpar = m_ring->copyCodecParameters();
+    if (!m_codecpar)
+    {
+        qDebug() << "RtspRewindWorker: nothing buffered to rewind";
+        return false;
+    }
+
+    AVCodec *codec = avcodec_find_decoder(m_codecpar->codec_id);
+    m_codecCtx = avcodec_alloc_context3(codec);
+    if (!codec || !m_codecCtx || avcodec_parameters_to_context(m_codecCtx, m_codecpar) < 0
+            || avcodec_open2(m_codecCtx, codec, 0) < 0)
+    {
+        qDebug() << "RtspRewindWorker: cannot open decoder for buffered video";
+        return false;
+    }
+
+    m_frame = av_frame_alloc();
+    return m_frame != 0;
+}
+
+void RtspRewindWorker::play()
+{
+    AVRational timeBase = m_ring->timeBase();
+    RtspStreamFrameFormatter formatter(m_codecpar);
+    QList<AVPacket *> packets = m_ring->packetsFrom(m_offset);
+
+    qDebug() << "RtspRewindWorker: replaying" << packets.size() << "packets";
+
+    QElapsedTimer clock;
+    qint64 startPts = AV_NOPTS_VALUE;
+
+    AVPacket *packet = 0;
+    while (!m_cancelFlag && (packet || !packets.isEmpty()))
+    {
+        if (!packet)
+            packet = packets.takeFirst();
+
+        /* A decoder with frames waiting to be taken refuses the packet; it is sent again
+         * once they are drained, since losing it would corrupt video up to the next
+         * keyframe */
+        int ret = avcodec_send_packet(m_codecCtx, packet);
+        bool resend = ret == AVERROR(EAGAIN);
+        if (!resend)
+            av_packet_free(&packet);
+
+        if (ret < 0 && !resend)
+            continue;
+
+        int received = 0;
+        while (!m_cancelFlag && avcodec_receive_frame(m_codecCtx, m_frame) == 0)
+        {
+            ++received;
+            qint64 pts = m_frame->best_effort_timestamp;
+            if (pts != (qint64)AV_NOPTS_VALUE)
+            {
+                pts = av_rescale_q(pts, timeBase, AV_TIME_BASE_Q);
+
+                /* Keep the pace the frames were received at */
+                if (startPts == (qint64)AV_NOPTS_VALUE)
+                {
+                    startPts = pts;
+                    clock.start();
+                }
+                else if (!waitUntil((pts - startPts) / 1000, clock))
+                    break;
+            }
+
+            {
+                QMutexLocker locker(&m_viewLock);
+                formatter.setFisheyeView(m_fisheyeView);
+            }
+            RtspStreamFrame *frame = formatter.formatFrame(m_frame, m_frameWidthHint, m_frameHeightHint, cropRect());
+            if (frame)
+            {
+                frame->setPts(pts);
+                m_frameQueue->enqueue(frame);
+            }
+        }
+
+        /* Nothing was drained, so sending again would be refused forever */
+        if (resend && received == 0 && !m_cancelFlag)
+            av_packet_free(&packet);
+    }
+
+    av_packet_free(&packet);
+    foreach (AVPacket *remaining, packets)
+        av_packet_free(&remaining);
+}
+
+bool RtspRewindWorker::waitUntil(qint64 msecs, const QElapsedTimer &clock)
+{
+    /* Sleep in short steps so that stop() takes effect quickly */
+    while (!m_cancelFlag)
+    {
+        qint64 remaining = msecs - clock.elapsed();
+        if (remaining <= 0)
+            return true;
+
+        QThread::msleep(ulong(qMin<qint64>(remaining, 50)));
+    }
+
+    return false;
+}
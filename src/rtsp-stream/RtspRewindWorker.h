@@ -0,0 +1,83 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RTSP_REWIND_WORKER_H
+#define RTSP_REWIND_WORKER_H
+
+#include "core/FisheyeView.h"
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QObject>
+#include <QRectF>
+#include <QSharedPointer>
+
+struct AVCodecContext;
+struct AVCodecParameters;
+struct AVFrame;
+struct AVPacket;
+
+class RtspPacketRing;
+class RtspStreamFrameQueue;
+
+/* Replays the packets buffered in a RtspPacketRing, from some seconds behind live up to
+ * the moment the replay was asked for, at normal speed. Runs on its own thread next to
+ * the live worker, which keeps filling the ring. When done it emits finished() and,
+ * like RtspStreamWorker, deletes itself. */
+
+class RtspRewindWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    RtspRewindWorker(const QSharedPointer<RtspPacketRing> &ring, QSharedPointer<RtspStreamFrameQueue> &shared_queue,
+                     qint64 offset, QObject *parent = 0);
+    virtual ~RtspRewindWorker();
+
+    void stop();
+    void setFrameSizeHint(int width, int height);
+    void setCropRect(const QRectF &rect);
+    void setFisheyeView(const FisheyeView &view);
+
+public slots:
+    void run();
+
+signals:
+    void finished();
+
+private:
+    QSharedPointer<RtspPacketRing> m_ring;
+    QSharedPointer<RtspStreamFrameQueue> m_frameQueue;
+    qint64 m_offset;
+    volatile bool m_cancelFlag;
+    volatile int m_frameWidthHint;
+    volatile int m_frameHeightHint;
+    QRectF m_cropRect;
+    FisheyeView m_fisheyeView;
+    /* Protects m_cropRect and m_fisheyeView */
+    QMutex m_viewLock;
+
+    AVCodecParameters *m_codecpar;
+    AVCodecContext *m_codecCtx;
+    AVFrame *m_frame;
+
+    QRectF cropRect();
+    bool openDecoder();
+    void play();
+    bool waitUntil(qint64 msecs, const QElapsedTimer &clock);
+};
+
+#endif // RTSP_REWIND_WORKER_H
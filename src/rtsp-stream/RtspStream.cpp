@@ -16,20 +16,32 @@
  */
 
 #include "RtspStream.h"
+#include "RtspPacketRing.h"
+#include "RtspRecordingWriter.h"
+#include "RtspRewindWorker.h"
 #include "RtspStreamFrame.h"
+#include "RtspStreamFrameQueue.h"
+#include "RtspStreamPublisher.h"
+#include "RtspStreamRecorder.h"
 #include "RtspStreamThread.h"
 #include "RtspStreamWorker.h"
 #include "core/BluecherryApp.h"
 #include "core/LiveViewManager.h"
 #include "core/LoggableUrl.h"
 #include "audio/AudioPlayer.h"
+#include "network/LiveStreamGateway.h"
+#include "server/DVRServer.h"
+#include "server/DVRServerConfiguration.h"
 #include <QMutex>
 #include <QMetaObject>
 #include <QTimer>
 #include <QDebug>
 #include <QSettings>
 #include <QDateTime>
+#include <QDesktopServices>
+#include <QDir>
 #include <QMetaMethod>
+#include <QRegExp>
 
 extern "C" {
 #   include "libavcodec/avcodec.h"
@@ -76,7 +88,6 @@ protected:
 
 QTimer *RtspStream::m_renderTimer = 0;
 static const int renderTimerFps = 60;
-QTimer *RtspStream::m_stateTimer = 0;
 
 void RtspStream::init()
 {
@@ -88,17 +99,18 @@ void RtspStream::init()
     m_renderTimer = new AutoTimer;
     m_renderTimer->setInterval(1000 / renderTimerFps);
     m_renderTimer->setSingleShot(false);
-
-    m_stateTimer = new AutoTimer;
-    m_stateTimer->setInterval(5000);
-    m_stateTimer->setSingleShot(false);
 }
 
 RtspStream::RtspStream(DVRCamera *camera, QObject *parent)
-    : LiveStream(parent), m_camera(camera), m_thread(0), m_currentFrameMutex(QMutex::Recursive),
+    : LiveStream(parent), m_camera(camera), m_thread(0), m_packetRing(new RtspPacketRing),
+      m_currentFrameMutex(QMutex::Recursive),
       m_frame(0), m_state(NotConnected),
-      m_autoStart(false), m_bandwidthMode(LiveViewManager::FullBandwidth), m_fpsUpdateCnt(0), m_fpsUpdateHits(0),
-      m_fps(0), m_hasAudio(false), m_isAudioEnabled(false), m_isHWAccelEnabled(false),
+      m_autoStart(false), m_bandwidthMode(LiveViewManager::FullBandwidth),
+      m_adaptiveLevel(LiveViewManager::MainStreamLevel), m_substreamRequested(false), m_deviceSubstreamMode(-1),
+      m_reconnectOnResume(false),
+      m_currentFrameCrop(0, 0, 1, 1),
+      m_fpsUpdateCnt(0), m_fpsUpdateHits(0),
+      m_fps(0), m_latency(-1), m_hasAudio(false), m_isAudioEnabled(false), m_isHWAccelEnabled(false),
       m_refcount(0)
 {
     Q_ASSERT(m_camera);
@@ -106,12 +118,30 @@ RtspStream::RtspStream(DVRCamera *camera, QObject *parent)
 
     bcApp->liveView->addStream(this);
     connect(bcApp, SIGNAL(settingsChanged()), SLOT(updateSettings()));
-    connect(m_stateTimer, SIGNAL(timeout()), SLOT(checkState()));
+    m_reconnectTimer.setSingleShot(true);
+    connect(&m_reconnectTimer, SIGNAL(timeout()), SLOT(checkState()));
+    connect(camera->data().server(), SIGNAL(substreamSwitched(int,bool)), SLOT(substreamSwitched(int,bool)));
+
+    /* A previous session switched the device and never got to put its setting back */
+    QSettings settings;
+    QVariant restore = settings.value(substreamRestoreKey());
+    if (restore.isValid() && camera->data().server()->isOnline())
+    {
+        camera->data().server()->switchSubstream(camera->data().id(), restore.toBool());
+        settings.remove(substreamRestoreKey());
+    }
 }
 
 RtspStream::~RtspStream()
 {
+    stopRecording();
+    updatePublishing(false);
     stop();
+
+    /* Put the device's own setting back for other viewers */
+    if (m_substreamRequested)
+        requestSubstream(false);
+
     bcApp->liveView->removeStream(this);
 }
 
@@ -151,12 +181,14 @@ void RtspStream::enableAudio(bool enable)
     if (enable)
     {
         bcApp->audioPlayer->setAudioFormat(m_audioSampleFmt, m_audioChannels, m_audioSampleRate);
-        connect(m_thread.data(), SIGNAL(audioSamplesAvailable(void *, int, int)), bcApp->audioPlayer, SLOT(feedSamples(void *, int, int)), Qt::DirectConnection);
+        /* Direct, so the player converts the samples on the worker thread before the
+         * frame is reused; only the converted samples cross to the audio thread */
+        connect(m_thread.data(), SIGNAL(audioFrameAvailable(AVFrame*,qint64)), bcApp->audioPlayer, SLOT(feedFrame(AVFrame*,qint64)), Qt::DirectConnection);
         bcApp->audioPlayer->play();
     }
     else
     {
-        disconnect(m_thread.data(), SIGNAL(audioSamplesAvailable(void *, int, int)), 0, 0);
+        disconnect(m_thread.data(), SIGNAL(audioFrameAvailable(AVFrame*,qint64)), 0, 0);
     }
 
     m_thread->enableAudio(enable);
@@ -190,7 +222,9 @@ QUrl RtspStream::url() const
         return QUrl();
 
     QUrl streamUrl = m_camera.data()->rtspStreamUrl();
-    if (m_bandwidthMode == LiveViewManager::LowBandwidth)
+    bool keyframesOnly = m_bandwidthMode == LiveViewManager::LowBandwidth
+            || (m_bandwidthMode == LiveViewManager::AdaptiveBandwidth && m_adaptiveLevel == LiveViewManager::KeyframeLevel);
+    if (keyframesOnly)
         streamUrl.setPath(streamUrl.path() + QLatin1String("/mode=keyframe"));
     return streamUrl;
 }
@@ -203,11 +237,147 @@ void RtspStream::setBandwidthMode(int value)
     m_bandwidthMode = (LiveViewManager::BandwidthMode)value;
     emit bandwidthModeChanged(value);
 
-    if (state() >= Connecting)
+    /* The stream is reconnected once the server confirms a switch */
+    if (!updateSubstream())
+        reconnect();
+}
+
+void RtspStream::setAdaptiveLevel(int level)
+{
+    if (level == m_adaptiveLevel)
+        return;
+
+    LiveViewManager::StreamLevel oldLevel = m_adaptiveLevel;
+    m_adaptiveLevel = (LiveViewManager::StreamLevel)level;
+
+    if (m_bandwidthMode != LiveViewManager::AdaptiveBandwidth)
+        return;
+
+    if (updateSubstream())
+        return;
+
+    if ((oldLevel == LiveViewManager::KeyframeLevel) != (m_adaptiveLevel == LiveViewManager::KeyframeLevel))
+        reconnect();
+}
+
+/* The substream is a setting of the device on the server, so switching it changes the
+ * stream for every viewer of the camera. Adaptive mode only does that when the user
+ * opted in; otherwise its substream level keeps the main stream. Returns true if a
+ * switch was requested. */
+bool RtspStream::updateSubstream()
+{
+    QSettings settings;
+    bool substream = settings.value(QLatin1String("ui/liveview/adaptiveSubstream"), false).toBool()
+            && m_bandwidthMode == LiveViewManager::AdaptiveBandwidth
+            && m_adaptiveLevel != LiveViewManager::MainStreamLevel;
+    if (substream == m_substreamRequested)
+        return false;
+
+    requestSubstream(substream);
+    return true;
+}
+
+void RtspStream::requestSubstream(bool enabled)
+{
+    if (!m_camera)
+        return;
+
+    const DVRCameraData &data = m_camera.data()->data();
+    QSettings settings;
+
+    /* Remember what the administrator had set, to put it back later, also across a crash */
+    if (enabled && m_deviceSubstreamMode < 0)
+        m_deviceSubstreamMode = data.substreamMode() ? 1 : 0;
+    if (enabled)
+        settings.setValue(substreamRestoreKey(), m_deviceSubstreamMode != 0);
+    else
+        settings.remove(substreamRestoreKey());
+
+    m_substreamRequested = enabled;
+    data.server()->switchSubstream(data.id(), enabled || m_deviceSubstreamMode > 0);
+}
+
+QString RtspStream::substreamRestoreKey() const
+{
+    const DVRCameraData &data = m_camera.data()->data();
+    return QString::fromLatin1("ui/liveview/substreamRestore/%1/%2")
+            .arg(data.server()->configuration().id()).arg(data.id());
+}
+
+void RtspStream::substreamSwitched(int deviceId, bool substreamEnabled)
+{
+    Q_UNUSED(substreamEnabled);
+
+    if (!m_camera || deviceId != m_camera.data()->data().id())
+        return;
+
+    reconnect();
+}
+
+void RtspStream::connectThread(RtspStreamThread *thread)
+{
+    connect(thread, SIGNAL(fatalError(QString)), this, SLOT(fatalError(QString)));
+    connect(thread, SIGNAL(hwAccelDisabled()), this, SLOT(hwAccelDisabled()));
+    connect(thread, SIGNAL(audioFormat(enum AVSampleFormat, int, int)), this, SLOT(setAudioFormat(AVSampleFormat,int,int)), Qt::DirectConnection);
+}
+
+/* Restart the connection with the current url(). While a picture is on screen, the current
+ * connection keeps delivering frames until the new one has decoded its first frame, so
+ * switching levels doesn't leave a gap or flash the status overlay. */
+void RtspStream::reconnect()
+{
+    if (state() < Connecting)
+        return;
+
+    if (state() == Paused)
+    {
+        m_reconnectOnResume = true;
+        return;
+    }
+
+    if (state() != Streaming || !m_thread || !m_thread->hasWorker())
     {
         stop();
         start();
+        return;
     }
+
+    m_pendingThread.reset(new RtspStreamThread());
+    connect(m_pendingThread.data(), SIGNAL(fatalError(QString)), this, SLOT(pendingFatalError(QString)));
+    m_pendingThread->start(url(), m_isHWAccelEnabled, m_packetRing);
+    m_pendingThread->setSinks(packetSinks());
+    if (m_frameSizeHint.isValid())
+        m_pendingThread->setFrameSizeHint(m_frameSizeHint.width(), m_frameSizeHint.height());
+    m_pendingThread->setCropRect(m_cropRect);
+    m_pendingThread->setFisheyeView(m_fisheyeView);
+}
+
+RtspStreamFrame *RtspStream::takePendingFrame()
+{
+    if (!m_pendingThread || !m_pendingThread->hasWorker())
+        return 0;
+
+    RtspStreamFrame *frame = m_pendingThread->frameToDisplay();
+    if (!frame)
+        return 0;
+
+    /* The new connection is producing; retire the old one */
+    m_pendingThread->disconnect(this);
+    m_thread.swap(m_pendingThread);
+    m_pendingThread.reset();
+    connectThread(m_thread.data());
+
+    updateSettings();
+    if (m_isAudioEnabled)
+        enableAudio(true);
+
+    return frame;
+}
+
+void RtspStream::pendingFatalError(const QString &message)
+{
+    qDebug() << "RtspStream: reconnection failed, keeping the current connection:" << LoggableUrl(url()) << message;
+    m_pendingThread.reset();
 }
 
 void RtspStream::enableHWAccel(bool hwAccel)
@@ -252,6 +422,7 @@ void RtspStream::start()
     }
 
     connect(m_renderTimer, SIGNAL(timeout()), SLOT(updateFrame()), Qt::UniqueConnection);
+    m_reconnectTimer.stop();
 
     m_frameInterval.start();
 
@@ -260,11 +431,14 @@ void RtspStream::start()
 
     updateHwAccelSettings();
 
+    m_pendingThread.reset();
+    m_reconnectOnResume = false;
     m_thread.reset(new RtspStreamThread());
-    connect(m_thread.data(), SIGNAL(fatalError(QString)), this, SLOT(fatalError(QString)));
-    connect(m_thread.data(), SIGNAL(hwAccelDisabled()), this, SLOT(hwAccelDisabled()));
-    connect(m_thread.data(), SIGNAL(audioFormat(enum AVSampleFormat, int, int)), this, SLOT(setAudioFormat(AVSampleFormat,int,int)), Qt::DirectConnection);
-    m_thread->start(url(), m_isHWAccelEnabled);
+    connectThread(m_thread.data());
+    m_thread->start(url(), m_isHWAccelEnabled, m_packetRing);
+    m_thread->setSinks(packetSinks());
+    m_thread->setCropRect(m_cropRect);
+    m_thread->setFisheyeView(m_fisheyeView);
 
     updateSettings();
     setState(Connecting);
@@ -273,10 +447,16 @@ void RtspStream::start()
 void RtspStream::stop()
 {
     disconnect(m_renderTimer, SIGNAL(timeout()), this, SLOT(updateFrame()));
+    m_reconnectTimer.stop();
 
     if (m_isAudioEnabled)
         bcApp->audioPlayer->stop();
 
+    logLatency();
+    m_latency = -1;
+
+    stopRewind();
+    m_pendingThread.reset();
     m_thread.reset();
 
     delete m_frame;
@@ -317,6 +497,12 @@ void RtspStream::setPaused(bool pause)
     else
         setState(Streaming);
     m_frameInterval.restart();
+
+    if (!pause && m_reconnectOnResume)
+    {
+        m_reconnectOnResume = false;
+        reconnect();
+    }
 }
 
 void RtspStream::updateFrame()
@@ -330,10 +516,17 @@ void RtspStream::updateFrame()
         m_fpsUpdateCnt = m_fpsUpdateHits = 0;
     }
 
-    if (!m_thread || !m_thread->hasWorker())
-        return;
+    RtspStreamFrame *sf = takePendingFrame();
+    if (!sf && m_thread)
+        sf = m_thread->frameToDisplay();
+
+    if (m_rewindQueue)
+    {
+        /* Live frames keep arriving, and filling the packet ring, but aren't shown */
+        delete sf;
+        sf = m_rewindQueue->dequeue();
+    }
 
-    RtspStreamFrame *sf = m_thread->frameToDisplay();
     if (!sf) // no new frame
         return;
 
@@ -342,9 +535,19 @@ void RtspStream::updateFrame()
     m_fpsUpdateHits++;
 
     if (state() == Connecting)
+    {
         setState(Streaming);
+        m_backoff.connected();
+    }
     m_frameInterval.restart();
 
+    if (!m_rewindQueue)
+    {
+        recordLatency(sf);
+        if (m_isAudioEnabled && sf->pts() != (qint64)AV_NOPTS_VALUE)
+            bcApp->audioPlayer->setVideoClock(sf->pts());
+    }
+
     QMutexLocker locker(&m_currentFrameMutex);
     //bool sizeChanged = (m_currentFrame.width() != sf->avFrame()->width ||
     //                    m_currentFrame.height() != sf->avFrame()->height);
@@ -353,6 +556,9 @@ void RtspStream::updateFrame()
     m_currentFrame = QImage(sf->avFrame()->data[0], sf->avFrame()->width, sf->avFrame()->height,
                             sf->avFrame()->linesize[0], QImage::Format_RGB32).copy();
 
+    m_currentFrameCrop = sf->crop();
+    m_motionCells = sf->motion();
+
     delete m_frame;
     m_frame = sf;
 
@@ -361,6 +567,214 @@ void RtspStream::updateFrame()
     emit updated();
 }
 
+void RtspStream::startRecording()
+{
+    if (m_recorder || !m_camera)
+        return;
+
+    QSettings settings;
+    QString directory = settings.value(QLatin1String("ui/liveview/recordingDirectory"),
+                                       QDir(QDesktopServices::storageLocation(QDesktopServices::MoviesLocation))
+                                       .filePath(QLatin1String("Bluecherry"))).toString();
+    RtspStreamRecorder::Format format =
+            settings.value(QLatin1String("ui/liveview/recordingFormat")).toString() == QLatin1String("mp4")
+            ? RtspStreamRecorder::Mp4 : RtspStreamRecorder::Matroska;
+    qint64 maxSize = settings.value(QLatin1String("ui/liveview/recordingMaxSize"), 1024).toLongLong() * 1024 * 1024;
+    int maxDuration = settings.value(QLatin1String("ui/liveview/recordingMaxDuration"), 30).toInt() * 60;
+
+    /* Keep the name usable as a file name on every platform */
+    QString name = m_camera.data()->data().displayName();
+    name.replace(QRegExp(QLatin1String("[\\\\/:*?\"<>|]")), QLatin1String("_"));
+
+    m_recorder = QSharedPointer<RtspStreamRecorder>(new RtspStreamRecorder(directory, name, format, maxSize, maxDuration));
+    bcApp->liveView->recordingWriter()->addRecorder(m_recorder);
+    updatePacketSinks();
+
+    emit recordingChanged(true);
+}
+
+void RtspStream::stopRecording()
+{
+    if (!m_recorder)
+        return;
+
+    QSharedPointer<RtspStreamRecorder> recorder = m_recorder;
+    m_recorder.clear();
+    updatePacketSinks();
+
+    if (recorder->droppedPackets())
+        qDebug() << "RtspStream: local recording dropped" << recorder->droppedPackets() << "packets";
+
+    /* The writer thread completes the file and releases the recorder */
+    recorder->stop();
+
+    emit recordingChanged(false);
+}
+
+QList<QSharedPointer<RtspPacketSink> > RtspStream::packetSinks() const
+{
+    QList<QSharedPointer<RtspPacketSink> > sinks;
+    if (m_recorder)
+        sinks.append(m_recorder);
+    if (m_publisher)
+        sinks.append(m_publisher);
+    return sinks;
+}
+
+void RtspStream::updatePacketSinks()
+{
+    QList<QSharedPointer<RtspPacketSink> > sinks = packetSinks();
+
+    if (m_thread)
+        m_thread->setSinks(sinks);
+    if (m_pendingThread)
+        m_pendingThread->setSinks(sinks);
+}
+
+void RtspStream::updatePublishing(bool enabled)
+{
+    if (enabled == !m_publisher.isNull() || (enabled && !m_camera))
+        return;
+
+    if (enabled)
+    {
+        DVRCamera *camera = m_camera.data();
+        m_publishedPath = LiveStreamGateway::streamPath(camera->data().server()->configuration().id(),
+                                                        camera->data().id());
+        m_publisher = QSharedPointer<RtspStreamPublisher>(new RtspStreamPublisher);
+        bcApp->liveView->streamGateway()->addPublisher(m_publishedPath, m_publisher);
+    }
+    else
+    {
+        if (m_publisher->droppedPackets())
+            qDebug() << "RtspStream: re-streaming dropped" << m_publisher->droppedPackets() << "packets";
+
+        /* The gateway disconnects the clients of a stream it no longer knows */
+        bcApp->liveView->streamGateway()->removePublisher(m_publishedPath);
+        m_publisher.clear();
+    }
+
+    updatePacketSinks();
+}
+
+int RtspStream::rewindAvailable() const
+{
+    return int(m_packetRing->bufferedDuration() / AV_TIME_BASE);
+}
+
+void RtspStream::rewind(int seconds)
+{
+    if (state() != Streaming || seconds <= 0)
+        return;
+
+    stopRewind();
+
+    QThread *thread = new QThread();
+    RtspRewindWorker *worker = new RtspRewindWorker(m_packetRing, m_rewindQueue, qint64(seconds) * AV_TIME_BASE);
+    worker->moveToThread(thread);
+    if (m_frameSizeHint.isValid())
+        worker->setFrameSizeHint(m_frameSizeHint.width(), m_frameSizeHint.height());
+    worker->setCropRect(m_cropRect);
+    worker->setFisheyeView(m_fisheyeView);
+
+    connect(thread, SIGNAL(started()), worker, SLOT(run()));
+    connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+    connect(worker, SIGNAL(destroyed()), thread, SLOT(quit()));
+    connect(worker, SIGNAL(finished()), this, SLOT(rewindFinished()));
+
+    m_rewindWorker = worker;
+    thread->start();
+
+    emit rewindingChanged(true);
+}
+
+void RtspStream::resumeLive()
+{
+    stopRewind();
+}
+
+void RtspStream::stopRewind()
+{
+    if (m_rewindWorker)
+    {
+        /* The worker deletes itself once it notices */
+        disconnect(m_rewindWorker.data(), 0, this, 0);
+        m_rewindWorker.data()->stop();
+        m_rewindWorker.clear();
+    }
+
+    if (m_rewindQueue)
+    {
+        m_rewindQueue.clear();
+        emit rewindingChanged(false);
+    }
+}
+
+void RtspStream::rewindFinished()
+{
+    /* Ignore a worker that was already replaced or stopped */
+    if (sender() != m_rewindWorker.data())
+        return;
+
+    stopRewind();
+}
+
+void RtspStream::recordLatency(RtspStreamFrame *frame)
+{
+    /* The frame is painted on the next pass of the event loop, a negligible time next
+     * to the rest of the pipeline, so display time is taken as now */
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    if (frame->receiveTime() >= 0)
+    {
+        m_latencyHistograms[DecodeLatency].record(frame->decodeTime() - frame->receiveTime());
+        m_latencyHistograms[ConvertLatency].record(frame->queueTime() - frame->decodeTime());
+    }
+    m_latencyHistograms[QueueLatency].record(now - frame->queueTime());
+
+    if (frame->captureTime() < 0)
+        return;
+
+    /* A capture time in the future means the clocks are not synchronized; such a latency
+     * would be meaningless, so none is shown */
+    qint64 latency = now - frame->captureTime();
+    if (latency < 0)
+    {
+        m_latency = -1;
+        return;
+    }
+
+    m_latencyHistograms[TotalLatency].record(latency);
+    if (frame->receiveTime() >= frame->captureTime())
+        m_latencyHistograms[NetworkLatency].record(frame->receiveTime() - frame->captureTime());
+
+    /* Smooth over about 16 frames so the figure in the header is readable */
+    m_latency = m_latency >= 0 ? m_latency + int(latency - m_latency) / 16 : int(latency);
+}
+
+void RtspStream::logLatency()
+{
+    if (!m_latencyHistograms[QueueLatency].count())
+        return;
+
+    static const char * const stageNames[LatencyStageCount] =
+    {
+        "total", "network", "decode", "convert", "queue"
+    };
+
+    qDebug() << "RtspStream: latency for" << LoggableUrl(url());
+    for (int i = 0; i < LatencyStageCount; ++i)
+    {
+        if (m_latencyHistograms[i].count())
+            qDebug() << "    " << stageNames[i] << m_latencyHistograms[i].summary();
+        m_latencyHistograms[i].clear();
+    }
+
+    /* Frames replaced in the mailbox before the render timer picked them up */
+    if (m_thread)
+        qDebug() << "     superseded frames" << m_thread->droppedFrames();
+}
+
 void RtspStream::setFrameSizeHint(int width, int height)
 {
     if (m_refcount > 1)
@@ -371,13 +785,51 @@ void RtspStream::setFrameSizeHint(int width, int height)
 
     QMutexLocker locker(&m_currentFrameMutex);
 
+    m_frameSizeHint = QSize(width, height);
     m_thread->setFrameSizeHint(width, height);
+    if (m_rewindWorker)
+        m_rewindWorker.data()->setFrameSizeHint(width, height);
+}
+
+void RtspStream::setCropRect(const QRectF &rect)
+{
+    /* Tiles sharing the stream may be zoomed differently; they crop when painting */
+    if (m_refcount > 1 || rect == m_cropRect)
+        return;
+
+    m_cropRect = rect;
+    if (m_thread)
+        m_thread->setCropRect(rect);
+    if (m_pendingThread)
+        m_pendingThread->setCropRect(rect);
+    if (m_rewindWorker)
+        m_rewindWorker.data()->setCropRect(rect);
+}
+
+void RtspStream::setFisheyeView(const FisheyeView &view)
+{
+    /* Dewarping changes the frames every tile sharing the stream gets, and unlike a crop
+     * it can't be undone when painting; shared streams stay as the camera sends them */
+    if (m_refcount > 1 || view == m_fisheyeView)
+        return;
+
+    m_fisheyeView = view;
+    if (m_thread)
+        m_thread->setFisheyeView(view);
+    if (m_pendingThread)
+        m_pendingThread->setFisheyeView(view);
+    if (m_rewindWorker)
+        m_rewindWorker.data()->setFisheyeView(view);
 }
 
 void RtspStream::ref()
 {
     if (m_refcount)
+    {
         setFrameSizeHint(-1, -1);
+        setCropRect(QRectF());
+        setFisheyeView(FisheyeView());
+    }
 
     m_refcount++;
 }
@@ -387,10 +839,25 @@ void RtspStream::unref()
     m_refcount--;
 }
 
+/* m_currentFrame is replaced for every frame and never modified in place, so callers can
+ * share it instead of copying a whole frame on each paint or snapshot */
 QImage RtspStream::currentFrame() const
 {
     QMutexLocker locker(&m_currentFrameMutex);
-    return m_currentFrame.copy();
+    return m_currentFrame;
+}
+
+QImage RtspStream::currentFrame(QRectF *crop) const
+{
+    QMutexLocker locker(&m_currentFrameMutex);
+    *crop = m_currentFrameCrop;
+    return m_currentFrame;
+}
+
+QBitArray RtspStream::motionCells() const
+{
+    QMutexLocker locker(&m_currentFrameMutex);
+    return m_motionCells;
 }
 
 QSize RtspStream::streamSize() const
@@ -409,7 +876,10 @@ void RtspStream::fatalError(const QString &message)
 
     m_errorMessage = message;
     setState(Error);
-    /* stateTimer will handle reconnection */
+
+    int delay = m_backoff.nextDelay();
+    qDebug() << "RtspStream: reconnecting in" << delay << "ms, attempt" << m_backoff.attempts();
+    m_reconnectTimer.start(delay);
 }
 
 void RtspStream::checkState()
@@ -420,11 +890,18 @@ void RtspStream::checkState()
 
 void RtspStream::updateSettings()
 {
+    updateSubstream();
+
+    QSettings settings;
+    m_packetRing->setDuration(settings.value(QLatin1String("ui/liveview/rewindDuration"), 30).toInt());
+    RtspPacketRing::setMemoryLimit(settings.value(QLatin1String("ui/liveview/rewindMemoryLimit"), 256).toInt() * 1024 * 1024);
+    updatePublishing(settings.value(QLatin1String("ui/liveview/gatewayPort"), 0).toInt() > 0);
+
     if (!m_thread || !m_thread->hasWorker())
         return;
 
-    QSettings settings;
     m_thread->setAutoDeinterlacing(settings.value(QLatin1String("ui/liveview/autoDeinterlace"), false).toBool());
+    m_thread->setMotionDetection(settings.value(QLatin1String("ui/liveview/motionDetection"), false).toBool());
 
     updateHwAccelSettings();
 }
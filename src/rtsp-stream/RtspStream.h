@@ -21,13 +21,22 @@
 #include <QMutex>
 #include <QObject>
 #include <QThread>
+#include <QTimer>
 #include <QImage>
 #include <QElapsedTimer>
 #include "camera/DVRCamera.h"
 #include "core/LiveStream.h"
 #include "core/LiveViewManager.h"
 #include "audio/AudioPlayer.h"
-
+#include "utils/LatencyHistogram.h"
+#include "utils/ReconnectBackoff.h"
+
+class RtspPacketRing;
+class RtspPacketSink;
+class RtspRewindWorker;
+class RtspStreamPublisher;
+class RtspStreamRecorder;
+class RtspStreamFrameQueue;
 class RtspStreamThread;
 
 class RtspStream : public LiveStream
@@ -35,6 +44,15 @@ class RtspStream : public LiveStream
     Q_OBJECT
 
 public:
+    enum LatencyStage
+    {
+        TotalLatency,       /* capture to display */
+        NetworkLatency,     /* capture to packet received, includes encoding and the server */
+        DecodeLatency,      /* packet received to decoded */
+        ConvertLatency,     /* decoded to scaled and queued */
+        QueueLatency,       /* queued to display */
+        LatencyStageCount
+    };
 
     static void init();
     explicit RtspStream(DVRCamera *camera, QObject *parent = 0);
@@ -43,23 +61,35 @@ public:
     QUrl url() const;
 
     int bandwidthMode() const { return m_bandwidthMode; }
+    int adaptiveLevel() const { return m_adaptiveLevel; }
     bool hwAccelStatus() const { return m_isHWAccelEnabled; };
 
     State state() const { return m_state; }
     QString errorMessage() const { return m_errorMessage; }
 
     QImage currentFrame() const;
+    QImage currentFrame(QRectF *crop) const;
+    QBitArray motionCells() const;
     QSize streamSize() const;
 
     float receivedFps() const { return m_fps; }
+    int latency() const { return m_latency; }
+    const LatencyHistogram &latencyHistogram(LatencyStage stage) const { return m_latencyHistograms[stage]; }
 
     bool isPaused() const { return state() == Paused; }
     bool isConnected() const { return state() > Connecting; }
     bool hasAudio() const { return m_hasAudio; }
     bool isAudioEnabled() const { return m_isAudioEnabled; }
+    int rewindAvailable() const;
+    bool isRewinding() const { return !m_rewindQueue.isNull(); }
+    bool isRecording() const { return !m_recorder.isNull(); }
     void setFrameSizeHint(int width, int height);
+    void setCropRect(const QRectF &rect);
+    void setFisheyeView(const FisheyeView &view);
+    void setFocused(bool focused) { Q_UNUSED(focused); }
     void ref();
     void unref();
+    bool isShared() const { return m_refcount > 1; }
 
 public slots:
     void start();
@@ -69,9 +99,14 @@ public slots:
     void togglePaused() { setPaused(!isPaused()); }
     void setOnline(bool online);
     void setBandwidthMode(int bandwidthMode);
+    void setAdaptiveLevel(int level);
     void enableAudio(bool);
     void enableHWAccel(bool hwAccel);
     void setAudioFormat(enum AVSampleFormat, int, int);
+    void rewind(int seconds);
+    void resumeLive();
+    void startRecording();
+    void stopRecording();
 
 private slots:
     void updateFrame();
@@ -80,12 +115,25 @@ private slots:
     void checkState();
     void hwAccelDisabled();
     void updateHwAccelSettings();
+    void substreamSwitched(int deviceId, bool substreamEnabled);
+    void pendingFatalError(const QString &message);
+    void rewindFinished();
 
 private:
-    static QTimer *m_renderTimer, *m_stateTimer;
+    static QTimer *m_renderTimer;
 
     QWeakPointer<DVRCamera> m_camera;
     QScopedPointer<RtspStreamThread> m_thread;
+    /* Replacement connection opened by reconnect(); takes over on its first frame */
+    QScopedPointer<RtspStreamThread> m_pendingThread;
+    /* Recent compressed video, kept across reconnections */
+    QSharedPointer<RtspPacketRing> m_packetRing;
+    QWeakPointer<RtspRewindWorker> m_rewindWorker;
+    QSharedPointer<RtspStreamFrameQueue> m_rewindQueue;
+    QSharedPointer<RtspStreamRecorder> m_recorder;
+    /* Set while re-served by LiveStreamGateway */
+    QSharedPointer<RtspStreamPublisher> m_publisher;
+    QString m_publishedPath;
     QImage m_currentFrame;
     mutable QMutex m_currentFrameMutex;
     class RtspStreamFrame *m_frame;
@@ -93,15 +141,31 @@ private:
     State m_state;
     bool m_autoStart;
     LiveViewManager::BandwidthMode m_bandwidthMode;
+    LiveViewManager::StreamLevel m_adaptiveLevel;
+    bool m_substreamRequested;
+    /* The device's substream setting before adaptive mode first switched it, or -1 */
+    int m_deviceSubstreamMode;
+    bool m_reconnectOnResume;
+    QSize m_frameSizeHint;
+    QRectF m_cropRect;
+    FisheyeView m_fisheyeView;
+    /* Part of the stream in m_currentFrame */
+    QRectF m_currentFrameCrop;
+    /* Motion in m_currentFrame, from the live stream only */
+    QBitArray m_motionCells;
 
     int m_fpsUpdateCnt;
     int m_fpsUpdateHits;
     float m_fps;
+    int m_latency;
+    LatencyHistogram m_latencyHistograms[LatencyStageCount];
     bool m_hasAudio;
     bool m_isAudioEnabled;
     bool m_isHWAccelEnabled;
 
     QElapsedTimer m_frameInterval;
+    QTimer m_reconnectTimer;
+    ReconnectBackoff m_backoff;
 
     enum AVSampleFormat m_audioSampleFmt;
     int m_audioChannels;
@@ -109,6 +173,18 @@ private:
     int m_refcount;
 
     void setState(State newState);
+    void connectThread(RtspStreamThread *thread);
+    void reconnect();
+    RtspStreamFrame *takePendingFrame();
+    bool updateSubstream();
+    void requestSubstream(bool enabled);
+    QString substreamRestoreKey() const;
+    void stopRewind();
+    QList<QSharedPointer<RtspPacketSink> > packetSinks() const;
+    void updatePacketSinks();
+    void updatePublishing(bool enabled);
+    void recordLatency(RtspStreamFrame *frame);
+    void logLatency();
 
 };
 
@@ -22,7 +22,9 @@ extern "C" {
 }
 
 RtspStreamFrame::RtspStreamFrame(AVFrame *avFrame, int width, int height)
-    : m_avFrame(avFrame), m_streamWidth(width), m_streamHeight(height)
+    : m_avFrame(avFrame), m_streamWidth(width), m_streamHeight(height),
+      m_captureTime(-1), m_receiveTime(-1), m_decodeTime(-1), m_queueTime(-1),
+      m_pts(AV_NOPTS_VALUE), m_crop(0, 0, 1, 1)
 {
     Q_ASSERT(m_avFrame);
 }
@@ -37,3 +39,11 @@ AVFrame * RtspStreamFrame::avFrame() const
 {
     return m_avFrame;
 }
+
+void RtspStreamFrame::setTimes(qint64 captureTime, qint64 receiveTime, qint64 decodeTime, qint64 queueTime)
+{
+    m_captureTime = captureTime;
+    m_receiveTime = receiveTime;
+    m_decodeTime = decodeTime;
+    m_queueTime = queueTime;
+}
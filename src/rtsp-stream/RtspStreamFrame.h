@@ -18,6 +18,8 @@
 #ifndef RTSP_STREAM_FRAME_H
 #define RTSP_STREAM_FRAME_H
 
+#include <QBitArray>
+#include <QRectF>
 #include <QtGlobal>
 
 struct AVFrame;
@@ -34,10 +36,38 @@ public:
     int width() { return m_streamWidth; }
     int height() { return m_streamHeight; }
 
+    /* Wall-clock times in msecs since the epoch, -1 where unknown. The capture time comes
+     * from the RTCP sender report mapping, so it is only meaningful when the camera (or the
+     * server relaying it) and this machine have synchronized clocks. */
+    qint64 captureTime() const { return m_captureTime; }
+    qint64 receiveTime() const { return m_receiveTime; }
+    qint64 decodeTime() const { return m_decodeTime; }
+    qint64 queueTime() const { return m_queueTime; }
+    void setTimes(qint64 captureTime, qint64 receiveTime, qint64 decodeTime, qint64 queueTime);
+
+    /* Presentation time in microseconds, or AV_NOPTS_VALUE */
+    qint64 pts() const { return m_pts; }
+    void setPts(qint64 pts) { m_pts = pts; }
+
+    /* Part of the stream this frame shows, relative to the stream size */
+    QRectF crop() const { return m_crop; }
+    void setCrop(const QRectF &crop) { m_crop = crop; }
+
+    /* Cells of the RtspMotionDetector grid with motion; empty when not detected */
+    QBitArray motion() const { return m_motion; }
+    void setMotion(const QBitArray &motion) { m_motion = motion; }
+
 private:
     AVFrame *m_avFrame;
     int m_streamWidth;
     int m_streamHeight;
+    qint64 m_captureTime;
+    qint64 m_receiveTime;
+    qint64 m_decodeTime;
+    qint64 m_queueTime;
+    qint64 m_pts;
+    QRectF m_crop;
+    QBitArray m_motion;
 };
 
 #endif // RTSP_STREAM_FRAME_H
@@ -18,6 +18,12 @@
 #include "RtspStreamFrameFormatter.h"
 #include "RtspStreamFrame.h"
 #include <QDebug>
+#include <QRectF>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+#include <math.h>
 
 extern "C"
 {
@@ -25,18 +31,107 @@ extern "C"
 #include "libavformat/avformat.h"
 #include "libswscale/swscale.h"
 #include "libavutil/imgutils.h"
+#include "libavutil/pixdesc.h"
 }
 
-RtspStreamFrameFormatter::RtspStreamFrameFormatter(AVStream *stream) :
-        m_stream(stream), m_sws_context(0), m_pixelFormat(AV_PIX_FMT_BGRA),
+/* Shared by the formatters of all streams; a single large stream gets every core, many
+ * streams compete for them the way their decoders already do */
+Q_GLOBAL_STATIC(QThreadPool, scalePool)
+
+class ScaleSliceTask : public QRunnable
+{
+public:
+    ScaleSliceTask(SwsContext *context, const uint8_t * const *src, const int *srcStride, int srcHeight,
+                   uint8_t * const *dst, const int *dstStride, QSemaphore *done)
+        : m_context(context), m_srcHeight(srcHeight), m_done(done)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            m_src[i] = src[i];
+            m_srcStride[i] = srcStride[i];
+            m_dst[i] = dst[i];
+            m_dstStride[i] = dstStride[i];
+        }
+    }
+
+    virtual void run()
+    {
+        sws_scale(m_context, m_src, m_srcStride, 0, m_srcHeight, m_dst, m_dstStride);
+        m_done->release();
+    }
+
+private:
+    SwsContext *m_context;
+    const uint8_t *m_src[4];
+    int m_srcStride[4];
+    int m_srcHeight;
+    uint8_t *m_dst[4];
+    int m_dstStride[4];
+    QSemaphore *m_done;
+};
+
+class DewarpSliceTask : public QRunnable
+{
+public:
+    DewarpSliceTask(const RtspFisheyeDewarp *dewarp, const AVFrame *src, AVFrame *dst, int firstRow, int lastRow,
+                    QSemaphore *done)
+        : m_dewarp(dewarp), m_src(src), m_dst(dst), m_firstRow(firstRow), m_lastRow(lastRow), m_done(done)
+    {
+    }
+
+    virtual void run()
+    {
+        m_dewarp->remapRows(m_src->data, m_src->linesize, m_dst->data, m_dst->linesize, m_firstRow, m_lastRow);
+        m_done->release();
+    }
+
+private:
+    const RtspFisheyeDewarp *m_dewarp;
+    const AVFrame *m_src;
+    AVFrame *m_dst;
+    int m_firstRow;
+    int m_lastRow;
+    QSemaphore *m_done;
+};
+
+/* Reuses frame when it already has this format and size */
+static bool prepareFrame(AVFrame **frame, AVPixelFormat format, int width, int height)
+{
+    if (*frame && (*frame)->format == format && (*frame)->width == width && (*frame)->height == height)
+        return true;
+
+    av_frame_free(frame);
+    *frame = av_frame_alloc();
+    if (!*frame)
+        return false;
+
+    (*frame)->format = format;
+    (*frame)->width = width;
+    (*frame)->height = height;
+    if (av_frame_get_buffer(*frame, 32) < 0)
+    {
+        av_frame_free(frame);
+        return false;
+    }
+
+    return true;
+}
+
+RtspStreamFrameFormatter::RtspStreamFrameFormatter(AVCodecParameters *codecpar) :
+        m_codecpar(codecpar), m_maxSlices(qBound(1, QThread::idealThreadCount(), int(maxSliceCount))),
+        m_pixelFormat(AV_PIX_FMT_BGRA),
         m_autoDeinterlacing(true), m_shouldTryDeinterlaceStream(shouldTryDeinterlaceStream()),
-        m_width(0), m_height(0)
+        m_width(0), m_height(0),
+        m_dewarpInputContext(0), m_dewarpInput(0), m_dewarpOutput(0)
 {
 }
 
 RtspStreamFrameFormatter::~RtspStreamFrameFormatter()
 {
-    sws_freeContext(m_sws_context);
+    clearSlices();
+    sws_freeContext(m_dewarpInputContext);
+    av_frame_free(&m_dewarpInput);
+    av_frame_free(&m_dewarpOutput);
 }
 
 void RtspStreamFrameFormatter::setAutoDeinterlacing(bool autoDeinterlacing)
@@ -44,29 +139,81 @@ void RtspStreamFrameFormatter::setAutoDeinterlacing(bool autoDeinterlacing)
     m_autoDeinterlacing = autoDeinterlacing;
 }
 
+void RtspStreamFrameFormatter::setMaxSlices(int maxSlices)
+{
+    m_maxSlices = qBound(1, maxSlices, int(maxSliceCount));
+}
+
 bool RtspStreamFrameFormatter::shouldTryDeinterlaceStream()
 {
     /* Assume that H.264 D1-resolution video is interlaced, to work around a solo(?) bug
      * that results in interlaced_frame not being set for videos from solo6110. */
 
-    if (m_stream->codecpar->codec_id != AV_CODEC_ID_H264)
+    if (m_codecpar->codec_id != AV_CODEC_ID_H264)
         return false;
 
-    if (m_stream->codecpar->width == 704 && m_stream->codecpar->height == 480)
+    if (m_codecpar->width == 704 && m_codecpar->height == 480)
         return true;
 
-    if (m_stream->codecpar->width == 720 && m_stream->codecpar->height == 576)
+    if (m_codecpar->width == 720 && m_codecpar->height == 576)
         return true;
 
     return false;
 }
 
-RtspStreamFrame * RtspStreamFrameFormatter::formatFrame(AVFrame* avFrame, int width, int height)
+RtspStreamFrame * RtspStreamFrameFormatter::formatFrame(AVFrame* avFrame, int width, int height, const QRectF &crop)
 {
     if (shouldTryDeinterlaceFrame(avFrame))
         deinterlaceFrame(avFrame);
 
-    return new RtspStreamFrame(scaleFrame(avFrame, width, height), avFrame->width, avFrame->height);
+    if (m_fisheyeView.isEnabled())
+    {
+        AVFrame *dewarped = dewarpFrame(avFrame, width, height);
+        if (dewarped)
+        {
+            QRect all(0, 0, dewarped->width, dewarped->height);
+            return new RtspStreamFrame(scaleFrame(dewarped, all, dewarped->width, dewarped->height),
+                                       avFrame->width, avFrame->height);
+        }
+    }
+
+    QRect region = cropRegion(avFrame, crop);
+
+    /* The region is aligned outwards, so it needs a little more than the requested size */
+    if (width != -1 && height != -1 && region.size() != QSize(avFrame->width, avFrame->height))
+    {
+        width = qMax(1, qRound(width * region.width() / (crop.width() * avFrame->width)));
+        height = qMax(1, qRound(height * region.height() / (crop.height() * avFrame->height)));
+    }
+
+    RtspStreamFrame *frame = new RtspStreamFrame(scaleFrame(avFrame, region, width, height), avFrame->width, avFrame->height);
+    frame->setCrop(QRectF(double(region.x()) / avFrame->width, double(region.y()) / avFrame->height,
+                          double(region.width()) / avFrame->width, double(region.height()) / avFrame->height));
+    return frame;
+}
+
+/* The crop in frame pixels, widened to whole chroma samples */
+QRect RtspStreamFrameFormatter::cropRegion(AVFrame *avFrame, const QRectF &crop) const
+{
+    QRect frameRect(0, 0, avFrame->width, avFrame->height);
+    if (crop.isEmpty() || crop.contains(QRectF(0, 0, 1, 1)))
+        return frameRect;
+
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)avFrame->format);
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_PAL)))
+        return frameRect;
+
+    int alignX = 1 << desc->log2_chroma_w;
+    int alignY = 1 << desc->log2_chroma_h;
+    int left = qMax(0, int(floor(crop.left() * avFrame->width))) & ~(alignX - 1);
+    int top = qMax(0, int(floor(crop.top() * avFrame->height))) & ~(alignY - 1);
+    int right = qMin(avFrame->width, (int(ceil(crop.right() * avFrame->width)) + alignX - 1) & ~(alignX - 1));
+    int bottom = qMin(avFrame->height, (int(ceil(crop.bottom() * avFrame->height)) + alignY - 1) & ~(alignY - 1));
+
+    if (right <= left || bottom <= top)
+        return frameRect;
+
+    return QRect(left, top, right - left, bottom - top);
 }
 
 bool RtspStreamFrameFormatter::shouldTryDeinterlaceFrame(AVFrame *avFrame)
@@ -83,18 +230,79 @@ bool RtspStreamFrameFormatter::shouldTryDeinterlaceFrame(AVFrame *avFrame)
 void RtspStreamFrameFormatter::deinterlaceFrame(AVFrame* avFrame)
 {
     //int ret = avpicture_deinterlace((AVPicture*)avFrame, (AVPicture*)avFrame,
-    //                                m_stream->codecpar->format, m_stream->codecpar->width, m_stream->codecpar->height);
+    //                                m_codecpar->format, m_codecpar->width, m_codecpar->height);
     int ret = -1;
     if (ret < 0)
         qDebug("deinterlacing failed");
 }
 
-AVFrame * RtspStreamFrameFormatter::scaleFrame(AVFrame* avFrame, int width, int height)
+AVFrame * RtspStreamFrameFormatter::dewarpFrame(AVFrame *avFrame, int width, int height)
+{
+    if (width == -1 || height == -1)
+    {
+        QSize size = RtspFisheyeDewarp::defaultSize(m_fisheyeView.mode(), avFrame->width, avFrame->height);
+        width = size.width();
+        height = size.height();
+    }
+
+    /* Formats the tables can't sample, such as NV12 from hardware decoders, go through
+     * planar 4:2:0 first */
+    AVFrame *source = avFrame;
+    AVPixelFormat format = (AVPixelFormat)avFrame->format;
+    if (!RtspFisheyeDewarp::isSupportedFormat(format))
+    {
+        format = AV_PIX_FMT_YUV420P;
+        if (!prepareFrame(&m_dewarpInput, format, avFrame->width, avFrame->height))
+            return NULL;
+
+        m_dewarpInputContext = sws_getCachedContext(m_dewarpInputContext,
+                                                    avFrame->width, avFrame->height, (AVPixelFormat)avFrame->format,
+                                                    avFrame->width, avFrame->height, format,
+                                                    SWS_POINT, NULL, NULL, NULL);
+        if (!m_dewarpInputContext)
+            return NULL;
+
+        sws_scale(m_dewarpInputContext, (const uint8_t**)avFrame->data, avFrame->linesize, 0, avFrame->height,
+                  m_dewarpInput->data, m_dewarpInput->linesize);
+        source = m_dewarpInput;
+    }
+
+    m_dewarp.setGeometry(m_fisheyeView, format, avFrame->width, avFrame->height, width, height);
+    if (!m_dewarp.isValid() || !prepareFrame(&m_dewarpOutput, format, width, height))
+        return NULL;
+
+    /* Bands start on a chroma row, like those of the scaler */
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    int align = 1 << desc->log2_chroma_h;
+    int count = qMax(1, qMin(m_maxSlices, height / (align * 16)));
+    QSemaphore done;
+
+    for (int i = count - 1; i >= 0; --i)
+    {
+        int firstRow = int(qint64(i) * height / count) & ~(align - 1);
+        int lastRow = i == count - 1 ? height : int(qint64(i + 1) * height / count) & ~(align - 1);
+
+        DewarpSliceTask *task = new DewarpSliceTask(&m_dewarp, source, m_dewarpOutput, firstRow, lastRow, &done);
+        if (i)
+            scalePool()->start(task);
+        else
+        {
+            task->run();
+            delete task;
+        }
+    }
+
+    done.acquire(count);
+    m_dewarpOutput->pts = avFrame->pts;
+    return m_dewarpOutput;
+}
+
+AVFrame * RtspStreamFrameFormatter::scaleFrame(AVFrame* avFrame, const QRect &region, int width, int height)
 {
     Q_ASSERT(avFrame->width != 0);
     Q_ASSERT(avFrame->height != 0);
-    m_width = avFrame->width;
-    m_height = avFrame->height;
+    m_width = region.width();
+    m_height = region.height();
 
     if (width == -1 || height == -1)
     {
@@ -102,19 +310,71 @@ AVFrame * RtspStreamFrameFormatter::scaleFrame(AVFrame* avFrame, int width, int
         height = m_height;
     }
 
-    updateSWSContext(width, height);
+    /* Frames downloaded from hardware decoders don't have the stream's format */
+    AVPixelFormat sourceFormat = avFrame->format >= 0 ? (AVPixelFormat)avFrame->format : (AVPixelFormat)m_codecpar->format;
+    updateSWSContext(sourceFormat, width, height);
 
-    if (!m_sws_context)
+    if (m_slices.isEmpty())
         return NULL;
 
+    /* Start of the region in each plane */
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(sourceFormat);
+    const uint8_t *src[4] = { 0, 0, 0, 0 };
+    int pixelSteps[4];
+    av_image_fill_max_pixsteps(pixelSteps, NULL, desc);
+
+    for (int plane = 0; plane < 4 && avFrame->data[plane]; ++plane)
+    {
+        bool chroma = (plane == 1 || plane == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        int x = chroma ? region.x() >> desc->log2_chroma_w : region.x();
+        int y = chroma ? region.y() >> desc->log2_chroma_h : region.y();
+        src[plane] = avFrame->data[plane] + y * avFrame->linesize[plane] + x * pixelSteps[plane];
+    }
+
     int bufSize  = av_image_get_buffer_size(m_pixelFormat, width, height, 4);
     uint8_t *buf = (uint8_t*) av_malloc(bufSize);
 
     AVFrame *result = av_frame_alloc();
 
     av_image_fill_arrays(result->data, result->linesize, buf, m_pixelFormat, width, height, 4);
-    sws_scale(m_sws_context, (const uint8_t**)avFrame->data, avFrame->linesize, 0, m_height,
-              result->data, result->linesize);
+
+    if (m_slices.size() == 1)
+    {
+        sws_scale(m_slices[0].context, src, avFrame->linesize, 0, m_height,
+                  result->data, result->linesize);
+    }
+    else
+    {
+        QSemaphore done;
+
+        /* Bands after the first go to the pool; this thread converts the first meanwhile */
+        for (int i = m_slices.size() - 1; i >= 0; --i)
+        {
+            const Slice &slice = m_slices[i];
+            const uint8_t *sliceSrc[4] = { 0, 0, 0, 0 };
+            uint8_t *dst[4] = { 0, 0, 0, 0 };
+
+            for (int plane = 0; plane < 4 && src[plane]; ++plane)
+            {
+                bool chroma = (plane == 1 || plane == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+                int rows = chroma ? slice.srcY >> desc->log2_chroma_h : slice.srcY;
+                sliceSrc[plane] = src[plane] + rows * avFrame->linesize[plane];
+            }
+            dst[0] = result->data[0] + slice.dstY * result->linesize[0];
+
+            ScaleSliceTask *task = new ScaleSliceTask(slice.context, sliceSrc, avFrame->linesize, slice.srcHeight,
+                                                      dst, result->linesize, &done);
+            if (i)
+                scalePool()->start(task);
+            else
+            {
+                task->run();
+                delete task;
+            }
+        }
+
+        done.acquire(m_slices.size());
+    }
 
     result->width = width;
     result->height = height;
@@ -123,13 +383,13 @@ AVFrame * RtspStreamFrameFormatter::scaleFrame(AVFrame* avFrame, int width, int
     return result;
 }
 
-void RtspStreamFrameFormatter::updateSWSContext(int dstWidth, int dstHeight)
+void RtspStreamFrameFormatter::updateSWSContext(AVPixelFormat sourceFormat, int dstWidth, int dstHeight)
 {
     AVPixelFormat pixFormat;
 
     //convert deprecated pixel format in incoming stream
     //in order to suppress swscaler warning
-    switch (m_stream->codecpar->format)
+    switch (sourceFormat)
     {
     case AV_PIX_FMT_YUVJ420P :
         pixFormat = AV_PIX_FMT_YUV420P;
@@ -142,15 +402,66 @@ void RtspStreamFrameFormatter::updateSWSContext(int dstWidth, int dstHeight)
         break;
     case AV_PIX_FMT_YUVJ440P :
         pixFormat = AV_PIX_FMT_YUV440P;
+        break;
     default:
-        pixFormat = (AVPixelFormat) m_stream->codecpar->format;
+        pixFormat = sourceFormat;
         break;
     }
 
-    m_sws_context = sws_getCachedContext(m_sws_context,
-                                         m_width, m_height,
-                                         pixFormat,
-                                         dstWidth, dstHeight,
-                                         m_pixelFormat,
-                                         SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pixFormat);
+    if (!desc)
+    {
+        clearSlices();
+        return;
+    }
+
+    /* Bands start on a chroma row and are tall enough to be worth a context; every band is
+     * filtered on its own, which at these sizes doesn't leave a visible seam */
+    int align = 1 << desc->log2_chroma_h;
+    int count = int(qMin<qint64>(m_maxSlices, qint64(m_width) * m_height / minSlicePixels));
+    count = qMin(count, qMin(m_height / (align * 16), dstHeight / 16));
+    count = qMax(count, 1);
+
+    while (m_slices.size() > count)
+    {
+        sws_freeContext(m_slices.last().context);
+        m_slices.removeLast();
+    }
+    while (m_slices.size() < count)
+    {
+        Slice slice = { 0, 0, 0, 0, 0 };
+        m_slices.append(slice);
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        Slice &slice = m_slices[i];
+        int srcEnd = i == count - 1 ? m_height : int(qint64(i + 1) * m_height / count) & ~(align - 1);
+        int dstEnd = i == count - 1 ? dstHeight : int(qint64(srcEnd) * dstHeight / m_height);
+
+        slice.srcY = i ? m_slices[i - 1].srcY + m_slices[i - 1].srcHeight : 0;
+        slice.dstY = i ? m_slices[i - 1].dstY + m_slices[i - 1].dstHeight : 0;
+        slice.srcHeight = srcEnd - slice.srcY;
+        slice.dstHeight = dstEnd - slice.dstY;
+
+        /* Returns the same context as long as the band geometry is unchanged */
+        slice.context = sws_getCachedContext(slice.context,
+                                             m_width, slice.srcHeight,
+                                             pixFormat,
+                                             dstWidth, slice.dstHeight,
+                                             m_pixelFormat,
+                                             SWS_FAST_BILINEAR, NULL, NULL, NULL);
+        if (!slice.context)
+        {
+            clearSlices();
+            return;
+        }
+    }
+}
+
+void RtspStreamFrameFormatter::clearSlices()
+{
+    foreach (const Slice &slice, m_slices)
+        sws_freeContext(slice.context);
+    m_slices.clear();
 }
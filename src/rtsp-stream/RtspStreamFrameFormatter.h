@@ -18,39 +18,84 @@
 #ifndef RTSP_STREAM_FRAME_FORMATTER_H
 #define RTSP_STREAM_FRAME_FORMATTER_H
 
+#include "RtspFisheyeDewarp.h"
+#include <QRect>
+#include <QVector>
+
 extern "C" {
 #   include "libavutil/pixfmt.h"
 }
 
 class RtspStreamFrame;
+struct AVCodecParameters;
 struct AVFrame;
-struct AVStream;
 
 struct SwsContext;
- 
+
+/* Converts decoded frames to BGRA at the size they are displayed at.
+ *
+ * Large frames are cut into horizontal bands, each converted by its own SwsContext on a
+ * shared pool while the calling thread does the first band, so one 4K or 12 MP stream can
+ * use several cores. Band contexts are kept between frames and only rebuilt when the source
+ * or target geometry changes.
+ *
+ * A crop limits conversion to part of the frame, for digital zoom; the size passed to
+ * formatFrame() is then the size that part is displayed at.
+ *
+ * Frames of fisheye cameras can be dewarped on the way, see RtspFisheyeDewarp; the remap is
+ * cut into bands on the same pool. Dewarped frames are always converted whole. */
+
 class RtspStreamFrameFormatter
 {
 public:
-    explicit RtspStreamFrameFormatter(AVStream *stream);
+    explicit RtspStreamFrameFormatter(AVCodecParameters *codecpar);
     ~RtspStreamFrameFormatter();
 
     void setAutoDeinterlacing(bool autoDeinterlacing);
-    RtspStreamFrame * formatFrame(AVFrame *avFrame, int width, int height);
+    /* At most this many bands are converted in parallel; 1 disables slicing */
+    void setMaxSlices(int maxSlices);
+    int sliceCount() const { return m_slices.size(); }
+    void setFisheyeView(const FisheyeView &view) { m_fisheyeView = view; }
+    /* crop is relative to the frame size; an empty crop converts the whole frame */
+    RtspStreamFrame * formatFrame(AVFrame *avFrame, int width, int height, const QRectF &crop = QRectF());
 
 private:
-    AVStream *m_stream;
-    SwsContext *m_sws_context;
+    struct Slice
+    {
+        SwsContext *context;
+        int srcY;
+        int srcHeight;
+        int dstY;
+        int dstHeight;
+    };
+
+    /* Below this many source pixels per band, slicing costs more than it saves */
+    static const int minSlicePixels = 1536 * 1024;
+    static const int maxSliceCount = 8;
+
+    AVCodecParameters *m_codecpar;
+    QVector<Slice> m_slices;
+    int m_maxSlices;
     AVPixelFormat m_pixelFormat;
     bool m_autoDeinterlacing;
     bool m_shouldTryDeinterlaceStream;
     int m_width;
     int m_height;
+    FisheyeView m_fisheyeView;
+    RtspFisheyeDewarp m_dewarp;
+    /* Input converted to a format the dewarp tables can sample, when needed */
+    SwsContext *m_dewarpInputContext;
+    AVFrame *m_dewarpInput;
+    AVFrame *m_dewarpOutput;
 
     bool shouldTryDeinterlaceStream();
     bool shouldTryDeinterlaceFrame(AVFrame *avFrame);
     void deinterlaceFrame(AVFrame *avFrame);
-    AVFrame * scaleFrame(AVFrame *avFrame, int width, int height);
-    void updateSWSContext(int dstWidth, int dstHeight);
+    AVFrame * dewarpFrame(AVFrame *avFrame, int width, int height);
+    QRect cropRegion(AVFrame *avFrame, const QRectF &crop) const;
+    AVFrame * scaleFrame(AVFrame *avFrame, const QRect &region, int width, int height);
+    void updateSWSContext(AVPixelFormat sourceFormat, int dstWidth, int dstHeight);
+    void clearSlices();
 
 };
 
@@ -18,60 +18,43 @@
 #include "RtspStreamFrameQueue.h"
 #include "RtspStreamFrame.h"
 
-extern "C" {
-#   include "libavcodec/avcodec.h"
-#   include "libavutil/avutil.h"
-#   include "libavutil/mathematics.h"
-}
-
-#define RENDER_TIMER_FPS 30
-
-RtspStreamFrameQueue::RtspStreamFrameQueue(quint16 sizeLimit) :
-        m_frameQueueLock(QMutex::NonRecursive), m_sizeLimit(sizeLimit), m_ptsBase(AV_NOPTS_VALUE)
+RtspStreamFrameQueue::RtspStreamFrameQueue(Mode mode, int sizeLimit) :
+        m_mode(mode), m_latest(0), m_sizeLimit(sizeLimit), m_mask(0),
+        m_writeCount(0), m_readCount(0), m_droppedFrames(0)
 {
+    Q_ASSERT(mode != Paced || sizeLimit > 0);
+
+    if (mode == Paced)
+    {
+        /* A power of two keeps slot indexes consistent when the counters wrap */
+        quint32 capacity = 1;
+        while (capacity < quint32(sizeLimit))
+            capacity <<= 1;
+        m_ring.fill(0, int(capacity));
+        m_mask = capacity - 1;
+    }
 }
 
 RtspStreamFrameQueue::~RtspStreamFrameQueue()
 {
-    clear();
+    /* Both threads are done with the queue by now */
+    RtspStreamFrame *frame;
+    while ((frame = dequeue()))
+        delete frame;
 }
 
 RtspStreamFrame * RtspStreamFrameQueue::dequeue()
 {
-    QMutexLocker locker(&m_frameQueueLock);
-    if (m_frameQueue.isEmpty())
-        return 0;
-
-    if (m_ptsBase == (int64_t)AV_NOPTS_VALUE)
-    {
-        m_ptsBase = m_frameQueue.head()->avFrame()->pts;
-        m_ptsTimer.start();
-    }
-
-    //qint64 now = m_ptsTimer.elapsed() * 1000;
-
-    // TODO: needs checking
-    // something is wrong with this code as after few minutes all frames are considered outdated - some calculation is off here
-    RtspStreamFrame *frame = m_frameQueue.dequeue();
-    /*while (!m_frameQueue.isEmpty() && frame)
-    {
-        qint64 scaledFrameDisplayTime = av_rescale_rnd(frame->avFrame()->pts - m_ptsBase, AV_TIME_BASE, 90000, AV_ROUND_NEAR_INF);
-        if (abs(scaledFrameDisplayTime - now) >= AV_TIME_BASE/2)
-        {
-            m_ptsBase = frame->avFrame()->pts;
-            m_ptsTimer.start();
-            now = scaledFrameDisplayTime = 0;
-        }
+    if (m_mode == LatestFrame)
+        return m_latest.fetchAndStoreAcquire(0);
 
-        if (now >= scaledFrameDisplayTime || (scaledFrameDisplayTime - now) <= AV_TIME_BASE/(RENDER_TIMER_FPS*2))
-        {
-            delete frame;
-            frame = m_frameQueue.dequeue();
-        }
-        else
-            break;
-    }*/
+    quint32 read = quint32(m_readCount.load());
+    if (read == quint32(m_writeCount.loadAcquire()))
+        return 0;
 
+    /* The acquire on m_writeCount makes the producer's write to this slot visible */
+    RtspStreamFrame *frame = m_ring[read & m_mask];
+    m_readCount.storeRelease(int(read + 1));
     return frame;
 }
 
@@ -80,25 +63,26 @@ void RtspStreamFrameQueue::enqueue(RtspStreamFrame *frame)
     if (!frame)
         return;
 
-    QMutexLocker locker(&m_frameQueueLock);
-    m_frameQueue.enqueue(frame);
-
-    dropOldFrames();
-}
-
-void RtspStreamFrameQueue::clear()
-{
-    QMutexLocker locker(&m_frameQueueLock);
-    qDeleteAll(m_frameQueue);
-    m_frameQueue.clear();
-}
+    if (m_mode == LatestFrame)
+    {
+        /* The consumer never saw the frame replaced here, so it is ours to free */
+        RtspStreamFrame *previous = m_latest.fetchAndStoreAcqRel(frame);
+        if (previous)
+        {
+            m_droppedFrames.ref();
+            delete previous;
+        }
+        return;
+    }
 
-// Calling this method should be proteced by m_frameQueueLock
-void RtspStreamFrameQueue::dropOldFrames()
-{
-    while (m_frameQueue.size() >= 6)
+    quint32 write = quint32(m_writeCount.load());
+    if (write - quint32(m_readCount.loadAcquire()) >= quint32(m_sizeLimit))
     {
-        RtspStreamFrame *frame = m_frameQueue.dequeue();
+        m_droppedFrames.ref();
         delete frame;
+        return;
     }
+
+    m_ring[write & m_mask] = frame;
+    m_writeCount.storeRelease(int(write + 1));
 }
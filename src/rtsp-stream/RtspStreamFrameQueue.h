@@ -18,35 +18,57 @@
 #ifndef RTSP_STREAM_FRAME_QUEUE_H
 #define RTSP_STREAM_FRAME_QUEUE_H
 
-#include "core/ThreadPause.h"
-#include <QDateTime>
-#include <QElapsedTimer>
-#include <QMutex>
-#include <QObject>
-#include <QQueue>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QVector>
 
 class RtspStreamFrame;
 
+/* Hands decoded frames from one producer thread to one consumer, without locks.
+ *
+ * LatestFrame is a mailbox for live view: the consumer always gets the newest frame and
+ * anything it didn't pick up in time is dropped by the producer. Swapping a single frame
+ * pointer gives the same guarantees as a triple buffer, with the producer filling its own
+ * frame and the consumer owning the one it took, so neither ever waits for the other.
+ *
+ * Paced keeps up to sizeLimit frames in order for playback the producer already paces;
+ * frames arriving while it is full are dropped.
+ *
+ * enqueue() may only be called from the producer thread and dequeue() from the consumer
+ * thread. */
+
 class RtspStreamFrameQueue
 {
     Q_DISABLE_COPY(RtspStreamFrameQueue)
 
 public:
-    RtspStreamFrameQueue(quint16 sizeLimit);
+    enum Mode
+    {
+        LatestFrame,
+        Paced
+    };
+
+    explicit RtspStreamFrameQueue(Mode mode, int sizeLimit = 6);
     ~RtspStreamFrameQueue();
 
+    Mode mode() const { return m_mode; }
+
     RtspStreamFrame * dequeue();
     void enqueue(RtspStreamFrame *frame);
-    void clear();
 
-private:
-    QMutex m_frameQueueLock;
-    QQueue<RtspStreamFrame *> m_frameQueue;
-    quint16 m_sizeLimit;
-    qint64 m_ptsBase;
-    QElapsedTimer m_ptsTimer;
+    /* Frames dropped before reaching the consumer; any thread */
+    int droppedFrames() const { return m_droppedFrames.loadAcquire(); }
 
-    void dropOldFrames();
+private:
+    const Mode m_mode;
+    QAtomicPointer<RtspStreamFrame> m_latest;
+    QVector<RtspStreamFrame *> m_ring;
+    const int m_sizeLimit;
+    quint32 m_mask;
+    /* Frames ever written and read; their difference is the fill level */
+    QAtomicInt m_writeCount;
+    QAtomicInt m_readCount;
+    QAtomicInt m_droppedFrames;
 
 };
 
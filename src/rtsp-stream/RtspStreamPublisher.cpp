@@ -0,0 +1,164 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RtspStreamPublisher.h"
+#include "RtspStreamRemuxer.h"
+
+extern "C" {
+#   include "libavcodec/avcodec.h"
+#   include "libavformat/avformat.h"
+}
+
+RtspStreamPublisher::RtspStreamPublisher()
+    : m_pendingBytes(0), m_writer(0), m_videoIndex(-1), m_audioIndex(-1),
+      m_generation(0), m_active(false), m_droppedPackets(0)
+{
+    for (int i = 0; i < 2; ++i)
+        m_codecpar[i] = 0;
+}
+
+RtspStreamPublisher::~RtspStreamPublisher()
+{
+    clearPending();
+
+    for (int i = 0; i < 2; ++i)
+        avcodec_parameters_free(&m_codecpar[i]);
+}
+
+void RtspStreamPublisher::setStreams(const void *writer, AVFormatContext *input, int videoStreamIndex, int audioStreamIndex)
+{
+    QMutexLocker locker(&m_lock);
+
+    m_writer = writer;
+    m_videoIndex = videoStreamIndex;
+    m_audioIndex = audioStreamIndex;
+
+    AVStream *streams[2] =
+    {
+        videoStreamIndex >= 0 ? input->streams[videoStreamIndex] : 0,
+        audioStreamIndex >= 0 ? input->streams[audioStreamIndex] : 0
+    };
+
+    bool changed = false;
+    for (int i = 0; i < 2; ++i)
+    {
+        AVCodecParameters *codecpar = streams[i] ? streams[i]->codecpar : 0;
+        if (RtspStreamRemuxer::sameParameters(m_codecpar[i], codecpar)
+                && (!streams[i] || !av_cmp_q(m_timeBase[i], streams[i]->time_base)))
+            continue;
+
+        changed = true;
+        avcodec_parameters_free(&m_codecpar[i]);
+        if (codecpar)
+        {
+            m_codecpar[i] = avcodec_parameters_alloc();
+            avcodec_parameters_copy(m_codecpar[i], codecpar);
+            m_timeBase[i] = streams[i]->time_base;
+        }
+    }
+
+    /* A reconnection with the same parameters continues the same output */
+    if (!changed)
+        return;
+
+    clearPending();
+    m_generation++;
+}
+
+void RtspStreamPublisher::append(const void *writer, const AVPacket *packet)
+{
+    QMutexLocker locker(&m_lock);
+
+    if (!m_active || writer != m_writer)
+        return;
+
+    int stream;
+    if (packet->stream_index == m_videoIndex)
+        stream = RtspStreamRemuxer::VideoStream;
+    else if (packet->stream_index == m_audioIndex)
+        stream = RtspStreamRemuxer::AudioStream;
+    else
+        return;
+
+    if (m_pendingBytes + packet->size > maxPendingBytes)
+    {
+        m_droppedPackets++;
+        return;
+    }
+
+    AVPacket *copy = av_packet_alloc();
+    if (!copy || av_packet_ref(copy, packet) < 0)
+    {
+        av_packet_free(&copy);
+        return;
+    }
+
+    copy->stream_index = stream;
+    m_pending.append(copy);
+    m_pendingBytes += copy->size;
+}
+
+void RtspStreamPublisher::setActive(bool active)
+{
+    QMutexLocker locker(&m_lock);
+
+    m_active = active;
+    if (!active)
+        clearPending();
+}
+
+int RtspStreamPublisher::takePending(QList<AVPacket *> &packets)
+{
+    QMutexLocker locker(&m_lock);
+
+    packets.append(m_pending);
+    m_pending.clear();
+    m_pendingBytes = 0;
+    return m_generation;
+}
+
+int RtspStreamPublisher::copyStreams(AVCodecParameters *codecpar[2], AVRational timeBase[2]) const
+{
+    QMutexLocker locker(&m_lock);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        codecpar[i] = 0;
+        if (!m_codecpar[i])
+            continue;
+
+        codecpar[i] = avcodec_parameters_alloc();
+        avcodec_parameters_copy(codecpar[i], m_codecpar[i]);
+        timeBase[i] = m_timeBase[i];
+    }
+
+    return m_generation;
+}
+
+int RtspStreamPublisher::droppedPackets() const
+{
+    QMutexLocker locker(&m_lock);
+    return m_droppedPackets;
+}
+
+void RtspStreamPublisher::clearPending()
+{
+    foreach (AVPacket *packet, m_pending)
+        av_packet_free(&packet);
+    m_pending.clear();
+    m_pendingBytes = 0;
+}
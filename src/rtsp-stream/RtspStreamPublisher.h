@@ -0,0 +1,78 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RTSP_STREAM_PUBLISHER_H
+#define RTSP_STREAM_PUBLISHER_H
+
+#include "RtspPacketSink.h"
+#include <QList>
+#include <QMutex>
+
+extern "C" {
+#   include "libavutil/rational.h"
+}
+
+struct AVCodecParameters;
+
+/* Hands the packets of one live stream to LiveStreamGateway, which re-serves them to
+ * local clients without opening another connection to the server.
+ *
+ * Packets are only queued while the gateway has clients for the stream, and the queue is
+ * bounded in case the gateway thread falls behind. Every change of stream parameters
+ * bumps the generation, which tells the gateway its clients' muxers are out of date. */
+
+class RtspStreamPublisher : public RtspPacketSink
+{
+    Q_DISABLE_COPY(RtspStreamPublisher)
+
+public:
+    RtspStreamPublisher();
+    virtual ~RtspStreamPublisher();
+
+    /* Worker thread */
+    virtual void setStreams(const void *writer, AVFormatContext *input, int videoStreamIndex, int audioStreamIndex);
+    virtual void append(const void *writer, const AVPacket *packet);
+
+    /* Gateway thread */
+    void setActive(bool active);
+    /* Moves the queued packets, stream_index VideoStream or AudioStream of
+     * RtspStreamRemuxer, into packets and returns their generation */
+    int takePending(QList<AVPacket *> &packets);
+    /* Copies the current parameters, to be freed by the caller, and returns their generation */
+    int copyStreams(AVCodecParameters *codecpar[2], AVRational timeBase[2]) const;
+    int droppedPackets() const;
+
+private:
+    static const int maxPendingBytes = 8 * 1024 * 1024;
+
+    mutable QMutex m_lock;
+    QList<AVPacket *> m_pending;
+    int m_pendingBytes;
+    const void *m_writer;
+    int m_videoIndex;
+    int m_audioIndex;
+    AVCodecParameters *m_codecpar[2];
+    AVRational m_timeBase[2];
+    int m_generation;
+    bool m_active;
+    int m_droppedPackets;
+
+    // Calling this method should be protected by m_lock
+    void clearPending();
+};
+
+#endif // RTSP_STREAM_PUBLISHER_H
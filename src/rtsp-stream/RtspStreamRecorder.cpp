@@ -0,0 +1,336 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RtspStreamRecorder.h"
+#include <QDebug>
+#include <QDir>
+
+extern "C" {
+#   include "libavcodec/avcodec.h"
+#   include "libavformat/avformat.h"
+}
+
+enum
+{
+    VideoStream = RtspStreamRemuxer::VideoStream,
+    AudioStream = RtspStreamRemuxer::AudioStream
+};
+
+RtspStreamRecorder::RtspStreamRecorder(const QString &directory, const QString &name, Format format,
+                                       qint64 maxFileSize, int maxFileDuration)
+    : m_directory(directory), m_name(name), m_format(format),
+      m_maxFileSize(maxFileSize), m_maxFileDuration(maxFileDuration),
+      m_pendingBytes(0), m_writer(0), m_videoIndex(-1), m_audioIndex(-1),
+      m_streamsChanged(false), m_stopped(false), m_droppedPackets(0), m_fileBytes(0)
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        m_codecpar[i] = 0;
+        m_fileCodecpar[i] = 0;
+    }
+}
+
+RtspStreamRecorder::~RtspStreamRecorder()
+{
+    closeFile();
+
+    foreach (AVPacket *packet, m_pending)
+        av_packet_free(&packet);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        avcodec_parameters_free(&m_codecpar[i]);
+        avcodec_parameters_free(&m_fileCodecpar[i]);
+    }
+}
+
+void RtspStreamRecorder::setStreams(const void *writer, AVFormatContext *input, int videoStreamIndex, int audioStreamIndex)
+{
+    QMutexLocker locker(&m_lock);
+
+    m_writer = writer;
+    m_videoIndex = videoStreamIndex;
+    m_audioIndex = audioStreamIndex;
+
+    AVStream *streams[2] =
+    {
+        videoStreamIndex >= 0 ? input->streams[videoStreamIndex] : 0,
+        audioStreamIndex >= 0 ? input->streams[audioStreamIndex] : 0
+    };
+
+    bool changed = false;
+    for (int i = 0; i < 2; ++i)
+    {
+        AVCodecParameters *codecpar = streams[i] ? streams[i]->codecpar : 0;
+        if (RtspStreamRemuxer::sameParameters(m_codecpar[i], codecpar)
+                && (!streams[i] || !av_cmp_q(m_timeBase[i], streams[i]->time_base)))
+            continue;
+
+        changed = true;
+        avcodec_parameters_free(&m_codecpar[i]);
+        if (codecpar)
+        {
+            m_codecpar[i] = avcodec_parameters_alloc();
+            avcodec_parameters_copy(m_codecpar[i], codecpar);
+            m_timeBase[i] = streams[i]->time_base;
+        }
+    }
+
+    if (!changed)
+        return;
+
+    /* Packets still pending belong to the old parameters; the writer starts a new file */
+    foreach (AVPacket *packet, m_pending)
+        av_packet_free(&packet);
+    m_pending.clear();
+    m_pendingBytes = 0;
+    m_streamsChanged = true;
+}
+
+void RtspStreamRecorder::append(const void *writer, const AVPacket *packet)
+{
+    QMutexLocker locker(&m_lock);
+
+    if (m_stopped || writer != m_writer)
+        return;
+
+    int stream;
+    if (packet->stream_index == m_videoIndex)
+        stream = VideoStream;
+    else if (packet->stream_index == m_audioIndex)
+        stream = AudioStream;
+    else
+        return;
+
+    /* The disk can't keep up; losing packets beats growing without bound */
+    if (m_pendingBytes + packet->size > maxPendingBytes)
+    {
+        m_droppedPackets++;
+        return;
+    }
+
+    AVPacket *copy = av_packet_alloc();
+    if (!copy || av_packet_ref(copy, packet) < 0)
+    {
+        av_packet_free(&copy);
+        return;
+    }
+
+    copy->stream_index = stream;
+    m_pending.append(copy);
+    m_pendingBytes += copy->size;
+}
+
+void RtspStreamRecorder::stop()
+{
+    QMutexLocker locker(&m_lock);
+    m_stopped = true;
+}
+
+bool RtspStreamRecorder::isStopped() const
+{
+    QMutexLocker locker(&m_lock);
+    return m_stopped;
+}
+
+int RtspStreamRecorder::droppedPackets() const
+{
+    QMutexLocker locker(&m_lock);
+    return m_droppedPackets;
+}
+
+bool RtspStreamRecorder::writePending()
+{
+    QList<AVPacket *> packets;
+    bool stopped;
+    bool streamsChanged;
+    AVCodecParameters *codecpar[2] = { 0, 0 };
+    AVRational timeBase[2];
+
+    {
+        QMutexLocker locker(&m_lock);
+
+        packets.swap(m_pending);
+        m_pendingBytes = 0;
+        stopped = m_stopped;
+
+        /* Take the parameters these packets were received with. Only copies are made
+         * here: the worker blocks on m_lock, so no file I/O happens while it is held. */
+        streamsChanged = m_streamsChanged;
+        if (m_streamsChanged)
+        {
+            for (int i = 0; i < 2; ++i)
+            {
+                if (m_codecpar[i])
+                {
+                    codecpar[i] = avcodec_parameters_alloc();
+                    avcodec_parameters_copy(codecpar[i], m_codecpar[i]);
+                    timeBase[i] = m_timeBase[i];
+                }
+            }
+            m_streamsChanged = false;
+        }
+    }
+
+    if (streamsChanged)
+    {
+        closeFile();
+        for (int i = 0; i < 2; ++i)
+        {
+            avcodec_parameters_free(&m_fileCodecpar[i]);
+            m_fileCodecpar[i] = codecpar[i];
+            if (codecpar[i])
+                m_fileTimeBase[i] = timeBase[i];
+        }
+    }
+
+    foreach (AVPacket *packet, packets)
+    {
+        writePacket(packet);
+        av_packet_free(&packet);
+    }
+
+    m_remuxer.flush();
+
+    if (stopped)
+    {
+        closeFile();
+        return false;
+    }
+
+    return true;
+}
+
+void RtspStreamRecorder::writePacket(AVPacket *packet)
+{
+    bool keyframe = packet->stream_index == VideoStream && (packet->flags & AV_PKT_FLAG_KEY);
+
+    if (keyframe && m_remuxer.isOpen() && shouldRotate())
+        closeFile();
+
+    /* Every file starts with a keyframe */
+    if (!m_remuxer.isOpen() && (!keyframe || !openFile()))
+        return;
+
+    m_remuxer.write(packet);
+}
+
+bool RtspStreamRecorder::shouldRotate() const
+{
+    if (m_maxFileSize > 0 && m_fileBytes >= m_maxFileSize)
+        return true;
+
+    if (m_maxFileDuration > 0 && m_fileStarted.secsTo(QDateTime::currentDateTime()) >= m_maxFileDuration)
+        return true;
+
+    return false;
+}
+
+bool RtspStreamRecorder::openFile()
+{
+    if (!m_fileCodecpar[VideoStream])
+        return false;
+
+    if (!QDir().mkpath(m_directory))
+    {
+        qDebug() << "RtspStreamRecorder: cannot create" << m_directory;
+        return false;
+    }
+
+    m_fileStarted = QDateTime::currentDateTime();
+    QString fileName = QString::fromLatin1("%1 - %2.%3").arg(m_name,
+                                                            m_fileStarted.toString(QLatin1String("yyyy-MM-dd hh-mm-ss")),
+                                                            QLatin1String(m_format == Mp4 ? "mp4" : "mkv"));
+    m_finalPath = QDir(m_directory).filePath(fileName);
+
+    /* The .part file is played back fine if the client dies; it just isn't renamed */
+    m_file.setFileName(m_finalPath + QLatin1String(".part"));
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered))
+    {
+        qDebug() << "RtspStreamRecorder: cannot open" << m_file.fileName() << m_file.errorString();
+        return false;
+    }
+
+    AVDictionary *options = 0;
+    if (m_format == Mp4)
+        av_dict_set(&options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+
+    m_fileBytes = 0;
+
+    /* Large buffer: the writer hands over a whole batch at once */
+    bool ok = m_remuxer.open(m_format == Mp4 ? "mp4" : "matroska", m_fileCodecpar, m_fileTimeBase,
+                             &options, this, writeCallback, seekCallback, ioBufferSize);
+    av_dict_free(&options);
+    if (!ok)
+    {
+        qDebug() << "RtspStreamRecorder: cannot start" << m_finalPath;
+        m_file.close();
+        m_file.remove();
+        return false;
+    }
+
+    qDebug() << "RtspStreamRecorder: recording to" << m_finalPath;
+    return true;
+}
+
+void RtspStreamRecorder::closeFile()
+{
+    if (!m_remuxer.isOpen())
+        return;
+
+    m_remuxer.close();
+
+    m_file.close();
+    if (!QFile::rename(m_file.fileName(), m_finalPath))
+        qDebug() << "RtspStreamRecorder: cannot rename" << m_file.fileName();
+}
+
+int RtspStreamRecorder::writeCallback(void *opaque, uint8_t *buf, int size)
+{
+    RtspStreamRecorder *recorder = static_cast<RtspStreamRecorder *>(opaque);
+
+    qint64 written = recorder->m_file.write(reinterpret_cast<const char *>(buf), size);
+    if (written < 0)
+        return AVERROR(EIO);
+
+    recorder->m_fileBytes += written;
+    return int(written);
+}
+
+int64_t RtspStreamRecorder::seekCallback(void *opaque, int64_t offset, int whence)
+{
+    RtspStreamRecorder *recorder = static_cast<RtspStreamRecorder *>(opaque);
+    QFile &file = recorder->m_file;
+
+    switch (whence & ~AVSEEK_FORCE)
+    {
+    case AVSEEK_SIZE:
+        return file.size();
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        offset += file.pos();
+        break;
+    case SEEK_END:
+        offset += file.size();
+        break;
+    default:
+        return -1;
+    }
+
+    return file.seek(offset) ? offset : -1;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RTSP_STREAM_RECORDER_H
+#define RTSP_STREAM_RECORDER_H
+
+#include "RtspPacketSink.h"
+#include "RtspStreamRemuxer.h"
+#include <QDateTime>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+extern "C" {
+#   include "libavutil/rational.h"
+}
+
+struct AVCodecParameters;
+
+/* Records one live stream to local files by remuxing the packets the stream worker
+ * receives; nothing is decoded or encoded.
+ *
+ * The worker thread only takes references to packets in append(); everything else happens
+ * on the recording writer thread, which calls writePending() a couple of times per second
+ * so that data reaches the disk in large batches. Files start on a keyframe, are rotated
+ * by size or duration, and are written as "name.part" and renamed when complete. Matroska
+ * and fragmented MP4 are both readable up to the last batch written if the client dies
+ * before that.
+ *
+ * Writers identify themselves as with RtspPacketRing: only the worker that described the
+ * streams last is recorded, and a change of stream parameters starts a new file. */
+
+class RtspStreamRecorder : public RtspPacketSink
+{
+    Q_DISABLE_COPY(RtspStreamRecorder)
+
+public:
+    enum Format
+    {
+        Matroska,
+        Mp4
+    };
+
+    RtspStreamRecorder(const QString &directory, const QString &name, Format format,
+                       qint64 maxFileSize, int maxFileDuration);
+    virtual ~RtspStreamRecorder();
+
+    /* Worker thread */
+    virtual void setStreams(const void *writer, AVFormatContext *input, int videoStreamIndex, int audioStreamIndex);
+    virtual void append(const void *writer, const AVPacket *packet);
+
+    /* Any thread; the writer thread closes the file on its next pass */
+    void stop();
+    bool isStopped() const;
+    int droppedPackets() const;
+
+    /* Writer thread; returns false once stopped and everything is written */
+    bool writePending();
+
+private:
+    static const int maxPendingBytes = 64 * 1024 * 1024;
+    static const int ioBufferSize = 1024 * 1024;
+
+    const QString m_directory;
+    const QString m_name;
+    const Format m_format;
+    const qint64 m_maxFileSize;
+    const int m_maxFileDuration;
+
+    /* Shared with the worker thread, protected by m_lock */
+    mutable QMutex m_lock;
+    QList<AVPacket *> m_pending;
+    int m_pendingBytes;
+    const void *m_writer;
+    int m_videoIndex;
+    int m_audioIndex;
+    AVCodecParameters *m_codecpar[2];
+    AVRational m_timeBase[2];
+    bool m_streamsChanged;
+    bool m_stopped;
+    int m_droppedPackets;
+
+    /* Writer thread only */
+    AVCodecParameters *m_fileCodecpar[2];
+    AVRational m_fileTimeBase[2];
+    RtspStreamRemuxer m_remuxer;
+    QFile m_file;
+    QString m_finalPath;
+    qint64 m_fileBytes;
+    QDateTime m_fileStarted;
+
+    bool openFile();
+    void closeFile();
+    void writePacket(AVPacket *packet);
+    bool shouldRotate() const;
+
+    static int writeCallback(void *opaque, uint8_t *buf, int size);
+    static int64_t seekCallback(void *opaque, int64_t offset, int whence);
+};
+
+#endif // RTSP_STREAM_RECORDER_H
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RtspStreamRemuxer.h"
+#include <QDebug>
+#include <string.h>
+
+extern "C" {
+#   include "libavcodec/avcodec.h"
+#   include "libavformat/avformat.h"
+#   include "libavutil/mathematics.h"
+}
+
+RtspStreamRemuxer::RtspStreamRemuxer()
+    : m_output(0), m_headerWritten(false), m_startTime(AV_NOPTS_VALUE)
+{
+    for (int i = 0; i < StreamCount; ++i)
+    {
+        m_outputStream[i] = 0;
+        m_lastDts[i] = AV_NOPTS_VALUE;
+    }
+}
+
+RtspStreamRemuxer::~RtspStreamRemuxer()
+{
+    close();
+}
+
+bool RtspStreamRemuxer::open(const char *formatName, AVCodecParameters * const codecpar[StreamCount],
+                             const AVRational timeBase[StreamCount], AVDictionary **options,
+                             void *opaque, WriteCallback write, SeekCallback seek, int bufferSize)
+{
+    Q_ASSERT(!m_output);
+
+    if (!codecpar[VideoStream])
+        return false;
+
+    avformat_alloc_output_context2(&m_output, 0, formatName, 0);
+    if (!m_output)
+        return false;
+
+    for (int i = 0; i < StreamCount; ++i)
+    {
+        m_outputStream[i] = 0;
+        m_lastDts[i] = AV_NOPTS_VALUE;
+        m_timeBase[i] = timeBase[i];
+
+        if (!codecpar[i])
+            continue;
+
+        /* Drop audio the container can't carry rather than the whole stream */
+        if (i == AudioStream && avformat_query_codec(m_output->oformat, codecpar[i]->codec_id, FF_COMPLIANCE_NORMAL) != 1)
+            continue;
+
+        AVStream *stream = avformat_new_stream(m_output, 0);
+        if (!stream)
+            continue;
+
+        avcodec_parameters_copy(stream->codecpar, codecpar[i]);
+        stream->codecpar->codec_tag = 0;
+        stream->time_base = timeBase[i];
+        m_outputStream[i] = stream;
+    }
+
+    unsigned char *buffer = (unsigned char *)av_malloc(bufferSize);
+    m_output->pb = avio_alloc_context(buffer, bufferSize, 1, opaque, 0, write, seek);
+    m_output->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    m_startTime = AV_NOPTS_VALUE;
+
+    int ret = avformat_write_header(m_output, options);
+    if (ret < 0)
+    {
+        qDebug() << "RtspStreamRemuxer: cannot write" << formatName << "header:" << ret;
+        close();
+        return false;
+    }
+
+    m_headerWritten = true;
+    return true;
+}
+
+void RtspStreamRemuxer::close()
+{
+    if (!m_output)
+        return;
+
+    if (m_headerWritten)
+        av_write_trailer(m_output);
+    m_headerWritten = false;
+
+    if (m_output->pb)
+    {
+        avio_flush(m_output->pb);
+        av_freep(&m_output->pb->buffer);
+        avio_context_free(&m_output->pb);
+    }
+
+    avformat_free_context(m_output);
+    m_output = 0;
+
+    for (int i = 0; i < StreamCount; ++i)
+        m_outputStream[i] = 0;
+}
+
+bool RtspStreamRemuxer::write(AVPacket *packet)
+{
+    Q_ASSERT(packet->stream_index >= 0 && packet->stream_index < StreamCount);
+
+    int stream = packet->stream_index;
+    AVStream *outputStream = m_outputStream[stream];
+    if (!m_output || !outputStream)
+        return false;
+
+    if (packet->dts == (int64_t)AV_NOPTS_VALUE)
+        packet->dts = packet->pts;
+    if (packet->dts == (int64_t)AV_NOPTS_VALUE)
+        return false;
+
+    /* m_startTime is in microseconds so that it applies to both streams */
+    if (m_startTime == (qint64)AV_NOPTS_VALUE)
+        m_startTime = av_rescale_q(packet->dts, m_timeBase[stream], AV_TIME_BASE_Q);
+
+    int64_t offset = av_rescale_q(m_startTime, AV_TIME_BASE_Q, m_timeBase[stream]);
+    packet->dts -= offset;
+    if (packet->pts != (int64_t)AV_NOPTS_VALUE)
+        packet->pts -= offset;
+
+    av_packet_rescale_ts(packet, m_timeBase[stream], outputStream->time_base);
+
+    /* Muxers reject timestamps going backwards, which happens across reconnections */
+    if (m_lastDts[stream] != (qint64)AV_NOPTS_VALUE && packet->dts <= m_lastDts[stream])
+    {
+        packet->dts = m_lastDts[stream] + 1;
+        if (packet->pts != (int64_t)AV_NOPTS_VALUE && packet->pts < packet->dts)
+            packet->pts = packet->dts;
+    }
+    m_lastDts[stream] = packet->dts;
+
+    packet->stream_index = outputStream->index;
+    packet->pos = -1;
+
+    int ret = av_interleaved_write_frame(m_output, packet);
+    if (ret < 0)
+    {
+        qDebug() << "RtspStreamRemuxer: writing packet failed:" << ret;
+        return false;
+    }
+
+    return true;
+}
+
+void RtspStreamRemuxer::flush()
+{
+    if (m_output && m_output->pb)
+        avio_flush(m_output->pb);
+}
+
+bool RtspStreamRemuxer::sameParameters(const AVCodecParameters *a, const AVCodecParameters *b)
+{
+    if (!a || !b)
+        return a == b;
+
+    if (a->codec_type != b->codec_type || a->codec_id != b->codec_id || a->width != b->width
+            || a->height != b->height || a->sample_rate != b->sample_rate
+            || a->extradata_size != b->extradata_size)
+        return false;
+
+    return !a->extradata_size || !memcmp(a->extradata, b->extradata, a->extradata_size);
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RTSP_STREAM_REMUXER_H
+#define RTSP_STREAM_REMUXER_H
+
+#include <QtGlobal>
+
+extern "C" {
+#   include "libavutil/rational.h"
+}
+
+struct AVCodecParameters;
+struct AVDictionary;
+struct AVFormatContext;
+struct AVPacket;
+struct AVStream;
+
+/* Writes a live video stream, and optionally its audio, into a container without
+ * decoding. Output goes through caller-supplied I/O callbacks.
+ *
+ * Packets are given with stream_index VideoStream or AudioStream, and timestamps in the
+ * time base passed to open(). Timestamps are moved so the output starts at zero and kept
+ * increasing across reconnections. */
+
+class RtspStreamRemuxer
+{
+    Q_DISABLE_COPY(RtspStreamRemuxer)
+
+public:
+    enum
+    {
+        VideoStream = 0,
+        AudioStream = 1,
+        StreamCount = 2
+    };
+
+    typedef int (*WriteCallback)(void *opaque, uint8_t *buf, int size);
+    typedef int64_t (*SeekCallback)(void *opaque, int64_t offset, int whence);
+
+    RtspStreamRemuxer();
+    ~RtspStreamRemuxer();
+
+    /* codecpar[AudioStream] may be null; audio the container can't carry is left out */
+    bool open(const char *formatName, AVCodecParameters * const codecpar[StreamCount],
+              const AVRational timeBase[StreamCount], AVDictionary **options,
+              void *opaque, WriteCallback write, SeekCallback seek, int bufferSize);
+    void close();
+    bool isOpen() const { return m_output != 0; }
+
+    bool write(AVPacket *packet);
+    void flush();
+
+    /* True if packets described by a can be written to a stream set up with b */
+    static bool sameParameters(const AVCodecParameters *a, const AVCodecParameters *b);
+
+private:
+    AVFormatContext *m_output;
+    AVStream *m_outputStream[StreamCount];
+    AVRational m_timeBase[StreamCount];
+    bool m_headerWritten;
+    qint64 m_startTime;
+    qint64 m_lastDts[StreamCount];
+};
+
+#endif // RTSP_STREAM_REMUXER_H
@@ -41,7 +41,7 @@ void RtspStreamThread::clearWorker()
     m_worker.clear();
 }
 
-void RtspStreamThread::start(const QUrl &url, bool hwaccelerated)
+void RtspStreamThread::start(const QUrl &url, bool hwaccelerated, const QSharedPointer<RtspPacketRing> &packetRing)
 {
     QMutexLocker locker(&m_workerMutex);
 
@@ -58,6 +58,7 @@ void RtspStreamThread::start(const QUrl &url, bool hwaccelerated)
         worker->moveToThread(m_thread.data());
 
         m_worker.data()->setUrl(url);
+        m_worker.data()->setPacketRing(packetRing);
 
         connect(m_thread.data(), SIGNAL(started()), m_worker.data(), SLOT(run()));
         connect(m_thread.data(), SIGNAL(finished()), m_thread.data(), SLOT(deleteLater()));
@@ -66,7 +67,7 @@ void RtspStreamThread::start(const QUrl &url, bool hwaccelerated)
         connect(m_worker.data(), SIGNAL(destroyed()), this, SLOT(clearWorker()), Qt::DirectConnection);
         connect(m_worker.data(), SIGNAL(destroyed()), m_thread.data(), SLOT(quit()));
         connect(m_worker.data(), SIGNAL(audioFormat(enum AVSampleFormat, int, int)), this, SIGNAL(audioFormat(enum AVSampleFormat,int,int)), Qt::DirectConnection);
-        connect(m_worker.data(), SIGNAL(audioSamplesAvailable(void *, int, int)), this, SIGNAL(audioSamplesAvailable(void*,int,int)), Qt::DirectConnection);
+        connect(m_worker.data(), SIGNAL(audioFrameAvailable(AVFrame*,qint64)), this, SIGNAL(audioFrameAvailable(AVFrame*,qint64)), Qt::DirectConnection);
 
         connect(m_worker.data(), SIGNAL(bytesDownloaded(uint)), bcApp->globalRate, SLOT(addSampleValue(uint)));
 
@@ -94,6 +95,30 @@ void RtspStreamThread::setFrameSizeHint(int width, int height)
         m_worker.data()->setFrameSizeHint(width, height);
 }
 
+void RtspStreamThread::setCropRect(const QRectF &rect)
+{
+    QMutexLocker locker(&m_workerMutex);
+
+    if (hasWorker())
+        m_worker.data()->setCropRect(rect);
+}
+
+void RtspStreamThread::setFisheyeView(const FisheyeView &view)
+{
+    QMutexLocker locker(&m_workerMutex);
+
+    if (hasWorker())
+        m_worker.data()->setFisheyeView(view);
+}
+
+void RtspStreamThread::setSinks(const QList<QSharedPointer<RtspPacketSink> > &sinks)
+{
+    QMutexLocker locker(&m_workerMutex);
+
+    if (hasWorker())
+        m_worker.data()->setSinks(sinks);
+}
+
 void RtspStreamThread::stop()
 {
     QMutexLocker locker(&m_workerMutex);
@@ -140,12 +165,26 @@ void RtspStreamThread::setAutoDeinterlacing(bool autoDeinterlacing)
         m_worker.data()->setAutoDeinterlacing(autoDeinterlacing);
 }
 
-RtspStreamFrame * RtspStreamThread::frameToDisplay()
+void RtspStreamThread::setMotionDetection(bool enabled)
 {
     QMutexLocker locker(&m_workerMutex);
 
+    if (hasWorker())
+        m_worker.data()->setMotionDetection(enabled);
+}
+
+/* Called for every rendered frame, so it doesn't take m_workerMutex: m_frameQueue is only
+ * replaced by start() and stop(), on the thread that also calls this, and the queue itself
+ * is lock-free. */
+RtspStreamFrame * RtspStreamThread::frameToDisplay()
+{
     if (m_frameQueue)
         return m_frameQueue->dequeue();
     else
         return 0;
 }
+
+int RtspStreamThread::droppedFrames() const
+{
+    return m_frameQueue ? m_frameQueue->droppedFrames() : 0;
+}
@@ -18,15 +18,20 @@
 #ifndef RTSP_STREAM_THREAD_H
 #define RTSP_STREAM_THREAD_H
 
+#include <QList>
 #include <QMutex>
 #include <QObject>
 #include <QWeakPointer>
 #include <QSharedPointer>
 #include "audio/AudioPlayer.h"
 
+class RtspPacketRing;
+class RtspPacketSink;
 class RtspStreamFrame;
 class RtspStreamWorker;
 class RtspStreamFrameQueue;
+class FisheyeView;
+class QRectF;
 class QThread;
 class QUrl;
 
@@ -38,7 +43,8 @@ public:
     explicit RtspStreamThread(QObject *parent = 0);
     virtual ~RtspStreamThread();
 
-    void start(const QUrl &url, bool hwaccelerated);
+    void start(const QUrl &url, bool hwaccelerated,
+               const QSharedPointer<RtspPacketRing> &packetRing = QSharedPointer<RtspPacketRing>());
     void stop();
     void setPaused(bool paused);
 
@@ -47,14 +53,19 @@ public:
     void enableAudio(bool enabled);
 
     void setAutoDeinterlacing(bool autoDeinterlacing);
+    void setMotionDetection(bool enabled);
     RtspStreamFrame * frameToDisplay();
+    int droppedFrames() const;
     void setFrameSizeHint(int width, int height);
+    void setCropRect(const QRectF &rect);
+    void setFisheyeView(const FisheyeView &view);
+    void setSinks(const QList<QSharedPointer<RtspPacketSink> > &sinks);
 
 signals:
     void fatalError(const QString &error);
     void finished();
     void audioFormat(enum AVSampleFormat fmt, int channelsNum, int sampleRate);
-    void audioSamplesAvailable(void *data, int samplesNum, int bytesNum);
+    void audioFrameAvailable(struct AVFrame *frame, qint64 pts);
     void hwAccelDisabled();
 
 private:
@@ -16,12 +16,17 @@
  */
 
 #include "RtspStreamWorker.h"
+#include "RtspDecodeEffort.h"
+#include "RtspMotionDetector.h"
+#include "RtspPacketRing.h"
+#include "RtspPacketSink.h"
 #include "RtspStreamFrame.h"
 #include "RtspStreamFrameFormatter.h"
 #include "RtspStreamFrameQueue.h"
 #include "core/BluecherryApp.h"
 #include <QDebug>
 #include <QCoreApplication>
+#include <QDateTime>
 #include <QThread>
 #include "core/VaapiHWAccel.h"
 extern "C"
@@ -49,11 +54,13 @@ RtspStreamWorker::RtspStreamWorker(QSharedPointer<RtspStreamFrameQueue> &shared_
       m_videoStreamIndex(-1), m_audioStreamIndex(-1),
       m_audioEnabled(false),
       m_hwaccelEnabled(hwaccelerated),
-      m_frameWidthHint(-1), m_frameHeightHint(-1),
-      m_cancelFlag(false), m_autoDeinterlacing(true),
-      m_frameQueue(new RtspStreamFrameQueue(6))
+      m_frameWidthHint(-1), m_frameHeightHint(-1), m_packetReceiveTime(-1), m_deadline(0),
+      m_decodeEffort(RtspDecodeEffort::FullEffort),
+      m_cancelFlag(false), m_autoDeinterlacing(true), m_motionDetection(false),
+      m_frameQueue(new RtspStreamFrameQueue(RtspStreamFrameQueue::LatestFrame))
 {
     shared_queue = m_frameQueue;
+    m_clock.start();
 }
 
 RtspStreamWorker::~RtspStreamWorker()
@@ -85,12 +92,18 @@ void RtspStreamWorker::setAutoDeinterlacing(bool autoDeinterlacing)
         m_frameFormatter->setAutoDeinterlacing(autoDeinterlacing);
 }
 
+void RtspStreamWorker::setMotionDetection(bool enabled)
+{
+    m_motionDetection = enabled;
+}
+
 bool RtspStreamWorker::shouldInterrupt() const
 {
     if (m_cancelFlag)
         return true;
 
-    if (m_timeout < QDateTime::currentDateTime())
+    /* FFmpeg calls this constantly while blocked; a monotonic clock read is cheap */
+    if (m_clock.elapsed() > m_deadline)
         return true;
 
     return false;
@@ -142,7 +155,10 @@ AVPacket RtspStreamWorker::readPacket(bool *ok)
     startInterruptableOperation(30);
     int re = av_read_frame(m_ctx, &packet);
     if (0 == re)
+    {
+        m_packetReceiveTime = QDateTime::currentMSecsSinceEpoch();
         return packet;
+    }
 
     emit fatalError(QString::fromLatin1("Reading error: %1").arg(errorMessageFromCode(re)));
     av_packet_unref(&packet);
@@ -156,6 +172,14 @@ bool RtspStreamWorker::processPacket(struct AVPacket packet)
 {
     emit bytesDownloaded(packet.size);
 
+    if (m_packetRing && packet.stream_index == m_videoStreamIndex)
+        m_packetRing->append(this, &packet);
+
+    if (m_sinksChanged.loadAcquire())
+        updateSinks();
+    foreach (const QSharedPointer<RtspPacketSink> &sink, m_sinks)
+        sink->append(this, &packet);
+
     while (packet.size > 0)
     {
         if (packet.stream_index == m_audioStreamIndex)
@@ -165,20 +189,15 @@ bool RtspStreamWorker::processPacket(struct AVPacket packet)
 
             AVFrame *frame = extractAudioFrame(packet);
 
+            /* The receiver converts the samples before returning; m_frame is reused */
             if (frame)
-            {
-                //feed samples to audio player
-                int bytesNum = 0;
-
-                //bytesNum is set to linesize because only first plane is played in case of planar sample format
-                av_samples_get_buffer_size(&bytesNum, frame->channels, frame->nb_samples, (enum AVSampleFormat)frame->format, 0);
-
-                emit audioSamplesAvailable(frame->data[0], frame->nb_samples, bytesNum);
-            }
+                emit audioFrameAvailable(frame, framePts(frame, m_audioStreamIndex));
         }
 
         if (packet.stream_index == m_videoStreamIndex)
         {
+            updateDecodeEffort(packet);
+            rememberReceiveTime(packet);
             AVFrame *frame = extractVideoFrame(packet);
 
             if (frame)
@@ -274,7 +293,91 @@ void RtspStreamWorker::processVideoFrame(struct AVFrame *rawFrame)
 {
     Q_ASSERT(m_frameFormatter);
     startInterruptableOperation(5);
-    m_frameQueue->enqueue(m_frameFormatter->formatFrame(rawFrame, m_frameWidthHint, m_frameHeightHint));
+
+    qint64 decodeTime = QDateTime::currentMSecsSinceEpoch();
+
+    /* Runs on the decoded luma plane, before any conversion, and on the whole picture
+     * whatever the tile shows. The detector is only ever used from this thread. */
+    QBitArray motion;
+    if (m_motionDetection)
+    {
+        if (!m_motionDetector)
+            m_motionDetector.reset(new RtspMotionDetector);
+        motion = m_motionDetector->process(rawFrame);
+    }
+    else
+        m_motionDetector.reset();
+
+    {
+        QMutexLocker locker(&m_viewLock);
+        m_frameFormatter->setFisheyeView(m_fisheyeView);
+    }
+    RtspStreamFrame *frame = m_frameFormatter->formatFrame(rawFrame, m_frameWidthHint, m_frameHeightHint, cropRect());
+    if (!frame)
+        return;
+
+    frame->setMotion(motion);
+
+    qint64 pts = framePts(rawFrame, m_videoStreamIndex);
+
+    frame->setPts(pts);
+    frame->setTimes(captureTime(pts), takeReceiveTime(rawFrame), decodeTime, QDateTime::currentMSecsSinceEpoch());
+    m_frameQueue->enqueue(frame);
+}
+
+void RtspStreamWorker::rememberReceiveTime(const AVPacket &packet)
+{
+    if (packet.pts == (int64_t)AV_NOPTS_VALUE)
+        return;
+
+    m_receiveTimes.insert(packet.pts, m_packetReceiveTime);
+
+    /* Packets the decoder drops never come out as frames; keep only a few reorder
+     * delays' worth */
+    while (m_receiveTimes.size() > 32)
+        m_receiveTimes.erase(m_receiveTimes.begin());
+}
+
+qint64 RtspStreamWorker::takeReceiveTime(const AVFrame *frame)
+{
+    /* Without timestamps the frame is taken to come from the packet just read */
+    QMap<qint64, qint64>::Iterator it = m_receiveTimes.find(frame->pts);
+    if (frame->pts == (int64_t)AV_NOPTS_VALUE || it == m_receiveTimes.end())
+        return m_packetReceiveTime;
+
+    qint64 receiveTime = *it;
+
+    /* Frames come out in presentation order, so earlier entries will not be matched */
+    while (m_receiveTimes.begin() != it)
+        m_receiveTimes.erase(m_receiveTimes.begin());
+    m_receiveTimes.erase(it);
+
+    return receiveTime;
+}
+
+qint64 RtspStreamWorker::framePts(AVFrame *frame, int streamIndex) const
+{
+    int64_t pts = frame->best_effort_timestamp;
+    if (pts == (int64_t)AV_NOPTS_VALUE)
+        pts = frame->pts;
+    if (pts == (int64_t)AV_NOPTS_VALUE)
+        return AV_NOPTS_VALUE;
+
+    return av_rescale_q(pts, m_ctx->streams[streamIndex]->time_base, AV_TIME_BASE_Q);
+}
+
+qint64 RtspStreamWorker::captureTime(qint64 pts) const
+{
+    /* The RTSP demuxer sets start_time_realtime from the first RTCP sender report: it is
+     * the wall-clock time of pts 0, and later timestamps follow the sender report mapping.
+     * Until a report arrives the capture time is unknown. */
+    if (m_ctx->start_time_realtime == (int64_t)AV_NOPTS_VALUE || m_ctx->start_time_realtime <= 0)
+        return -1;
+
+    if (pts == (qint64)AV_NOPTS_VALUE)
+        return -1;
+
+    return (m_ctx->start_time_realtime + pts) / 1000;
 }
 
 QString RtspStreamWorker::errorMessageFromCode(int errorCode)
@@ -298,9 +401,13 @@ bool RtspStreamWorker::setup()
 
     if (prepared)
     {
-        m_frameFormatter.reset(new RtspStreamFrameFormatter(m_ctx->streams[m_videoStreamIndex]));
+        m_frameFormatter.reset(new RtspStreamFrameFormatter(m_ctx->streams[m_videoStreamIndex]->codecpar));
         m_frameFormatter->setAutoDeinterlacing(m_autoDeinterlacing);
         m_frame = av_frame_alloc();
+
+        AVStream *videoStream = m_ctx->streams[m_videoStreamIndex];
+        if (m_packetRing)
+            m_packetRing->setStream(this, videoStream->codecpar, videoStream->time_base);
     }
     else if (m_ctx)
     {
@@ -502,17 +609,105 @@ bool RtspStreamWorker::openCodec(AVStream *stream, AVCodecContext *avctx, AVDict
     return 0 == errorCode;
 }
 
+/* Follows the size the stream is displayed at; see RtspDecodeEffort */
+void RtspStreamWorker::updateDecodeEffort(const AVPacket &packet)
+{
+    /* Hardware decoders ignore these settings */
+    if (m_hwaccelEnabled)
+        return;
+
+    const AVCodecParameters *codecpar = m_ctx->streams[m_videoStreamIndex]->codecpar;
+    int width = m_frameWidthHint;
+    int height = m_frameHeightHint;
+
+    /* When zoomed in, only the cropped part is scaled down to the tile */
+    QRectF crop = cropRect();
+    int codedWidth = crop.isEmpty() ? codecpar->width : qRound(codecpar->width * qMin(crop.width(), 1.0));
+    int codedHeight = crop.isEmpty() ? codecpar->height : qRound(codecpar->height * qMin(crop.height(), 1.0));
+
+    /* Dewarped views magnify small parts of the fisheye circle, so the tile size says
+     * nothing about the detail they sample; they always get the full picture */
+    bool dewarping;
+    {
+        QMutexLocker locker(&m_viewLock);
+        dewarping = m_fisheyeView.isEnabled();
+    }
+
+    RtspDecodeEffort::Level level = dewarping ? RtspDecodeEffort::FullEffort
+            : RtspDecodeEffort::level(codedWidth, codedHeight, width, height, m_decodeEffort);
+    if (level != m_decodeEffort)
+    {
+        qDebug() << "RtspStreamWorker: decoding with" << RtspDecodeEffort::name(level) << "effort for"
+                 << width << "x" << height;
+        m_decodeEffort = level;
+        RtspDecodeEffort::apply(m_videoCodecCtx, level);
+    }
+
+    /* A different lowres needs a new decoder, which has to start on a keyframe */
+    if (!(packet.flags & AV_PKT_FLAG_KEY))
+        return;
+
+    int lowres = dewarping ? 0 : RtspDecodeEffort::lowres(m_videoCodecCtx->codec, codedWidth, codedHeight, width, height,
+                                                          m_videoCodecCtx->lowres);
+    if (lowres != m_videoCodecCtx->lowres)
+        reopenVideoCodec(lowres);
+}
+
+bool RtspStreamWorker::reopenVideoCodec(int lowres)
+{
+    AVCodecContext *avctx = avcodec_alloc_context3(NULL);
+    if (!avctx)
+        return false;
+
+    avctx->lowres = lowres;
+
+    AVDictionary *options = createOptions();
+    bool codecOpened = openCodec(m_ctx->streams[m_videoStreamIndex], avctx, options);
+    av_dict_free(&options);
+
+    if (!codecOpened)
+    {
+        qDebug() << "RtspStreamWorker: cannot reopen video decoder with lowres" << lowres;
+        avcodec_free_context(&avctx);
+        return false;
+    }
+
+    avcodec_free_context(&m_videoCodecCtx);
+    m_videoCodecCtx = avctx;
+    RtspDecodeEffort::apply(m_videoCodecCtx, m_decodeEffort);
+    return true;
+}
+
 void RtspStreamWorker::startInterruptableOperation(int timeoutInSeconds)
 {
-    m_timeout = QDateTime::currentDateTime().addSecs(timeoutInSeconds);
+    m_deadline = m_clock.elapsed() + qint64(timeoutInSeconds) * 1000;
 }
 
-RtspStreamFrame * RtspStreamWorker::frameToDisplay()
+void RtspStreamWorker::setSinks(const QList<QSharedPointer<RtspPacketSink> > &sinks)
 {
-    if (m_cancelFlag || !m_frameQueue)
-        return 0;
+    QMutexLocker locker(&m_sinksLock);
+    m_newSinks = sinks;
+    m_sinksChanged.storeRelease(1);
+}
+
+void RtspStreamWorker::updateSinks()
+{
+    ASSERT_WORKER_THREAD();
+
+    QList<QSharedPointer<RtspPacketSink> > previous = m_sinks;
+
+    {
+        QMutexLocker locker(&m_sinksLock);
+        m_sinks = m_newSinks;
+        m_sinksChanged.storeRelease(0);
+    }
 
-    return m_frameQueue.data()->dequeue();
+    /* Only sinks new to this worker need the streams described */
+    foreach (const QSharedPointer<RtspPacketSink> &sink, m_sinks)
+    {
+        if (!previous.contains(sink))
+            sink->setStreams(this, m_ctx, m_videoStreamIndex, m_audioStreamIndex);
+    }
 }
 
 void RtspStreamWorker::setFrameSizeHint(int width, int height)
@@ -521,6 +716,24 @@ void RtspStreamWorker::setFrameSizeHint(int width, int height)
     m_frameHeightHint = height;
 }
 
+void RtspStreamWorker::setCropRect(const QRectF &rect)
+{
+    QMutexLocker locker(&m_viewLock);
+    m_cropRect = rect;
+}
+
+QRectF RtspStreamWorker::cropRect()
+{
+    QMutexLocker locker(&m_viewLock);
+    return m_cropRect;
+}
+
+void RtspStreamWorker::setFisheyeView(const FisheyeView &view)
+{
+    QMutexLocker locker(&m_viewLock);
+    m_fisheyeView = view;
+}
+
 void RtspStreamWorker::stop()
 {
     m_cancelFlag = true;
@@ -18,9 +18,16 @@
 #ifndef RTSPSTREAMWORKER_H
 #define RTSPSTREAMWORKER_H
 
+#include "RtspDecodeEffort.h"
+#include "core/FisheyeView.h"
 #include "core/ThreadPause.h"
-#include <QDateTime>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
 #include <QObject>
+#include <QRectF>
+#include <QMap>
 #include <QUrl>
 #include <QSharedPointer>
 #include "audio/AudioPlayer.h"
@@ -29,6 +36,9 @@ struct AVDictionary;
 struct AVFrame;
 struct AVStream;
 
+class RtspMotionDetector;
+class RtspPacketRing;
+class RtspPacketSink;
 class RtspStreamFrame;
 class RtspStreamFrameFormatter;
 class RtspStreamFrameQueue;
@@ -46,12 +56,19 @@ public:
     void stop();
     void setPaused(bool paused);
     void setAutoDeinterlacing(bool autoDeinterlacing);
+    void setMotionDetection(bool enabled);
 
     bool shouldInterrupt() const;
-    RtspStreamFrame * frameToDisplay();
 
     void enableAudio(bool enabled) { m_audioEnabled = enabled; }
     void setFrameSizeHint(int width, int height);
+    /* Thread-safe; part of the frame to convert, see RtspStreamFrameFormatter */
+    void setCropRect(const QRectF &rect);
+    /* Thread-safe */
+    void setFisheyeView(const FisheyeView &view);
+    void setPacketRing(const QSharedPointer<RtspPacketRing> &packetRing) { m_packetRing = packetRing; }
+    /* Thread-safe; the worker picks the sinks up with the next packet */
+    void setSinks(const QList<QSharedPointer<RtspPacketSink> > &sinks);
 
 public slots:
     void run();
@@ -61,7 +78,7 @@ signals:
     void finished();
     void bytesDownloaded(unsigned int bytes);
     void audioFormat(enum AVSampleFormat fmt, int channelsNum, int sampleRate);
-    void audioSamplesAvailable(void *data, int samplesNum, int bytesNum);
+    void audioFrameAvailable(struct AVFrame *frame, qint64 pts);
     void hwAccelDisabled();
 
 private:
@@ -69,10 +86,10 @@ private:
     struct AVCodecContext *m_videoCodecCtx;
     struct AVCodecContext *m_audioCodecCtx;
     struct AVFrame *m_frame;
-    QDateTime m_timeout;
     QUrl m_url;
     bool m_cancelFlag;
     bool m_autoDeinterlacing;
+    bool m_motionDetection;
     mutable bool m_lastCancel;
     mutable int m_lastSeconds;
     int m_decodeErrorsCnt;
@@ -82,10 +99,28 @@ private:
     bool m_hwaccelEnabled;
     int m_frameWidthHint;
     int m_frameHeightHint;
+    QRectF m_cropRect;
+    FisheyeView m_fisheyeView;
+    /* Protects m_cropRect and m_fisheyeView */
+    QMutex m_viewLock;
+    qint64 m_packetReceiveTime;
+    /* Receive times of video packets sent to the decoder, by packet pts, so that frames
+     * put out after reordering are matched with the packet they came from */
+    QMap<qint64, qint64> m_receiveTimes;
+    /* Interrupt deadline of the current operation, on m_clock */
+    QElapsedTimer m_clock;
+    qint64 m_deadline;
+    RtspDecodeEffort::Level m_decodeEffort;
 
     ThreadPause m_threadPause;
     QScopedPointer<RtspStreamFrameFormatter> m_frameFormatter;
+    QScopedPointer<RtspMotionDetector> m_motionDetector;
     QSharedPointer<RtspStreamFrameQueue> m_frameQueue;
+    QSharedPointer<RtspPacketRing> m_packetRing;
+    QList<QSharedPointer<RtspPacketSink> > m_sinks;
+    QList<QSharedPointer<RtspPacketSink> > m_newSinks;
+    QMutex m_sinksLock;
+    QAtomicInt m_sinksChanged;
 
 
     bool setup();
@@ -107,6 +142,14 @@ private:
     AVFrame * extractVideoFrame(struct AVPacket &packet);
     AVFrame * extractAudioFrame(struct AVPacket &packet);
     void processVideoFrame(struct AVFrame *frame);
+    void rememberReceiveTime(const struct AVPacket &packet);
+    qint64 takeReceiveTime(const struct AVFrame *frame);
+    void updateSinks();
+    QRectF cropRect();
+    void updateDecodeEffort(const struct AVPacket &packet);
+    bool reopenVideoCodec(int lowres);
+    qint64 framePts(struct AVFrame *frame, int streamIndex) const;
+    qint64 captureTime(qint64 pts) const;
 
     QString errorMessageFromCode(int errorCode);
     void startInterruptableOperation(int timeoutInSeconds);
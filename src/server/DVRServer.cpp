@@ -53,6 +53,7 @@ DVRServer::DVRServer(int id, QObject *parent)
     connect(m_api, SIGNAL(loginError(QString)), this, SIGNAL(loginError(QString)));
     connect(m_api, SIGNAL(statusChanged(int)), this, SIGNAL(statusChanged(int)));
     connect(m_api, SIGNAL(onlineChanged(bool)), this, SIGNAL(onlineChanged(bool)));
+    connect(m_api, SIGNAL(substreamSwitched(int,bool)), this, SIGNAL(substreamSwitched(int,bool)));
 
     connect(&m_refreshTimer, SIGNAL(timeout()), SLOT(updateCameras()));
 }
@@ -103,6 +103,7 @@ signals:
     void disconnected(DVRServer *server);
     void statusChanged(int status);
     void onlineChanged(bool online);
+    void substreamSwitched(int deviceId, bool substreamEnabled);
 
 private slots:
     void updateCamerasReply();
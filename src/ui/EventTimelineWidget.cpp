@@ -20,15 +20,20 @@
 #include "model/EventsModel.h"
 #include "TimeRangeScrollBar.h"
 #include "core/EventData.h"
+#include "event/EventDensityPyramid.h"
+#include "event/EventIntervalIndex.h"
+#include "event/EventStore.h"
 #include "server/DVRServer.h"
 #include "server/DVRServerConfiguration.h"
 #include <QPaintEvent>
 #include <QPainter>
+#include <QPixmap>
 #include <QVector>
 #include <QScrollBar>
 #include <QFontMetrics>
 #include <QDebug>
 #include <qmath.h>
+#include <algorithm>
 
 struct RowData
 {
@@ -58,13 +63,102 @@ struct ServerData : public RowData
 struct LocationData : public RowData
 {
     ServerData *serverData;
-    QList<EventData*> events;
+    EventIntervalIndex events;
+    EventDensityPyramid density;
+    /* Rendered row, by tile; see EventTimelineWidget::updateTiles */
+    QHash<int,QPixmap> tiles;
+    /* Time spans changed since the tiles were last checked */
+    QList<QPair<qint64,qint64> > dirtySpans;
     int locationId;
 
     LocationData() : RowData(Location)
     {
     }
 
+    void markDirty(qint64 from, qint64 to)
+    {
+        if (from == EventStore::NoTime)
+            return;
+
+        /* Many scattered changes are merged into one span */
+        if (dirtySpans.size() >= 32)
+        {
+            for (int i = 0; i < dirtySpans.size(); ++i)
+            {
+                from = qMin(from, dirtySpans[i].first);
+                to = qMax(to, dirtySpans[i].second);
+            }
+            dirtySpans.clear();
+        }
+
+        dirtySpans.append(qMakePair(from, to));
+    }
+
+    void insertEvent(const EventRef &event)
+    {
+        events.insert(event);
+        density.insert(event.startTime(), event.endTime(), event.level());
+        markDirty(event.startTime(), event.endTime());
+    }
+
+    void insertEvents(const QVector<EventRef> &newEvents)
+    {
+        events.insert(newEvents);
+        foreach (const EventRef &event, newEvents)
+        {
+            density.insert(event.startTime(), event.endTime(), event.level());
+            markDirty(event.startTime(), event.endTime());
+        }
+    }
+
+    bool removeEvent(const EventRef &event)
+    {
+        int i = events.indexOf(event);
+        if (i < 0)
+            return false;
+
+        /* The event may have changed already, so remove what was counted */
+        density.remove(events.startTime(i), events.endTime(i), events.level(i));
+        markDirty(events.startTime(i), events.endTime(i));
+        events.removeAt(i);
+        return true;
+    }
+
+    /* Compacts the index once for all of the events */
+    int removeEvents(const QVector<EventRef> &removed)
+    {
+        QVector<int> positions;
+        positions.reserve(removed.size());
+        foreach (const EventRef &event, removed)
+        {
+            int i = events.indexOf(event);
+            if (i < 0)
+                continue;
+
+            density.remove(events.startTime(i), events.endTime(i), events.level(i));
+            markDirty(events.startTime(i), events.endTime(i));
+            positions.append(i);
+        }
+
+        events.removeAt(positions);
+        return positions.size();
+    }
+
+    /* Counts all events again, after density levels were added */
+    void refillDensity()
+    {
+        for (int i = 0; i < events.size(); ++i)
+            density.insert(events.startTime(i), events.endTime(i), events.level(i));
+    }
+
+    bool updateEvent(const EventRef &event)
+    {
+        if (!removeEvent(event))
+            return false;
+        insertEvent(event);
+        return true;
+    }
+
     QString uiLocation() const
     {
         return EventData::uiLocation(serverData->server, locationId);
@@ -82,8 +176,9 @@ inline ServerData *RowData::toServer()
 }
 
 EventTimelineWidget::EventTimelineWidget(QWidget *parent)
-    : QAbstractItemView(parent), cachedTopPadding(0),
-      cachedLeftPadding(-1), rowsMapUpdateStart(-1), mouseRubberBand(0)
+    : QAbstractItemView(parent), rowsMapUpdateStart(-1), cachedTopPadding(0),
+      cachedLeftPadding(-1), mouseRubberBand(0), tilePixelsPerMSec(0), tileOriginMSecs(0),
+      tileRowHeight(0)
 {
     setAutoFillBackground(false);
 
@@ -109,7 +204,9 @@ void EventTimelineWidget::clearData()
     }
 
     serversMap.clear();
-    rowsMap.clear();
+    rowEvents.clear();
+    slotRows.clear();
+    rowsMapUpdateStart = -1;
     visibleTimeRange.clear();
 
     clearLeftPaddingCache();
@@ -135,6 +232,7 @@ void EventTimelineWidget::setModel(QAbstractItemModel *newModel)
     }
 
     connect(newModel, SIGNAL(rowsRemoved(QModelIndex,int,int)), SLOT(rowsRemoved(QModelIndex,int,int)));
+    connect(newModel, SIGNAL(layoutChanged()), SLOT(modelLayoutChanged()));
     /* setModel calls reset(), which will set up the new internal state */
     QAbstractItemView::setModel(newModel);
 }
@@ -144,19 +242,19 @@ QRect EventTimelineWidget::visualRect(const QModelIndex &index) const
     if (!index.isValid())
         return QRect();
 
-    EventData *event = rowData(index.row());
-    if (!event)
+    EventRef event = rowData(index.row());
+    if (!event.isValid())
         return QRect();
 
     ServerData *serverData;
     LocationData *locationData;
-    if (!const_cast<EventTimelineWidget*>(this)->findEvent(event, false, &serverData, &locationData, 0))
+    if (!const_cast<EventTimelineWidget*>(this)->findEvent(event, false, &serverData, &locationData))
         return QRect();
 
     const_cast<EventTimelineWidget*>(this)->ensureLayout();
     QRect itemArea = viewportItemArea();
 
-    QRect re = timeCellRect(event->localStartDate(), event->durationInSeconds());
+    QRect re = timeCellRect(event.localStartDate(), event.durationInSeconds());
     re.translate(itemArea.topLeft());
     re.moveTop(itemArea.top() + locationData->y - verticalScrollBar()->value());
     re.setHeight(rowHeight());
@@ -192,7 +290,9 @@ void EventTimelineWidget::scrollTo(const QModelIndex &index, ScrollHint hint)
     QRect itemRect = visualRect(index);
     itemRect.moveTop(itemRect.top() - itemArea.top());
 
-    EventData *event = rowData(index.row());
+    EventRef event = rowData(index.row());
+    if (!event.isValid())
+        return;
 
     switch (hint)
     {
@@ -217,7 +317,7 @@ void EventTimelineWidget::scrollTo(const QModelIndex &index, ScrollHint hint)
     }
 
     if (!isEventVisible(event))
-        horizontalScrollBar()->setValue(visibleTimeRange.range().start().secsTo(event->localStartDate()));
+        horizontalScrollBar()->setValue(visibleTimeRange.range().start().secsTo(event.localStartDate()));
 }
 
 bool rowDataLessThan(const RowData *a, const RowData *b)
@@ -240,7 +340,7 @@ QList<RowData *>::const_iterator EventTimelineWidget::findLayoutRow(int y) const
     return it;
 }
 
-EventData *EventTimelineWidget::eventAt(const QPoint &point) const
+EventRef EventTimelineWidget::eventAt(const QPoint &point) const
 {
     const_cast<EventTimelineWidget*>(this)->ensureLayout();
 
@@ -248,34 +348,51 @@ EventData *EventTimelineWidget::eventAt(const QPoint &point) const
     int ry = (point.y() - itemArea.top()) + verticalScrollBar()->value();
 
     if (!itemArea.contains(point) || ry >= layoutRowsBottom || layoutRows.isEmpty())
-        return 0;
+        return EventRef();
 
     QList<RowData *>::ConstIterator it = findLayoutRow(ry);
 
     if ((*it)->type != RowData::Location)
-        return 0;
+        return EventRef();
 
     LocationData *location = (*it)->toLocation();
 
-    /* This is slow and can likely be improved. */
-    for (QList<EventData*>::ConstIterator evit = location->events.begin(); evit != location->events.end(); ++evit)
+    qint64 from, to;
+    columnsTimeSpan(point.x() - itemArea.left(), point.x() - itemArea.left(), &from, &to);
+
+    int first, last;
+    location->events.findOverlapping(from, to, &first, &last);
+    for (int i = first; i < last; ++i)
     {
-        QRect eventRect = timeCellRect((*evit)->localStartDate(), (*evit)->durationInSeconds()).translated(itemArea.left(), 0);
+        EventRef event = location->events.at(i);
+        QRect eventRect = timeCellRect(event.localStartDate(), event.durationInSeconds()).translated(itemArea.left(), 0);
         if (point.x() >= eventRect.left() && point.x() <= eventRect.right())
-            return *evit;
+            return event;
     }
 
-    return 0;
+    return EventRef();
+}
+
+void EventTimelineWidget::columnsTimeSpan(int left, int right, qint64 *from, qint64 *to) const
+{
+    double msecsPerPixel = 1000.0 * qMax(visibleTimeRange.visibleSeconds(), 1) / qMax(viewportItemArea().width(), 1);
+    qint64 visibleStart = visibleTimeRange.visibleRange().start().toMSecsSinceEpoch();
+
+    /* Events starting before the visible range are drawn from its first column */
+    if (left <= 0)
+        *from = EventStore::NoTime + 1;
+    else
+        *from = visibleStart + qint64((left - 1) * msecsPerPixel);
+    *to = visibleStart + qint64((right + 1) * msecsPerPixel) + 1;
 }
 
 QModelIndex EventTimelineWidget::indexAt(const QPoint &point) const
 {
-    EventData *event = eventAt(point);
-    if (!event)
+    EventRef event = eventAt(point);
+    if (!event.isValid())
         return QModelIndex();
 
-    int row = rowsMap[event];
-    return model()->index(row, 0);
+    return model()->index(modelRow(event), 0);
 }
 
 QSize EventTimelineWidget::sizeHint() const
@@ -319,6 +436,9 @@ void EventTimelineWidget::setSelection(const QRect &irect, QItemSelectionModel::
     /* The y coordinate of rect is now in scroll-invariant inner y, the same as layoutRows */
     QList<RowData *>::ConstIterator it = findLayoutRow(rect.y());
 
+    qint64 from, to;
+    columnsTimeSpan(rect.x() - itemArea.left(), rect.right() - itemArea.left(), &from, &to);
+
     for (; it != layoutRows.end() && (*it)->y <= rect.bottom(); ++it)
     {
         if ((*it)->type != RowData::Location)
@@ -326,15 +446,18 @@ void EventTimelineWidget::setSelection(const QRect &irect, QItemSelectionModel::
 
         LocationData *location = (*it)->toLocation();
 
-        for (QList<EventData*>::ConstIterator evit = location->events.begin(); evit != location->events.end(); ++evit)
+        int first, last;
+        location->events.findOverlapping(from, to, &first, &last);
+        for (int i = first; i < last; ++i)
         {
-            QRect eventRect = timeCellRect((*evit)->localStartDate(), (*evit)->durationInSeconds()).translated(itemArea.left(), 0);
+            EventRef event = location->events.at(i);
+            QRect eventRect = timeCellRect(event.localStartDate(), event.durationInSeconds()).translated(itemArea.left(), 0);
             if (eventRect.x() >= rect.x())
             {
                 if (eventRect.x() > rect.right())
                     break;
 
-                int row = rowsMap[*evit];
+                int row = modelRow(event);
                 sel.select(model()->index(row, 0), model()->index(row, model()->columnCount()-1));
             }
         }
@@ -352,31 +475,29 @@ QRegion EventTimelineWidget::visualRegionForSelection(const QItemSelection &sele
     return QRegion();
 }
 
-EventData *EventTimelineWidget::rowData(int row) const
+EventRef EventTimelineWidget::rowData(int row) const
 {
     QModelIndex idx = model()->index(row, 0);
-    return idx.data(EventsModel::EventDataPtr).value<EventData*>();
+    return idx.data(EventsModel::EventRefRole).value<EventRef>();
 }
 
-bool EventTimelineWidget::findEvent(EventData *event, bool create, ServerData **server,
-                                    LocationData **location, int *position)
+bool EventTimelineWidget::findEvent(const EventRef &event, bool create, ServerData **server,
+                                    LocationData **location)
 {
     if (server)
         *server = 0;
     if (location)
         *location = 0;
-    if (position)
-        *position = -1;
 
     /* Find associated server */
-    QHash<DVRServer*,ServerData*>::ConstIterator it = serversMap.find(event->server());
+    QHash<DVRServer*,ServerData*>::ConstIterator it = serversMap.find(event.server());
     if (it == serversMap.end())
     {
         if (!create)
             return false;
 
         ServerData *serverData = new ServerData;
-        serverData->server = event->server();
+        serverData->server = event.server();
         it = serversMap.insert(serverData->server, serverData);
 
         scheduleDelayedItemsLayout(DoRowsLayout);
@@ -388,14 +509,14 @@ bool EventTimelineWidget::findEvent(EventData *event, bool create, ServerData **
         *server = serverData;
 
     /* Find associated location (within the server) */
-    QHash<int,LocationData*>::ConstIterator lit = serverData->locationsMap.find(event->locationId());
+    QHash<int,LocationData*>::ConstIterator lit = serverData->locationsMap.find(event.locationId());
     if (lit == serverData->locationsMap.end())
     {
         if (!create)
             return false;
 
         LocationData *locationData = new LocationData;
-        locationData->locationId = event->locationId();
+        locationData->locationId = event.locationId();
         locationData->serverData = serverData;
         lit = serverData->locationsMap.insert(locationData->locationId, locationData);
 
@@ -407,49 +528,39 @@ bool EventTimelineWidget::findEvent(EventData *event, bool create, ServerData **
     if (location)
         *location = locationData;
 
-    if (position && create)
-    {
-        /* Find the position where this event belongs */
-        int p = 0;
-        for (int n = locationData->events.size(); p < n; ++p)
-        {
-            if (event->localStartDate() < locationData->events[p]->localStartDate())
-                break;
-        }
-        *position = p;
-    }
-    else if (position)
-        *position = locationData->events.indexOf(event);
-
     return true;
 }
 
 QDateTime EventTimelineWidget::earliestDate()
 {
-    QDateTime result;
-
-    for (QHash<EventData *, int>::Iterator it = rowsMap.begin(); it != rowsMap.end(); ++it)
+    qint64 earliest = EventStore::NoTime;
+    foreach (ServerData *serverData, serversMap)
     {
-        QDateTime date = it.key()->localStartDate();
-        if (result.isNull() || date < result)
-            result = date;
+        foreach (LocationData *locationData, serverData->locationsMap)
+        {
+            qint64 time = locationData->events.minStartTime();
+            if (time != EventStore::NoTime && (earliest == EventStore::NoTime || time < earliest))
+                earliest = time;
+        }
     }
 
-    return result;
+    if (earliest == EventStore::NoTime)
+        return QDateTime();
+    return QDateTime::fromMSecsSinceEpoch(earliest);
 }
 
 QDateTime EventTimelineWidget::latestDate()
 {
-    QDateTime result;
-
-    for (QHash<EventData *, int>::Iterator it = rowsMap.begin(); it != rowsMap.end(); ++it)
+    qint64 latest = EventStore::NoTime;
+    foreach (ServerData *serverData, serversMap)
     {
-        QDateTime date = it.key()->localEndDate();
-        if (result.isNull() || date > result)
-            result = date;
+        foreach (LocationData *locationData, serverData->locationsMap)
+            latest = qMax(latest, locationData->events.maxEndTime());
     }
 
-    return result;
+    if (latest == EventStore::NoTime)
+        return QDateTime();
+    return QDateTime::fromMSecsSinceEpoch(latest);
 }
 
 void EventTimelineWidget::updateTimeRange(bool fromData)
@@ -470,23 +581,37 @@ void EventTimelineWidget::updateTimeRange(bool fromData)
 
     updateScrollBars();
     viewport()->update();
-
-    scheduleDelayedItemsLayout(DoUpdateTimeRange);
 }
 
-void EventTimelineWidget::updateRowsMap(int row)
+void EventTimelineWidget::updateRowsMap() const
 {
-    for (int n = model()->rowCount(); row < n; ++row)
+    if (rowsMapUpdateStart < 0)
+        return;
+
+    /* Rows hold events of a single store, so its slots index the map directly */
+    if (!rowEvents.isEmpty() && rowEvents.first().isValid())
     {
-        EventData *data = rowData(row);
-        if (!data)
-            continue;
+        int oldSize = slotRows.size();
+        int slotCount = rowEvents.first().store()->slotCount();
+        if (slotCount > oldSize)
+        {
+            slotRows.resize(slotCount);
+            std::fill(slotRows.begin() + oldSize, slotRows.end(), -1);
+        }
+    }
 
-        rowsMap.insert(data, row);
+    const EventRef *events = rowEvents.constData();
+    int *rows = slotRows.data();
+    for (int row = rowsMapUpdateStart, n = rowEvents.size(); row < n; ++row)
+    {
+        if (events[row].isValid())
+            rows[events[row].slot()] = row;
     }
 
+    rowsMapUpdateStart = -1;
+
 #ifndef QT_NO_DEBUG
-    Q_ASSERT(rowsMap.size() == model()->rowCount());
+    Q_ASSERT(rowEvents.size() == model()->rowCount());
     int count = 0;
     foreach (ServerData *sd, serversMap)
     {
@@ -495,14 +620,22 @@ void EventTimelineWidget::updateRowsMap(int row)
             count += ld->events.size();
         }
     }
-    Q_ASSERT(count == rowsMap.size());
+    Q_ASSERT(count == rowEvents.size());
 #endif
 }
 
-void EventTimelineWidget::updateRowsMapDelayed(int start)
+void EventTimelineWidget::invalidateRowsMap(int start)
 {
     rowsMapUpdateStart = (rowsMapUpdateStart < 0) ? start : qMin(rowsMapUpdateStart, start);
-    scheduleDelayedItemsLayout(DoUpdateRowsMap);
+}
+
+int EventTimelineWidget::modelRow(const EventRef &event) const
+{
+    updateRowsMap();
+
+    int row = slotRows.value(event.slot(), -1);
+    Q_ASSERT(row >= 0 && rowEvents[row] == event);
+    return row;
 }
 
 inline static bool serverSort(const ServerData *s1, const ServerData *s2)
@@ -531,12 +664,6 @@ void EventTimelineWidget::doItemsLayout()
     if (layout & DoRowsLayout)
         doRowsLayout();
 
-    if (layout & DoUpdateRowsMap)
-    {
-        updateRowsMap(rowsMapUpdateStart);
-        rowsMapUpdateStart = -1;
-    }
-
     if (layout & DoUpdateTimeRangeFromData)
         updateTimeRange(true);
     else if (layout & DoUpdateTimeRange)
@@ -584,26 +711,53 @@ void EventTimelineWidget::addModelRows(int first, int last)
     if (last < 0)
         last = model()->rowCount() - 1;
 
-    DateTimeRange dateTimeRange = visibleTimeRange.range();
+    if (last < first)
+        return;
+
+    QVector<EventRef> added;
+    added.reserve(last - first + 1);
+    QHash<LocationData*,QVector<EventRef> > locationEvents;
+    LocationData *locationData = 0;
+
+    qint64 earliest = EventStore::NoTime, latest = EventStore::NoTime;
     for (int i = first; i <= last; ++i)
     {
-        EventData *data = rowData(i);
-        if (!data)
+        EventRef data = rowData(i);
+        added.append(data);
+        if (!data.isValid())
             continue;
 
-        LocationData *locationData;
-        int pos;
-        findEvent(data, true, 0, &locationData, &pos);
+        /* Rows usually come in runs for the same location */
+        if (!locationData || locationData->locationId != data.locationId()
+            || locationData->serverData->server != data.server())
+            findEvent(data, true, 0, &locationData);
+        locationEvents[locationData].append(data);
+
+        if (data.startTime() != EventStore::NoTime)
+        {
+            if (earliest == EventStore::NoTime || data.startTime() < earliest)
+                earliest = data.startTime();
+            latest = qMax(latest, data.endTime());
+        }
+    }
+
+    /* Sorted and merged once per location, rather than inserted one by one */
+    for (QHash<LocationData*,QVector<EventRef> >::ConstIterator it = locationEvents.constBegin();
+         it != locationEvents.constEnd(); ++it)
+        it.key()->insertEvents(it.value());
 
-        locationData->events.insert(pos, data);
-        rowsMap.insert(data, i);
+    rowEvents.insert(first, added.size(), EventRef());
+    std::copy(added.constBegin(), added.constEnd(), rowEvents.begin() + first);
+    invalidateRowsMap(first);
 
-        dateTimeRange = dateTimeRange.extendWith(data->localStartDate());
-        dateTimeRange = dateTimeRange.extendWith(data->localEndDate());
+    if (earliest != EventStore::NoTime)
+    {
+        DateTimeRange dateTimeRange = visibleTimeRange.range();
+        dateTimeRange = dateTimeRange.extendWith(QDateTime::fromMSecsSinceEpoch(earliest));
+        dateTimeRange = dateTimeRange.extendWith(QDateTime::fromMSecsSinceEpoch(latest));
+        visibleTimeRange.setDateTimeRange(dateTimeRange);
     }
 
-    visibleTimeRange.setDateTimeRange(dateTimeRange);
-    updateRowsMapDelayed(last+1);
     scheduleDelayedItemsLayout(DoUpdateTimeRange);
 }
 
@@ -618,27 +772,41 @@ void EventTimelineWidget::rowsAboutToBeRemoved(const QModelIndex &parent, int st
 {
     Q_ASSERT(!parent.isValid());
 
+    QHash<LocationData*,QVector<EventRef> > locationEvents;
+    LocationData *locationData = 0;
+
     for (int i = start; i <= end; ++i)
     {
-        EventData *data = rowData(i);
-        if (!data)
+        EventRef data = rowEvents.value(i);
+        if (!data.isValid())
             continue;
 
-        ServerData *serverData;
-        LocationData *locationData;
-        if (!findEvent(data, false, &serverData, &locationData, 0))
-            continue;
+        /* Rows usually come in runs for the same location */
+        if (!locationData || locationData->locationId != data.locationId()
+            || locationData->serverData->server != data.server())
+        {
+            if (!findEvent(data, false, 0, &locationData))
+                continue;
+        }
+        locationEvents[locationData].append(data);
+    }
 
-        bool ok = locationData->events.removeOne(data);
-        Q_ASSERT(ok);
-        Q_UNUSED(ok);
-        rowsMap.remove(data);
+    /* Removed at once per location; one by one, a large range would shift each index
+     * once per event */
+    for (QHash<LocationData*,QVector<EventRef> >::ConstIterator it = locationEvents.constBegin();
+         it != locationEvents.constEnd(); ++it)
+    {
+        LocationData *location = it.key();
+        int removed = location->removeEvents(it.value());
+        Q_ASSERT(removed == it.value().size());
+        Q_UNUSED(removed);
 
-        if (locationData->events.isEmpty())
+        if (location->events.isEmpty())
         {
-            serverData->locationsMap.remove(locationData->locationId);
-            layoutRows.removeAll(locationData);
-            delete locationData;
+            ServerData *serverData = location->serverData;
+            serverData->locationsMap.remove(location->locationId);
+            layoutRows.removeAll(location);
+            delete location;
 
             if (serverData->locationsMap.isEmpty())
             {
@@ -657,13 +825,40 @@ void EventTimelineWidget::rowsAboutToBeRemoved(const QModelIndex &parent, int st
 void EventTimelineWidget::rowsRemoved(const QModelIndex &parent, int start, int end)
 {
     Q_UNUSED(parent);
-    Q_UNUSED(end);
     Q_ASSERT(!parent.isValid());
 
-    updateRowsMapDelayed(start);
+    rowEvents.remove(start, end - start + 1);
+    invalidateRowsMap(start);
     scheduleDelayedItemsLayout(DoUpdateTimeRangeFromData);
 }
 
+void EventTimelineWidget::modelLayoutChanged()
+{
+    /* Usually a new sort order, with the same events in other rows; anything else
+     * starts over. */
+    if (rowEvents.size() != model()->rowCount())
+    {
+        reset();
+        return;
+    }
+
+    for (int row = 0, n = rowEvents.size(); row < n; ++row)
+    {
+        EventRef data = rowData(row);
+        LocationData *locationData;
+        if (data.isValid() && (!findEvent(data, false, 0, &locationData) || !locationData->events.contains(data)))
+        {
+            reset();
+            return;
+        }
+
+        rowEvents[row] = data;
+    }
+
+    invalidateRowsMap(0);
+    viewport()->update();
+}
+
 void EventTimelineWidget::reset()
 {
     clearData();
@@ -676,38 +871,36 @@ void EventTimelineWidget::dataChanged(const QModelIndex &topLeft, const QModelIn
 
     for (int row = firstRow; row <= lastRow; ++row)
     {
-        EventData *data = rowData(row);
-        Q_ASSERT(rowsMap[data] == row);
+        EventRef data = rowData(row);
+        Q_ASSERT(rowEvents.value(row) == data);
 
         /* Try to find this event to handle (relatively quickly) the common case when
-         * location/server do not change. */
+         * location/server do not change; its times may have. */
         ServerData *server = 0;
-        if (findEvent(data, false, &server, 0, 0) || !server)
+        LocationData *location = 0;
+        if ((findEvent(data, false, &server, &location) && location->updateEvent(data)) || !server)
             continue;
 
         /* Brute-force search of all locations in this server to find the old one and move it.
          * Server cannot change. */
-        foreach (LocationData *location, server->locationsMap)
+        foreach (LocationData *oldLocation, server->locationsMap)
         {
-            int pos = location->events.indexOf(data);
-            if (pos < 0)
+            if (!oldLocation->removeEvent(data))
                 continue;
 
-            location->events.removeAt(pos);
-            if (location->events.isEmpty())
+            if (oldLocation->events.isEmpty())
             {
-                server->locationsMap.remove(location->locationId);
-                delete location;
+                server->locationsMap.remove(oldLocation->locationId);
+                layoutRows.removeAll(oldLocation);
+                delete oldLocation;
                 scheduleDelayedItemsLayout(DoRowsLayout);
             }
 
             break;
         }
 
-        LocationData *location;
-        int pos;
-        findEvent(data, true, &server, &location, &pos);
-        location->events.insert(pos, data);
+        findEvent(data, true, &server, &location);
+        location->insertEvent(data);
     }
 
     scheduleDelayedItemsLayout(DoUpdateTimeRangeFromData);
@@ -773,7 +966,7 @@ bool EventTimelineWidget::viewportEvent(QEvent *event)
         cachedTopPadding = height;
 
         clearLeftPaddingCache();
-        scheduleDelayedItemsLayout(DoUpdateTimeRange);
+        scheduleDelayedItemsLayout(DoRowsLayout | DoUpdateTimeRange);
     }
 
     return re;
@@ -798,10 +991,10 @@ void EventTimelineWidget::paintDays(QPainter &p)
 
 int EventTimelineWidget::utcOffset() const
 {
-    if (rowsMap.isEmpty())
+    if (rowEvents.isEmpty() || !rowEvents.first().isValid())
         return 0;
 
-    return rowsMap.begin().key()->serverDateTzOffsetMins() * 60;
+    return rowEvents.first().serverDateTzOffsetMins() * 60;
 }
 
 void EventTimelineWidget::paintEvent(QPaintEvent *event)
@@ -812,7 +1005,7 @@ void EventTimelineWidget::paintEvent(QPaintEvent *event)
     p.eraseRect(event->rect());
 
     QAbstractItemModel *model = this->model();
-    if (!model || rowsMap.isEmpty())
+    if (!model || rowEvents.isEmpty())
         return;
 
     // we dont have to draw anything now
@@ -841,7 +1034,7 @@ void EventTimelineWidget::paintEvent(QPaintEvent *event)
     p.drawLine(0, 0, r.width(), 0);
     p.drawLine(0, 0, 0, r.height());
     p.setClipRect(0, 1, r.width(), r.height());
-    paintChart(p, r.width());
+    paintChart(p, viewportItemArea().width());
     p.restore();
 }
 
@@ -925,55 +1118,243 @@ void EventTimelineWidget::paintLegend(QPainter& p)
 
 void EventTimelineWidget::paintChart(QPainter& p, int width)
 {
+    updateTiles();
+
+    int viewLeft = tileX(visibleTimeRange.visibleRange().start().toMSecsSinceEpoch());
+    int firstTile = floorDivide(viewLeft, TileWidth);
+    int lastTile = floorDivide(viewLeft + width - 1, TileWidth);
+
+    QList<LocationData*> visibleLocations;
     QList<RowData *>::ConstIterator it = findLayoutRow(verticalScrollBar()->value());
     for (; it != layoutRows.end(); ++it)
     {
         int ry = (*it)->y - verticalScrollBar()->value();
+        if (ry > viewport()->height())
+            break;
 
-        if ((*it)->type != RowData::Server)
+        if ((*it)->type == RowData::Server)
+            continue;
+
+        /* Tiles already rendered are only copied; the rest are rendered as they come into view */
+        LocationData *locationData = (*it)->toLocation();
+        for (int tile = firstTile; tile <= lastTile; ++tile)
         {
-            QRect rowRect(0, ry, width, rowHeight());
-            paintRow(&p, rowRect, (*it)->toLocation());
+            QHash<int,QPixmap>::ConstIterator tileIt = locationData->tiles.constFind(tile);
+            if (tileIt == locationData->tiles.constEnd())
+                tileIt = locationData->tiles.insert(tile, renderTile(locationData, tile));
+            p.drawPixmap(tile * TileWidth - viewLeft, ry, *tileIt);
+        }
+
+        visibleLocations.append(locationData);
+    }
+
+    /* Keep a screen of tiles to either side for scrolling back, and drop the rest */
+    int margin = lastTile - firstTile + 1;
+    foreach (ServerData *serverData, serversMap)
+    {
+        foreach (LocationData *locationData, serverData->locationsMap)
+        {
+            if (!visibleLocations.contains(locationData))
+            {
+                locationData->tiles.clear();
+                continue;
+            }
+
+            for (QHash<int,QPixmap>::Iterator tileIt = locationData->tiles.begin(); tileIt != locationData->tiles.end();)
+            {
+                if (tileIt.key() < firstTile - margin || tileIt.key() > lastTile + margin)
+                    tileIt = locationData->tiles.erase(tileIt);
+                else
+                    ++tileIt;
+            }
         }
     }
 }
 
-bool EventTimelineWidget::isEventVisible(EventData *data) const
+bool EventTimelineWidget::isEventVisible(const EventRef &data) const
 {
-    if (data->localEndDate() < visibleTimeRange.visibleRange().start())
+    if (data.endTime() < visibleTimeRange.visibleRange().start().toMSecsSinceEpoch())
         return false;
-    if (data->localStartDate() > visibleTimeRange.visibleRange().end())
+    if (data.startTime() > visibleTimeRange.visibleRange().end().toMSecsSinceEpoch())
         return false;
 
     return true;
 }
 
-void EventTimelineWidget::paintRow(QPainter *p, QRect r, LocationData *locationData)
+int EventTimelineWidget::floorDivide(int value, int divisor)
+{
+    return (value >= 0) ? value / divisor : -((-value - 1) / divisor) - 1;
+}
+
+int EventTimelineWidget::tileX(qint64 msecs) const
+{
+    double x = (msecs - tileOriginMSecs) * tilePixelsPerMSec;
+    return qFloor(qBound(-1e9, x, 1e9) + 0.5);
+}
+
+qint64 EventTimelineWidget::tileTime(int x) const
+{
+    return tileOriginMSecs + qint64(x / qMax(tilePixelsPerMSec, 1e-12));
+}
+
+void EventTimelineWidget::updateTiles()
+{
+    double pixelsPerMSec = pixelsPerSeconds(1) / 1000.0;
+    qint64 origin = visibleTimeRange.range().start().toMSecsSinceEpoch();
+
+    /* Tiles are only valid for the scale and origin they were rendered with */
+    bool valid = pixelsPerMSec == tilePixelsPerMSec && origin == tileOriginMSecs && rowHeight() == tileRowHeight;
+    tilePixelsPerMSec = pixelsPerMSec;
+    tileOriginMSecs = origin;
+    tileRowHeight = rowHeight();
+
+    /* Only keep the density levels that some zoom level can draw at this width */
+    int width = qMax(viewportItemArea().width(), 1);
+    int firstLevel = EventDensityPyramid::levelForResolution(1000.0 * visibleTimeRange.minVisibleSeconds() / width);
+    int lastLevel = EventDensityPyramid::levelForResolution(1000.0 * qMax(visibleTimeRange.maxVisibleSeconds(), 1) / width);
+
+    foreach (ServerData *serverData, serversMap)
+    {
+        foreach (LocationData *locationData, serverData->locationsMap)
+        {
+            if (locationData->density.setLevels(qMax(firstLevel, 0), lastLevel))
+            {
+                locationData->refillDensity();
+                locationData->tiles.clear();
+            }
+
+            if (!valid)
+                locationData->tiles.clear();
+
+            typedef QPair<qint64,qint64> Span;
+            foreach (const Span &span, locationData->dirtySpans)
+            {
+                if (locationData->tiles.isEmpty())
+                    break;
+
+                int first = floorDivide(tileX(span.first) - TileMargin, TileWidth);
+                int last = floorDivide(tileX(span.second) + TileMargin, TileWidth);
+                if (last - first < locationData->tiles.size())
+                {
+                    for (int tile = first; tile <= last; ++tile)
+                        locationData->tiles.remove(tile);
+                    continue;
+                }
+
+                for (QHash<int,QPixmap>::Iterator it = locationData->tiles.begin(); it != locationData->tiles.end();)
+                {
+                    if (it.key() >= first && it.key() <= last)
+                        it = locationData->tiles.erase(it);
+                    else
+                        ++it;
+                }
+            }
+
+            locationData->dirtySpans.clear();
+        }
+    }
+}
+
+QPixmap EventTimelineWidget::renderTile(LocationData *locationData, int tile)
 {
-    p->save();
-    p->setRenderHint(QPainter::Antialiasing, true);
-    p->setPen(Qt::NoPen);
-    p->setClipRect(r, Qt::IntersectClip);
-    p->translate(r.topLeft());
+    QPixmap pixmap(TileWidth, rowHeight());
+    pixmap.fill(Qt::transparent);
+
+    QPainter p(&pixmap);
+    p.setRenderHint(QPainter::Antialiasing, true);
+    p.setPen(Qt::NoPen);
 
-    // TODO: what about finding first and last visible event by binary search?
-    foreach (EventData *event, locationData->events)
-        if (isEventVisible(event))
-            paintEvent(*p, r.height(), event);
+    /* Include events that reach into the tile by a few pixels from either side */
+    int tileLeft = tile * TileWidth;
+    qint64 from = tileTime(tileLeft - TileMargin);
+    qint64 to = tileTime(tileLeft + TileWidth + TileMargin);
 
-    p->restore();
+    const EventIntervalIndex &events = locationData->events;
+    int first, last;
+    events.findOverlapping(from, to, &first, &last);
+
+    /* When events outnumber the pixels they would cover, draw their density instead */
+    int densityLevel = EventDensityPyramid::levelForResolution(1.0 / qMax(tilePixelsPerMSec, 1e-12));
+    if (densityLevel >= 0 && locationData->density.hasLevel(densityLevel) && last - first > TileWidth / 4)
+        paintDensity(p, pixmap.height(), locationData->density, densityLevel, tileLeft, from, to);
+    else
+    {
+        for (int i = first; i < last; ++i)
+        {
+            if (events.endTime(i) >= from)
+                paintEvent(p, pixmap.height(), events.at(i), tileLeft);
+        }
+    }
+
+    return pixmap;
 }
 
-void EventTimelineWidget::paintEvent(QPainter &p, int boxHeight, EventData *event)
+void EventTimelineWidget::paintDensity(QPainter &p, int boxHeight, const EventDensityPyramid &density, int level,
+                                       int tileLeft, qint64 from, qint64 to)
 {
-    Q_ASSERT(event);
-    Q_ASSERT(rowsMap.contains(event));
+    qint64 bucketMSecs = EventDensityPyramid::bucketMSecs(level);
+
+    p.save();
+    p.setRenderHint(QPainter::Antialiasing, false);
+
+    /* Adjacent buckets of the same color are drawn as one rectangle */
+    QColor runColor;
+    int runLeft = 0, runRight = -1;
+
+    qint64 last = EventDensityPyramid::bucketIndex(level, to);
+    for (qint64 index = EventDensityPyramid::bucketIndex(level, from); index <= last + 1; ++index)
+    {
+        const EventDensityPyramid::Bucket *bucket = (index <= last) ? density.bucket(level, index) : 0;
 
-    int modelRow = rowsMap[event];
+        QColor color;
+        int left = 0, right = -1;
+        if (bucket)
+        {
+            left = tileX(index * bucketMSecs) - tileLeft;
+            right = qMax(left, tileX((index + 1) * bucketMSecs) - tileLeft - 1);
+
+            /* Each doubling of the events in a bucket makes it more opaque */
+            int magnitude = 0;
+            for (int count = bucket->count(); count > 1; count >>= 1)
+                ++magnitude;
+
+            color = bucket->maxLevel().uiColor();
+            color.setAlpha(qMin(255, 96 + 32 * magnitude));
+        }
 
-    QRect cellRect = timeCellRect(event->localStartDate(), event->durationInSeconds(), 0, boxHeight);
+        if (runRight >= runLeft && (!bucket || color != runColor || left > runRight + 1))
+        {
+            p.fillRect(QRect(runLeft, 1, runRight - runLeft + 1, boxHeight - 2), runColor);
+            runRight = -1;
+        }
 
-    p.setBrush(event->uiColor());
+        if (!bucket)
+            continue;
+
+        if (runRight < runLeft)
+        {
+            runColor = color;
+            runLeft = left;
+        }
+        runRight = qMax(runRight, right);
+    }
+
+    p.restore();
+}
+
+void EventTimelineWidget::paintEvent(QPainter &p, int boxHeight, const EventRef &event, int tileLeft)
+{
+    Q_ASSERT(event.isValid());
+
+    int modelRow = this->modelRow(event);
+
+    QRect cellRect;
+    cellRect.setTop(0);
+    cellRect.setHeight(boxHeight);
+    cellRect.setLeft(tileX(event.startTime()) - tileLeft);
+    cellRect.setRight(tileX(event.endTime()) - tileLeft);
+
+    p.setBrush(event.uiColor());
     p.drawRoundedRect(cellRect.adjusted(0, 1, 0, -1), 2, 2);
 
     if (selectionModel()->rowIntersectsSelection(modelRow, QModelIndex()))
@@ -984,6 +1365,29 @@ void EventTimelineWidget::paintEvent(QPainter &p, int boxHeight, EventData *even
     }
 }
 
+void EventTimelineWidget::selectionChanged(const QItemSelection &selected, const QItemSelection &deselected)
+{
+    /* Selected events are outlined in the tiles of their rows */
+    invalidateTiles(selected);
+    invalidateTiles(deselected);
+    QAbstractItemView::selectionChanged(selected, deselected);
+    viewport()->update();
+}
+
+void EventTimelineWidget::invalidateTiles(const QItemSelection &selection)
+{
+    foreach (const QItemSelectionRange &range, selection)
+    {
+        for (int row = range.top(); row <= range.bottom(); ++row)
+        {
+            EventRef event = rowEvents.value(row);
+            LocationData *locationData;
+            if (event.isValid() && findEvent(event, false, 0, &locationData))
+                locationData->markDirty(event.startTime(), event.endTime());
+        }
+    }
+}
+
 void EventTimelineWidget::clearLeftPaddingCache()
 {
     cachedLeftPadding = -1;
@@ -1024,14 +1428,13 @@ void EventTimelineWidget::mousePressEvent(QMouseEvent *event)
         return;
     }
 
-    EventData *data = eventAt(event->pos());
+    EventRef data = eventAt(event->pos());
 
-    if (data)
+    if (data.isValid())
     {
         QAbstractItemView::mousePressEvent(event);
 
-        Q_ASSERT(rowsMap.contains(data));
-        QModelIndex index = model()->index(rowsMap[data], 0);
+        QModelIndex index = model()->index(modelRow(data), 0);
         Q_ASSERT(index.isValid());
 
         selectionModel()->select(index, QItemSelectionModel::Toggle | QItemSelectionModel::Rows);
@@ -19,16 +19,18 @@
 #define EVENTTIMELINEWIDGET_H
 
 #include "VisibleTimeRange.h"
+#include "event/EventStore.h"
 #include <QAbstractItemView>
 #include <QDateTime>
 
 class DVRServer;
+class EventDensityPyramid;
+class QPixmap;
 class QRubberBand;
 
 struct RowData;
 struct ServerData;
 struct LocationData;
-class EventData;
 
 class EventTimelineWidget : public QAbstractItemView
 {
@@ -77,15 +79,22 @@ protected:
     virtual void rowsInserted(const QModelIndex &parent, int start, int end);
     virtual void rowsAboutToBeRemoved(const QModelIndex &parent, int start, int end);
     virtual void dataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
-    /* layoutChanged, rowsMoved */
+    /* rowsMoved */
+
+    virtual void selectionChanged(const QItemSelection &selected, const QItemSelection &deselected);
 
 private slots:
     void rowsRemoved(const QModelIndex &parent, int start, int end);
+    void modelLayoutChanged();
     void setViewStartOffset(int secs);
 
 private:
     QHash<DVRServer*,ServerData*> serversMap;
-    QHash<EventData*,int> rowsMap;
+    /* Events of the model rows, mirrored so that row changes don't go through the model */
+    QVector<EventRef> rowEvents;
+    /* Model row of each event by store slot, valid for rows before rowsMapUpdateStart */
+    mutable QVector<int> slotRows;
+    mutable int rowsMapUpdateStart;
     int m_rowHeight;
 
     VisibleTimeRange visibleTimeRange;
@@ -94,13 +103,11 @@ private:
     mutable int cachedLeftPadding;
 
     /* Cached layout information */
-    int rowsMapUpdateStart;
     enum LayoutFlag
     {
-        DoRowsLayout = 1,
-        DoUpdateRowsMap,
-        DoUpdateTimeRange, /* Update cached time range information, assuming that dataTimeStart is accurate */
-        DoUpdateTimeRangeFromData, /* Update cached time range information from underlying data */
+        DoRowsLayout = 0x1,
+        DoUpdateTimeRange = 0x2, /* Update cached time range information, assuming that dataTimeStart is accurate */
+        DoUpdateTimeRangeFromData = 0x4 /* Update cached time range information from underlying data */
     };
     Q_DECLARE_FLAGS(LayoutFlags, LayoutFlag)
     LayoutFlags pendingLayouts;
@@ -108,14 +115,16 @@ private:
     QDateTime earliestDate();
     QDateTime latestDate();
 
-    bool isEventVisible(EventData *data) const;
+    bool isEventVisible(const EventRef &data) const;
 
     void scheduleDelayedItemsLayout(LayoutFlags flags);
     void ensureLayout();
 
-    /* Update the rowsMap starting with the item at row 'start' and continuing to the end */
-    void updateRowsMap(int start = 0);
-    void updateRowsMapDelayed(int start = 0);
+    /* Mark the row of every event from row 'start' to the end as changed; they are
+     * updated when next needed */
+    void invalidateRowsMap(int start = 0);
+    void updateRowsMap() const;
+    int modelRow(const EventRef &event) const;
     /* Call when the time range in the underlying data may have changed. If fromData is true, dataTimeStart
      * and dataTimeEnd will be updated. Must be called regardless, to update various other cached data. */
     void updateTimeRange(bool fromData = true);
@@ -146,15 +155,17 @@ private:
 
     void clearLeftPaddingCache();
 
-    EventData *rowData(int row) const;
-    bool findEvent(EventData *event, bool create, ServerData **server, LocationData **location, int *position);
+    EventRef rowData(int row) const;
+    bool findEvent(const EventRef &event, bool create, ServerData **server, LocationData **location);
 
     void addModelRows(int first, int last = -1);
     void clearData();
     /* Update the scroll bar position, which is necessary when viewSeconds has changed */
     void updateScrollBars();
 
-    EventData *eventAt(const QPoint &point) const;
+    EventRef eventAt(const QPoint &point) const;
+    /* Time span of the item area columns [left, right], widened by a pixel for rounding */
+    void columnsTimeSpan(int left, int right, qint64 *from, qint64 *to) const;
 
     int utcOffset() const;
 
@@ -165,8 +176,33 @@ private:
     double pixelsPerSeconds(int seconds) const;
     QRect timeCellRect(const QDateTime &start, int duration, int top = 0, int height = 0) const;
 
-    void paintRow(QPainter *p, QRect rect, LocationData *locationData);
-    void paintEvent(QPainter &p, int boxHeight, EventData *event);
+    /* Location rows are rendered in tiles of TileWidth pixels, aligned to the start of the
+     * data range at the current scale, and copied to the screen when painting. Tiles are
+     * rendered as they come into view, and dropped when events in them change or when
+     * the scale, data range start or row height change. */
+    enum
+    {
+        TileWidth = 256,
+        /* Events this many pixels outside a tile can still be drawn into it */
+        TileMargin = 4
+    };
+
+    double tilePixelsPerMSec;
+    qint64 tileOriginMSecs;
+    int tileRowHeight;
+
+    static int floorDivide(int value, int divisor);
+    /* Position of a time in the tile layout, and the reverse */
+    int tileX(qint64 msecs) const;
+    qint64 tileTime(int x) const;
+
+    void updateTiles();
+    void invalidateTiles(const QItemSelection &selection);
+    QPixmap renderTile(LocationData *locationData, int tile);
+
+    void paintEvent(QPainter &p, int boxHeight, const EventRef &event, int tileLeft);
+    void paintDensity(QPainter &p, int boxHeight, const EventDensityPyramid &density, int level,
+                      int tileLeft, qint64 from, qint64 to);
 
 };
 
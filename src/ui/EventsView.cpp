@@ -74,9 +74,9 @@ EventList EventsView::selectedEvents() const
     const QModelIndexList &selectedItems = selectionModel()->selectedRows();
     foreach (const QModelIndex &selectedItem, selectedItems)
     {
-        EventData *eventData = selectedItem.data(EventsModel::EventDataPtr).value<EventData*>();
-        if (eventData)
-            result.append(*eventData);
+        QVariant eventData = selectedItem.data(EventsModel::EventDataRole);
+        if (eventData.isValid())
+            result.append(eventData.value<EventData>());
     }
 
     return result;
@@ -122,11 +122,11 @@ void EventsView::sortEvents(int logicalIndex, Qt::SortOrder sortOrder)
 
 void EventsView::openEvent(const QModelIndex &index)
 {
-    EventData *event = index.data(EventsModel::EventDataPtr).value<EventData*>();
-    if (!event)
+    QVariant event = index.data(EventsModel::EventDataRole);
+    if (!event.isValid())
         return;
 
-    EventViewWindow::open(*event, 0);
+    EventViewWindow::open(event.value<EventData>(), 0);
 }
 
 void EventsView::loadingStarted()
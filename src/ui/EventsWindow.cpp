@@ -275,6 +275,8 @@ QWidget * EventsWindow::createResultsView()
 
     connect(m_eventsUpdater, SIGNAL(serverEventsAvailable(DVRServer*,QList<QSharedPointer<EventData> >)),
             eventsModel, SLOT(setServerEvents(DVRServer*,QList<QSharedPointer<EventData> >)));
+    connect(m_eventsUpdater, SIGNAL(serverEventsAdded(DVRServer*,QList<QSharedPointer<EventData> >)),
+            eventsModel, SLOT(addServerEvents(DVRServer*,QList<QSharedPointer<EventData> >)));
 
     m_resultsView->setFrameStyle(QFrame::NoFrame);
     m_resultsView->setContextMenuPolicy(Qt::CustomContextMenu);
@@ -459,10 +461,14 @@ void EventsWindow::timelineSliderChanged(int value)
 
 void EventsWindow::showServerEvent(const QModelIndex &index)
 {
-    EventData *data = index.data(EventsModel::EventDataPtr).value<EventData*>();
-    showServerEvent(*data);
+    QVariant eventData = index.data(EventsModel::EventDataRole);
+    if (!eventData.isValid())
+        return;
+
+    EventData data = eventData.value<EventData>();
+    showServerEvent(data);
 
-    m_modelEventsCursor->setCameraFilter(data->locationCamera());
+    m_modelEventsCursor->setCameraFilter(data.locationCamera());
     m_modelEventsCursor->blockSignals(true);
     m_modelEventsCursor->setIndex(index.row());
     m_modelEventsCursor->blockSignals(false);
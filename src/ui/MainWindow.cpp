@@ -461,6 +461,8 @@ QWidget *MainWindow::createRecentEvents()
     EventsUpdater *updater = new EventsUpdater(m_serverRepository, m_eventsModel);
     connect(updater, SIGNAL(serverEventsAvailable(DVRServer*,QList<QSharedPointer<EventData>>)),
             m_eventsModel, SLOT(setServerEvents(DVRServer*,QList<QSharedPointer<EventData>>)));
+    connect(updater, SIGNAL(serverEventsAdded(DVRServer*,QList<QSharedPointer<EventData>>)),
+            m_eventsModel, SLOT(addServerEvents(DVRServer*,QList<QSharedPointer<EventData>>)));
 
     m_eventsView->setModel(m_eventsModel, updater->isUpdating());
 
@@ -25,7 +25,9 @@
 #include <QGroupBox>
 #include <QFormLayout>
 #include <QLabel>
+#include <QLineEdit>
 #include <QSettings>
+#include <QSpinBox>
 #include <QSystemTrayIcon>
 #include <QMessageBox>
 #include <QDir>
@@ -86,6 +88,72 @@ OptionsGeneralPage::OptionsGeneralPage(QWidget *parent)
     m_deinterlace->setChecked(settings.value(QLatin1String("ui/liveview/autoDeinterlace"), false).toBool());
     layout->addWidget(m_deinterlace);
 
+    m_motionDetection = new QCheckBox(tr("Highlight live tiles on motion"));
+    m_motionDetection->setToolTip(tr("Compares decoded frames of RTSP streams to spot motion, without waiting for server events"));
+    m_motionDetection->setChecked(settings.value(QLatin1String("ui/liveview/motionDetection"), false).toBool());
+    layout->addWidget(m_motionDetection);
+
+    m_adaptiveSubstream = new QCheckBox(tr("Let adaptive bandwidth mode switch cameras to their substream"));
+    m_adaptiveSubstream->setToolTip(tr("The substream is a setting of the camera on the server, so this changes "
+                                       "the live stream for everyone watching the camera. The camera's own setting "
+                                       "is restored when the stream is closed."));
+    m_adaptiveSubstream->setChecked(settings.value(QLatin1String("ui/liveview/adaptiveSubstream"), false).toBool());
+    layout->addWidget(m_adaptiveSubstream);
+
+    QFormLayout *liveLayout = new QFormLayout();
+    m_adaptiveBandwidthLimit = new QSpinBox();
+    m_adaptiveBandwidthLimit->setRange(0, 1024 * 1024);
+    m_adaptiveBandwidthLimit->setSingleStep(128);
+    m_adaptiveBandwidthLimit->setSuffix(tr(" KB/s"));
+    m_adaptiveBandwidthLimit->setSpecialValueText(tr("No limit"));
+    m_adaptiveBandwidthLimit->setValue(settings.value(QLatin1String("ui/liveview/adaptiveBandwidthLimit"), 0).toInt());
+    m_adaptiveBandwidthLimit->setToolTip(tr("In adaptive bandwidth mode, lower the quality of live streams "
+                                            "while their total rate is above this limit"));
+    liveLayout->addRow(new QLabel(tr("Adaptive bandwidth limit:")), m_adaptiveBandwidthLimit);
+
+    m_rewindDuration = new QSpinBox();
+    m_rewindDuration->setRange(0, 120);
+    m_rewindDuration->setSuffix(tr(" s"));
+    m_rewindDuration->setSpecialValueText(tr("Disabled"));
+    m_rewindDuration->setValue(settings.value(QLatin1String("ui/liveview/rewindDuration"), 30).toInt());
+    m_rewindDuration->setToolTip(tr("Keep this much recent video of each live camera in memory for rewinding"));
+    liveLayout->addRow(new QLabel(tr("Live rewind buffer:")), m_rewindDuration);
+
+    m_rewindMemoryLimit = new QSpinBox();
+    m_rewindMemoryLimit->setRange(16, 2047);
+    m_rewindMemoryLimit->setSingleStep(64);
+    m_rewindMemoryLimit->setSuffix(tr(" MB"));
+    m_rewindMemoryLimit->setValue(settings.value(QLatin1String("ui/liveview/rewindMemoryLimit"), 256).toInt());
+    m_rewindMemoryLimit->setToolTip(tr("Memory shared by the rewind buffers of all cameras"));
+    liveLayout->addRow(new QLabel(tr("Rewind memory limit:")), m_rewindMemoryLimit);
+
+    m_gatewayPort = new QSpinBox();
+    m_gatewayPort->setRange(0, 65535);
+    m_gatewayPort->setSpecialValueText(tr("Disabled"));
+    m_gatewayPort->setValue(settings.value(QLatin1String("ui/liveview/gatewayPort"), 0).toInt());
+    m_gatewayPort->setToolTip(tr("Let other players watch open live streams at "
+                                 "http://<address>:<port>/live/<server id>/<camera id>.ts"));
+    liveLayout->addRow(new QLabel(tr("Re-streaming port:")), m_gatewayPort);
+
+    m_gatewayAddress = new QLineEdit();
+    m_gatewayAddress->setPlaceholderText(QLatin1String("127.0.0.1"));
+    m_gatewayAddress->setText(settings.value(QLatin1String("ui/liveview/gatewayAddress")).toString());
+    m_gatewayAddress->setToolTip(tr("Address to accept re-streaming players on; 0.0.0.0 for all networks"));
+    liveLayout->addRow(new QLabel(tr("Re-streaming address:")), m_gatewayAddress);
+
+    m_gatewayAllowedSubnets = new QLineEdit();
+    m_gatewayAllowedSubnets->setPlaceholderText(QLatin1String("192.168.1.0/24"));
+    m_gatewayAllowedSubnets->setText(settings.value(QLatin1String("ui/liveview/gatewayAllowedSubnets")).toString());
+    m_gatewayAllowedSubnets->setToolTip(tr("Comma-separated networks other computers may re-stream from; "
+                                           "this computer is always allowed"));
+    liveLayout->addRow(new QLabel(tr("Re-streaming networks:")), m_gatewayAllowedSubnets);
+
+    m_gatewayToken = new QLineEdit();
+    m_gatewayToken->setText(settings.value(QLatin1String("ui/liveview/gatewayToken")).toString());
+    m_gatewayToken->setToolTip(tr("If set, players must add ?token=<token> to stream addresses"));
+    liveLayout->addRow(new QLabel(tr("Re-streaming token:")), m_gatewayToken);
+    layout->addLayout(liveLayout);
+
     m_updateNotifications = new QCheckBox(tr("Disable notifications about available Bluecherry client updates"));
     m_updateNotifications->setChecked(settings.value(QLatin1String("ui/disableUpdateNotifications"), false).toBool());
     layout->addWidget(m_updateNotifications);
@@ -94,6 +162,17 @@ OptionsGeneralPage::OptionsGeneralPage(QWidget *parent)
     m_thumbnails->setChecked(settings.value(QLatin1String("ui/enableThumbnails"), true).toBool());
     layout->addWidget(m_thumbnails);
 
+    QFormLayout *eventsLayout = new QFormLayout();
+    m_eventCacheSize = new QSpinBox();
+    m_eventCacheSize->setRange(0, 4096);
+    m_eventCacheSize->setSingleStep(16);
+    m_eventCacheSize->setSuffix(tr(" MB"));
+    m_eventCacheSize->setSpecialValueText(tr("Disabled"));
+    m_eventCacheSize->setValue(settings.value(QLatin1String("ui/events/cacheSize"), 64).toInt());
+    m_eventCacheSize->setToolTip(tr("Keep past events of each server on disk, so that they don't have to be downloaded again"));
+    eventsLayout->addRow(new QLabel(tr("Event cache size:")), m_eventCacheSize);
+    layout->addLayout(eventsLayout);
+
     m_session = new QCheckBox(tr("Restore previous session on startup"));
     m_session->setChecked(settings.value(QLatin1String("ui/saveSession"), false).toBool());
     layout->addWidget(m_session);
@@ -177,8 +256,18 @@ void OptionsGeneralPage::saveChanges()
     settings.setValue(QLatin1String("ui/main/closeToTray"), m_closeToTray->isChecked());
     bcApp->mainWindow->updateTrayIcon();
     settings.setValue(QLatin1String("ui/liveview/autoDeinterlace"), m_deinterlace->isChecked());
+    settings.setValue(QLatin1String("ui/liveview/motionDetection"), m_motionDetection->isChecked());
+    settings.setValue(QLatin1String("ui/liveview/adaptiveSubstream"), m_adaptiveSubstream->isChecked());
+    settings.setValue(QLatin1String("ui/liveview/adaptiveBandwidthLimit"), m_adaptiveBandwidthLimit->value());
+    settings.setValue(QLatin1String("ui/liveview/rewindDuration"), m_rewindDuration->value());
+    settings.setValue(QLatin1String("ui/liveview/rewindMemoryLimit"), m_rewindMemoryLimit->value());
+    settings.setValue(QLatin1String("ui/liveview/gatewayPort"), m_gatewayPort->value());
+    settings.setValue(QLatin1String("ui/liveview/gatewayAddress"), m_gatewayAddress->text().trimmed());
+    settings.setValue(QLatin1String("ui/liveview/gatewayAllowedSubnets"), m_gatewayAllowedSubnets->text().trimmed());
+    settings.setValue(QLatin1String("ui/liveview/gatewayToken"), m_gatewayToken->text());
     settings.setValue(QLatin1String("ui/disableUpdateNotifications"), m_updateNotifications->isChecked());
     settings.setValue(QLatin1String("ui/enableThumbnails"), m_thumbnails->isChecked());
+    settings.setValue(QLatin1String("ui/events/cacheSize"), m_eventCacheSize->value());
     settings.setValue(QLatin1String("ui/saveSession"), m_session->isChecked());
     settings.setValue(QLatin1String("ui/startupFullscreen"), m_fullScreen->isChecked());
     settings.setValue(QLatin1String("ui/startup"), m_startup->isChecked());
@@ -22,6 +22,8 @@
 
 class QCheckBox;
 class QComboBox;
+class QLineEdit;
+class QSpinBox;
 
 class OptionsGeneralPage : public OptionsDialogPage
 {
@@ -40,12 +42,20 @@ private slots:
 
 private:
     QCheckBox *m_eventsPauseLive, *m_closeToTray, *m_vaapiDecodingAcceleration,
-                    *m_deinterlace, *m_updateNotifications, *m_thumbnails,
+                    *m_deinterlace, *m_motionDetection, *m_adaptiveSubstream, *m_updateNotifications, *m_thumbnails,
                     *m_session, *m_fullScreen, *m_startup /*,
                     *m_ssFullscreen, *m_ssVideo, *m_ssNever*/;
 
 	QComboBox *m_languages;
     QComboBox *m_mpvvo;
+    QSpinBox *m_adaptiveBandwidthLimit;
+    QSpinBox *m_rewindDuration;
+    QSpinBox *m_rewindMemoryLimit;
+    QSpinBox *m_gatewayPort;
+    QLineEdit *m_gatewayAddress;
+    QLineEdit *m_gatewayAllowedSubnets;
+    QLineEdit *m_gatewayToken;
+    QSpinBox *m_eventCacheSize;
 
     void fillLanguageComboBox();
     void fillMpvVOComboBox();
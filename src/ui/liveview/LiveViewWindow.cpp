@@ -21,6 +21,8 @@
 #include "core/BluecherryApp.h"
 #include "server/DVRServer.h"
 #include "ui/liveview/cameracontainerwidget.h"
+#include "utils/FileUtils.h"
+#include "utils/ImageEncodeTask.h"
 #include <QBoxLayout>
 #include <QToolBar>
 #include <QComboBox>
@@ -41,6 +43,12 @@
 #include <QKeyEvent>
 #include <QPainter>
 #include <QMimeData>
+#include <QDateTime>
+#include <QDesktopServices>
+#include <QDir>
+#include <QFileDialog>
+#include <QSet>
+#include <QThreadPool>
 
 
 bool LiveViewWindow::m_isSessionRestoring = false;
@@ -87,7 +95,7 @@ LiveViewWindow::LiveViewWindow(DVRServerRepository *serverRepository, QWidget *p
       m_lastLayoutIndex(-1), m_switchItemIndex(-1), m_autoSized(false), m_isLayoutChanging(false),
       m_wasOpenedFs(openfs), m_liveviewlayout(0),
       m_rows(1), m_cols(1), m_dragStartPosition(-1, -1),
-      m_dragSrcRow(-1), m_dragSrcCol(-1)
+      m_dragSrcRow(-1), m_dragSrcCol(-1), m_pendingSnapshots(0)
 {
     setBackgroundRole(QPalette::Shadow);
     QBoxLayout *layout = new QVBoxLayout(this);
@@ -175,6 +183,19 @@ LiveViewWindow::LiveViewWindow(DVRServerRepository *serverRepository, QWidget *p
                            tr("8x4"), mapper, SLOT(map()));
     mapper->setMapping(a, QString("8x4"));
 
+    spacer = new QWidget;
+    spacer->setFixedWidth(16);
+	m_toolBar->addWidget(spacer);
+
+    QMenu *snapshotMenu = new QMenu(this);
+    snapshotMenu->addAction(tr("Separate Files..."), this, SLOT(snapshotAllToFiles()));
+    snapshotMenu->addAction(tr("Contact Sheet..."), this, SLOT(snapshotAllToSheet()));
+    a = m_toolBar->addAction(QIcon(QLatin1String(":/icons/webcam.png")), tr("Snapshot All"));
+    a->setMenu(snapshotMenu);
+    QToolButton *snapshotButton = qobject_cast<QToolButton*>(m_toolBar->widgetForAction(a));
+    if (snapshotButton)
+        snapshotButton->setPopupMode(QToolButton::InstantPopup);
+
     spacer = new QWidget;
     spacer->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
 	m_toolBar->addWidget(spacer);
@@ -631,6 +652,115 @@ QByteArray LiveViewWindow::serializeLayout() const
 
     return re;
 }
+
+/* Takes the current frame of every tile in grid order. The frames are shared with the
+ * streams, so this is cheap enough to catch all tiles at the same moment. */
+void LiveViewWindow::captureTiles(QList<QImage> *frames, QStringList *cameraNames) const
+{
+    for (int i = 0; i < m_rows; i++)
+    {
+        for (int j = 0; j < m_cols; j++)
+        {
+            QLayoutItem *item = m_liveviewlayout->itemAtPosition(i, j);
+            if (!item || !item->widget())
+                continue;
+
+            CameraContainerWidget *ccw = (CameraContainerWidget *)item->widget();
+            if (!ccw->camera() || !ccw->stream())
+                continue;
+
+            QImage frame = ccw->stream()->currentFrame();
+            if (frame.isNull())
+                continue;
+
+            frames->append(frame);
+            cameraNames->append(ccw->cameraName());
+        }
+    }
+}
+
+void LiveViewWindow::snapshotAllToFiles()
+{
+    QList<QImage> frames;
+    QStringList cameraNames;
+    captureTiles(&frames, &cameraNames);
+    QString time = QDateTime::currentDateTime().toString(QLatin1String("yyyy-MM-dd hh-mm-ss"));
+
+    if (frames.isEmpty())
+        return;
+
+    QSettings settings;
+    QString dir = QFileDialog::getExistingDirectory(this, tr("Save Snapshots"),
+                                                    settings.value(QLatin1String("ui/snapshotSaveLocation"),
+                                                                   QDesktopServices::storageLocation(QDesktopServices::PicturesLocation)).toString());
+    if (dir.isEmpty())
+        return;
+    settings.setValue(QLatin1String("ui/snapshotSaveLocation"), dir);
+
+    /* One task per tile, so the pool encodes them in parallel */
+    QSet<QString> usedNames;
+    for (int i = 0; i < frames.size(); ++i)
+    {
+        QString name = sanitizeFilename(QString::fromLatin1("%1 - %2").arg(cameraNames[i], time));
+        QString uniqueName = name;
+        for (int n = 2; usedNames.contains(uniqueName); ++n)
+            uniqueName = QString::fromLatin1("%1 (%2)").arg(name).arg(n);
+        usedNames.insert(uniqueName);
+
+        ImageEncodeTask *task = new ImageEncodeTask(this, "snapshotSaved",
+                                                    QDir(dir).filePath(uniqueName + QLatin1String(".jpg")));
+        task->setImage(frames[i]);
+        m_pendingSnapshots++;
+        QThreadPool::globalInstance()->start(task);
+    }
+}
+
+void LiveViewWindow::snapshotAllToSheet()
+{
+    QList<QImage> frames;
+    QStringList cameraNames;
+    captureTiles(&frames, &cameraNames);
+    QString time = QDateTime::currentDateTime().toString(QLatin1String("yyyy-MM-dd hh-mm-ss"));
+
+    if (frames.isEmpty())
+        return;
+
+    QString file = getSaveFileNameExt(this, tr("Save Contact Sheet"),
+                                      QDesktopServices::storageLocation(QDesktopServices::PicturesLocation),
+                                      QLatin1String("ui/snapshotSaveLocation"),
+                                      tr("Live View - %1.jpg").arg(time),
+                                      tr("JPEG image (*.jpg);;PNG image (*.png)"));
+    if (file.isEmpty())
+        return;
+    if (!file.endsWith(QLatin1String(".jpg"), Qt::CaseInsensitive)
+            && !file.endsWith(QLatin1String(".png"), Qt::CaseInsensitive))
+        file.append(QLatin1String(".jpg"));
+
+    for (int i = 0; i < cameraNames.size(); ++i)
+        cameraNames[i] = QString::fromLatin1("%1 - %2").arg(cameraNames[i], time);
+
+    ImageEncodeTask *task = new ImageEncodeTask(this, "snapshotSaved", file);
+    task->setContactSheet(frames, cameraNames);
+    m_pendingSnapshots++;
+    QThreadPool::globalInstance()->start(task);
+}
+
+void LiveViewWindow::snapshotSaved(ThreadTask *task)
+{
+    ImageEncodeTask *encodeTask = static_cast<ImageEncodeTask*>(task);
+    if (!encodeTask->isOk())
+        m_failedSnapshots.append(QDir::toNativeSeparators(encodeTask->fileName()));
+
+    /* One message for the whole batch */
+    if (--m_pendingSnapshots > 0 || m_failedSnapshots.isEmpty())
+        return;
+
+    QMessageBox::critical(this, tr("Snapshot Error"),
+                          tr("An error occurred while saving these snapshot images:\n%1")
+                          .arg(m_failedSnapshots.join(QLatin1String("\n"))), QMessageBox::Ok);
+    m_failedSnapshots.clear();
+}
+
 //<<<<<<<<<<<<<<<
 void LiveViewWindow::savedLayoutChanged(int index)
 {
@@ -30,6 +30,8 @@ class DVRServerRepository;
 class LiveViewArea;
 class QAction;
 class QComboBox;
+class QImage;
+class ThreadTask;
 class QToolBar;
 
 class LiveViewWindow : public QWidget
@@ -114,6 +116,9 @@ private slots:
     void updateLayoutActionStates();
     void camerasBrowseKeys(QKeyEvent *event);
     void removeCamera(QWidget *widget);
+    void snapshotAllToFiles();
+    void snapshotAllToSheet();
+    void snapshotSaved(ThreadTask *task);
 
 private:
 
@@ -137,6 +142,8 @@ private:
     int m_rows, m_cols;
     QPoint m_dragStartPosition;
     int m_dragSrcRow, m_dragSrcCol;
+    int m_pendingSnapshots;
+    QStringList m_failedSnapshots;
 
     void retranslateUI();
     void geometryChanged();
@@ -148,6 +155,7 @@ private:
     void removeColumns(int remove);
     bool findEmptyLayoutCell(int *r, int *c);
     void gridPos(const QPoint &pos, int *row, int *column);
+    void captureTiles(QList<QImage> *frames, QStringList *cameraNames) const;
 };
 
 #endif // LIVEVIEWWINDOW_H
@@ -23,10 +23,14 @@
 #include "core/BluecherryApp.h"
 #include "camera/DVRCamera.h"
 #include "utils/FileUtils.h"
+#include "utils/ImageEncodeTask.h"
 #include "PtzPresetsWindow.h"
 #include "core/CameraPtzControl.h"
+#include "core/LiveBandwidthController.h"
 #include "core/LiveViewManager.h"
 #include "core/PtzPresetsModel.h"
+#include "rtsp-stream/RtspMotionDetector.h"
+#include "rtsp-stream/RtspStream.h"
 #include "LiveViewWindow.h"
 #include "ui/MainWindow.h"
 #include "audio/AudioPlayer.h"
@@ -42,17 +46,25 @@
 #include <QSettings>
 #include <QDesktopServices>
 #include <QAction>
+#include <QApplication>
 #include <QDateTime>
 #include <QContextMenuEvent>
 #include <QSignalMapper>
 #include <QInputDialog>
 #include <QPixmapCache>
 #include <QPainter>
+#include <QThreadPool>
 #include <math.h>
 #include <QDebug>
 
+static const qreal maxZoom = 8;
+/* Cells outside the mask that must show motion for the tile to be highlighted */
+static const int minMotionCells = 2;
+static const int motionHighlightDuration = 1000;
+
 CameraContainerWidget::CameraContainerWidget(QWidget *parent)
-    : QFrame(parent),m_serverRepository(0)
+    : QFrame(parent),m_serverRepository(0), m_zoom(1), m_zoomCenter(0.5, 0.5), m_panning(false),
+      m_editingMotionMask(false)
 {
     setAttribute(Qt::WA_OpaquePaintEvent);
     //setBackgroundRole(QPalette::Shadow);
@@ -100,7 +112,8 @@ void CameraContainerWidget::initStaticText()
 
 void CameraContainerWidget::drawHeader(QPainter *p, const QRect &r)
 {
-    int fps;
+    int fps = 0;
+    int latency = -1;
     QRect headerText(r);
     QRect brect;
     headerText.adjust(5, 2, -10, -4);
@@ -109,7 +122,10 @@ void CameraContainerWidget::drawHeader(QPainter *p, const QRect &r)
     brect = p->boundingRect(headerText, Qt::AlignLeft | Qt::AlignTop, cameraName());
     p->drawStaticText(brect.topLeft(), m_cameraname);
     if (m_stream)
+    {
         fps = (int)ceilf(m_stream->receivedFps());
+        latency = m_stream->latency();
+    }
 
     if (camera() && camera()->hasPtz())
     {
@@ -119,7 +135,17 @@ void CameraContainerWidget::drawHeader(QPainter *p, const QRect &r)
     }
 
 
-    p->drawText(headerText, Qt::AlignRight | Qt::AlignTop, tr("%1 %2fps").arg(ptztext).arg(fps), &brect);
+    QString ratetext = tr("%1 %2fps").arg(ptztext).arg(fps);
+    if (m_stream && m_stream->isRewinding())
+        ratetext.prepend(tr("Rewind "));
+    if (m_stream && m_stream->isRecording())
+        ratetext.prepend(tr("REC "));
+    if (latency >= 0)
+        ratetext.append(tr(" %1ms").arg(latency));
+    if (m_zoom > 1)
+        ratetext.prepend(tr("%1x ").arg(m_zoom, 0, 'f', 1));
+
+    p->drawText(headerText, Qt::AlignRight | Qt::AlignTop, ratetext, &brect);
 
     if (m_stream && m_stream.data()->hasAudio())
     {
@@ -149,7 +175,8 @@ void CameraContainerWidget::paintEvent(QPaintEvent *event)
 
     drawHeader(&p, event->rect());
 
-    QImage frame = m_stream.data()->currentFrame();
+    QRectF frameCrop;
+    QImage frame = m_stream.data()->currentFrame(&frameCrop);
 
     if (!frame.isNull())
     {
@@ -157,27 +184,57 @@ void CameraContainerWidget::paintEvent(QPaintEvent *event)
         float xScale, yScale;
         bool rescale = false;
 
-        if (frame.size().width() != frameRect.width() || frame.size().height() != frameRect.height())
+        /* The frame can show more than the zoomed part: while frames cropped for a new zoom
+         * are on their way, or when the stream doesn't crop at all */
+        QRectF zoom = zoomRect();
+        QRectF source((zoom.x() - frameCrop.x()) / frameCrop.width() * frame.width(),
+                      (zoom.y() - frameCrop.y()) / frameCrop.height() * frame.height(),
+                      zoom.width() / frameCrop.width() * frame.width(),
+                      zoom.height() / frameCrop.height() * frame.height());
+        source &= QRectF(frame.rect());
+        if (source.isEmpty())
+            source = frame.rect();
+        QSize sourceSize = source.size().toSize();
+
+        if (sourceSize.width() != frameRect.width() || sourceSize.height() != frameRect.height())
         {
-            xScale = (float)frameRect.width() / (float)frame.size().width();
-            yScale = (float)frameRect.height() / (float)frame.size().height();
+            xScale = (float)frameRect.width() / (float)sourceSize.width();
+            yScale = (float)frameRect.height() / (float)sourceSize.height();
 
-            if(xScale * frame.size().height() > frameRect.height())
+            if(xScale * sourceSize.height() > frameRect.height())
             {
-                int dx = (frameRect.width() - frame.size().width() * yScale) / 2;
-                frameRect.setRect(frameRect.x() + dx, frameRect.y(), frame.size().width() * yScale, frameRect.height());
+                int dx = (frameRect.width() - sourceSize.width() * yScale) / 2;
+                frameRect.setRect(frameRect.x() + dx, frameRect.y(), sourceSize.width() * yScale, frameRect.height());
             }
             else
             {
-                int dy = (frameRect.height() - frame.size().height() * xScale) / 2;
-                frameRect.setRect(frameRect.x(), frameRect.y() + dy, frameRect.width(), frame.size().height() * xScale);
+                int dy = (frameRect.height() - sourceSize.height() * xScale) / 2;
+                frameRect.setRect(frameRect.x(), frameRect.y() + dy, frameRect.width(), sourceSize.height() * xScale);
             }
             rescale = true;
         }
-        p.drawImage(frameRect, frame);
+        p.drawImage(frameRect, frame, source);
+        m_videoRect = frameRect;
 
         if (rescale && frameRect.width() > 0 &&  frameRect.height() > 0)
             m_stream.data()->setFrameSizeHint(frameRect.width(), frameRect.height());
+        m_stream.data()->setCropRect(zoom);
+        /* Taken up again once no other tile shares the stream */
+        m_stream.data()->setFisheyeView(m_fisheyeView);
+
+        if (m_editingMotionMask || hasRecentMotion())
+        {
+            p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+            if (m_editingMotionMask)
+                drawMotionMask(&p);
+            if (hasRecentMotion())
+            {
+                p.setPen(QPen(Qt::red, 3));
+                p.setBrush(Qt::NoBrush);
+                p.drawRect(QRectF(frameRect).adjusted(1.5, 1.5, -1.5, -1.5));
+            }
+            p.setCompositionMode(QPainter::CompositionMode_Source);
+        }
     }
 
     if (m_stream->state() != LiveStream::Streaming)
@@ -251,6 +308,32 @@ void CameraContainerWidget::setBandwidthModeFromAction()
     stream()->setPaused(false);
 }
 
+void CameraContainerWidget::rewindFromAction()
+{
+    QAction *a = qobject_cast<QAction*>(sender());
+    if (!a || a->data().isNull() || !stream())
+        return;
+
+    stream()->rewind(a->data().toInt());
+}
+
+void CameraContainerWidget::resumeLive()
+{
+    if (stream())
+        stream()->resumeLive();
+}
+
+void CameraContainerWidget::toggleLocalRecording()
+{
+    if (!stream())
+        return;
+
+    if (stream()->isRecording())
+        stream()->stopRecording();
+    else
+        stream()->startRecording();
+}
+
 void CameraContainerWidget::enableAudio()
 {
     Q_ASSERT(stream());
@@ -337,20 +420,27 @@ void CameraContainerWidget::saveSnapshot()
                            QString::fromLatin1("%1 - %2.jpg").arg(m_camera.data()->data().displayName(),
                                                                   QDateTime::currentDateTime().toString(
                                                                   QLatin1String("yyyy-MM-dd hh-mm-ss"))),
-                           tr("Image (*.jpg)"));
+                           tr("JPEG image (*.jpg);;PNG image (*.png)"));
 
         if (file.isEmpty())
             return;
-        if (!file.endsWith(QLatin1String(".jpg"), Qt::CaseInsensitive))
+        if (!file.endsWith(QLatin1String(".jpg"), Qt::CaseInsensitive)
+                && !file.endsWith(QLatin1String(".png"), Qt::CaseInsensitive))
             file.append(QLatin1String(".jpg"));
     }
 
-    if (!frame.save(file, "jpeg"))
-    {
-        QMessageBox::critical(window, tr("Snapshot Error"), tr("An error occurred while saving the snapshot image."),
+    /* Encoding a large frame takes long enough to stall live video */
+    ImageEncodeTask *task = new ImageEncodeTask(this, "snapshotSaved", file);
+    task->setImage(frame);
+    QThreadPool::globalInstance()->start(task);
+}
+
+void CameraContainerWidget::snapshotSaved(ThreadTask *task)
+{
+    ImageEncodeTask *encodeTask = static_cast<ImageEncodeTask*>(task);
+    if (!encodeTask->isOk())
+        QMessageBox::critical(this, tr("Snapshot Error"), tr("An error occurred while saving the snapshot image."),
                               QMessageBox::Ok);
-        return;
-    }
 }
 
 CameraPtzControl::Movement CameraContainerWidget::moveForPosition(int x, int y)
@@ -549,6 +639,38 @@ void CameraContainerWidget::contextMenuEvent(QContextMenuEvent *event)
     QAction *a = menu.addAction(tr("Snapshot"), this, SLOT(saveSnapshot()));
     a->setEnabled(stream() && !stream()->currentFrame().isNull());
 
+    if (m_zoom > 1)
+        menu.addAction(tr("Reset digital zoom"), this, SLOT(resetZoom()));
+
+    /* Dewarping is done while converting decoded RTSP frames */
+    if (qobject_cast<RtspStream *>(stream()))
+    {
+        const QString modeNames[] = { tr("Off"), tr("Panorama"), tr("Quad view"), tr("Virtual PTZ") };
+
+        QMenu *fisheyeMenu = menu.addMenu(tr("Fisheye dewarp"));
+        fisheyeMenu->setEnabled(canDewarp());
+        for (int mode = FisheyeView::Off; mode <= FisheyeView::VirtualPtz; ++mode)
+        {
+            a = fisheyeMenu->addAction(modeNames[mode], this, SLOT(setFisheyeModeFromAction()));
+            a->setCheckable(true);
+            a->setChecked(m_fisheyeView.mode() == mode);
+            a->setData(mode);
+        }
+    }
+
+    if (qobject_cast<RtspStream *>(stream())
+            && QSettings().value(QLatin1String("ui/liveview/motionDetection"), false).toBool())
+    {
+        QMenu *motionMenu = menu.addMenu(tr("Motion detection"));
+        a = motionMenu->addAction(tr("Edit mask"), this, SLOT(setEditingMotionMask(bool)));
+        a->setCheckable(true);
+        a->setChecked(m_editingMotionMask);
+        /* The grid covers the camera image, not the dewarped view */
+        a->setEnabled(!m_fisheyeView.isEnabled() || !canDewarp());
+        a = motionMenu->addAction(tr("Clear mask"), this, SLOT(clearMotionMask()));
+        a->setEnabled(m_motionMask.count(true) > 0);
+    }
+
     QMenu substream_menu;
     substream_menu.setTitle(tr("Switch liveview substream"));
     substream_menu.addAction(tr("Main Stream"), this, SLOT(set_main_stream()));
@@ -556,6 +678,26 @@ void CameraContainerWidget::contextMenuEvent(QContextMenuEvent *event)
     a = menu.addMenu(&substream_menu);
     a->setEnabled(camera());
 
+    if (stream() && (stream()->rewindAvailable() > 0 || stream()->isRewinding()))
+    {
+        static const int rewindSeconds[] = { 10, 20, 30 };
+
+        QMenu *rewindMenu = menu.addMenu(tr("Rewind"));
+        for (unsigned i = 0; i < sizeof(rewindSeconds) / sizeof(rewindSeconds[0]); ++i)
+        {
+            a = rewindMenu->addAction(tr("%1 seconds back").arg(rewindSeconds[i]), this, SLOT(rewindFromAction()));
+            a->setData(rewindSeconds[i]);
+        }
+        rewindMenu->addSeparator();
+        a = rewindMenu->addAction(tr("Back to live"), this, SLOT(resumeLive()));
+        a->setEnabled(stream()->isRewinding());
+    }
+
+    /* Recording remuxes RTSP packets; MJPEG streams have nothing to remux */
+    if (qobject_cast<RtspStream *>(stream()))
+        menu.addAction(stream()->isRecording() ? tr("Stop local recording") : tr("Record locally"),
+                       this, SLOT(toggleLocalRecording()));
+
     QMenu *ptzmenu = 0;
     if (camera() && camera()->hasPtz())
     {
@@ -602,6 +744,31 @@ void CameraContainerWidget::contextMenuEvent(QContextMenuEvent *event)
 
 void CameraContainerWidget::mouseMoveEvent(QMouseEvent *event)
 {
+    if (m_panning)
+    {
+        event->accept();
+
+        if (m_videoRect.width() > 0 && m_videoRect.height() > 0 && isSteeringFisheye())
+        {
+            /* Steer the view, as if dragging the image */
+            QPoint delta = event->pos() - m_panOrigin;
+            double degreesPerPixel = m_panFisheyeView.fov() / m_videoRect.width();
+            FisheyeView view = m_panFisheyeView;
+            view.setPan(view.pan() - delta.x() * degreesPerPixel);
+            view.setTilt(view.tilt() + delta.y() * degreesPerPixel);
+            setFisheyeView(view);
+        }
+        else if (m_videoRect.width() > 0 && m_videoRect.height() > 0)
+        {
+            QPoint delta = event->pos() - m_panOrigin;
+            m_zoomCenter = m_panCenter - QPointF(delta.x() / (m_videoRect.width() * m_zoom),
+                                                 delta.y() / (m_videoRect.height() * m_zoom));
+            m_zoomCenter = zoomRect().center();
+            update();
+        }
+        return;
+    }
+
     if (!m_ptz)
     {
         event->ignore();
@@ -646,8 +813,37 @@ void CameraContainerWidget::mouseDoubleClickEvent(QMouseEvent *event)
 
 void CameraContainerWidget::mousePressEvent(QMouseEvent *event)
 {
+    if (m_editingMotionMask && event->button() == Qt::LeftButton)
+    {
+        event->accept();
+        for (int cell = 0; cell < m_motionMask.size(); ++cell)
+        {
+            if (motionCellRect(cell).contains(event->pos()))
+            {
+                m_motionMask.toggleBit(cell);
+                saveMotionMask();
+                update();
+                break;
+            }
+        }
+        return;
+    }
+
     if (!m_ptz)
     {
+        /* Dragging pans a zoomed image or steers a virtual PTZ view; otherwise it moves the
+         * tile within the live view */
+        if ((m_zoom > 1 || isSteeringFisheye()) && event->button() == Qt::LeftButton)
+        {
+            event->accept();
+            m_panning = true;
+            m_panOrigin = event->pos();
+            m_panCenter = zoomRect().center();
+            m_panFisheyeView = m_fisheyeView;
+            setCursor(Qt::ClosedHandCursor);
+            return;
+        }
+
         event->ignore();
         return;
     }
@@ -661,6 +857,16 @@ void CameraContainerWidget::mousePressEvent(QMouseEvent *event)
 
 void CameraContainerWidget::mouseReleaseEvent(QMouseEvent *event)
 {
+    if (m_panning)
+    {
+        event->accept();
+        m_panning = false;
+        setCursor(QCursor());
+        if (m_fisheyeView.mode() == FisheyeView::VirtualPtz)
+            saveFisheyeView();
+        return;
+    }
+
     if (!m_ptz)
     {
         event->ignore();
@@ -673,7 +879,8 @@ void CameraContainerWidget::mouseReleaseEvent(QMouseEvent *event)
 
 void CameraContainerWidget::wheelEvent(QWheelEvent *event)
 {
-    if (!m_ptz)
+    /* Without PTZ, the wheel zooms digitally, or changes the field of a virtual PTZ view */
+    if (!m_ptz && !m_stream)
     {
         event->ignore();
         return;
@@ -685,7 +892,17 @@ void CameraContainerWidget::wheelEvent(QWheelEvent *event)
     if (!steps)
         return;
 
-    m_ptz->move((steps < 0) ? CameraPtzControl::MoveWide : CameraPtzControl::MoveTele);
+    if (m_ptz)
+        m_ptz->move((steps < 0) ? CameraPtzControl::MoveWide : CameraPtzControl::MoveTele);
+    else if (isSteeringFisheye())
+    {
+        FisheyeView view = m_fisheyeView;
+        view.setFov(view.fov() / pow(1.25, steps));
+        setFisheyeView(view);
+        saveFisheyeView();
+    }
+    else
+        zoomAt(m_zoom * pow(1.25, steps), event->pos());
 }
 
 void CameraContainerWidget::keyPressEvent(QKeyEvent *event)
@@ -716,6 +933,251 @@ void CameraContainerWidget::keyPressEvent(QKeyEvent *event)
     }
 }
 
+void CameraContainerWidget::focusInEvent(QFocusEvent *event)
+{
+    if (m_stream)
+        m_stream.data()->setFocused(true);
+
+    QFrame::focusInEvent(event);
+}
+
+void CameraContainerWidget::focusOutEvent(QFocusEvent *event)
+{
+    if (m_stream)
+        m_stream.data()->setFocused(false);
+
+    QFrame::focusOutEvent(event);
+}
+
+void CameraContainerWidget::resizeEvent(QResizeEvent *event)
+{
+    QFrame::resizeEvent(event);
+    updateTileSize();
+}
+
+void CameraContainerWidget::showEvent(QShowEvent *event)
+{
+    QFrame::showEvent(event);
+    updateTileSize();
+}
+
+void CameraContainerWidget::hideEvent(QHideEvent *event)
+{
+    QFrame::hideEvent(event);
+    updateTileSize();
+}
+
+/* Tell the adaptive bandwidth controller how large the video is rendered; when zoomed in,
+ * the whole image would be that much larger */
+void CameraContainerWidget::updateTileSize()
+{
+    QSize videoSize = isVisible() ? (size() - QSize(0, 20)) * m_zoom : QSize();
+    bcApp->liveView->bandwidthController()->setTileSize(this, m_stream.data(), videoSize);
+}
+
+QRectF CameraContainerWidget::zoomRect() const
+{
+    qreal size = 1 / m_zoom;
+    return QRectF(qBound(qreal(0), m_zoomCenter.x() - size / 2, 1 - size),
+                  qBound(qreal(0), m_zoomCenter.y() - size / 2, 1 - size), size, size);
+}
+
+void CameraContainerWidget::setZoom(qreal zoom)
+{
+    zoomAt(zoom, m_videoRect.center());
+}
+
+/* Keeps the part of the image under pos where it is */
+void CameraContainerWidget::zoomAt(qreal zoom, const QPoint &pos)
+{
+    zoom = qBound(qreal(1), zoom, maxZoom);
+    if (qFuzzyCompare(zoom, m_zoom))
+        return;
+
+    QRectF before = zoomRect();
+    QPointF anchor(0.5, 0.5);
+    if (m_videoRect.width() > 0 && m_videoRect.height() > 0)
+        anchor = QPointF(qBound(qreal(0), qreal(pos.x() - m_videoRect.x()) / m_videoRect.width(), qreal(1)),
+                         qBound(qreal(0), qreal(pos.y() - m_videoRect.y()) / m_videoRect.height(), qreal(1)));
+
+    QPointF target(before.x() + anchor.x() * before.width(), before.y() + anchor.y() * before.height());
+    m_zoom = zoom;
+    m_zoomCenter = target + QPointF((0.5 - anchor.x()) / zoom, (0.5 - anchor.y()) / zoom);
+    m_zoomCenter = zoomRect().center();
+
+    update();
+    updateTileSize();
+}
+
+/* A stream shared with other tiles isn't dewarped, so its view can't be changed here */
+bool CameraContainerWidget::canDewarp() const
+{
+    return qobject_cast<RtspStream *>(stream()) && !stream()->isShared();
+}
+
+/* Dragging and the wheel steer the view instead of zooming */
+bool CameraContainerWidget::isSteeringFisheye() const
+{
+    return m_fisheyeView.mode() == FisheyeView::VirtualPtz && canDewarp();
+}
+
+void CameraContainerWidget::setFisheyeView(const FisheyeView &view)
+{
+    m_fisheyeView = view;
+    if (m_stream)
+        m_stream.data()->setFisheyeView(view);
+
+    /* The wheel and dragging steer a virtual PTZ view instead */
+    if (view.mode() == FisheyeView::VirtualPtz && m_zoom > 1)
+    {
+        m_zoom = 1;
+        m_zoomCenter = QPointF(0.5, 0.5);
+        updateTileSize();
+    }
+
+    update();
+}
+
+void CameraContainerWidget::setFisheyeModeFromAction()
+{
+    QAction *a = qobject_cast<QAction*>(sender());
+    if (!a || a->data().isNull())
+        return;
+
+    setFisheyeView(FisheyeView(FisheyeView::Mode(a->data().toInt()), m_fisheyeView.pan(),
+                               m_fisheyeView.tilt(), m_fisheyeView.fov()));
+    saveFisheyeView();
+}
+
+QString CameraContainerWidget::cameraSettingsKey(const char *group) const
+{
+    if (!m_camera)
+        return QString();
+
+    return QString::fromLatin1("ui/liveview/%1/%2/%3").arg(QLatin1String(group))
+            .arg(m_camera.data()->data().server()->configuration().id())
+            .arg(m_camera.data()->data().id());
+}
+
+void CameraContainerWidget::loadFisheyeView()
+{
+    QString key = cameraSettingsKey("fisheye");
+    if (key.isEmpty())
+        return;
+
+    QSettings settings;
+    setFisheyeView(FisheyeView::fromString(settings.value(key).toString()));
+}
+
+void CameraContainerWidget::saveFisheyeView()
+{
+    QString key = cameraSettingsKey("fisheye");
+    if (key.isEmpty())
+        return;
+
+    QSettings settings;
+    if (m_fisheyeView.isEnabled())
+        settings.setValue(key, m_fisheyeView.toString());
+    else
+        settings.remove(key);
+}
+
+void CameraContainerWidget::checkMotion()
+{
+    if (!m_stream)
+        return;
+
+    QBitArray cells = m_stream.data()->motionCells();
+    if (cells.size() != m_motionMask.size())
+        return;
+
+    cells &= ~m_motionMask;
+    if (cells.count(true) < minMotionCells)
+        return;
+
+    /* Draws attention to the window when motion starts; nothing happens if it is active */
+    if (!hasRecentMotion())
+        QApplication::alert(window());
+    m_lastMotion.start();
+}
+
+bool CameraContainerWidget::hasRecentMotion() const
+{
+    return m_lastMotion.isValid() && m_lastMotion.elapsed() < motionHighlightDuration;
+}
+
+/* In widget coordinates, following the digital zoom */
+QRectF CameraContainerWidget::motionCellRect(int cell) const
+{
+    QRectF zoom = zoomRect();
+    qreal cellWidth = 1.0 / RtspMotionDetector::gridColumns;
+    qreal cellHeight = 1.0 / RtspMotionDetector::gridRows;
+    qreal x = (cell % RtspMotionDetector::gridColumns) * cellWidth;
+    qreal y = (cell / RtspMotionDetector::gridColumns) * cellHeight;
+
+    qreal xScale = m_videoRect.width() / zoom.width();
+    qreal yScale = m_videoRect.height() / zoom.height();
+    return QRectF(m_videoRect.x() + (x - zoom.x()) * xScale, m_videoRect.y() + (y - zoom.y()) * yScale,
+                  cellWidth * xScale, cellHeight * yScale);
+}
+
+void CameraContainerWidget::drawMotionMask(QPainter *p)
+{
+    p->save();
+    p->setClipRect(m_videoRect);
+    p->setPen(QColor(255, 255, 255, 64));
+
+    for (int cell = 0; cell < m_motionMask.size(); ++cell)
+    {
+        QRectF r = motionCellRect(cell);
+        if (m_motionMask.testBit(cell))
+            p->fillRect(r, QColor(0, 0, 0, 160));
+        p->drawRect(r);
+    }
+
+    p->restore();
+}
+
+void CameraContainerWidget::setEditingMotionMask(bool editing)
+{
+    m_editingMotionMask = editing;
+    update();
+}
+
+void CameraContainerWidget::clearMotionMask()
+{
+    m_motionMask.fill(false);
+    saveMotionMask();
+    update();
+}
+
+void CameraContainerWidget::loadMotionMask()
+{
+    m_motionMask = QBitArray(RtspMotionDetector::gridColumns * RtspMotionDetector::gridRows);
+
+    QString key = cameraSettingsKey("motionMask");
+    if (key.isEmpty())
+        return;
+
+    QSettings settings;
+    QBitArray mask = settings.value(key).toBitArray();
+    if (mask.size() == m_motionMask.size())
+        m_motionMask = mask;
+}
+
+void CameraContainerWidget::saveMotionMask()
+{
+    QString key = cameraSettingsKey("motionMask");
+    if (key.isEmpty())
+        return;
+
+    QSettings settings;
+    if (m_motionMask.count(true))
+        settings.setValue(key, m_motionMask);
+    else
+        settings.remove(key);
+}
+
 void CameraContainerWidget::setCamera(DVRCamera *camera)
 {
     if (camera == m_camera.data())
@@ -728,6 +1190,11 @@ void CameraContainerWidget::setCamera(DVRCamera *camera)
     }
 
     m_camera = camera;
+    m_zoom = 1;
+    m_zoomCenter = QPointF(0.5, 0.5);
+    m_panning = false;
+    m_editingMotionMask = false;
+    m_lastMotion.invalidate();
 
     {
         if (camera->liveStream() == m_stream)
@@ -736,6 +1203,7 @@ void CameraContainerWidget::setCamera(DVRCamera *camera)
         if (m_stream)
         {
             m_stream.data()->disconnect(this);
+            m_stream.data()->setFocused(false);
             m_stream.data()->unref();
         }
 
@@ -744,13 +1212,17 @@ void CameraContainerWidget::setCamera(DVRCamera *camera)
         if (m_stream.data())
         {
             connect(m_stream.data(), SIGNAL(updated()), SLOT(updateFrame()));
+            m_stream.data()->setFocused(hasFocus());
             //connect(m_stream.data(), SIGNAL(streamSizeChanged(QSize)), SLOT(updateFrameSize()));
             m_stream.data()->start();
             m_stream.data()->ref();
         }
 
         //updateFrameSize();
+        loadFisheyeView();
+        loadMotionMask();
         updateFrame();
+        updateTileSize();
     }
 
     if (m_camera)
@@ -19,9 +19,12 @@
 #define CAMERACONTAINERWIDGET_H
 
 #include <QWidget>
+#include <QBitArray>
+#include <QElapsedTimer>
 #include <QFrame>
 #include <QStaticText>
 #include "core/CameraPtzControl.h"
+#include "core/FisheyeView.h"
 #include "core/LiveStream.h"
 
 
@@ -29,6 +32,7 @@ class DVRCamera;
 class QMenu;
 class DVRServerRepository;
 class QLabel;
+class ThreadTask;
 
 class CameraContainerWidget : public QFrame//QWidget
 {
@@ -73,6 +77,14 @@ public slots:
     void openFullScreen();
     void clear() { setCamera(0); }
     void setCustomCursor(CustomCursor cursor);
+    /* Digital zoom, converted by the stream's decoder where possible; 1 shows the whole image */
+    void setZoom(qreal zoom);
+    void resetZoom() { setZoom(1); }
+    /* Remembered per camera */
+    void setFisheyeView(const FisheyeView &view);
+    /* While editing, clicking a cell of the motion grid masks or unmasks it */
+    void setEditingMotionMask(bool editing);
+    void clearMotionMask();
 
     void enableAudio();
     void disableAudio();
@@ -93,17 +105,28 @@ protected:
     virtual void mouseReleaseEvent(QMouseEvent *event);
     virtual void wheelEvent(QWheelEvent *event);
     virtual void keyPressEvent(QKeyEvent *event);
+    virtual void focusInEvent(QFocusEvent *event);
+    virtual void focusOutEvent(QFocusEvent *event);
+    virtual void resizeEvent(QResizeEvent *event);
+    virtual void showEvent(QShowEvent *event);
+    virtual void hideEvent(QHideEvent *event);
     void paintEvent(QPaintEvent *event);
 
 private slots:
     void cameraDataUpdated();
     void updateAudioState(enum AudioState state = Load);
     void setBandwidthModeFromAction();
+    void rewindFromAction();
+    void resumeLive();
+    void toggleLocalRecording();
     void serverRemoved(DVRServer *server);
     void set_main_stream();
     void set_sub_stream();
+    void setFisheyeModeFromAction();
+    void snapshotSaved(ThreadTask *task);
     void updateFrame()
     {
+        checkMotion();
         update();
     }
 private:
@@ -114,6 +137,22 @@ private:
     QSharedPointer<LiveStream> m_stream;
     QStaticText m_cameraname;
     QStaticText m_streamstatus;
+    qreal m_zoom;
+    /* Center of the zoomed part, relative to the stream size */
+    QPointF m_zoomCenter;
+    /* Where the video was last painted */
+    QRect m_videoRect;
+    bool m_panning;
+    QPoint m_panOrigin;
+    QPointF m_panCenter;
+    FisheyeView m_fisheyeView;
+    /* View when steering a virtual PTZ view started */
+    FisheyeView m_panFisheyeView;
+    /* Motion detector cells ignored by this tile, remembered per camera */
+    QBitArray m_motionMask;
+    bool m_editingMotionMask;
+    /* Restarted while there is motion outside the mask */
+    QElapsedTimer m_lastMotion;
     /* Caller is responsible for deleting */
     QMenu *ptzMenu();
     QList<QAction*> bandwidthActions();
@@ -121,6 +160,20 @@ private:
     QString statusOverlayMessage();
     void drawHeader(QPainter *p, const QRect &r);
     void initStaticText();
+    void updateTileSize();
+    QRectF zoomRect() const;
+    void zoomAt(qreal zoom, const QPoint &pos);
+    QString cameraSettingsKey(const char *group) const;
+    bool canDewarp() const;
+    bool isSteeringFisheye() const;
+    void loadFisheyeView();
+    void saveFisheyeView();
+    void checkMotion();
+    bool hasRecentMotion() const;
+    QRectF motionCellRect(int cell) const;
+    void drawMotionMask(QPainter *p);
+    void loadMotionMask();
+    void saveMotionMask();
 };
 
 #endif // CAMERACONTAINERWIDGET_H
@@ -27,6 +27,8 @@
 #include <QSettings>
 #include <QApplication>
 #include <QDesktopWidget>
+#include <QHash>
+#include <QSet>
 
 EventsModel::EventsModel(DVRServerRepository *serverRepository, QObject *parent)
     : QAbstractItemModel(parent), m_serverRepository(serverRepository)
@@ -50,7 +52,7 @@ int EventsModel::rowCount(const QModelIndex &parent) const
     if (parent.isValid())
         return 0;
 
-    return m_items.size();
+    return m_rows.size();
 }
 
 int EventsModel::columnCount(const QModelIndex &parent) const
@@ -63,10 +65,10 @@ int EventsModel::columnCount(const QModelIndex &parent) const
 
 QModelIndex EventsModel::index(int row, int column, const QModelIndex &parent) const
 {
-    if (parent.isValid() || row < 0 || column < 0 || row >= m_items.size() || column >= columnCount())
+    if (parent.isValid() || row < 0 || column < 0 || row >= m_rows.size() || column >= columnCount())
         return QModelIndex();
 
-    return createIndex(row, column, m_items[row].data());
+    return createIndex(row, column);
 }
 
 QModelIndex EventsModel::parent(const QModelIndex &child) const
@@ -77,14 +79,16 @@ QModelIndex EventsModel::parent(const QModelIndex &child) const
 
 QVariant EventsModel::data(const QModelIndex &index, int role) const
 {
-    if (!index.isValid())
+    if (!index.isValid() || index.row() >= m_rows.size())
         return QVariant();
 
-    EventData *data = reinterpret_cast<EventData*>(index.internalPointer());
-    if (!data)
-        return QVariant();
+    const EventRef data = eventAt(index.row());
 
-    if (role == EventDataPtr)
+    if (role == EventDataRole)
+    {
+        return QVariant::fromValue(data.toEventData());
+    }
+    else if (role == EventRefRole)
     {
         return QVariant::fromValue(data);
     }
@@ -97,9 +101,10 @@ QVariant EventsModel::data(const QModelIndex &index, int role) const
         int tmbWidth;
 
         if (settings.value(QLatin1String("ui/enableThumbnails"), true).toBool()
-                && (data->type() == EventType::CameraContinuous || data->type() == EventType::CameraMotion))
+                && (data.type() == EventType::CameraContinuous || data.type() == EventType::CameraMotion))
         {
-            imgStatus = bcApp->thumbnailManager()->getThumbnail(data, imgPath);
+            EventData event = data.toEventData();
+            imgStatus = bcApp->thumbnailManager()->getThumbnail(&event, imgPath);
 
             switch(imgStatus)
             {
@@ -123,12 +128,12 @@ QVariant EventsModel::data(const QModelIndex &index, int role) const
             }
         }
 
-        return tr("%1 (%2)<br>%3 on %4<br>%5<br>%6").arg(data->uiType(), data->uiLevel(), Qt::escape(data->uiLocation()),
-                                                   Qt::escape(data->uiServer()), data->localStartDate().toString(), imgString);
+        return tr("%1 (%2)<br>%3 on %4<br>%5<br>%6").arg(data.uiType(), data.uiLevel(), Qt::escape(data.uiLocation()),
+                                                   Qt::escape(data.uiServer()), data.localStartDate().toString(), imgString);
     }
     else if (role == Qt::ForegroundRole)
     {
-        return data->uiColor(false);
+        return data.uiColor(false);
     }
 
     switch (index.column())
@@ -136,28 +141,28 @@ QVariant EventsModel::data(const QModelIndex &index, int role) const
     case ServerColumn:
         if (role == Qt::DisplayRole)
         {
-            if (data->server())
-                return data->server()->configuration().displayName();
+            if (data.server())
+                return data.server()->configuration().displayName();
             else
                 return QString();
         }
         break;
     case LocationColumn:
         if (role == Qt::DisplayRole)
-            return data->uiLocation();
+            return data.uiLocation();
         break;
     case TypeColumn:
         if (role == Qt::DisplayRole)
-            return data->uiType();
+            return data.uiType();
         else if (role == Qt::DecorationRole)
-            return data->hasMedia() ? QIcon(QLatin1String(":/icons/control-000-small.png")) : QVariant();
+            return data.hasMedia() ? QIcon(QLatin1String(":/icons/control-000-small.png")) : QVariant();
         break;
     case DurationColumn:
         if (role == Qt::DisplayRole)
-            return data->uiDuration();
+            return data.uiDuration();
         else if (role == Qt::EditRole)
-            return data->durationInSeconds();
-        else if (role == Qt::FontRole && data->inProgress())
+            return data.durationInSeconds();
+        else if (role == Qt::FontRole && data.inProgress())
         {
             QFont f;
             f.setBold(true);
@@ -166,15 +171,15 @@ QVariant EventsModel::data(const QModelIndex &index, int role) const
         break;
     case LevelColumn:
         if (role == Qt::DisplayRole)
-            return data->uiLevel();
+            return data.uiLevel();
         else if (role == Qt::EditRole)
-            return data->level().level;
+            return data.level().level;
         break;
     case DateColumn:
         if (role == Qt::DisplayRole)
-            return data->localStartDate().toString();
+            return data.localStartDate().toString();
         else if (role == Qt::EditRole)
-            return data->localStartDate();
+            return data.localStartDate();
         break;
     }
 
@@ -211,22 +216,86 @@ void EventsModel::computeBoundaries()
     }
 }
 
+/* Merges the events into the server's rows instead of replacing them, so that a refresh
+ * which brings nothing new doesn't reset views, selections, and the timeline. Rows that
+ * stay keep their slot in the store, which handles point to, and are updated in place. */
 void EventsModel::setServerEvents(DVRServer *server, const QList<QSharedPointer<EventData> > &events)
 {
-    clearServerEvents(server);
     computeBoundaries();
 
-    int insertedRowBegin = m_serverEventsBoundaries.value(server).first;
-    int insertedRowEnd = insertedRowBegin + events.count() - 1;
+    int begin = m_serverEventsBoundaries.value(server).first;
+    int count = m_serverEventsCount.value(server, 0);
+
+    QSet<qint64> incoming;
+    foreach (const QSharedPointer<EventData> &event, events)
+        incoming.insert(event->eventId());
+
+    /* Rows to remove, in runs from the end so that earlier rows keep their positions */
+    for (int row = begin + count - 1; row >= begin; --row)
+    {
+        if (incoming.contains(m_store.eventId(m_rows[row])))
+            continue;
+
+        int first = row;
+        while (first > begin && !incoming.contains(m_store.eventId(m_rows[first - 1])))
+            --first;
+
+        beginRemoveRows(QModelIndex(), first, row);
+        for (int i = first; i <= row; ++i)
+            m_store.remove(m_rows[i]);
+        m_rows.remove(first, row - first + 1);
+        endRemoveRows();
+
+        count -= row - first + 1;
+        row = first;
+    }
+
+    m_serverEventsCount.insert(server, count);
+    addServerEvents(server, events);
+}
+
+void EventsModel::addServerEvents(DVRServer *server, const QList<QSharedPointer<EventData> > &events)
+{
+    computeBoundaries();
+
+    int begin = m_serverEventsBoundaries.value(server).first;
+    int count = m_serverEventsCount.value(server, 0);
+
+    QHash<qint64, QSharedPointer<EventData> > incoming;
+    foreach (const QSharedPointer<EventData> &event, events)
+        incoming.insert(event->eventId(), event);
+
+    QSet<qint64> existing;
+    for (int row = begin; row < begin + count; ++row)
+    {
+        int slot = m_rows[row];
+        existing.insert(m_store.eventId(slot));
+
+        QSharedPointer<EventData> update = incoming.value(m_store.eventId(slot));
+        if (update && !m_store.matches(slot, *update))
+        {
+            m_store.update(slot, *update);
+            emit dataChanged(index(row, 0, QModelIndex()), index(row, LastColumn, QModelIndex()));
+        }
+    }
+
+    QVector<int> added;
+    foreach (const QSharedPointer<EventData> &event, events)
+    {
+        if (!existing.contains(event->eventId()))
+            added.append(m_store.insert(*event));
+    }
 
-    if (insertedRowEnd >= insertedRowBegin)
+    if (!added.isEmpty())
     {
-        beginInsertRows(QModelIndex(), insertedRowBegin, insertedRowEnd);
-        m_items = m_items.mid(0, insertedRowBegin) + events + m_items.mid(insertedRowBegin);
+        int end = begin + count;
+        beginInsertRows(QModelIndex(), end, end + added.count() - 1);
+        m_rows.insert(end, added.count(), -1);
+        qCopy(added.constBegin(), added.constEnd(), m_rows.begin() + end);
         endInsertRows();
     }
 
-    m_serverEventsCount.insert(server, events.count());
+    m_serverEventsCount.insert(server, count + added.count());
 }
 
 void EventsModel::clearServerEvents(DVRServer *server)
@@ -239,9 +308,9 @@ void EventsModel::clearServerEvents(DVRServer *server)
     if (removedRowEnd >= removedRowBegin)
     {
         beginRemoveRows(QModelIndex(), removedRowBegin, removedRowEnd);
-        //QList<QSharedPointer<EventData> > removedEvents = m_items.mid(removedRowBegin, removedRowEnd - removedRowBegin + 1);
-        //qDeleteAll(removedEvents.begin(), removedEvents.end());
-        m_items = m_items.mid(0, removedRowBegin) + m_items.mid(removedRowEnd + 1);
+        for (int row = removedRowBegin; row <= removedRowEnd; ++row)
+            m_store.remove(m_rows[row]);
+        m_rows.remove(removedRowBegin, removedRowEnd - removedRowBegin + 1);
         endRemoveRows();
     }
 
@@ -22,6 +22,7 @@
 #include <QSharedPointer>
 
 #include "../../core/EventData.h"
+#include "../../event/EventStore.h"
 
 class DVRServer;
 class DVRServerRepository;
@@ -34,7 +35,8 @@ class EventsModel : public QAbstractItemModel
 public:
     enum
     {
-        EventDataPtr = Qt::UserRole
+        EventDataRole = Qt::UserRole, /* EventData copied out of the store */
+        EventRefRole /* EventRef, valid until the row is removed */
     };
 
     enum
@@ -58,8 +60,13 @@ public:
     virtual QVariant data(const QModelIndex &index, int role) const;
     virtual QVariant headerData(int section, Qt::Orientation orientation, int role) const;
 
+    EventRef eventAt(int row) const { return m_store.ref(m_rows[row]); }
+    const EventStore &store() const { return m_store; }
+
 public slots:
     void setServerEvents(DVRServer *server, const QList<QSharedPointer<EventData> > &events);
+    /* Adds or updates events, keeping the other events of the server */
+    void addServerEvents(DVRServer *server, const QList<QSharedPointer<EventData> > &events);
     void clearServerEvents(DVRServer *server);
 
 private slots:
@@ -68,7 +75,9 @@ private slots:
 private:
     DVRServerRepository *m_serverRepository;
 
-    QList<QSharedPointer<EventData> > m_items;
+    /* Events are held in columns; rows map to their slots in the store */
+    EventStore m_store;
+    QVector<int> m_rows;
     QMap<DVRServer *, QPair<int, int> > m_serverEventsBoundaries;
     QMap<DVRServer *, int> m_serverEventsCount;
 
@@ -16,13 +16,21 @@
  */
 
 #include "EventsProxyModel.h"
+#include "camera/DVRCamera.h"
 #include "core/EventData.h"
+#include "server/DVRServer.h"
+#include "server/DVRServerConfiguration.h"
 #include "ui/model/EventsModel.h"
+#include "utils/StringUtils.h"
 #include <QSet>
+#include <QThread>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
 
 EventsProxyModel::EventsProxyModel(QObject *parent) :
-        QSortFilterProxyModel(parent), m_column(EventsModel::ServerColumn),
-        m_incompletePlace(IncompleteInPlace), m_minimumLevel(EventLevel::Minimum)
+        QSortFilterProxyModel(parent), m_eventsModel(0), m_column(EventsModel::ServerColumn),
+        m_incompletePlace(IncompleteInPlace), m_minimumLevel(EventLevel::Minimum),
+        m_startTime(0), m_endTime(0), m_sortKeysValid(false), m_acceptedSlotsValid(false)
 {
 }
 
@@ -30,29 +38,66 @@ EventsProxyModel::~EventsProxyModel()
 {
 }
 
+void EventsProxyModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    if (m_eventsModel)
+    {
+        disconnect(m_eventsModel, 0, this, SLOT(clearRowRanks()));
+        disconnect(m_eventsModel, 0, this, SLOT(sourceRowsInserted(QModelIndex,int,int)));
+        disconnect(m_eventsModel, 0, this, SLOT(sourceDataChanged(QModelIndex,QModelIndex)));
+        disconnect(m_eventsModel, 0, this, SLOT(clearAcceptedSlots()));
+    }
+
+    /* Rows are read straight from the store rather than through data() */
+    m_eventsModel = qobject_cast<EventsModel *>(sourceModel);
+    m_sortKeysValid = false;
+    m_rowRanks.clear();
+    m_acceptedSlotsValid = false;
+
+    /* Connected ahead of the base class, so that row ranks are dropped and the
+     * accepted slots are brought up to date before it filters and sorts changed rows */
+    if (m_eventsModel)
+    {
+        connect(m_eventsModel, SIGNAL(rowsInserted(QModelIndex,int,int)), SLOT(clearRowRanks()));
+        connect(m_eventsModel, SIGNAL(rowsRemoved(QModelIndex,int,int)), SLOT(clearRowRanks()));
+        connect(m_eventsModel, SIGNAL(dataChanged(QModelIndex,QModelIndex)), SLOT(clearRowRanks()));
+        connect(m_eventsModel, SIGNAL(layoutChanged()), SLOT(clearRowRanks()));
+        connect(m_eventsModel, SIGNAL(modelReset()), SLOT(clearRowRanks()));
+        connect(m_eventsModel, SIGNAL(rowsInserted(QModelIndex,int,int)), SLOT(sourceRowsInserted(QModelIndex,int,int)));
+        connect(m_eventsModel, SIGNAL(dataChanged(QModelIndex,QModelIndex)), SLOT(sourceDataChanged(QModelIndex,QModelIndex)));
+        connect(m_eventsModel, SIGNAL(modelReset()), SLOT(clearAcceptedSlots()));
+    }
+
+    QSortFilterProxyModel::setSourceModel(sourceModel);
+}
+
 bool EventsProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
 {
     if (sourceParent.isValid())
         return true;
 
-    EventData *eventData = sourceModel()->index(sourceRow, 0).data(EventsModel::EventDataPtr).value<EventData *>();
-    if (!eventData)
+    if (!m_eventsModel || sourceRow < 0 || sourceRow >= m_eventsModel->rowCount())
         return false;
 
-    return filterAcceptsRow(eventData);
+    if (!m_acceptedSlotsValid)
+        updateAcceptedSlots();
+
+    int slot = m_eventsModel->eventAt(sourceRow).slot();
+    return slot < m_acceptedSlots.size() && m_acceptedSlots.testBit(slot);
 }
 
-bool EventsProxyModel::filterAcceptsRow(EventData *eventData) const
+bool EventsProxyModel::filterAcceptsRow(const EventRef &eventData) const
 {
-    if (eventData->level() < m_minimumLevel)
+    if (eventData.level() < m_minimumLevel)
         return false;
 
-    if (!m_types.isNull() && (int)eventData->type() >= 0 && !m_types.testBit((int)eventData->type()))
+    int type = eventData.type();
+    if (!m_types.isNull() && type >= 0 && (type >= m_types.size() || !m_types.testBit(type)))
         return false;
 
     //if (!m_day.isNull() && eventData->localStartDate().date() != m_day)
     //  return false;
-    if (!m_dtStart.isNull() && !m_dtEnd.isNull() && (eventData->localStartDate() < m_dtStart || eventData->localStartDate() > m_dtEnd))
+    if (!m_dtStart.isNull() && !m_dtEnd.isNull() && (eventData.startTime() < m_startTime || eventData.startTime() > m_endTime))
         return false;
 
 
@@ -60,14 +105,14 @@ bool EventsProxyModel::filterAcceptsRow(EventData *eventData) const
     if (m_sources.isEmpty())
         return true;
 
-    QMap<DVRServer*, QSet<int> >::ConstIterator it = m_sources.find(eventData->server());
+    QMap<DVRServer*, QSet<int> >::ConstIterator it = m_sources.find(eventData.server());
     if (it == m_sources.end())
         return false;
 
     if (it->isEmpty())
         return true;
 
-    if (it->contains(eventData->locationId()))
+    if (it->contains(eventData.locationId()))
         return true;
 
     return false;
@@ -75,22 +120,27 @@ bool EventsProxyModel::filterAcceptsRow(EventData *eventData) const
 
 bool EventsProxyModel::lessThan(const QModelIndex &left, const QModelIndex &right) const
 {
-    EventData *leftEvent = left.data(EventsModel::EventDataPtr).value<EventData *>();
-    EventData *rightEvent = right.data(EventsModel::EventDataPtr).value<EventData *>();
+    if (m_eventsModel && left.model() == m_eventsModel && right.model() == m_eventsModel)
+    {
+        if (!m_rowRanks.isEmpty())
+        {
+            Q_ASSERT(m_rowRanks.size() == m_eventsModel->rowCount());
+            return m_rowRanks[left.row()] < m_rowRanks[right.row()];
+        }
 
-    if (leftEvent && rightEvent)
-        return lessThan(leftEvent, rightEvent, m_column);
+        return lessThan(m_eventsModel->eventAt(left.row()), m_eventsModel->eventAt(right.row()), m_column);
+    }
 
     return QSortFilterProxyModel::lessThan(left, right);
 }
 
-bool EventsProxyModel::lessThan(EventData *left, EventData *right, int column) const
+bool EventsProxyModel::lessThan(const EventRef &left, const EventRef &right, int column) const
 {
     if (m_incompletePlace != IncompleteInPlace)
     {
-        if (left->inProgress() && !right->inProgress())
+        if (left.inProgress() && !right.inProgress())
             return m_incompletePlace == IncompleteFirst ? true : false;
-        else if (right->inProgress() && !left->inProgress())
+        else if (right.inProgress() && !left.inProgress())
             return m_incompletePlace == IncompleteFirst ? false : true;
     }
 
@@ -101,24 +151,28 @@ bool EventsProxyModel::lessThan(EventData *left, EventData *right, int column) c
         return res < 0;
 }
 
-int EventsProxyModel::compare(EventData *left, EventData *right, int column) const
+int EventsProxyModel::compare(const EventRef &left, const EventRef &right, int column) const
 {
     switch (column)
     {
         case EventsModel::ServerColumn:
-            return QString::localeAwareCompare(left->server()->configuration().displayName(), right->server()->configuration().displayName());
+            return serverRank(left) - serverRank(right);
         case EventsModel::LocationColumn:
-            return QString::localeAwareCompare(left->uiLocation(), right->uiLocation());
+            return locationRank(left) - locationRank(right);
         case EventsModel::TypeColumn:
-            return QString::localeAwareCompare(left->uiType(), right->uiType());
+            return typeRank(left) - typeRank(right);
         case EventsModel::DurationColumn:
-            return left->durationInSeconds() - right->durationInSeconds();
+            return left.durationInSeconds() - right.durationInSeconds();
         case EventsModel::LevelColumn:
-            return left->level() - right->level();
+            return left.level() - right.level();
         case EventsModel::DateColumn:
-            return right->localStartDate().secsTo(left->localStartDate());
+        {
+            /* Whole seconds, as the dates used to be compared */
+            qint64 diff = left.startTime() / 1000 - right.startTime() / 1000;
+            return diff < 0 ? -1 : (diff > 0 ? 1 : 0);
+        }
         default:
-            return left - right;
+            return left.slot() - right.slot();
     }
 }
 
@@ -128,6 +182,7 @@ void EventsProxyModel::setColumn(int column)
         return;
 
     m_column = column;
+    m_rowRanks.clear();
     invalidateFilter();
 }
 
@@ -137,6 +192,7 @@ void EventsProxyModel::setIncompletePlace(IncompletePlace incompletePlace)
         return;
 
     m_incompletePlace = incompletePlace;
+    m_rowRanks.clear();
     invalidateFilter();
 }
 
@@ -145,8 +201,9 @@ void EventsProxyModel::setMinimumLevel(EventLevel minimumLevel)
     if (m_minimumLevel == minimumLevel)
         return;
 
+    bool narrowed = minimumLevel > m_minimumLevel;
     m_minimumLevel = minimumLevel;
-    invalidateFilter();
+    filterChanged(&EventsProxyModel::levelSlots, narrowed);
 }
 
 void EventsProxyModel::setTypes(QBitArray types)
@@ -154,8 +211,15 @@ void EventsProxyModel::setTypes(QBitArray types)
     if (m_types == types)
         return;
 
+    bool narrowed = !types.isNull();
+    for (int type = 0; narrowed && !m_types.isNull() && type < types.size(); ++type)
+    {
+        if (types.testBit(type) && (type >= m_types.size() || !m_types.testBit(type)))
+            narrowed = false;
+    }
+
     m_types = types;
-    invalidateFilter();
+    filterChanged(&EventsProxyModel::typeSlots, narrowed);
 }
 
 void EventsProxyModel::setDay(const QDate &day)
@@ -167,11 +231,17 @@ void EventsProxyModel::setDay(const QDate &day)
     if (m_dtStart.date() == day && m_dtEnd.date() == day)
         return;
 
+    bool wasLimited = !m_dtStart.isNull() && !m_dtEnd.isNull();
+    qint64 startTime = m_startTime;
+    qint64 endTime = m_endTime;
+
     m_dtStart.setDate(day);
     m_dtEnd.setDate(day);
     m_dtEnd.setTime(QTime(23, 59, 59, 999));
+    updateTimeBounds();
 
-    invalidateFilter();
+    bool narrowed = !wasLimited || (m_startTime >= startTime && m_endTime <= endTime);
+    filterChanged(&EventsProxyModel::timeSlots, narrowed);
 }
 
 void EventsProxyModel::setTimeRange(const QDateTime &from, const QDateTime &to)
@@ -179,9 +249,17 @@ void EventsProxyModel::setTimeRange(const QDateTime &from, const QDateTime &to)
     if (m_dtStart == from && m_dtEnd == to)
         return;
 
+    bool wasLimited = !m_dtStart.isNull() && !m_dtEnd.isNull();
+    qint64 startTime = m_startTime;
+    qint64 endTime = m_endTime;
+
     m_dtStart = from;
     m_dtEnd = to;
-    invalidateFilter();
+    updateTimeBounds();
+
+    bool isLimited = !m_dtStart.isNull() && !m_dtEnd.isNull();
+    bool narrowed = isLimited && (!wasLimited || (m_startTime >= startTime && m_endTime <= endTime));
+    filterChanged(&EventsProxyModel::timeSlots, narrowed);
 }
 
 void EventsProxyModel::setSources(const QMap<DVRServer *, QSet<int> > &sources)
@@ -189,6 +267,312 @@ void EventsProxyModel::setSources(const QMap<DVRServer *, QSet<int> > &sources)
     if (m_sources == sources)
         return;
 
+    bool narrowed = !sources.isEmpty();
+    if (!m_sources.isEmpty())
+    {
+        for (QMap<DVRServer *, QSet<int> >::ConstIterator it = sources.constBegin();
+             narrowed && it != sources.constEnd(); ++it)
+        {
+            QMap<DVRServer *, QSet<int> >::ConstIterator old = m_sources.constFind(it.key());
+            if (old == m_sources.constEnd())
+                narrowed = false;
+            else if (!old->isEmpty())
+                narrowed = !it->isEmpty() && old->contains(*it);
+        }
+    }
+
     m_sources = sources;
+    filterChanged(&EventsProxyModel::sourceSlots, narrowed);
+}
+
+void EventsProxyModel::updateTimeBounds()
+{
+    m_startTime = m_dtStart.isValid() ? m_dtStart.toMSecsSinceEpoch() : 0;
+    m_endTime = m_dtEnd.isValid() ? m_dtEnd.toMSecsSinceEpoch() : 0;
+}
+
+bool EventsProxyModel::levelSlots(QBitArray &bits) const
+{
+    if (m_minimumLevel == EventLevel::Minimum)
+        return false;
+
+    const EventBitmapIndex &bitmaps = m_eventsModel->store().bitmaps();
+    for (int level = m_minimumLevel; level <= EventLevel::Critical; ++level)
+        bits |= bitmaps.levelSlots(level);
+    return true;
+}
+
+bool EventsProxyModel::typeSlots(QBitArray &bits) const
+{
+    if (m_types.isNull())
+        return false;
+
+    /* Events of an unknown type are never filtered out */
+    const EventBitmapIndex &bitmaps = m_eventsModel->store().bitmaps();
+    bits |= bitmaps.typeSlots(EventType::UnknownType);
+    for (int type = 0; type <= EventType::Max && type < m_types.size(); ++type)
+    {
+        if (m_types.testBit(type))
+            bits |= bitmaps.typeSlots(type);
+    }
+    return true;
+}
+
+bool EventsProxyModel::timeSlots(QBitArray &bits) const
+{
+    if (m_dtStart.isNull() || m_dtEnd.isNull())
+        return false;
+
+    bits = m_eventsModel->store().slotsStartedWithin(m_startTime, m_endTime);
+    return true;
+}
+
+bool EventsProxyModel::sourceSlots(QBitArray &bits) const
+{
+    if (m_sources.isEmpty())
+        return false;
+
+    const EventStore &store = m_eventsModel->store();
+    for (int source = 0; source < store.sourceCount(); ++source)
+    {
+        QMap<DVRServer *, QSet<int> >::ConstIterator it = m_sources.constFind(store.sourceServer(source));
+        if (it != m_sources.constEnd() && (it->isEmpty() || it->contains(store.sourceLocationId(source))))
+            bits |= store.bitmaps().sourceSlots(source);
+    }
+    return true;
+}
+
+void EventsProxyModel::updateAcceptedSlots() const
+{
+    static const SlotsFunction parts[] = {
+        &EventsProxyModel::levelSlots, &EventsProxyModel::typeSlots,
+        &EventsProxyModel::timeSlots, &EventsProxyModel::sourceSlots
+    };
+
+    m_acceptedSlots = QBitArray(m_eventsModel ? m_eventsModel->store().slotCount() : 0, true);
+    m_acceptedSlotsValid = true;
+    if (!m_eventsModel)
+        return;
+
+    /* Bits past the end of a part are clear, so the result never outgrows it */
+    for (unsigned i = 0; i < sizeof(parts) / sizeof(parts[0]); ++i)
+    {
+        QBitArray bits;
+        if ((this->*parts[i])(bits))
+            m_acceptedSlots &= bits;
+    }
+}
+
+void EventsProxyModel::updateAcceptedRows(int first, int last)
+{
+    if (!m_acceptedSlotsValid)
+        return;
+
+    m_acceptedSlots.resize(qMax(m_acceptedSlots.size(), m_eventsModel->store().slotCount()));
+    for (int row = first; row <= last; ++row)
+    {
+        EventRef event = m_eventsModel->eventAt(row);
+        m_acceptedSlots.setBit(event.slot(), filterAcceptsRow(event));
+    }
+}
+
+void EventsProxyModel::filterChanged(SlotsFunction slotsOf, bool narrowed)
+{
+    /* A narrower filter can only drop slots, so the changed part is enough */
+    if (narrowed && m_acceptedSlotsValid && m_eventsModel)
+    {
+        QBitArray bits;
+        if ((this->*slotsOf)(bits))
+            m_acceptedSlots &= bits;
+    }
+    else
+        m_acceptedSlotsValid = false;
+
+    /* The base class keeps its mapping, removing and inserting only the rows whose
+     * result changed */
     invalidateFilter();
 }
+
+void EventsProxyModel::sourceRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    if (!parent.isValid())
+        updateAcceptedRows(first, last);
+}
+
+void EventsProxyModel::sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    if (!topLeft.parent().isValid())
+        updateAcceptedRows(topLeft.row(), bottomRight.row());
+}
+
+void EventsProxyModel::clearAcceptedSlots()
+{
+    m_acceptedSlotsValid = false;
+}
+
+void EventsProxyModel::updateSortKeys() const
+{
+    m_serverNames.clear();
+    m_locationNames.clear();
+
+    if (m_eventsModel)
+    {
+        const EventStore &store = m_eventsModel->store();
+        for (int i = 0; i < store.sourceCount(); ++i)
+        {
+            DVRServer *server = store.sourceServer(i);
+            int locationId = store.sourceLocationId(i);
+
+            m_serverNames.append(server ? server->configuration().displayName() : QString());
+            m_locationNames.append(EventData::uiLocation(server, locationId));
+
+            if (!server)
+                continue;
+
+            connect(server, SIGNAL(changed()), this, SLOT(sourceNamesChanged()), Qt::UniqueConnection);
+            connect(server, SIGNAL(cameraAdded(DVRCamera*)), this, SLOT(sourceNamesChanged()), Qt::UniqueConnection);
+            connect(server, SIGNAL(cameraRemoved(DVRCamera*)), this, SLOT(sourceNamesChanged()), Qt::UniqueConnection);
+            if (DVRCamera *camera = server->getCamera(locationId))
+                connect(camera, SIGNAL(dataUpdated()), this, SLOT(sourceNamesChanged()), Qt::UniqueConnection);
+        }
+    }
+
+    m_serverRanks = collationRanks(m_serverNames);
+    m_locationRanks = collationRanks(m_locationNames);
+
+    if (m_typeRanks.isEmpty())
+    {
+        QStringList typeNames;
+        for (int type = EventType::UnknownType; type <= EventType::Max; ++type)
+            typeNames.append(EventType(EventType::Type(type)).uiString());
+        m_typeRanks = collationRanks(typeNames);
+    }
+
+    m_sortKeysValid = true;
+}
+
+int EventsProxyModel::serverRank(const EventRef &event) const
+{
+    int source = event.store()->sourceIndex(event.slot());
+    if (!m_sortKeysValid || source >= m_serverRanks.size())
+        updateSortKeys();
+    return m_serverRanks.value(source);
+}
+
+int EventsProxyModel::locationRank(const EventRef &event) const
+{
+    int source = event.store()->sourceIndex(event.slot());
+    if (!m_sortKeysValid || source >= m_locationRanks.size())
+        updateSortKeys();
+    return m_locationRanks.value(source);
+}
+
+int EventsProxyModel::typeRank(const EventRef &event) const
+{
+    if (!m_sortKeysValid)
+        updateSortKeys();
+    return m_typeRanks.value(int(event.type()) - EventType::UnknownType);
+}
+
+void EventsProxyModel::sourceNamesChanged()
+{
+    QStringList serverNames = m_serverNames;
+    QStringList locationNames = m_locationNames;
+    updateSortKeys();
+
+    if (m_serverNames == serverNames && m_locationNames == locationNames)
+        return;
+
+    m_rowRanks.clear();
+    if (dynamicSortFilter() && (m_column == EventsModel::ServerColumn || m_column == EventsModel::LocationColumn))
+        invalidate();
+}
+
+void EventsProxyModel::clearRowRanks()
+{
+    m_rowRanks.clear();
+}
+
+struct SourceRowLessThan
+{
+    const EventsProxyModel *model;
+
+    explicit SourceRowLessThan(const EventsProxyModel *m) : model(m) { }
+
+    bool operator()(int left, int right) const
+    {
+        return model->lessThan(model->m_eventsModel->eventAt(left), model->m_eventsModel->eventAt(right),
+                               model->m_column);
+    }
+};
+
+/* Rows [first, last) to sort, or to merge at middle once both halves are sorted */
+struct SortRange
+{
+    int first;
+    int middle;
+    int last;
+
+    SortRange(int f, int m, int l) : first(f), middle(m), last(l) { }
+};
+
+struct SortRowsRange
+{
+    typedef void result_type;
+
+    int *rows;
+    SourceRowLessThan lessThan;
+
+    SortRowsRange(int *r, const SourceRowLessThan &l) : rows(r), lessThan(l) { }
+
+    void operator()(const SortRange &range) const
+    {
+        if (range.middle < 0)
+            std::stable_sort(rows + range.first, rows + range.last, lessThan);
+        else
+            std::inplace_merge(rows + range.first, rows + range.middle, rows + range.last, lessThan);
+    }
+};
+
+void EventsProxyModel::updateRowRanks()
+{
+    int count = m_eventsModel->rowCount();
+
+    /* Workers only read the sort keys, so they must be complete before starting */
+    updateSortKeys();
+
+    QVector<int> rows(count);
+    for (int i = 0; i < count; ++i)
+        rows[i] = i;
+
+    int chunkCount = qMax(1, QThread::idealThreadCount());
+    int chunkSize = (count + chunkCount - 1) / chunkCount;
+    SortRowsRange sortRange(rows.data(), SourceRowLessThan(this));
+
+    /* Sort a chunk per thread, then merge pairs of chunks until one is left */
+    QList<SortRange> ranges;
+    for (int first = 0; first < count; first += chunkSize)
+        ranges.append(SortRange(first, -1, qMin(first + chunkSize, count)));
+    QtConcurrent::blockingMap(ranges, sortRange);
+
+    for (int width = chunkSize; width < count; width *= 2)
+    {
+        ranges.clear();
+        for (int first = 0; first + width < count; first += 2 * width)
+            ranges.append(SortRange(first, first + width, qMin(first + 2 * width, count)));
+        QtConcurrent::blockingMap(ranges, sortRange);
+    }
+
+    m_rowRanks.resize(count);
+    for (int i = 0; i < count; ++i)
+        m_rowRanks[rows[i]] = i;
+}
+
+void EventsProxyModel::sort(int column, Qt::SortOrder order)
+{
+    /* The base class then only compares precomputed positions */
+    if (m_eventsModel && m_rowRanks.isEmpty() && m_eventsModel->rowCount() >= ParallelSortThreshold)
+        updateRowRanks();
+
+    QSortFilterProxyModel::sort(column, order);
+}
@@ -19,8 +19,14 @@
 #define EVENTS_PROXY_MODEL_H
 
 #include "core/EventData.h"
+#include "event/EventStore.h"
 #include <QBitArray>
 #include <QSortFilterProxyModel>
+#include <QStringList>
+#include <QVector>
+
+class EventsModel;
+struct SourceRowLessThan;
 
 class EventsProxyModel : public QSortFilterProxyModel
 {
@@ -39,6 +45,8 @@ public:
 
     virtual bool filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const;
     virtual bool lessThan(const QModelIndex &left, const QModelIndex &right) const;
+    virtual void setSourceModel(QAbstractItemModel *sourceModel);
+    virtual void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
 
     void setColumn(int column);
     void setIncompletePlace(IncompletePlace incompletePlace);
@@ -49,7 +57,24 @@ public:
     void setTimeRange(const QDateTime &from, const QDateTime &to);
     void setSources(const QMap<DVRServer*, QSet<int> > &sources);
 
+private slots:
+    void sourceNamesChanged();
+    void clearRowRanks();
+    void sourceRowsInserted(const QModelIndex &parent, int first, int last);
+    void sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void clearAcceptedSlots();
+
 private:
+    friend struct SourceRowLessThan;
+
+    /* Sorts of at least this many rows are ranked on all threads beforehand */
+    enum { ParallelSortThreshold = 20000 };
+
+    /* Fills bits with the store slots passing one part of the filter, or returns
+     * false if that part lets everything through */
+    typedef bool (EventsProxyModel::*SlotsFunction)(QBitArray &bits) const;
+
+    EventsModel *m_eventsModel;
     int m_column;
     IncompletePlace m_incompletePlace;
     EventLevel m_minimumLevel;
@@ -57,11 +82,46 @@ private:
     //QDate m_day;
     QDateTime m_dtStart;
     QDateTime m_dtEnd;
+    /* m_dtStart and m_dtEnd in epoch milliseconds, compared against the store */
+    qint64 m_startTime;
+    qint64 m_endTime;
     QMap<DVRServer*, QSet<int> > m_sources;
 
-    bool filterAcceptsRow(EventData *eventData) const;
-    bool lessThan(EventData *left, EventData *right, int column) const;
-    int compare(EventData *left, EventData *right, int column) const;
+    /* Collation ranks of server and location names by store source, and of type names,
+     * so that sorting compares integers. Rebuilt when a source is added or renamed. */
+    mutable bool m_sortKeysValid;
+    mutable QStringList m_serverNames;
+    mutable QStringList m_locationNames;
+    mutable QVector<int> m_serverRanks;
+    mutable QVector<int> m_locationRanks;
+    mutable QVector<int> m_typeRanks;
+
+    /* Position of each source row in the sort order, while the source is unchanged */
+    QVector<int> m_rowRanks;
+
+    /* Store slots passing the filter, combined from the store's bitmaps. Rows added
+     * or changed later are tested one by one as they arrive. */
+    mutable bool m_acceptedSlotsValid;
+    mutable QBitArray m_acceptedSlots;
+
+    bool filterAcceptsRow(const EventRef &event) const;
+    bool lessThan(const EventRef &left, const EventRef &right, int column) const;
+    int compare(const EventRef &left, const EventRef &right, int column) const;
+    void updateTimeBounds();
+
+    bool levelSlots(QBitArray &bits) const;
+    bool typeSlots(QBitArray &bits) const;
+    bool timeSlots(QBitArray &bits) const;
+    bool sourceSlots(QBitArray &bits) const;
+    void updateAcceptedSlots() const;
+    void updateAcceptedRows(int first, int last);
+    void filterChanged(SlotsFunction slotsOf, bool narrowed);
+
+    void updateSortKeys() const;
+    int serverRank(const EventRef &event) const;
+    int locationRank(const EventRef &event) const;
+    int typeRank(const EventRef &event) const;
+    void updateRowRanks();
 
 };
 
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CpuUsage.h"
+#include <QThread>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#endif
+
+CpuUsage::CpuUsage()
+    : m_lastCpuTime(processCpuTime()), m_lastSample(0), m_cores(qMax(1, QThread::idealThreadCount()))
+{
+    m_wallTimer.start();
+}
+
+qreal CpuUsage::sample()
+{
+    qint64 cpuTime = processCpuTime();
+    qint64 wallTime = m_wallTimer.restart() * 1000;
+
+    if (wallTime > 0 && cpuTime >= m_lastCpuTime)
+        m_lastSample = qBound(qreal(0), qreal(cpuTime - m_lastCpuTime) / (qreal(wallTime) * m_cores), qreal(1));
+
+    m_lastCpuTime = cpuTime;
+    return m_lastSample;
+}
+
+/* User and system time of the whole process, in microseconds */
+qint64 CpuUsage::processCpuTime()
+{
+#ifdef Q_OS_WIN
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0;
+
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    /* FILETIME is in 100ns units */
+    return qint64((k.QuadPart + u.QuadPart) / 10);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    return qint64(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+            + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CPUUSAGE_H
+#define CPUUSAGE_H
+
+#include <QElapsedTimer>
+
+/* Measures the CPU time used by this process between calls to sample(), as a fraction
+ * of the total capacity of all cores (0 to 1). */
+
+class CpuUsage
+{
+public:
+    CpuUsage();
+
+    qreal sample();
+    qreal lastSample() const { return m_lastSample; }
+
+private:
+    QElapsedTimer m_wallTimer;
+    qint64 m_lastCpuTime;
+    qreal m_lastSample;
+    int m_cores;
+
+    static qint64 processCpuTime();
+};
+
+#endif // CPUUSAGE_H
@@ -18,6 +18,7 @@
 #include "DateTimeUtils.h"
 #include <QDateTime>
 #include <QLatin1Char>
+#include <QStringRef>
 
 QDateTime isoToDateTime(const QString &str, qint16 *tzOffsetMins)
 {
@@ -65,3 +66,98 @@ QDateTime isoToDateTime(const QString &str, qint16 *tzOffsetMins)
     re.setTimeSpec(Qt::UTC);
     return re.addSecs(int(-offset)*60);
 }
+
+static bool readDigits(const QChar *p, int count, int *value)
+{
+    int v = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        ushort c = p[i].unicode();
+        if (c < '0' || c > '9')
+            return false;
+        v = v * 10 + (c - '0');
+    }
+
+    *value = v;
+    return true;
+}
+
+/* Days since 1970-01-01 of a proleptic Gregorian date */
+static qint64 daysFromCivil(int y, int m, int d)
+{
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return qint64(era) * 146097 + doe - 719468;
+}
+
+bool parseIsoDateTime(const QStringRef &str, qint64 *utcMSecs, qint16 *tzOffsetMins)
+{
+    const QChar *p = str.unicode();
+    int size = str.size();
+    int year, month, day, hour, minute, second;
+
+    if (size < 19 || p[4] != QLatin1Char('-') || p[7] != QLatin1Char('-') || p[10] != QLatin1Char('T')
+            || p[13] != QLatin1Char(':') || p[16] != QLatin1Char(':'))
+        return false;
+
+    if (!readDigits(p, 4, &year) || !readDigits(p + 5, 2, &month) || !readDigits(p + 8, 2, &day)
+            || !readDigits(p + 11, 2, &hour) || !readDigits(p + 14, 2, &minute) || !readDigits(p + 17, 2, &second))
+        return false;
+
+    if (!QDate::isValid(year, month, day) || hour > 23 || minute > 59 || second > 59)
+        return false;
+
+    int pos = 19;
+    int msecs = 0;
+    if (pos < size && (p[pos] == QLatin1Char('.') || p[pos] == QLatin1Char(',')))
+    {
+        int scale = 100;
+        for (++pos; pos < size && p[pos].unicode() >= '0' && p[pos].unicode() <= '9'; ++pos)
+        {
+            msecs += (p[pos].unicode() - '0') * scale;
+            scale /= 10;
+        }
+    }
+
+    int offset = 0;
+    if (pos < size)
+    {
+        if (p[pos] == QLatin1Char('Z'))
+            ++pos;
+        else if (p[pos] == QLatin1Char('+') || p[pos] == QLatin1Char('-'))
+        {
+            bool positive = p[pos] == QLatin1Char('+');
+            int hours, minutes = 0;
+
+            if (pos + 3 > size || !readDigits(p + pos + 1, 2, &hours))
+                return false;
+            pos += 3;
+
+            if (pos < size && p[pos] == QLatin1Char(':'))
+                ++pos;
+            if (pos < size)
+            {
+                if (pos + 2 > size || !readDigits(p + pos, 2, &minutes))
+                    return false;
+                pos += 2;
+            }
+
+            offset = hours * 60 + minutes;
+            if (!positive)
+                offset = -offset;
+        }
+    }
+
+    if (pos != size)
+        return false;
+
+    if (tzOffsetMins)
+        *tzOffsetMins = qint16(offset);
+
+    qint64 seconds = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    *utcMSecs = (seconds - qint64(offset) * 60) * 1000 + msecs;
+    return true;
+}
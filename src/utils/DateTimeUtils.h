@@ -22,7 +22,13 @@
 
 class QDateTime;
 class QString;
+class QStringRef;
 
 QDateTime isoToDateTime(const QString &str, qint16 *tzOffsetMins = 0);
 
+/* Fast path for the common "YYYY-MM-DDThh:mm:ss[.fff][Z|+hh[:mm]]" form, giving msecs since
+ * the epoch in UTC without going through QDateTime. Returns false for anything else, which
+ * isoToDateTime may still understand. */
+bool parseIsoDateTime(const QStringRef &str, qint64 *utcMSecs, qint16 *tzOffsetMins = 0);
+
 #endif // DATETIMEUTILS_H
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ImageDecodePool.h"
+#include "ImageDecodeTask.h"
+#include <QThread>
+
+ImageDecodePool::ImageDecodePool()
+{
+    /* Leave a core for the GUI and the RTSP workers, but never go below two threads so that
+     * one large frame can't hold up every other stream */
+    m_pool.setMaxThreadCount(qBound(2, QThread::idealThreadCount() - 1, 8));
+    m_pool.setExpiryTimeout(60000);
+}
+
+ImageDecodePool::~ImageDecodePool()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void ImageDecodePool::start(ImageDecodeTask *task, Priority priority)
+{
+    Q_ASSERT(task);
+    m_pool.start(task, priority);
+}
+
+bool ImageDecodePool::drop(ImageDecodeTask *task)
+{
+    if (!task)
+        return false;
+
+#if QT_VERSION >= 0x050900
+    if (m_pool.tryTake(task))
+    {
+        task->discard();
+        return true;
+    }
+#endif
+
+    task->cancel();
+    return false;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEDECODEPOOL_H
+#define IMAGEDECODEPOOL_H
+
+#include <QThreadPool>
+
+class ImageDecodeTask;
+
+/* Bounded thread pool dedicated to live image decoding.
+ *
+ * The global pool is shared with QtConcurrent (event parsing, file copies), so a long job
+ * there can starve live decoding. Tasks are ordered by priority lane; within a lane they run
+ * in submission order. A task that has not started yet can be taken back with drop(), which
+ * is how stale frames are skipped without being decoded. */
+
+class ImageDecodePool
+{
+    Q_DISABLE_COPY(ImageDecodePool)
+
+public:
+    enum Priority
+    {
+        BackgroundPriority,
+        NormalPriority,
+        FocusedPriority
+    };
+
+    ImageDecodePool();
+    ~ImageDecodePool();
+
+    int maxThreadCount() const { return m_pool.maxThreadCount(); }
+
+    void start(ImageDecodeTask *task, Priority priority = NormalPriority);
+
+    /* Removes a task that has not started yet and frees it; returns false if the task
+     * is already running or finished, in which case it will still deliver a result. */
+    bool drop(ImageDecodeTask *task);
+
+private:
+    QThreadPool m_pool;
+};
+
+#endif // IMAGEDECODEPOOL_H
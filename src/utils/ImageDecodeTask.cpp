@@ -24,12 +24,15 @@
 extern const char *jpegFormatName;
 
 ImageDecodeTask::ImageDecodeTask(QObject *caller, const char *callback, quint64 id)
-    : ThreadTask(caller, callback), imageId(id)
+    : ThreadTask(caller, callback), imageId(id), m_queueTime(0), m_decodeTime(0)
 {
+    m_timer.start();
 }
 
 void ImageDecodeTask::runTask()
 {
+    m_queueTime = m_timer.elapsed();
+
     if (isCancelled() || m_data.isNull())
     {
         m_data.clear();
@@ -53,6 +56,7 @@ void ImageDecodeTask::runTask()
 
     buffer.close();
     m_data.clear();
+    m_decodeTime = m_timer.elapsed() - m_queueTime;
 
     if (!ok)
     {
@@ -19,6 +19,7 @@
 #define IMAGEDECODETASK_H
 
 #include "ThreadTask.h"
+#include <QElapsedTimer>
 #include <QImage>
 #include <QVector>
 
@@ -33,12 +34,21 @@ public:
 
     QImage result() const { return m_result; }
 
+    /* Time spent waiting in the pool, and time spent decoding, in milliseconds */
+    qint64 queueTime() const { return m_queueTime; }
+    qint64 decodeTime() const { return m_decodeTime; }
+    /* Time since the task was created */
+    qint64 elapsed() const { return m_timer.elapsed(); }
+
 protected:
     virtual void runTask();
 
 private:
     QByteArray m_data;
     QImage m_result;
+    QElapsedTimer m_timer;
+    qint64 m_queueTime;
+    qint64 m_decodeTime;
 };
 
 #endif // IMAGEDECODETASK_H
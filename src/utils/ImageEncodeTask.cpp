@@ -0,0 +1,102 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ImageEncodeTask.h"
+#include <QImageWriter>
+#include <QPainter>
+#include <QDebug>
+#include <math.h>
+
+/* Space for each image on a contact sheet, and for its caption below it */
+static const QSize sheetCellSize(640, 360);
+static const int sheetCaptionHeight = 24;
+
+ImageEncodeTask::ImageEncodeTask(QObject *caller, const char *callback, const QString &fileName)
+    : ThreadTask(caller, callback), m_fileName(fileName), m_ok(false)
+{
+}
+
+void ImageEncodeTask::setImage(const QImage &image)
+{
+    m_images = QList<QImage>() << image;
+    m_captions.clear();
+}
+
+void ImageEncodeTask::setContactSheet(const QList<QImage> &images, const QStringList &captions)
+{
+    Q_ASSERT(images.size() == captions.size());
+    m_images = images;
+    m_captions = captions;
+}
+
+void ImageEncodeTask::runTask()
+{
+    if (isCancelled() || m_images.isEmpty())
+    {
+        m_images.clear();
+        return;
+    }
+
+    QImage image = m_captions.isEmpty() ? m_images.first() : contactSheet();
+    /* Drop our references as early as possible; the streams are still producing frames */
+    m_images.clear();
+
+    QImageWriter writer(m_fileName);
+    if (writer.format().isEmpty())
+        writer.setFormat("jpeg");
+
+    m_ok = writer.write(image);
+    if (!m_ok)
+    {
+        m_errorString = writer.errorString();
+        qDebug() << "Image encoding error:" << m_fileName << m_errorString;
+    }
+}
+
+QImage ImageEncodeTask::contactSheet() const
+{
+    int columns = int(ceil(sqrt(double(m_images.size()))));
+    int rows = (m_images.size() + columns - 1) / columns;
+    int cellHeight = sheetCellSize.height() + sheetCaptionHeight;
+
+    QImage sheet(columns * sheetCellSize.width(), rows * cellHeight, QImage::Format_RGB32);
+    sheet.fill(Qt::black);
+
+    QPainter p(&sheet);
+    p.setRenderHint(QPainter::SmoothPixmapTransform);
+    p.setPen(Qt::white);
+
+    for (int i = 0; i < m_images.size(); ++i)
+    {
+        QRect cell((i % columns) * sheetCellSize.width(), (i / columns) * cellHeight,
+                   sheetCellSize.width(), sheetCellSize.height());
+
+        const QImage &image = m_images[i];
+        if (!image.isNull())
+        {
+            QSize size = image.size().scaled(cell.size(), Qt::KeepAspectRatio);
+            QRect target(QPoint(cell.x() + (cell.width() - size.width()) / 2,
+                                cell.y() + (cell.height() - size.height()) / 2), size);
+            p.drawImage(target, image);
+        }
+
+        p.drawText(QRect(cell.x(), cell.bottom() + 1, cell.width(), sheetCaptionHeight),
+                   Qt::AlignCenter, m_captions[i]);
+    }
+
+    return sheet;
+}
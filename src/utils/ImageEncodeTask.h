@@ -0,0 +1,58 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEENCODETASK_H
+#define IMAGEENCODETASK_H
+
+#include "ThreadTask.h"
+#include <QImage>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+/* Encodes an image to a file off the GUI thread; the format follows the file suffix.
+ *
+ * Images are implicitly shared with the caller rather than copied, which is safe as long as
+ * the caller only ever replaces its images instead of painting into them. Given several
+ * images, the task lays them out on a contact sheet with their captions and saves that. */
+
+class ImageEncodeTask : public ThreadTask
+{
+public:
+    ImageEncodeTask(QObject *caller, const char *callback, const QString &fileName);
+
+    void setImage(const QImage &image);
+    void setContactSheet(const QList<QImage> &images, const QStringList &captions);
+
+    QString fileName() const { return m_fileName; }
+    bool isOk() const { return m_ok; }
+    QString errorString() const { return m_errorString; }
+
+protected:
+    virtual void runTask();
+
+private:
+    QString m_fileName;
+    QList<QImage> m_images;
+    QStringList m_captions;
+    bool m_ok;
+    QString m_errorString;
+
+    QImage contactSheet() const;
+};
+
+#endif // IMAGEENCODETASK_H
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LatencyHistogram.h"
+#include <string.h>
+
+static const qint64 bucketBounds[LatencyHistogram::BucketCount - 1] =
+{
+    5, 10, 20, 35, 50, 75, 100, 150, 200, 300, 400, 500, 750, 1000, 1500, 2000, 5000
+};
+
+LatencyHistogram::LatencyHistogram()
+{
+    clear();
+}
+
+void LatencyHistogram::record(qint64 msecs)
+{
+    if (msecs < 0)
+        return;
+
+    int bucket = 0;
+    while (bucket < BucketCount - 1 && msecs > bucketBounds[bucket])
+        ++bucket;
+
+    m_buckets[bucket]++;
+    m_count++;
+    m_sum += msecs;
+    m_maximum = qMax(m_maximum, msecs);
+}
+
+void LatencyHistogram::clear()
+{
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_count = 0;
+    m_sum = 0;
+    m_maximum = 0;
+}
+
+qint64 LatencyHistogram::bucketUpperBound(int bucket)
+{
+    Q_ASSERT(bucket >= 0 && bucket < BucketCount);
+    /* The last bucket has no upper bound */
+    return bucket < BucketCount - 1 ? bucketBounds[bucket] : -1;
+}
+
+qint64 LatencyHistogram::mean() const
+{
+    return m_count ? m_sum / m_count : 0;
+}
+
+qint64 LatencyHistogram::percentile(double fraction) const
+{
+    if (!m_count)
+        return 0;
+
+    int target = qMax(1, qRound(m_count * fraction));
+    int seen = 0;
+    for (int i = 0; i < BucketCount - 1; ++i)
+    {
+        seen += m_buckets[i];
+        if (seen >= target)
+            return qMin(bucketBounds[i], m_maximum);
+    }
+
+    return m_maximum;
+}
+
+QString LatencyHistogram::summary() const
+{
+    return QString::fromLatin1("n=%1 mean=%2ms p50<=%3ms p90<=%4ms p99<=%5ms max=%6ms")
+            .arg(m_count).arg(mean()).arg(percentile(0.5)).arg(percentile(0.9))
+            .arg(percentile(0.99)).arg(m_maximum);
+}
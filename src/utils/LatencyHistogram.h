@@ -0,0 +1,59 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QString>
+
+/* Histogram of latency samples in milliseconds.
+ *
+ * Buckets grow roughly geometrically, so short latencies are resolved finely while
+ * multi-second stalls still land in a bucket; the last bucket is unbounded. Percentiles
+ * are reported as the upper bound of the bucket they fall in. */
+
+class LatencyHistogram
+{
+public:
+    enum
+    {
+        BucketCount = 18
+    };
+
+    LatencyHistogram();
+
+    void record(qint64 msecs);
+    void clear();
+
+    int count() const { return m_count; }
+    int bucketCount(int bucket) const { return m_buckets[bucket]; }
+    static qint64 bucketUpperBound(int bucket);
+
+    qint64 mean() const;
+    qint64 maximum() const { return m_maximum; }
+    qint64 percentile(double fraction) const;
+
+    QString summary() const;
+
+private:
+    int m_buckets[BucketCount];
+    int m_count;
+    qint64 m_sum;
+    qint64 m_maximum;
+};
+
+#endif // LATENCYHISTOGRAM_H
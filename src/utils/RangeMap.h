@@ -36,6 +36,8 @@ public:
     /* Return the first subrange of search that is not included in this RangeMap.
        May return empty range if it is contained. */
     Range nextMissingRange(const Range &search);
+
+    QList<Range> ranges() const { return m_ranges; }
 private:
     int size() const { return m_ranges.size(); }
 
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ReconnectBackoff.h"
+#include <QRandomGenerator>
+#include <QtGlobal>
+
+ReconnectBackoff::ReconnectBackoff(int firstDelay, int maximumDelay, int stableTime)
+    : m_firstDelay(firstDelay), m_maximumDelay(qMax(firstDelay, maximumDelay)), m_stableTime(stableTime),
+      m_attempts(0)
+{
+}
+
+void ReconnectBackoff::reset()
+{
+    m_attempts = 0;
+    m_connectedTime.invalidate();
+}
+
+int ReconnectBackoff::nominalDelay() const
+{
+    qint64 delay = m_firstDelay;
+    for (int i = 0; i < m_attempts && delay < m_maximumDelay; ++i)
+        delay *= 2;
+
+    return int(qMin<qint64>(delay, m_maximumDelay));
+}
+
+int ReconnectBackoff::nextDelay()
+{
+    if (m_connectedTime.isValid())
+    {
+        if (m_connectedTime.elapsed() >= m_stableTime)
+            m_attempts = 0;
+        m_connectedTime.invalidate();
+    }
+
+    int delay = nominalDelay();
+    m_attempts++;
+
+    /* Seeded per process, so that clients restarted together don't retry in step */
+    int half = delay / 2;
+    return delay - half + (half ? int(QRandomGenerator::global()->bounded(half + 1)) : 0);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2010-2019 Bluecherry, LLC
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECONNECTBACKOFF_H
+#define RECONNECTBACKOFF_H
+
+#include <QElapsedTimer>
+
+/* Delays between reconnection attempts.
+ *
+ * The first retry comes quickly, to get over short network glitches; after that the delay
+ * doubles up to maximumDelay. Each delay is picked randomly between half and all of its
+ * nominal value, so streams that failed together, as when a server restarts, don't all
+ * come back at the same instant.
+ *
+ * A connection only resets the backoff once it has stayed up for stableTime, so a stream
+ * that connects and fails again right away keeps backing off. */
+
+class ReconnectBackoff
+{
+public:
+    explicit ReconnectBackoff(int firstDelay = 500, int maximumDelay = 30000, int stableTime = 30000);
+
+    /* Delay in milliseconds before the next attempt */
+    int nextDelay();
+    /* Call when the connection is up */
+    void connected() { m_connectedTime.start(); }
+    void reset();
+
+    int attempts() const { return m_attempts; }
+    int nominalDelay() const;
+
+private:
+    const int m_firstDelay;
+    const int m_maximumDelay;
+    const int m_stableTime;
+    int m_attempts;
+    QElapsedTimer m_connectedTime;
+};
+
+#endif // RECONNECTBACKOFF_H
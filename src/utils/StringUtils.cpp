@@ -17,6 +17,7 @@
 
 #include "StringUtils.h"
 #include <QApplication>
+#include <QHash>
 
 QString byteSizeString(quint64 bytes, ByteSizeFormat format)
 {
@@ -56,3 +57,30 @@ QString withSuffix(const QString &string, const QString &suffix)
     else
         return string + suffix;
 }
+
+static bool localeAwareLessThan(const QString &s1, const QString &s2)
+{
+    return QString::localeAwareCompare(s1, s2) < 0;
+}
+
+QVector<int> collationRanks(const QStringList &strings)
+{
+    QStringList distinct = strings;
+    distinct.removeDuplicates();
+    qSort(distinct.begin(), distinct.end(), localeAwareLessThan);
+
+    QHash<QString, int> ranks;
+    int rank = -1;
+    for (int i = 0; i < distinct.size(); ++i)
+    {
+        if (i == 0 || QString::localeAwareCompare(distinct[i - 1], distinct[i]) != 0)
+            ++rank;
+        ranks.insert(distinct[i], rank);
+    }
+
+    QVector<int> result;
+    result.reserve(strings.size());
+    foreach (const QString &string, strings)
+        result.append(ranks.value(string));
+    return result;
+}
@@ -19,6 +19,8 @@
 #define STRINGUTILS_H
 
 #include <QString>
+#include <QStringList>
+#include <QVector>
 
 enum ByteSizeFormat {
     Bytes,
@@ -28,4 +30,8 @@ enum ByteSizeFormat {
 QString byteSizeString(quint64 bytes, ByteSizeFormat format);
 QString withSuffix(const QString &string, const QString &suffix);
 
+/* Position of each string in locale-aware order, with equal strings sharing one, so
+ * that strings compared many times over are collated only once */
+QVector<int> collationRanks(const QStringList &strings);
+
 #endif // STRINGUTILS_H
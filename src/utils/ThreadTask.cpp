@@ -35,3 +35,8 @@ void ThreadTask::run()
 	runTask();
 	ThreadTaskCourier::notify(this);
 }
+
+void ThreadTask::discard()
+{
+	ThreadTaskCourier::discard(this);
+}
@@ -34,7 +34,10 @@ class ThreadTaskCourier;
  * The ThreadTask instance is passed to the caller as the result (via a meta-method
  * invocation of the callback function), who is expected to know how to cast the object
  * and retrieve the result from the subclass. The caller may be destroyed at any time,
- * and this object will be freed by the courier. */
+ * and this object will be freed by the courier.
+ *
+ * A task that was taken back from its pool before it started (QThreadPool::tryTake) must
+ * be released with discard() instead; the callback is not invoked for discarded tasks. */
 
 class ThreadTask : public QRunnable
 {
@@ -46,6 +49,9 @@ public:
 	void cancel() { cancelFlag = true; }
 	bool isCancelled() const { return cancelFlag; }
 
+	/* Frees a task that will never run. Must be called on the GUI thread. */
+	void discard();
+
 protected:
 	virtual void runTask() = 0;
 	virtual void run();
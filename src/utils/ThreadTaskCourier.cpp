@@ -74,15 +74,31 @@ void ThreadTaskCourier::deliverNotify(ThreadTask *task)
 	Q_ASSERT_X(ok, "ThreadTaskCourier", "Invocation of thread task callback failed");
 	Q_UNUSED(ok);
 
+	releaseTask(it);
+	delete task;
+}
+
+void ThreadTaskCourier::discard(ThreadTask *task)
+{
+	Q_ASSERT(instance);
+	Q_ASSERT(QThread::currentThread() == qApp->thread());
+
+	QHash<QObject*,int>::iterator it = instance->pending.find(task->taskCaller);
+	if (it != instance->pending.end())
+		instance->releaseTask(it);
+
+	delete task;
+}
+
+void ThreadTaskCourier::releaseTask(QHash<QObject*,int>::iterator it)
+{
 	if (*it < 2)
 	{
-		disconnect(caller, SIGNAL(destroyed()), this, SLOT(objectDestroyed()));
+		disconnect(it.key(), SIGNAL(destroyed()), this, SLOT(objectDestroyed()));
 		pending.erase(it);
 	}
 	else
 		(*it)--;
-
-	delete task;
 }
 
 void ThreadTaskCourier::objectDestroyed()
@@ -42,6 +42,9 @@ private:
 
 	static void addTask(QObject *caller);
 	static void notify(ThreadTask *task);
+	static void discard(ThreadTask *task);
+
+	void releaseTask(QHash<QObject*,int>::iterator it);
 };
 
 #endif
@@ -0,0 +1,156 @@
+#include "event/EventBitmapIndex.h"
+#include "event/EventStore.h"
+#include <QtTest/QtTest>
+#include <QDebug>
+
+const char *jpegFormatName = "jpeg"; // hack
+
+class EventBitmapIndexTestCase : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testDayOf();
+    void testAttributes();
+    void testRemove();
+    void testStartedWithin();
+    void testReusedSlots();
+    void testStoreUpdate();
+
+private:
+    static QList<int> setBits(const QBitArray &bits);
+};
+
+QList<int> EventBitmapIndexTestCase::setBits(const QBitArray &bits)
+{
+    QList<int> result;
+    for (int i = 0; i < bits.size(); ++i)
+    {
+        if (bits.testBit(i))
+            result.append(i);
+    }
+    return result;
+}
+
+void EventBitmapIndexTestCase::testDayOf()
+{
+    QCOMPARE(EventBitmapIndex::dayOf(0), Q_INT64_C(0));
+    QCOMPARE(EventBitmapIndex::dayOf(86399999), Q_INT64_C(0));
+    QCOMPARE(EventBitmapIndex::dayOf(86400000), Q_INT64_C(1));
+    QCOMPARE(EventBitmapIndex::dayOf(-1), Q_INT64_C(-1));
+    QCOMPARE(EventBitmapIndex::dayOf(-86400000), Q_INT64_C(-1));
+    QCOMPARE(EventBitmapIndex::dayOf(-86400001), Q_INT64_C(-2));
+}
+
+void EventBitmapIndexTestCase::testAttributes()
+{
+    EventBitmapIndex index;
+    index.insert(0, EventLevel::Info, EventType::CameraMotion, 0, 1000);
+    index.insert(1, EventLevel::Alarm, EventType::UnknownType, 1, 2000);
+    index.insert(2, EventLevel::Alarm, EventType::CameraMotion, 1, 3000);
+
+    QCOMPARE(setBits(index.levelSlots(EventLevel::Info)), QList<int>() << 0);
+    QCOMPARE(setBits(index.levelSlots(EventLevel::Alarm)), QList<int>() << 1 << 2);
+    QVERIFY(setBits(index.levelSlots(EventLevel::Critical)).isEmpty());
+
+    QCOMPARE(setBits(index.typeSlots(EventType::CameraMotion)), QList<int>() << 0 << 2);
+    QCOMPARE(setBits(index.typeSlots(EventType::UnknownType)), QList<int>() << 1);
+    QVERIFY(setBits(index.typeSlots(EventType::SystemBoot)).isEmpty());
+
+    QCOMPARE(setBits(index.sourceSlots(0)), QList<int>() << 0);
+    QCOMPARE(setBits(index.sourceSlots(1)), QList<int>() << 1 << 2);
+    QVERIFY(setBits(index.sourceSlots(5)).isEmpty());
+}
+
+void EventBitmapIndexTestCase::testRemove()
+{
+    EventBitmapIndex index;
+    index.insert(0, EventLevel::Alarm, EventType::CameraMotion, 0, 1000);
+    index.insert(1, EventLevel::Alarm, EventType::CameraMotion, 0, 2000);
+    index.remove(0, EventLevel::Alarm, EventType::CameraMotion, 0, 1000);
+
+    QCOMPARE(setBits(index.levelSlots(EventLevel::Alarm)), QList<int>() << 1);
+    QCOMPARE(setBits(index.typeSlots(EventType::CameraMotion)), QList<int>() << 1);
+    QCOMPARE(setBits(index.sourceSlots(0)), QList<int>() << 1);
+
+    QVector<qint64> startTimes;
+    startTimes << 1000 << 2000;
+    QCOMPARE(setBits(index.startedWithin(0, 10000, startTimes)), QList<int>() << 1);
+
+    index.clear();
+    QVERIFY(setBits(index.levelSlots(EventLevel::Alarm)).isEmpty());
+    QVERIFY(setBits(index.startedWithin(0, 10000, startTimes)).isEmpty());
+}
+
+void EventBitmapIndexTestCase::testStartedWithin()
+{
+    const qint64 day = EventBitmapIndex::MSecsPerDay;
+
+    QVector<qint64> startTimes;
+    startTimes << day - 1 << day << day + 5000 << 2 * day + 100 << 3 * day << EventStore::NoTime;
+
+    EventBitmapIndex index;
+    for (int slot = 0; slot < startTimes.size(); ++slot)
+        index.insert(slot, EventLevel::Info, EventType::CameraMotion, 0, startTimes[slot]);
+
+    /* Whole days */
+    QCOMPARE(setBits(index.startedWithin(day, 3 * day - 1, startTimes)), QList<int>() << 1 << 2 << 3);
+    /* Partial days at both ends are checked exactly */
+    QCOMPARE(setBits(index.startedWithin(day - 1, day + 4999, startTimes)), QList<int>() << 0 << 1);
+    QCOMPARE(setBits(index.startedWithin(day + 1, 2 * day + 100, startTimes)), QList<int>() << 2 << 3);
+    QCOMPARE(setBits(index.startedWithin(3 * day, 3 * day, startTimes)), QList<int>() << 4);
+    QVERIFY(setBits(index.startedWithin(4 * day, 5 * day, startTimes)).isEmpty());
+    QVERIFY(setBits(index.startedWithin(2 * day, day, startTimes)).isEmpty());
+
+    /* Events without a time are in no range */
+    QVERIFY(!index.startedWithin(EventStore::NoTime + 1, 4 * day, startTimes).testBit(5));
+}
+
+void EventBitmapIndexTestCase::testReusedSlots()
+{
+    QVector<qint64> startTimes(100, 1000);
+
+    EventBitmapIndex index;
+    index.insert(90, EventLevel::Info, EventType::CameraMotion, 0, 1000);
+    index.insert(95, EventLevel::Info, EventType::CameraMotion, 0, 1000);
+    /* Below the day's base */
+    index.insert(3, EventLevel::Info, EventType::CameraMotion, 0, 1000);
+    index.insert(50, EventLevel::Info, EventType::CameraMotion, 0, 1000);
+
+    QCOMPARE(setBits(index.startedWithin(0, 2000, startTimes)), QList<int>() << 3 << 50 << 90 << 95);
+
+    index.remove(90, EventLevel::Info, EventType::CameraMotion, 0, 1000);
+    index.remove(3, EventLevel::Info, EventType::CameraMotion, 0, 1000);
+    QCOMPARE(setBits(index.startedWithin(0, 2000, startTimes)), QList<int>() << 50 << 95);
+}
+
+void EventBitmapIndexTestCase::testStoreUpdate()
+{
+    EventData event;
+    event.setEventId(1);
+    event.setUtcStartDate(QDateTime(QDate(2013, 4, 16), QTime(16, 10, 3), Qt::UTC));
+    event.setLocationId(1);
+    event.setLevel(EventLevel::Info);
+    event.setType(EventType::CameraMotion);
+
+    EventStore store;
+    int slot = store.insert(event);
+    QCOMPARE(setBits(store.bitmaps().levelSlots(EventLevel::Info)), QList<int>() << slot);
+
+    event.setLevel(EventLevel::Critical);
+    event.setUtcStartDate(QDateTime(QDate(2013, 4, 18), QTime(16, 10, 3), Qt::UTC));
+    store.update(slot, event);
+    QVERIFY(setBits(store.bitmaps().levelSlots(EventLevel::Info)).isEmpty());
+    QCOMPARE(setBits(store.bitmaps().levelSlots(EventLevel::Critical)), QList<int>() << slot);
+
+    qint64 start = store.startTime(slot);
+    QCOMPARE(setBits(store.slotsStartedWithin(start, start)), QList<int>() << slot);
+    QVERIFY(setBits(store.slotsStartedWithin(start - 2 * EventBitmapIndex::MSecsPerDay, start - 1)).isEmpty());
+
+    store.remove(slot);
+    QVERIFY(setBits(store.bitmaps().levelSlots(EventLevel::Critical)).isEmpty());
+}
+
+QTEST_MAIN(EventBitmapIndexTestCase)
+
+#include "EventBitmapIndexTestCase.moc"
@@ -0,0 +1,210 @@
+#include "event/EventCache.h"
+#include "core/EventData.h"
+#include <QtTest/QtTest>
+#include <QTemporaryDir>
+#include <QDebug>
+
+const char *jpegFormatName = "jpeg"; // hack
+
+class EventCacheTestCase : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void testAppendAndQuery();
+    void testSupersede();
+    void testInProgressSkipped();
+    void testCoverage();
+    void testFetchCoverage();
+    void testEviction();
+    void testIncompatibleFile();
+
+private:
+    QTemporaryDir *m_directory;
+
+    QString cachePath() const { return m_directory->path() + QLatin1String("/server"); }
+    static QSharedPointer<EventData> makeEvent(qint64 id, uint startTime, int duration = 30);
+    static QList<qint64> ids(const QList<QSharedPointer<EventData> > &events);
+};
+
+void EventCacheTestCase::init()
+{
+    m_directory = new QTemporaryDir;
+    QVERIFY(m_directory->isValid());
+}
+
+void EventCacheTestCase::cleanup()
+{
+    delete m_directory;
+    m_directory = 0;
+}
+
+QSharedPointer<EventData> EventCacheTestCase::makeEvent(qint64 id, uint startTime, int duration)
+{
+    QSharedPointer<EventData> event(new EventData);
+    event->setEventId(id);
+    event->setMediaId(id + 1000);
+    event->setUtcStartDate(QDateTime::fromTime_t(startTime).toUTC());
+    event->setDurationInSeconds(duration);
+    event->setLocationId(int(id % 4));
+    event->setLevel(EventLevel::Warning);
+    event->setType(EventType::CameraMotion);
+    return event;
+}
+
+QList<qint64> EventCacheTestCase::ids(const QList<QSharedPointer<EventData> > &events)
+{
+    QList<qint64> result;
+    foreach (const QSharedPointer<EventData> &event, events)
+        result.append(event->eventId());
+    return result;
+}
+
+void EventCacheTestCase::testAppendAndQuery()
+{
+    ServerEventCache cache(cachePath());
+    QVERIFY(cache.open());
+
+    QList<QSharedPointer<EventData> > events;
+    events << makeEvent(3, 3000) << makeEvent(1, 1000) << makeEvent(2, 2000);
+    QVERIFY(cache.append(events));
+    QCOMPARE(cache.size(), 3);
+
+    QCOMPARE(ids(cache.events(0, 0, 5000)), QList<qint64>() << 1 << 2 << 3);
+    QCOMPARE(ids(cache.events(0, 1500, 3000)), QList<qint64>() << 2 << 3);
+    QVERIFY(cache.events(0, 3001, 5000).isEmpty());
+
+    QSharedPointer<EventData> event = cache.events(0, 2000, 2000).first();
+    QCOMPARE(event->localStartDate(), events[2]->localStartDate());
+    QCOMPARE(event->mediaId(), Q_INT64_C(1002));
+    QCOMPARE(event->durationInSeconds(), 30);
+    QVERIFY(event->level() == EventLevel::Warning);
+    QVERIFY(event->type() == EventType::CameraMotion);
+
+    cache.close();
+    QVERIFY(cache.open());
+    QCOMPARE(ids(cache.events(0, 0, 5000)), QList<qint64>() << 1 << 2 << 3);
+}
+
+void EventCacheTestCase::testSupersede()
+{
+    ServerEventCache cache(cachePath());
+    QVERIFY(cache.open());
+
+    QVERIFY(cache.append(QList<QSharedPointer<EventData> >() << makeEvent(1, 1000) << makeEvent(2, 2000)));
+    qint64 size = cache.fileSize();
+
+    /* Unchanged events aren't written again */
+    QVERIFY(cache.append(QList<QSharedPointer<EventData> >() << makeEvent(1, 1000)));
+    QCOMPARE(cache.fileSize(), size);
+
+    QVERIFY(cache.append(QList<QSharedPointer<EventData> >() << makeEvent(1, 1000, 90)));
+    QCOMPARE(cache.size(), 2);
+    QCOMPARE(cache.events(0, 1000, 1000).first()->durationInSeconds(), 90);
+}
+
+void EventCacheTestCase::testInProgressSkipped()
+{
+    ServerEventCache cache(cachePath());
+    QVERIFY(cache.open());
+
+    QSharedPointer<EventData> event = makeEvent(1, 1000);
+    event->setInProgress();
+    QVERIFY(cache.append(QList<QSharedPointer<EventData> >() << event << makeEvent(2, 2000)));
+    QCOMPARE(ids(cache.events(0, 0, 5000)), QList<qint64>() << 2);
+}
+
+void EventCacheTestCase::testCoverage()
+{
+    ServerEventCache cache(cachePath());
+    QVERIFY(cache.open());
+
+    Range missing = cache.missingRange(1000, 5000);
+    QCOMPARE(missing.start(), 1000u);
+    QCOMPARE(missing.end(), 5000u);
+
+    cache.addCoverage(1000, 2999);
+    missing = cache.missingRange(1000, 5000);
+    QCOMPARE(missing.start(), 3000u);
+    QCOMPARE(missing.end(), 5000u);
+
+    cache.close();
+    QVERIFY(cache.open());
+
+    cache.addCoverage(3000, 6000);
+    QVERIFY(!cache.missingRange(1000, 5000).isValid());
+    QVERIFY(cache.missingRange(500, 5000).isValid());
+}
+
+void EventCacheTestCase::testFetchCoverage()
+{
+    ServerEventCache cache(cachePath());
+    QVERIFY(cache.open());
+
+    /* Nothing from the start of an event in progress on */
+    cache.addFetchCoverage(1000, 5000, QList<uint>() << 4000, 1000, false);
+    QCOMPARE(cache.missingRange(1000, 5000).start(), 4000u);
+
+    /* A limited fetch is only complete after its oldest event */
+    cache.addFetchCoverage(10000, 20000, QList<uint>(), 15000, true);
+    QCOMPARE(cache.missingRange(10000, 20000).start(), 10000u);
+    QCOMPARE(cache.missingRange(10000, 20000).end(), 15000u);
+
+    /* The last few minutes may still change */
+    uint now = QDateTime::currentDateTime().toTime_t();
+    cache.addFetchCoverage(now - 3600, now, QList<uint>(), now - 3600, false);
+    QVERIFY(!cache.missingRange(now - 3600, now - 600).isValid());
+    QVERIFY(cache.missingRange(now - 3600, now).isValid());
+}
+
+void EventCacheTestCase::testEviction()
+{
+    ServerEventCache cache(cachePath());
+    QVERIFY(cache.open());
+
+    QList<QSharedPointer<EventData> > events;
+    for (int i = 0; i < 10000; ++i)
+        events << makeEvent(i + 1, 100000 + i * 10);
+    QVERIFY(cache.append(events));
+    cache.addCoverage(100000, 200000);
+
+    qint64 maxSize = cache.fileSize() / 2;
+    cache.evict(maxSize);
+
+    QVERIFY(cache.fileSize() <= maxSize);
+    QVERIFY(cache.size() > 0);
+    QVERIFY(cache.size() < 10000);
+
+    /* The newest events are kept, and only their part of the range stays covered */
+    QList<QSharedPointer<EventData> > kept = cache.events(0, 0, 300000);
+    QCOMPARE(kept.last()->eventId(), Q_INT64_C(10000));
+    uint oldest = kept.first()->localStartDate().toTime_t();
+    QVERIFY(cache.missingRange(100000, 200000).isValid());
+    QVERIFY(!cache.missingRange(oldest, 200000).isValid());
+
+    cache.close();
+    QVERIFY(cache.open());
+    QCOMPARE(cache.size(), kept.size());
+}
+
+void EventCacheTestCase::testIncompatibleFile()
+{
+    QDir().mkpath(cachePath());
+    QFile file(cachePath() + QLatin1String("/events.dat"));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("not an event cache at all");
+    file.close();
+
+    ServerEventCache cache(cachePath());
+    QVERIFY(cache.open());
+    QCOMPARE(cache.size(), 0);
+    QVERIFY(cache.append(QList<QSharedPointer<EventData> >() << makeEvent(1, 1000)));
+    QCOMPARE(cache.size(), 1);
+}
+
+QTEST_MAIN(EventCacheTestCase)
+
+#include "EventCacheTestCase.moc"
@@ -0,0 +1,166 @@
+#include "event/EventDensityPyramid.h"
+#include "event/EventStore.h"
+#include <QtTest/QtTest>
+#include <QDebug>
+
+const char *jpegFormatName = "jpeg"; // hack
+
+class EventDensityPyramidTestCase : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testBucketIndex();
+    void testLevelForResolution();
+    void testInsert();
+    void testLongEvent();
+    void testRemove();
+    void testNoTime();
+    void testLongDuration();
+    void testSetLevels();
+};
+
+void EventDensityPyramidTestCase::testBucketIndex()
+{
+    QCOMPARE(EventDensityPyramid::bucketMSecs(0), Q_INT64_C(64000));
+    QCOMPARE(EventDensityPyramid::bucketMSecs(1), Q_INT64_C(128000));
+
+    QCOMPARE(EventDensityPyramid::bucketIndex(0, 0), Q_INT64_C(0));
+    QCOMPARE(EventDensityPyramid::bucketIndex(0, 63999), Q_INT64_C(0));
+    QCOMPARE(EventDensityPyramid::bucketIndex(0, 64000), Q_INT64_C(1));
+    QCOMPARE(EventDensityPyramid::bucketIndex(0, -1), Q_INT64_C(-1));
+    QCOMPARE(EventDensityPyramid::bucketIndex(0, -64000), Q_INT64_C(-1));
+    QCOMPARE(EventDensityPyramid::bucketIndex(0, -64001), Q_INT64_C(-2));
+    QCOMPARE(EventDensityPyramid::bucketIndex(2, 256000), Q_INT64_C(1));
+}
+
+void EventDensityPyramidTestCase::testLevelForResolution()
+{
+    /* Zoomed in far enough to draw each event */
+    QCOMPARE(EventDensityPyramid::levelForResolution(1000), -1);
+    QCOMPARE(EventDensityPyramid::levelForResolution(31999), -1);
+
+    QCOMPARE(EventDensityPyramid::levelForResolution(32000), 0);
+    QCOMPARE(EventDensityPyramid::levelForResolution(64000), 0);
+    QCOMPARE(EventDensityPyramid::levelForResolution(64001), 1);
+    QCOMPARE(EventDensityPyramid::levelForResolution(1e12), int(EventDensityPyramid::LevelCount) - 1);
+}
+
+void EventDensityPyramidTestCase::testInsert()
+{
+    EventDensityPyramid pyramid;
+    pyramid.setLevels(0, EventDensityPyramid::LevelCount - 1);
+    QVERIFY(pyramid.isEmpty());
+
+    pyramid.insert(1000, 2000, EventLevel::Info);
+    pyramid.insert(3000, 4000, EventLevel::Alarm);
+    pyramid.insert(70000, 71000, EventLevel::Warning);
+
+    const EventDensityPyramid::Bucket *bucket = pyramid.bucket(0, 0);
+    QVERIFY(bucket);
+    QCOMPARE(bucket->count(), 2);
+    QCOMPARE(bucket->maxLevel().level, EventLevel::Alarm);
+
+    bucket = pyramid.bucket(0, 1);
+    QVERIFY(bucket);
+    QCOMPARE(bucket->count(), 1);
+    QCOMPARE(bucket->maxLevel().level, EventLevel::Warning);
+
+    QVERIFY(!pyramid.bucket(0, 2));
+
+    /* Coarser levels combine the buckets below */
+    bucket = pyramid.bucket(1, 0);
+    QVERIFY(bucket);
+    QCOMPARE(bucket->count(), 3);
+    QCOMPARE(bucket->maxLevel().level, EventLevel::Alarm);
+    QCOMPARE(pyramid.bucket(EventDensityPyramid::LevelCount - 1, 0)->count(), 3);
+}
+
+void EventDensityPyramidTestCase::testLongEvent()
+{
+    EventDensityPyramid pyramid;
+    pyramid.setLevels(0, EventDensityPyramid::LevelCount - 1);
+    pyramid.insert(0, 10 * 64000 - 1, EventLevel::Critical);
+
+    for (int i = 0; i < 10; ++i)
+    {
+        QVERIFY(pyramid.bucket(0, i));
+        QCOMPARE(pyramid.bucket(0, i)->maxLevel().level, EventLevel::Critical);
+    }
+    QVERIFY(!pyramid.bucket(0, 10));
+    QVERIFY(pyramid.bucket(3, 1));
+    QVERIFY(!pyramid.bucket(3, 2));
+}
+
+void EventDensityPyramidTestCase::testRemove()
+{
+    EventDensityPyramid pyramid;
+    pyramid.setLevels(0, EventDensityPyramid::LevelCount - 1);
+    pyramid.insert(1000, 2000, EventLevel::Info);
+    pyramid.insert(3000, 4000, EventLevel::Critical);
+
+    pyramid.remove(3000, 4000, EventLevel::Critical);
+    const EventDensityPyramid::Bucket *bucket = pyramid.bucket(0, 0);
+    QVERIFY(bucket);
+    QCOMPARE(bucket->count(), 1);
+    QCOMPARE(bucket->maxLevel().level, EventLevel::Info);
+
+    pyramid.remove(1000, 2000, EventLevel::Info);
+    QVERIFY(!pyramid.bucket(0, 0));
+    QVERIFY(pyramid.isEmpty());
+}
+
+void EventDensityPyramidTestCase::testNoTime()
+{
+    EventDensityPyramid pyramid;
+    pyramid.setLevels(0, EventDensityPyramid::LevelCount - 1);
+    pyramid.insert(EventStore::NoTime, EventStore::NoTime, EventLevel::Info);
+    QVERIFY(pyramid.isEmpty());
+}
+
+void EventDensityPyramidTestCase::testLongDuration()
+{
+    EventDensityPyramid pyramid;
+    pyramid.setLevels(0, EventDensityPyramid::LevelCount - 1);
+    pyramid.insert(0, Q_INT64_C(1) << 50, EventLevel::Info);
+
+    qint64 last = EventDensityPyramid::bucketIndex(0, EventDensityPyramid::MaxEventMSecs);
+    QVERIFY(pyramid.bucket(0, last));
+    QVERIFY(!pyramid.bucket(0, last + 1));
+
+    /* Removing clamps the same way */
+    pyramid.remove(0, Q_INT64_C(1) << 50, EventLevel::Info);
+    QVERIFY(pyramid.isEmpty());
+}
+
+void EventDensityPyramidTestCase::testSetLevels()
+{
+    EventDensityPyramid pyramid;
+    pyramid.insert(1000, 2000, EventLevel::Info);
+    QVERIFY(pyramid.isEmpty());
+    QVERIFY(!pyramid.bucket(0, 0));
+
+    QVERIFY(pyramid.setLevels(2, 5));
+    QVERIFY(!pyramid.setLevels(2, 5));
+    pyramid.insert(1000, 2000, EventLevel::Info);
+    QVERIFY(!pyramid.bucket(1, 0));
+    QVERIFY(pyramid.bucket(2, 0));
+    QVERIFY(pyramid.bucket(5, 0));
+    QVERIFY(!pyramid.bucket(6, 0));
+
+    /* Dropping levels keeps the others */
+    QVERIFY(!pyramid.setLevels(3, 5));
+    QVERIFY(!pyramid.hasLevel(2));
+    QCOMPARE(pyramid.bucket(3, 0)->count(), 1);
+
+    /* Adding one needs all events again */
+    QVERIFY(pyramid.setLevels(3, 6));
+    QVERIFY(pyramid.isEmpty());
+
+    QVERIFY(!pyramid.setLevels(0, -1));
+    QVERIFY(!pyramid.hasLevel(0));
+}
+
+QTEST_MAIN(EventDensityPyramidTestCase)
+
+#include "EventDensityPyramidTestCase.moc"
@@ -0,0 +1,229 @@
+#include "event/EventIntervalIndex.h"
+#include <QtTest/QtTest>
+#include <QDebug>
+
+const char *jpegFormatName = "jpeg"; // hack
+
+class EventIntervalIndexTestCase : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testOrder();
+    void testBulkInsert();
+    void testOverlapping();
+    void testUpdate();
+    void testRemove();
+    void testBulkRemove();
+    void benchmarkOverlapping();
+    void benchmarkBulkRemove();
+
+private:
+    EventStore m_store;
+
+    EventRef addEvent(qint64 id, int startSecs, int duration);
+    static QList<qint64> overlappingIds(const EventIntervalIndex &index, qint64 from, qint64 to);
+};
+
+EventRef EventIntervalIndexTestCase::addEvent(qint64 id, int startSecs, int duration)
+{
+    EventData event;
+    event.setEventId(id);
+    event.setUtcStartDate(QDateTime(QDate(2013, 4, 16), QTime(0, 0), Qt::UTC).addSecs(startSecs));
+    event.setDurationInSeconds(duration);
+    event.setLocationId(1);
+    return m_store.ref(m_store.insert(event));
+}
+
+QList<qint64> EventIntervalIndexTestCase::overlappingIds(const EventIntervalIndex &index, qint64 from, qint64 to)
+{
+    QList<qint64> result;
+    int first, last;
+    index.findOverlapping(from, to, &first, &last);
+    for (int i = first; i < last; ++i)
+    {
+        if (index.endTime(i) >= from)
+            result.append(index.at(i).eventId());
+    }
+    return result;
+}
+
+void EventIntervalIndexTestCase::testOrder()
+{
+    EventIntervalIndex index;
+    index.insert(addEvent(1, 300, 10));
+    index.insert(addEvent(2, 100, 10));
+    index.insert(addEvent(3, 300, 10));
+    index.insert(addEvent(4, 200, 10));
+
+    QCOMPARE(index.size(), 4);
+    QCOMPARE(index.at(0).eventId(), Q_INT64_C(2));
+    QCOMPARE(index.at(1).eventId(), Q_INT64_C(4));
+    /* Equal start times keep their insertion order */
+    QCOMPARE(index.at(2).eventId(), Q_INT64_C(1));
+    QCOMPARE(index.at(3).eventId(), Q_INT64_C(3));
+
+    QCOMPARE(index.minStartTime(), index.at(0).startTime());
+    QCOMPARE(index.maxEndTime(), index.at(3).endTime());
+}
+
+void EventIntervalIndexTestCase::testBulkInsert()
+{
+    EventIntervalIndex index;
+    index.insert(addEvent(1, 100, 10));
+    index.insert(addEvent(2, 300, 10));
+
+    QVector<EventRef> events;
+    events << addEvent(3, 400, 10) << addEvent(4, 200, 10) << addEvent(5, 300, 10) << addEvent(6, 50, 10);
+    index.insert(events);
+
+    QList<qint64> ids;
+    for (int i = 0; i < index.size(); ++i)
+        ids.append(index.at(i).eventId());
+    QCOMPARE(ids, QList<qint64>() << 6 << 1 << 4 << 2 << 5 << 3);
+
+    for (int i = 1; i < index.size(); ++i)
+        QVERIFY(index.startTime(i - 1) <= index.startTime(i));
+}
+
+void EventIntervalIndexTestCase::testOverlapping()
+{
+    EventIntervalIndex index;
+    EventRef longEvent = addEvent(1, 0, 1000);
+    index.insert(longEvent);
+    for (int i = 0; i < 10; ++i)
+        index.insert(addEvent(10 + i, 100 * i + 50, 10));
+
+    qint64 base = longEvent.startTime();
+
+    /* The long event starts well before the span, but still covers it */
+    QCOMPARE(overlappingIds(index, base + 555000, base + 565000), QList<qint64>() << 1 << 15);
+    QCOMPARE(overlappingIds(index, base + 2000000, base + 3000000), QList<qint64>());
+    QCOMPARE(overlappingIds(index, base - 10000, base - 1), QList<qint64>());
+
+    /* Events ending exactly at the start of the span overlap it */
+    QCOMPARE(overlappingIds(index, base + 1000000, base + 1000000), QList<qint64>() << 1);
+}
+
+void EventIntervalIndexTestCase::testUpdate()
+{
+    EventIntervalIndex index;
+    EventRef a = addEvent(1, 100, 10);
+    EventRef b = addEvent(2, 200, 10);
+    index.insert(a);
+    index.insert(b);
+
+    qint64 base = a.startTime();
+    QCOMPARE(overlappingIds(index, base + 500000, base + 600000), QList<qint64>());
+
+    EventData data = a.toEventData();
+    data.setDurationInSeconds(1000);
+    m_store.update(a.slot(), data);
+    QVERIFY(index.update(a));
+    QCOMPARE(overlappingIds(index, base + 500000, base + 600000), QList<qint64>() << 1);
+
+    data.setUtcStartDate(QDateTime::fromMSecsSinceEpoch(a.startTime()).toUTC().addSecs(500));
+    m_store.update(a.slot(), data);
+    QVERIFY(index.update(a));
+    QCOMPARE(index.at(0).eventId(), Q_INT64_C(2));
+    QCOMPARE(index.at(1).eventId(), Q_INT64_C(1));
+
+    EventIntervalIndex other;
+    QVERIFY(!other.update(a));
+}
+
+void EventIntervalIndexTestCase::testRemove()
+{
+    EventIntervalIndex index;
+    EventRef longEvent = addEvent(1, 0, 1000);
+    EventRef shortEvent = addEvent(2, 500, 10);
+    index.insert(longEvent);
+    index.insert(shortEvent);
+
+    qint64 base = longEvent.startTime();
+    QCOMPARE(overlappingIds(index, base + 800000, base + 900000), QList<qint64>() << 1);
+
+    QVERIFY(index.remove(longEvent));
+    QVERIFY(!index.remove(longEvent));
+    QVERIFY(!index.contains(longEvent));
+    QVERIFY(index.contains(shortEvent));
+    QCOMPARE(overlappingIds(index, base + 800000, base + 900000), QList<qint64>());
+    QCOMPARE(index.maxEndTime(), shortEvent.endTime());
+
+    QVERIFY(index.remove(shortEvent));
+    QVERIFY(index.isEmpty());
+    QCOMPARE(index.minStartTime(), EventStore::NoTime);
+    QCOMPARE(index.maxEndTime(), EventStore::NoTime);
+}
+
+void EventIntervalIndexTestCase::testBulkRemove()
+{
+    EventIntervalIndex index;
+    QVector<EventRef> events;
+    events << addEvent(1, 100, 10) << addEvent(2, 200, 1000) << addEvent(3, 300, 10)
+           << addEvent(4, 400, 10) << addEvent(5, 500, 10);
+    index.insert(events);
+
+    /* Bring the running maximum up to date, so removal has to invalidate it */
+    qint64 base = QDateTime(QDate(2013, 4, 16), QTime(0, 0), Qt::UTC).toMSecsSinceEpoch();
+    QCOMPARE(index.maxEndTime(), events[1].endTime());
+
+    EventRef missing = addEvent(6, 600, 10);
+    QVector<EventRef> removed;
+    removed << events[3] << events[1] << missing;
+    QCOMPARE(index.remove(removed), 2);
+
+    QList<qint64> ids;
+    for (int i = 0; i < index.size(); ++i)
+        ids.append(index.at(i).eventId());
+    QCOMPARE(ids, QList<qint64>() << 1 << 3 << 5);
+
+    QCOMPARE(index.maxEndTime(), events[4].endTime());
+    QCOMPARE(overlappingIds(index, base + 350000, base + 450000), QList<qint64>());
+    QCOMPARE(overlappingIds(index, base + 300000, base + 500000), QList<qint64>() << 3 << 5);
+
+    QCOMPARE(index.remove(QVector<EventRef>() << events[0] << events[2] << events[4]), 3);
+    QVERIFY(index.isEmpty());
+    QCOMPARE(index.maxEndTime(), EventStore::NoTime);
+}
+
+void EventIntervalIndexTestCase::benchmarkOverlapping()
+{
+    EventIntervalIndex index;
+    QVector<EventRef> events;
+    for (int i = 0; i < 100000; ++i)
+        events.append(addEvent(i + 1, (i * 7919) % 1000000, 30 + i % 600));
+    index.insert(events);
+
+    qint64 base = QDateTime(QDate(2013, 4, 16), QTime(0, 0), Qt::UTC).toMSecsSinceEpoch();
+    int count = 0;
+    QBENCHMARK
+    {
+        for (int step = 0; step < 100; ++step)
+            count += overlappingIds(index, base + step * 10000000, base + step * 10000000 + 3600000).size();
+    }
+    QVERIFY(count > 0);
+}
+
+/* Every other event of a large row, as a filter change or a server disconnecting removes */
+void EventIntervalIndexTestCase::benchmarkBulkRemove()
+{
+    QVector<EventRef> events;
+    for (int i = 0; i < 100000; ++i)
+        events.append(addEvent(i + 1, (i * 7919) % 1000000, 30 + i % 600));
+
+    QVector<EventRef> removed;
+    for (int i = 0; i < events.size(); i += 2)
+        removed.append(events[i]);
+
+    QBENCHMARK
+    {
+        EventIntervalIndex index;
+        index.insert(events);
+        QCOMPARE(index.remove(removed), removed.size());
+    }
+}
+
+QTEST_MAIN(EventIntervalIndexTestCase)
+
+#include "EventIntervalIndexTestCase.moc"
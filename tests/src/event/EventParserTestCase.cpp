@@ -1,6 +1,7 @@
 #include "bluecherry-config.h"
 #include "core/EventData.h"
 #include "event/EventParser.h"
+#include "utils/DateTimeUtils.h"
 #include <QtTest/QtTest>
 #include <QDebug>
 
@@ -19,10 +20,20 @@ private Q_SLOTS:
     void testMedia_data();
     void testCategoryLevel();
     void testCategoryLevel_data();
+    void testChunkedInput();
+    void testIsoDateTime();
+    void testIsoDateTime_data();
+
+    void benchmarkParser();
+    void benchmarkReferenceParser();
+    void benchmarkIsoDateTime();
+    void benchmarkReferenceIsoDateTime();
 
 private:
-    QList<EventData *> parseFile(const QString &fileName);
-    EventData * parseSingleEventFile(const QString &fileName);
+    QByteArray readFile(const QString &fileName);
+    QList<QSharedPointer<EventData> > parseFile(const QString &fileName);
+    QSharedPointer<EventData> parseSingleEventFile(const QString &fileName);
+    QByteArray syntheticFeed(int copies);
     QDateTime parseUTCDateTime(const QString &dateTimeString);
     QDateTime parseUTCDateTimeWithHoursOffset(const QString &dateTimeString, int offsetInHours);
 
@@ -32,24 +43,46 @@ Q_DECLARE_METATYPE(Qt::TimeSpec);
 Q_DECLARE_METATYPE(EventLevel::Level);
 Q_DECLARE_METATYPE(EventType::Type);
 
-QList<EventData *> EventParserTestCase::parseFile(const QString &fileName)
+QByteArray EventParserTestCase::readFile(const QString &fileName)
 {
     QFile file(QString::fromLatin1("%1/event/%2").arg(QString::fromLatin1(TEST_DATA_DIR)).arg(fileName));
     if (!file.open(QIODevice::ReadOnly))
-        return QList<EventData *>();
+        return QByteArray();
 
-    QList<EventData *> result = EventParser::parseEvents(0, file.readAll());
-    file.close();
+    return file.readAll();
+}
 
-    return result;
+QList<QSharedPointer<EventData> > EventParserTestCase::parseFile(const QString &fileName)
+{
+    return EventParser::parseEvents(0, readFile(fileName));
 }
 
-EventData * EventParserTestCase::parseSingleEventFile(const QString &fileName)
+QSharedPointer<EventData> EventParserTestCase::parseSingleEventFile(const QString &fileName)
 {
-    QList<EventData *> events = parseFile(fileName);
+    QList<QSharedPointer<EventData> > events = parseFile(fileName);
     return events.at(0);
 }
 
+/* The entries of v2demo.xml repeated, with unique ids, as a month of events would be */
+QByteArray EventParserTestCase::syntheticFeed(int copies)
+{
+    QByteArray demo = readFile(QLatin1String("v2demo.xml"));
+    int entriesBegin = demo.indexOf("<entry>");
+    int entriesEnd = demo.lastIndexOf("</entry>") + int(strlen("</entry>"));
+    QByteArray entries = demo.mid(entriesBegin, entriesEnd - entriesBegin);
+
+    QByteArray feed = demo.left(entriesBegin);
+    for (int i = 0; i < copies; ++i)
+    {
+        QByteArray copy = entries;
+        copy.replace("raw=\"", "raw=\"" + QByteArray::number(i + 1000));
+        feed += copy;
+    }
+    feed += demo.mid(entriesEnd);
+
+    return feed;
+}
+
 QDateTime EventParserTestCase::parseUTCDateTime(const QString &dateTimeString)
 {
     QDateTime result = QDateTime::fromString(dateTimeString, Qt::ISODate);
@@ -69,7 +102,7 @@ QDateTime EventParserTestCase::parseUTCDateTimeWithHoursOffset(const QString &da
 
 void EventParserTestCase::testV2DemoFileSize()
 {
-    QList<EventData *> events = parseFile(QLatin1String("v2demo.xml"));
+    QList<QSharedPointer<EventData> > events = parseFile(QLatin1String("v2demo.xml"));
     QCOMPARE(events.size(), 50);
 }
 
@@ -97,7 +130,7 @@ void EventParserTestCase::testSingleItems()
     QFETCH(bool, isCamera);
     QFETCH(bool, hasMedia);
 
-    EventData *event = parseSingleEventFile(fileName);
+    QSharedPointer<EventData> event = parseSingleEventFile(fileName);
     QVERIFY(!event->server());
     QCOMPARE(event->eventId(), eventId);
     QCOMPARE(event->localStartDate(), localStartDate);
@@ -359,7 +392,7 @@ void EventParserTestCase::testMedia()
     QFETCH(long long, mediaId);
     QFETCH(bool, hasMedia);
 
-    EventData *event = parseSingleEventFile(fileName);
+    QSharedPointer<EventData> event = parseSingleEventFile(fileName);
     QVERIFY(!event->server());
     QCOMPARE(event->mediaId(), mediaId);
     QCOMPARE(event->hasMedia(), hasMedia);
@@ -398,7 +431,7 @@ void EventParserTestCase::testCategoryLevel()
     QFETCH(EventLevel::Level, level);
     QFETCH(EventType::Type, type);
 
-    EventData *event = parseSingleEventFile(fileName);
+    QSharedPointer<EventData> event = parseSingleEventFile(fileName);
     QVERIFY(!event->server());
     QCOMPARE(event->level().level, level);
     QCOMPARE(event->type().type, type);
@@ -516,6 +549,151 @@ void EventParserTestCase::testCategoryLevel_data()
         << EventType::SystemPowerOutage;
 }
 
+void EventParserTestCase::testChunkedInput()
+{
+    QByteArray feed = readFile(QLatin1String("v2demo.xml"));
+    QList<QSharedPointer<EventData> > expected = EventParser::parseEvents(0, feed);
+
+    /* Chunk sizes that split names, attributes, and dates */
+    const int chunkSizes[] = { 1, 7, 100, 4096 };
+    for (unsigned i = 0; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]); ++i)
+    {
+        EventParser parser(0);
+        QList<QSharedPointer<EventData> > events;
+        for (int pos = 0; pos < feed.size(); pos += chunkSizes[i])
+        {
+            parser.addData(feed.mid(pos, chunkSizes[i]));
+            events += parser.takeEvents();
+        }
+        parser.finish();
+        events += parser.takeEvents();
+
+        QVERIFY(!parser.hasError());
+        QCOMPARE(events.size(), expected.size());
+        for (int j = 0; j < events.size(); ++j)
+        {
+            QCOMPARE(events[j]->eventId(), expected[j]->eventId());
+            QCOMPARE(events[j]->localStartDate(), expected[j]->localStartDate());
+            QCOMPARE(events[j]->durationInSeconds(), expected[j]->durationInSeconds());
+            QCOMPARE(events[j]->type().type, expected[j]->type().type);
+        }
+    }
+
+    EventParser truncated(0);
+    truncated.addData(feed.left(feed.size() / 2));
+    QVERIFY(!truncated.hasError());
+    truncated.finish();
+    QVERIFY(truncated.hasError());
+}
+
+void EventParserTestCase::testIsoDateTime()
+{
+    QFETCH(QString, string);
+
+    qint64 msecs = 0;
+    qint16 offset = 0, expectedOffset = 0;
+    QDateTime expected = isoToDateTime(string, &expectedOffset);
+
+    QVERIFY(parseIsoDateTime(QStringRef(&string), &msecs, &offset));
+    QCOMPARE(msecs, expected.toMSecsSinceEpoch());
+    QCOMPARE(offset, expectedOffset);
+}
+
+void EventParserTestCase::testIsoDateTime_data()
+{
+    QTest::addColumn<QString>("string");
+
+    QTest::newRow("Negative offset") << QString::fromLatin1("2013-04-16T16:10:03-05:00");
+    QTest::newRow("Positive offset") << QString::fromLatin1("2013-01-01T02:00:00+01:00");
+    QTest::newRow("Offset without colon") << QString::fromLatin1("2013-01-01T02:00:00+0130");
+    QTest::newRow("Offset hours only") << QString::fromLatin1("2013-01-01T02:00:00-03");
+    QTest::newRow("Zulu") << QString::fromLatin1("2016-02-29T23:59:59Z");
+    QTest::newRow("No offset") << QString::fromLatin1("1999-12-31T00:00:00");
+    QTest::newRow("Milliseconds") << QString::fromLatin1("2013-03-01T02:00:00.250+00:00");
+}
+
+void EventParserTestCase::benchmarkParser()
+{
+    QByteArray feed = syntheticFeed(200);
+    int count = 0;
+
+    QBENCHMARK {
+        count = EventParser::parseEvents(0, feed).size();
+    }
+
+    QCOMPARE(count, 10000);
+}
+
+/* The parser as it was before the fast path, for comparison */
+void EventParserTestCase::benchmarkReferenceParser()
+{
+    QByteArray feed = syntheticFeed(200);
+    int count = 0;
+
+    QBENCHMARK {
+        QXmlStreamReader reader(feed);
+        QList<QSharedPointer<EventData> > events;
+        QScopedPointer<EventData> data;
+
+        while (reader.readNext() != QXmlStreamReader::Invalid && !reader.atEnd())
+        {
+            if (reader.isEndElement() && reader.name() == QLatin1String("entry"))
+                events.append(QSharedPointer<EventData>(data.take()));
+            if (!reader.isStartElement())
+                continue;
+
+            if (reader.name() == QLatin1String("entry"))
+                data.reset(new EventData);
+            else if (!data)
+                continue;
+            else if (reader.name() == QLatin1String("id"))
+                data->setEventId(reader.attributes().value(QLatin1String("raw")).toString().toLongLong());
+            else if (reader.name() == QLatin1String("published"))
+                data->setUtcStartDate(isoToDateTime(reader.readElementText()));
+            else if (reader.name() == QLatin1String("updated"))
+            {
+                QString d = reader.readElementText();
+                if (d.isEmpty())
+                    data->setInProgress();
+                else
+                    data->setDurationInSeconds(data->localStartDate().secsTo(isoToDateTime(d)));
+            }
+            else if (reader.name() == QLatin1String("content"))
+                data->setMediaId(reader.attributes().value(QLatin1String("media_id")).toString().toLongLong());
+            else if (reader.name() == QLatin1String("category"))
+            {
+                QStringList cd = reader.attributes().value(QLatin1String("term")).toString().split(QLatin1Char('/'));
+                data->setLocationId(cd[0].toInt());
+                data->setLevel(cd[1]);
+                data->setType(cd[2]);
+            }
+        }
+
+        count = events.size();
+    }
+
+    QCOMPARE(count, 10000);
+}
+
+void EventParserTestCase::benchmarkIsoDateTime()
+{
+    QString string = QString::fromLatin1("2013-04-16T16:10:03-05:00");
+    qint64 msecs;
+
+    QBENCHMARK {
+        parseIsoDateTime(QStringRef(&string), &msecs);
+    }
+}
+
+void EventParserTestCase::benchmarkReferenceIsoDateTime()
+{
+    QString string = QString::fromLatin1("2013-04-16T16:10:03-05:00");
+
+    QBENCHMARK {
+        isoToDateTime(string);
+    }
+}
+
 QTEST_MAIN(EventParserTestCase)
 
 #include "EventParserTestCase.moc"
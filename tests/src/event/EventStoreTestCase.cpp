@@ -0,0 +1,134 @@
+#include "event/EventStore.h"
+#include <QtTest/QtTest>
+#include <QDebug>
+
+const char *jpegFormatName = "jpeg"; // hack
+
+class EventStoreTestCase : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testRoundTrip();
+    void testInProgress();
+    void testSlotReuse();
+    void testUpdate();
+    void testMemoryUsage();
+
+private:
+    EventData makeEvent(qint64 id, int locationId = 1);
+};
+
+EventData EventStoreTestCase::makeEvent(qint64 id, int locationId)
+{
+    EventData event;
+    event.setEventId(id);
+    event.setMediaId(id * 10);
+    event.setUtcStartDate(QDateTime(QDate(2013, 4, 16), QTime(16, 10, 3), Qt::UTC).addSecs(id * 60));
+    event.setDurationInSeconds(30);
+    event.setLocationId(locationId);
+    event.setLevel(EventLevel::Alarm);
+    event.setType(EventType::CameraMotion);
+    event.setServerDateTzOffsetMins(-300);
+    return event;
+}
+
+void EventStoreTestCase::testRoundTrip()
+{
+    EventStore store;
+    EventData event = makeEvent(42);
+
+    int slot = store.insert(event);
+    QCOMPARE(store.size(), 1);
+
+    EventRef ref = store.ref(slot);
+    QVERIFY(ref.isValid());
+    QCOMPARE(ref.eventId(), Q_INT64_C(42));
+    QCOMPARE(ref.mediaId(), Q_INT64_C(420));
+    QCOMPARE(ref.localStartDate(), event.localStartDate());
+    QCOMPARE(ref.localEndDate(), event.localEndDate());
+    QCOMPARE(ref.durationInSeconds(), 30);
+    QCOMPARE(ref.locationId(), 1);
+    QCOMPARE(ref.level().level, EventLevel::Alarm);
+    QCOMPARE(ref.type().type, EventType::CameraMotion);
+    QCOMPARE(ref.serverDateTzOffsetMins(), qint16(-300));
+
+    EventData copy = ref.toEventData();
+    QCOMPARE(copy.eventId(), event.eventId());
+    QCOMPARE(copy.localStartDate(), event.localStartDate());
+    QCOMPARE(copy.serverStartDate(), event.serverStartDate());
+    QCOMPARE(copy.uiDuration(), event.uiDuration());
+    QVERIFY(store.matches(slot, event));
+}
+
+void EventStoreTestCase::testInProgress()
+{
+    EventStore store;
+    EventData event = makeEvent(1);
+    event.setInProgress();
+
+    EventRef ref = store.ref(store.insert(event));
+    QVERIFY(ref.inProgress());
+    QVERIFY(!ref.hasDuration());
+    QCOMPARE(ref.endTime(), ref.startTime());
+    QCOMPARE(ref.uiDuration(), event.uiDuration());
+}
+
+void EventStoreTestCase::testSlotReuse()
+{
+    EventStore store;
+    int a = store.insert(makeEvent(1));
+    int b = store.insert(makeEvent(2, 2));
+    int c = store.insert(makeEvent(3));
+
+    store.remove(b);
+    QCOMPARE(store.size(), 2);
+    QCOMPARE(store.ref(a).eventId(), Q_INT64_C(1));
+    QCOMPARE(store.ref(c).eventId(), Q_INT64_C(3));
+
+    int d = store.insert(makeEvent(4));
+    QCOMPARE(d, b);
+    QCOMPARE(store.slotCount(), 3);
+    QCOMPARE(store.ref(d).eventId(), Q_INT64_C(4));
+    QCOMPARE(store.ref(d).locationId(), 1);
+
+    store.remove(a);
+    store.remove(c);
+    store.remove(d);
+    QVERIFY(store.isEmpty());
+    QCOMPARE(store.slotCount(), 0);
+}
+
+void EventStoreTestCase::testUpdate()
+{
+    EventStore store;
+    EventData event = makeEvent(7);
+    event.setInProgress();
+    int slot = store.insert(event);
+
+    EventData finished = makeEvent(7, 3);
+    QVERIFY(!store.matches(slot, finished));
+
+    store.update(slot, finished);
+    QVERIFY(store.matches(slot, finished));
+    QCOMPARE(store.ref(slot).durationInSeconds(), 30);
+    QCOMPARE(store.ref(slot).locationId(), 3);
+}
+
+void EventStoreTestCase::testMemoryUsage()
+{
+    const int count = 1000000;
+
+    EventStore store;
+    for (int i = 0; i < count; ++i)
+        store.insert(makeEvent(i, i % 16));
+
+    qint64 bytesPerEvent = store.memoryUsage() / count;
+    qDebug() << "Bytes per event:" << bytesPerEvent;
+    /* Columns grow geometrically, so allow for spare capacity */
+    QVERIFY(bytesPerEvent <= 80);
+}
+
+QTEST_MAIN(EventStoreTestCase)
+
+#include "EventStoreTestCase.moc"
@@ -0,0 +1,87 @@
+#include "bluecherry-config.h"
+#include "core/EventData.h"
+#include "event/EventParser.h"
+#include "event/EventsLoader.h"
+#include <QtTest/QtTest>
+#include <QDebug>
+
+const char *jpegFormatName = "jpeg"; // hack
+
+typedef QList<QSharedPointer<EventData> > EventList;
+
+Q_DECLARE_METATYPE(EventList)
+
+class EventsLoaderTestCase : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testBatches();
+
+private:
+    QByteArray readFile(const QString &fileName);
+    static int entryEnd(const QByteArray &feed, int entries);
+
+};
+
+QByteArray EventsLoaderTestCase::readFile(const QString &fileName)
+{
+    QFile file(QString::fromLatin1("%1/event/%2").arg(QString::fromLatin1(TEST_DATA_DIR)).arg(fileName));
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    return file.readAll();
+}
+
+/* Position just after the given number of entries */
+int EventsLoaderTestCase::entryEnd(const QByteArray &feed, int entries)
+{
+    int pos = 0;
+    for (int i = 0; i < entries; ++i)
+        pos = feed.indexOf("</entry>", pos) + int(strlen("</entry>"));
+    return pos;
+}
+
+void EventsLoaderTestCase::initTestCase()
+{
+    qRegisterMetaType<EventList>();
+}
+
+/* The reply arrives in three pieces: the first batch goes out at once, the second piece
+ * is held back until the batch interval passed, and then goes out with the third */
+void EventsLoaderTestCase::testBatches()
+{
+    QByteArray feed = readFile(QLatin1String("v2demo.xml"));
+    EventList expected = EventParser::parseEvents(0, feed);
+    QCOMPARE(expected.size(), 50);
+
+    int first = entryEnd(feed, 10);
+    int second = entryEnd(feed, 20);
+
+    EventsLoader loader(0);
+    QSignalSpy spy(&loader, SIGNAL(eventsParsed(DVRServer*,QList<QSharedPointer<EventData> >)));
+
+    /* Half an entry only completes with the next piece */
+    loader.addReplyData(feed.left(first + 10));
+    QCOMPARE(spy.count(), 1);
+    EventList batch = spy.at(0).at(1).value<EventList>();
+    QCOMPARE(batch.size(), 10);
+    for (int i = 0; i < batch.size(); ++i)
+        QCOMPARE(batch[i]->eventId(), expected[i]->eventId());
+
+    loader.addReplyData(feed.mid(first + 10, second - first - 10));
+    QCOMPARE(spy.count(), 1);
+
+    QTest::qWait(300);
+    loader.addReplyData(feed.mid(second));
+    QCOMPARE(spy.count(), 2);
+    batch = spy.at(1).at(1).value<EventList>();
+    QCOMPARE(batch.size(), 40);
+    for (int i = 0; i < batch.size(); ++i)
+        QCOMPARE(batch[i]->eventId(), expected[i + 10]->eventId());
+}
+
+QTEST_MAIN(EventsLoaderTestCase)
+
+#include "EventsLoaderTestCase.moc"
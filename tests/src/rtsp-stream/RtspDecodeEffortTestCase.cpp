@@ -0,0 +1,248 @@
+#include "rtsp-stream/RtspDecodeEffort.h"
+#include <QtTest/QtTest>
+#include <math.h>
+
+extern "C" {
+#   include "libavcodec/avcodec.h"
+#   include "libavutil/frame.h"
+#   include "libavutil/opt.h"
+}
+
+class RtspDecodeEffortTestCase : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testLevels();
+    void testHysteresis();
+    void testLowres();
+    void benchmarkDecode_data();
+    void benchmarkDecode();
+
+private:
+    QList<AVPacket *> m_packets;
+    AVCodecParameters *m_codecpar;
+
+    static void fillFrame(AVFrame *frame, int index);
+    QList<AVFrame *> decodeAll(RtspDecodeEffort::Level level);
+};
+
+static const int clipWidth = 1920;
+static const int clipHeight = 1080;
+static const int clipFrames = 50;
+
+void RtspDecodeEffortTestCase::fillFrame(AVFrame *frame, int index)
+{
+    /* Moving diagonal stripes keep the encoder producing real residuals */
+    for (int y = 0; y < frame->height; ++y)
+    {
+        uint8_t *row = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < frame->width; ++x)
+            row[x] = uint8_t(((x + y + index * 8) / 16 % 2) * 160 + (x * y + index) % 64);
+    }
+    for (int plane = 1; plane < 3; ++plane)
+    {
+        for (int y = 0; y < frame->height / 2; ++y)
+            memset(frame->data[plane] + y * frame->linesize[plane], 96 + plane * 32 + index % 16, frame->width / 2);
+    }
+}
+
+/* Encodes a short H.264 clip in memory, so the benchmark needs no sample file. It has
+ * B-frames that nothing is predicted from, so every level has something to skip */
+void RtspDecodeEffortTestCase::initTestCase()
+{
+    m_codecpar = 0;
+
+    AVCodec *encoder = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (!encoder)
+        return;
+
+    AVCodecContext *context = avcodec_alloc_context3(encoder);
+    context->width = clipWidth;
+    context->height = clipHeight;
+    context->pix_fmt = AV_PIX_FMT_YUV420P;
+    context->time_base.num = 1;
+    context->time_base.den = 25;
+    context->gop_size = 25;
+    context->max_b_frames = 2;
+    context->bit_rate = 4000000;
+    if (context->priv_data)
+        av_opt_set(context->priv_data, "b-pyramid", "none", 0);
+
+    if (avcodec_open2(context, encoder, 0) < 0)
+    {
+        avcodec_free_context(&context);
+        return;
+    }
+
+    AVFrame *frame = av_frame_alloc();
+    frame->format = context->pix_fmt;
+    frame->width = clipWidth;
+    frame->height = clipHeight;
+    av_frame_get_buffer(frame, 32);
+
+    for (int i = 0; i <= clipFrames; ++i)
+    {
+        if (i < clipFrames)
+        {
+            av_frame_make_writable(frame);
+            fillFrame(frame, i);
+            frame->pts = i;
+        }
+
+        avcodec_send_frame(context, i < clipFrames ? frame : 0);
+
+        AVPacket *packet = av_packet_alloc();
+        while (avcodec_receive_packet(context, packet) == 0)
+        {
+            m_packets.append(packet);
+            packet = av_packet_alloc();
+        }
+        av_packet_free(&packet);
+    }
+
+    m_codecpar = avcodec_parameters_alloc();
+    avcodec_parameters_from_context(m_codecpar, context);
+
+    av_frame_free(&frame);
+    avcodec_free_context(&context);
+}
+
+void RtspDecodeEffortTestCase::cleanupTestCase()
+{
+    foreach (AVPacket *packet, m_packets)
+        av_packet_free(&packet);
+    m_packets.clear();
+    avcodec_parameters_free(&m_codecpar);
+}
+
+void RtspDecodeEffortTestCase::testLevels()
+{
+    QCOMPARE(RtspDecodeEffort::level(1920, 1080, -1, -1, RtspDecodeEffort::MinimalEffort), RtspDecodeEffort::FullEffort);
+    QCOMPARE(RtspDecodeEffort::level(1920, 1080, 1280, 720, RtspDecodeEffort::FullEffort), RtspDecodeEffort::FullEffort);
+    QCOMPARE(RtspDecodeEffort::level(1920, 1080, 640, 360, RtspDecodeEffort::FullEffort), RtspDecodeEffort::ReducedEffort);
+    QCOMPARE(RtspDecodeEffort::level(1920, 1080, 320, 180, RtspDecodeEffort::FullEffort), RtspDecodeEffort::MinimalEffort);
+}
+
+void RtspDecodeEffortTestCase::testHysteresis()
+{
+    /* Just under the threshold: keep full effort, but a larger tile always gets it back */
+    QCOMPARE(RtspDecodeEffort::level(1920, 1080, 950, 534, RtspDecodeEffort::FullEffort), RtspDecodeEffort::FullEffort);
+    QCOMPARE(RtspDecodeEffort::level(1920, 1080, 950, 534, RtspDecodeEffort::ReducedEffort), RtspDecodeEffort::ReducedEffort);
+    QCOMPARE(RtspDecodeEffort::level(1920, 1080, 1000, 562, RtspDecodeEffort::ReducedEffort), RtspDecodeEffort::FullEffort);
+}
+
+void RtspDecodeEffortTestCase::testLowres()
+{
+    AVCodec *mjpeg = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
+    if (!mjpeg)
+        QSKIP("No MJPEG decoder");
+
+    QCOMPARE(RtspDecodeEffort::lowres(mjpeg, 1920, 1080, -1, -1, 1), 0);
+    QCOMPARE(RtspDecodeEffort::lowres(mjpeg, 1920, 1080, 960, 540, 1), 1);
+    QCOMPARE(RtspDecodeEffort::lowres(mjpeg, 1920, 1080, 426, 240, 1), 2);
+    QCOMPARE(RtspDecodeEffort::lowres(mjpeg, 1920, 1080, 100, 50, 0), mjpeg->max_lowres);
+
+    /* Exactly half the coded size isn't clearly below full resolution, and a tile just
+     * above it goes back to full resolution at once */
+    QCOMPARE(RtspDecodeEffort::lowres(mjpeg, 1920, 1080, 960, 540, 0), 0);
+    QCOMPARE(RtspDecodeEffort::lowres(mjpeg, 1920, 1080, 800, 450, 0), 1);
+    QCOMPARE(RtspDecodeEffort::lowres(mjpeg, 1920, 1080, 1000, 562, 1), 0);
+}
+
+QList<AVFrame *> RtspDecodeEffortTestCase::decodeAll(RtspDecodeEffort::Level level)
+{
+    QList<AVFrame *> frames;
+
+    AVCodecContext *context = avcodec_alloc_context3(0);
+    avcodec_parameters_to_context(context, m_codecpar);
+    context->thread_count = 1;
+    if (avcodec_open2(context, avcodec_find_decoder(m_codecpar->codec_id), 0) < 0)
+    {
+        avcodec_free_context(&context);
+        return frames;
+    }
+    RtspDecodeEffort::apply(context, level);
+
+    AVFrame *frame = av_frame_alloc();
+    for (int i = 0; i <= m_packets.size(); ++i)
+    {
+        avcodec_send_packet(context, i < m_packets.size() ? m_packets[i] : 0);
+        while (avcodec_receive_frame(context, frame) == 0)
+        {
+            frames.append(frame);
+            frame = av_frame_alloc();
+        }
+    }
+
+    av_frame_free(&frame);
+    avcodec_free_context(&context);
+    return frames;
+}
+
+void RtspDecodeEffortTestCase::benchmarkDecode_data()
+{
+    QTest::addColumn<int>("level");
+
+    QTest::newRow("full") << int(RtspDecodeEffort::FullEffort);
+    QTest::newRow("reduced") << int(RtspDecodeEffort::ReducedEffort);
+    QTest::newRow("minimal") << int(RtspDecodeEffort::MinimalEffort);
+}
+
+/* Decoding time of the clip per level. The luma PSNR against the source pictures and the
+ * number of frames decoded are logged alongside, so the CPU saved can be weighed against
+ * what is lost. Frames are matched to the source by pts, as minimal effort drops some */
+void RtspDecodeEffortTestCase::benchmarkDecode()
+{
+    QFETCH(int, level);
+
+    if (!m_codecpar)
+        QSKIP("No H.264 encoder to create the test clip");
+
+    QList<AVFrame *> frames = decodeAll(RtspDecodeEffort::Level(level));
+    QVERIFY(!frames.isEmpty());
+    if (level == RtspDecodeEffort::FullEffort)
+        QCOMPARE(frames.size(), clipFrames);
+
+    AVFrame *source = av_frame_alloc();
+    source->format = AV_PIX_FMT_YUV420P;
+    source->width = clipWidth;
+    source->height = clipHeight;
+    av_frame_get_buffer(source, 32);
+
+    double squaredError = 0;
+    foreach (AVFrame *frame, frames)
+    {
+        QVERIFY(frame->pts >= 0 && frame->pts < clipFrames);
+        fillFrame(source, int(frame->pts));
+
+        for (int y = 0; y < clipHeight; ++y)
+        {
+            const uint8_t *a = source->data[0] + y * source->linesize[0];
+            const uint8_t *b = frame->data[0] + y * frame->linesize[0];
+            for (int x = 0; x < clipWidth; ++x)
+                squaredError += (a[x] - b[x]) * (a[x] - b[x]);
+        }
+    }
+
+    double mse = squaredError / (double(clipWidth) * clipHeight * frames.size());
+    qDebug("%s: %d of %d frames decoded, luma PSNR %.1f dB", RtspDecodeEffort::name(RtspDecodeEffort::Level(level)),
+           frames.size(), clipFrames, mse > 0 ? 10 * log10(255.0 * 255.0 / mse) : 99.0);
+
+    av_frame_free(&source);
+    foreach (AVFrame *frame, frames)
+        av_frame_free(&frame);
+
+    QBENCHMARK
+    {
+        QList<AVFrame *> decoded = decodeAll(RtspDecodeEffort::Level(level));
+        foreach (AVFrame *frame, decoded)
+            av_frame_free(&frame);
+    }
+}
+
+QTEST_MAIN(RtspDecodeEffortTestCase)
+
+#include "RtspDecodeEffortTestCase.moc"
@@ -0,0 +1,171 @@
+#include "rtsp-stream/RtspFisheyeDewarp.h"
+#include "rtsp-stream/RtspStreamFrameFormatter.h"
+#include "rtsp-stream/RtspStreamFrame.h"
+#include <QtTest/QtTest>
+#include <math.h>
+
+extern "C" {
+#   include "libavcodec/avcodec.h"
+#   include "libavutil/frame.h"
+}
+
+class RtspFisheyeDewarpTestCase : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testSupportedFormats();
+    void testMapping();
+    void testUniformImage();
+    void testViewChangeInBackground();
+    void benchmarkDewarp_data();
+    void benchmarkDewarp();
+
+private:
+    static AVFrame * createFrame(int width, int height, int luma);
+};
+
+AVFrame * RtspFisheyeDewarpTestCase::createFrame(int width, int height, int luma)
+{
+    AVFrame *frame = av_frame_alloc();
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    av_frame_get_buffer(frame, 32);
+
+    for (int y = 0; y < height; ++y)
+        memset(frame->data[0] + y * frame->linesize[0], luma, width);
+    for (int y = 0; y < height / 2; ++y)
+    {
+        memset(frame->data[1] + y * frame->linesize[1], 128, width / 2);
+        memset(frame->data[2] + y * frame->linesize[2], 128, width / 2);
+    }
+
+    return frame;
+}
+
+void RtspFisheyeDewarpTestCase::testSupportedFormats()
+{
+    QVERIFY(RtspFisheyeDewarp::isSupportedFormat(AV_PIX_FMT_YUV420P));
+    QVERIFY(RtspFisheyeDewarp::isSupportedFormat(AV_PIX_FMT_YUVJ422P));
+    QVERIFY(!RtspFisheyeDewarp::isSupportedFormat(AV_PIX_FMT_NV12));
+    QVERIFY(!RtspFisheyeDewarp::isSupportedFormat(AV_PIX_FMT_BGRA));
+    QVERIFY(!RtspFisheyeDewarp::isSupportedFormat(AV_PIX_FMT_YUV420P10LE));
+}
+
+void RtspFisheyeDewarpTestCase::testMapping()
+{
+    double x, y;
+
+    /* Straight down is the center of the circle */
+    FisheyeView down(FisheyeView::VirtualPtz, 0, 0, 90);
+    QVERIFY(RtspFisheyeDewarp::mapPoint(down, 2000, 2000, 640, 480, 320, 240, &x, &y));
+    QVERIFY(qAbs(x - 1000) < 0.01 && qAbs(y - 1000) < 0.01);
+
+    /* The top of a panorama is the edge of the circle */
+    FisheyeView panorama(FisheyeView::Panorama);
+    QVERIFY(RtspFisheyeDewarp::mapPoint(panorama, 2000, 2000, 1600, 400, 0.5, 0.5, &x, &y));
+    QVERIFY(hypot(x - 1000, y - 1000) > 990);
+
+    /* Above the horizon there is nothing to show */
+    FisheyeView horizon(FisheyeView::VirtualPtz, 0, 90, 90);
+    QVERIFY(!RtspFisheyeDewarp::mapPoint(horizon, 2000, 2000, 640, 480, 320, 10, &x, &y));
+    QVERIFY(RtspFisheyeDewarp::mapPoint(horizon, 2000, 2000, 640, 480, 320, 470, &x, &y));
+}
+
+void RtspFisheyeDewarpTestCase::testUniformImage()
+{
+    AVFrame *src = createFrame(1024, 1024, 100);
+    AVFrame *dst = createFrame(640, 480, 0);
+
+    RtspFisheyeDewarp dewarp;
+    dewarp.setGeometry(FisheyeView(FisheyeView::QuadView), AV_PIX_FMT_YUV420P, 1024, 1024, 640, 480);
+    QVERIFY(dewarp.isValid());
+
+    /* Split like the formatter does; sampling a flat image must give the same value */
+    dewarp.remapRows(src->data, src->linesize, dst->data, dst->linesize, 0, 240);
+    dewarp.remapRows(src->data, src->linesize, dst->data, dst->linesize, 240, 480);
+
+    static const int centers[][2] = { { 160, 120 }, { 480, 120 }, { 160, 360 }, { 480, 360 } };
+    for (int i = 0; i < 4; ++i)
+    {
+        QCOMPARE(int(dst->data[0][centers[i][1] * dst->linesize[0] + centers[i][0]]), 100);
+        QCOMPARE(int(dst->data[1][centers[i][1] / 2 * dst->linesize[1] + centers[i][0] / 2]), 128);
+    }
+
+    av_frame_free(&src);
+    av_frame_free(&dst);
+}
+
+void RtspFisheyeDewarpTestCase::testViewChangeInBackground()
+{
+    /* A size no other test uses, so that nothing is cached yet */
+    RtspFisheyeDewarp dewarp;
+    dewarp.setGeometry(FisheyeView(FisheyeView::VirtualPtz, 10, 45, 90), AV_PIX_FMT_YUV420P, 1000, 1000, 320, 240);
+    QVERIFY(dewarp.isValid());
+    QCOMPARE(dewarp.view(), FisheyeView(FisheyeView::VirtualPtz, 10, 45, 90));
+
+    /* Steering keeps the current tables until the new ones are built */
+    FisheyeView steered(FisheyeView::VirtualPtz, 123.3, 45.1, 90);
+    dewarp.setGeometry(steered, AV_PIX_FMT_YUV420P, 1000, 1000, 320, 240);
+    QVERIFY(dewarp.isValid());
+    QCOMPARE(dewarp.view(), FisheyeView(FisheyeView::VirtualPtz, 10, 45, 90));
+
+    QThreadPool::globalInstance()->waitForDone();
+    dewarp.setGeometry(steered, AV_PIX_FMT_YUV420P, 1000, 1000, 320, 240);
+    QCOMPARE(dewarp.view(), FisheyeView(FisheyeView::VirtualPtz, 123.25, 45, 90));
+
+    /* A new geometry can't reuse the old tables, so it is built right away */
+    dewarp.setGeometry(steered, AV_PIX_FMT_YUV420P, 1000, 1000, 640, 480);
+    QVERIFY(dewarp.isValid());
+    QCOMPARE(dewarp.view(), FisheyeView(FisheyeView::VirtualPtz, 123.25, 45, 90));
+}
+
+void RtspFisheyeDewarpTestCase::benchmarkDewarp_data()
+{
+    QTest::addColumn<int>("mode");
+    QTest::addColumn<int>("slices");
+
+    static const char *modeNames[] = { "off", "panorama", "quad", "ptz" };
+    for (int mode = FisheyeView::Off; mode <= FisheyeView::VirtualPtz; ++mode)
+    {
+        for (int slices = 1; slices <= 8; slices *= 8)
+        {
+            QTest::newRow(qPrintable(QString::fromLatin1("%1, %2 slices").arg(QLatin1String(modeNames[mode])).arg(slices)))
+                    << mode << slices;
+        }
+    }
+}
+
+/* A 12 MP fisheye frame shown full screen; the tables are built before measuring, as
+ * they are once per view */
+void RtspFisheyeDewarpTestCase::benchmarkDewarp()
+{
+    QFETCH(int, mode);
+    QFETCH(int, slices);
+
+    AVCodecParameters *codecpar = avcodec_parameters_alloc();
+    codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    codecpar->codec_id = AV_CODEC_ID_H264;
+    codecpar->format = AV_PIX_FMT_YUV420P;
+    codecpar->width = 4000;
+    codecpar->height = 3000;
+    AVFrame *frame = createFrame(4000, 3000, 100);
+
+    RtspStreamFrameFormatter formatter(codecpar);
+    formatter.setMaxSlices(slices);
+    formatter.setFisheyeView(FisheyeView(FisheyeView::Mode(mode)));
+    delete formatter.formatFrame(frame, 1920, 1080);
+
+    QBENCHMARK
+    {
+        delete formatter.formatFrame(frame, 1920, 1080);
+    }
+
+    av_frame_free(&frame);
+    avcodec_parameters_free(&codecpar);
+}
+
+QTEST_MAIN(RtspFisheyeDewarpTestCase)
+
+#include "RtspFisheyeDewarpTestCase.moc"
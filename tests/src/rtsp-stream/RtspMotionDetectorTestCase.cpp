@@ -0,0 +1,156 @@
+#include "rtsp-stream/RtspMotionDetector.h"
+#include <QtTest/QtTest>
+
+extern "C" {
+#   include "libavutil/frame.h"
+}
+
+class RtspMotionDetectorTestCase : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testUnsupportedFormat();
+    void testStaticScene();
+    void testMovingBlock();
+    void testStoppedBlockBecomesBackground();
+    void benchmarkDetection_data();
+    void benchmarkDetection();
+
+private:
+    static AVFrame * createFrame(int width, int height, AVPixelFormat format = AV_PIX_FMT_YUV420P);
+    static void drawScene(AVFrame *frame, int blockX, int blockY);
+    static int cellAt(const AVFrame *frame, int x, int y);
+};
+
+AVFrame * RtspMotionDetectorTestCase::createFrame(int width, int height, AVPixelFormat format)
+{
+    AVFrame *frame = av_frame_alloc();
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    av_frame_get_buffer(frame, 32);
+    return frame;
+}
+
+/* A gradient background with a bright 200x200 block, or no block for negative positions */
+void RtspMotionDetectorTestCase::drawScene(AVFrame *frame, int blockX, int blockY)
+{
+    for (int y = 0; y < frame->height; ++y)
+    {
+        uint8_t *line = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < frame->width; ++x)
+        {
+            bool inBlock = blockX >= 0 && x >= blockX && x < blockX + 200 && y >= blockY && y < blockY + 200;
+            line[x] = inBlock ? 230 : uint8_t(40 + (x + y) % 64);
+        }
+    }
+}
+
+int RtspMotionDetectorTestCase::cellAt(const AVFrame *frame, int x, int y)
+{
+    return (y * RtspMotionDetector::gridRows / frame->height) * RtspMotionDetector::gridColumns
+            + x * RtspMotionDetector::gridColumns / frame->width;
+}
+
+void RtspMotionDetectorTestCase::testUnsupportedFormat()
+{
+    AVFrame *frame = createFrame(640, 480, AV_PIX_FMT_BGRA);
+    RtspMotionDetector detector;
+
+    for (int i = 0; i < 5; ++i)
+        QVERIFY(detector.process(frame).isEmpty());
+
+    av_frame_free(&frame);
+}
+
+void RtspMotionDetectorTestCase::testStaticScene()
+{
+    AVFrame *frame = createFrame(1920, 1080);
+    drawScene(frame, 400, 300);
+    RtspMotionDetector detector;
+
+    QBitArray cells;
+    for (int i = 0; i < 10; ++i)
+        cells = detector.process(frame);
+
+    QCOMPARE(cells.size(), RtspMotionDetector::gridColumns * RtspMotionDetector::gridRows);
+    QCOMPARE(cells.count(true), 0);
+
+    av_frame_free(&frame);
+}
+
+void RtspMotionDetectorTestCase::testMovingBlock()
+{
+    AVFrame *frame = createFrame(1920, 1080);
+    RtspMotionDetector detector;
+
+    drawScene(frame, -1, -1);
+    for (int i = 0; i < 5; ++i)
+        detector.process(frame);
+
+    drawScene(frame, 1200, 600);
+    QBitArray cells = detector.process(frame);
+
+    QVERIFY(cells.testBit(cellAt(frame, 1300, 700)));
+    QVERIFY(!cells.testBit(cellAt(frame, 100, 100)));
+    QVERIFY(!cells.testBit(cellAt(frame, 1800, 1000)));
+    QVERIFY(cells.count(true) <= 9);
+
+    av_frame_free(&frame);
+}
+
+void RtspMotionDetectorTestCase::testStoppedBlockBecomesBackground()
+{
+    AVFrame *frame = createFrame(1280, 720);
+    RtspMotionDetector detector;
+
+    drawScene(frame, -1, -1);
+    for (int i = 0; i < 5; ++i)
+        detector.process(frame);
+
+    drawScene(frame, 500, 300);
+    QVERIFY(detector.process(frame).count(true) > 0);
+
+    /* The background steps one level per frame towards the block */
+    QBitArray cells;
+    for (int i = 0; i < 255; ++i)
+        cells = detector.process(frame);
+    QCOMPARE(cells.count(true), 0);
+
+    av_frame_free(&frame);
+}
+
+void RtspMotionDetectorTestCase::benchmarkDetection_data()
+{
+    QTest::addColumn<int>("width");
+    QTest::addColumn<int>("height");
+
+    QTest::newRow("1920x1080") << 1920 << 1080;
+    QTest::newRow("4000x3000") << 4000 << 3000;
+}
+
+/* Per camera at 30 fps, staying under 1% of a core leaves about 330 usecs per frame */
+void RtspMotionDetectorTestCase::benchmarkDetection()
+{
+    QFETCH(int, width);
+    QFETCH(int, height);
+
+    AVFrame *frames[2] = { createFrame(width, height), createFrame(width, height) };
+    drawScene(frames[0], 100, 100);
+    drawScene(frames[1], 140, 100);
+
+    RtspMotionDetector detector;
+    detector.process(frames[0]);
+
+    int i = 0;
+    QBENCHMARK {
+        detector.process(frames[++i & 1]);
+    }
+
+    av_frame_free(&frames[0]);
+    av_frame_free(&frames[1]);
+}
+
+QTEST_MAIN(RtspMotionDetectorTestCase)
+#include "RtspMotionDetectorTestCase.moc"
@@ -0,0 +1,184 @@
+#include "rtsp-stream/RtspStreamFrameFormatter.h"
+#include "rtsp-stream/RtspStreamFrame.h"
+#include <QtTest/QtTest>
+
+extern "C" {
+#   include "libavcodec/avcodec.h"
+#   include "libavutil/frame.h"
+}
+
+class RtspStreamFrameFormatterTestCase : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testSliceCount();
+    void testSlicedMatchesSingle();
+    void testCrop();
+    void benchmarkScaling_data();
+    void benchmarkScaling();
+
+private:
+    static AVCodecParameters * createParameters(int width, int height);
+    static AVFrame * createFrame(int width, int height);
+};
+
+AVCodecParameters * RtspStreamFrameFormatterTestCase::createParameters(int width, int height)
+{
+    AVCodecParameters *codecpar = avcodec_parameters_alloc();
+    codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    codecpar->codec_id = AV_CODEC_ID_H264;
+    codecpar->format = AV_PIX_FMT_YUV420P;
+    codecpar->width = width;
+    codecpar->height = height;
+    return codecpar;
+}
+
+AVFrame * RtspStreamFrameFormatterTestCase::createFrame(int width, int height)
+{
+    AVFrame *frame = av_frame_alloc();
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    av_frame_get_buffer(frame, 32);
+
+    /* A gradient, so that misplaced bands show up as differences */
+    for (int y = 0; y < height; ++y)
+        memset(frame->data[0] + y * frame->linesize[0], y * 255 / height, width);
+    for (int y = 0; y < height / 2; ++y)
+    {
+        memset(frame->data[1] + y * frame->linesize[1], 64 + y * 128 / height, width / 2);
+        memset(frame->data[2] + y * frame->linesize[2], 192 - y * 128 / height, width / 2);
+    }
+
+    return frame;
+}
+
+void RtspStreamFrameFormatterTestCase::testSliceCount()
+{
+    AVCodecParameters *codecpar = createParameters(3840, 2160);
+    AVFrame *frame = createFrame(3840, 2160);
+
+    RtspStreamFrameFormatter formatter(codecpar);
+    formatter.setMaxSlices(4);
+    delete formatter.formatFrame(frame, -1, -1);
+    QCOMPARE(formatter.sliceCount(), 4);
+
+    formatter.setMaxSlices(1);
+    delete formatter.formatFrame(frame, -1, -1);
+    QCOMPARE(formatter.sliceCount(), 1);
+
+    av_frame_free(&frame);
+    avcodec_parameters_free(&codecpar);
+}
+
+void RtspStreamFrameFormatterTestCase::testSlicedMatchesSingle()
+{
+    AVCodecParameters *codecpar = createParameters(3840, 2160);
+    AVFrame *frame = createFrame(3840, 2160);
+
+    RtspStreamFrameFormatter single(codecpar);
+    single.setMaxSlices(1);
+    RtspStreamFrameFormatter sliced(codecpar);
+    sliced.setMaxSlices(8);
+
+    RtspStreamFrame *expected = single.formatFrame(frame, 1920, 1080);
+    RtspStreamFrame *actual = sliced.formatFrame(frame, 1920, 1080);
+
+    /* Band edges are filtered separately; allow rounding differences only */
+    int maxDifference = 0;
+    for (int y = 0; y < 1080; ++y)
+    {
+        const uint8_t *a = expected->avFrame()->data[0] + y * expected->avFrame()->linesize[0];
+        const uint8_t *b = actual->avFrame()->data[0] + y * actual->avFrame()->linesize[0];
+        for (int x = 0; x < 1920 * 4; ++x)
+            maxDifference = qMax(maxDifference, qAbs(int(a[x]) - int(b[x])));
+    }
+    QVERIFY(maxDifference <= 4);
+
+    delete expected;
+    delete actual;
+    av_frame_free(&frame);
+    avcodec_parameters_free(&codecpar);
+}
+
+void RtspStreamFrameFormatterTestCase::testCrop()
+{
+    AVCodecParameters *codecpar = createParameters(1920, 1080);
+    AVFrame *frame = createFrame(1920, 1080);
+
+    RtspStreamFrameFormatter formatter(codecpar);
+    RtspStreamFrame *whole = formatter.formatFrame(frame, -1, -1);
+    RtspStreamFrame *cropped = formatter.formatFrame(frame, 960, 540, QRectF(0.25, 0.25, 0.5, 0.5));
+
+    QCOMPARE(cropped->crop(), QRectF(0.25, 0.25, 0.5, 0.5));
+    QCOMPARE(cropped->avFrame()->width, 960);
+    QCOMPARE(cropped->avFrame()->height, 540);
+
+    /* Converted at its own size, the crop is the same as that part of the whole frame */
+    int maxDifference = 0;
+    for (int y = 0; y < 540; ++y)
+    {
+        const uint8_t *a = whole->avFrame()->data[0] + (y + 270) * whole->avFrame()->linesize[0] + 480 * 4;
+        const uint8_t *b = cropped->avFrame()->data[0] + y * cropped->avFrame()->linesize[0];
+        for (int x = 0; x < 960 * 4; ++x)
+            maxDifference = qMax(maxDifference, qAbs(int(a[x]) - int(b[x])));
+    }
+    QVERIFY(maxDifference <= 2);
+    delete cropped;
+
+    /* Odd edges are widened to whole chroma samples */
+    cropped = formatter.formatFrame(frame, -1, -1, QRectF(301.0 / 1920, 101.0 / 1080, 0.5, 0.5));
+    QCOMPARE(cropped->crop().x() * 1920, 300.0);
+    QCOMPARE(cropped->crop().y() * 1080, 100.0);
+    QCOMPARE(cropped->avFrame()->width % 2, 0);
+
+    delete cropped;
+    delete whole;
+    av_frame_free(&frame);
+    avcodec_parameters_free(&codecpar);
+}
+
+void RtspStreamFrameFormatterTestCase::benchmarkScaling_data()
+{
+    QTest::addColumn<int>("width");
+    QTest::addColumn<int>("height");
+    QTest::addColumn<int>("slices");
+
+    static const int sizes[][2] = { { 3840, 2160 }, { 4000, 3000 } };
+    for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+    {
+        for (int slices = 1; slices <= 8; slices *= 2)
+        {
+            QTest::newRow(qPrintable(QString::fromLatin1("%1x%2, %3 slices").arg(sizes[i][0]).arg(sizes[i][1]).arg(slices)))
+                    << sizes[i][0] << sizes[i][1] << slices;
+        }
+    }
+}
+
+/* Full-screen conversion of one frame; compare rows of the same size to see how
+ * throughput scales with cores */
+void RtspStreamFrameFormatterTestCase::benchmarkScaling()
+{
+    QFETCH(int, width);
+    QFETCH(int, height);
+    QFETCH(int, slices);
+
+    AVCodecParameters *codecpar = createParameters(width, height);
+    AVFrame *frame = createFrame(width, height);
+
+    RtspStreamFrameFormatter formatter(codecpar);
+    formatter.setMaxSlices(slices);
+
+    QBENCHMARK
+    {
+        delete formatter.formatFrame(frame, 2560, 1440);
+    }
+
+    av_frame_free(&frame);
+    avcodec_parameters_free(&codecpar);
+}
+
+QTEST_MAIN(RtspStreamFrameFormatterTestCase)
+
+#include "RtspStreamFrameFormatterTestCase.moc"
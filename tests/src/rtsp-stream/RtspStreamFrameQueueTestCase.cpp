@@ -0,0 +1,210 @@
+#include "rtsp-stream/RtspStreamFrame.h"
+#include "rtsp-stream/RtspStreamFrameQueue.h"
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+
+extern "C" {
+#   include "libavutil/frame.h"
+#   include "libavutil/mem.h"
+}
+
+/* The decoder and GUI sides of a frame handoff, so the lock-free queue can be measured
+ * against the mutex-protected queue it replaced */
+class FrameHandoff
+{
+public:
+    virtual ~FrameHandoff() { }
+    virtual void enqueue(RtspStreamFrame *frame) = 0;
+    virtual RtspStreamFrame * dequeue() = 0;
+};
+
+/* The queue used before frames were handed over without locks: frames beyond six are
+ * freed by the producer while it holds the lock */
+class MutexFrameHandoff : public FrameHandoff
+{
+public:
+    ~MutexFrameHandoff() { qDeleteAll(m_queue); }
+
+    void enqueue(RtspStreamFrame *frame)
+    {
+        QMutexLocker locker(&m_lock);
+        m_queue.enqueue(frame);
+        while (m_queue.size() >= 6)
+            delete m_queue.dequeue();
+    }
+
+    RtspStreamFrame * dequeue()
+    {
+        QMutexLocker locker(&m_lock);
+        return m_queue.isEmpty() ? 0 : m_queue.dequeue();
+    }
+
+private:
+    QMutex m_lock;
+    QQueue<RtspStreamFrame *> m_queue;
+};
+
+class LockFreeFrameHandoff : public FrameHandoff
+{
+public:
+    LockFreeFrameHandoff() : m_queue(RtspStreamFrameQueue::LatestFrame) { }
+
+    void enqueue(RtspStreamFrame *frame) { m_queue.enqueue(frame); }
+    RtspStreamFrame * dequeue() { return m_queue.dequeue(); }
+
+private:
+    RtspStreamFrameQueue m_queue;
+};
+
+class FrameProducer : public QThread
+{
+public:
+    FrameProducer(FrameHandoff *handoff, int count) : m_handoff(handoff), m_count(count), m_worstEnqueue(0) { }
+
+    qint64 worstEnqueue() const { return m_worstEnqueue; }
+
+protected:
+    void run()
+    {
+        QElapsedTimer timer;
+        for (int i = 0; i < m_count; ++i)
+        {
+            RtspStreamFrame *frame = createLargeFrame();
+            timer.start();
+            m_handoff->enqueue(frame);
+            m_worstEnqueue = qMax(m_worstEnqueue, timer.nsecsElapsed());
+        }
+    }
+
+private:
+    FrameHandoff *m_handoff;
+    int m_count;
+    qint64 m_worstEnqueue;
+
+    /* A 1080p RGB32 picture, so that freeing a dropped frame costs what it does live */
+    static RtspStreamFrame * createLargeFrame()
+    {
+        AVFrame *avFrame = av_frame_alloc();
+        avFrame->data[0] = static_cast<uint8_t *>(av_malloc(1920 * 1080 * 4));
+        avFrame->data[0][0] = 0;
+        return new RtspStreamFrame(avFrame, 1920, 1080);
+    }
+};
+
+class RtspStreamFrameQueueTestCase : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testLatestFrame();
+    void testPaced();
+    void benchmarkHandoff_data();
+    void benchmarkHandoff();
+
+private:
+    static RtspStreamFrame * createFrame(qint64 pts);
+};
+
+RtspStreamFrame * RtspStreamFrameQueueTestCase::createFrame(qint64 pts)
+{
+    AVFrame *avFrame = av_frame_alloc();
+    avFrame->data[0] = static_cast<uint8_t *>(av_malloc(16));
+    RtspStreamFrame *frame = new RtspStreamFrame(avFrame, 4, 1);
+    frame->setPts(pts);
+    return frame;
+}
+
+void RtspStreamFrameQueueTestCase::testLatestFrame()
+{
+    RtspStreamFrameQueue queue(RtspStreamFrameQueue::LatestFrame);
+    QVERIFY(!queue.dequeue());
+
+    queue.enqueue(createFrame(1));
+    queue.enqueue(createFrame(2));
+    queue.enqueue(createFrame(3));
+
+    RtspStreamFrame *frame = queue.dequeue();
+    QVERIFY(frame);
+    QCOMPARE(frame->pts(), Q_INT64_C(3));
+    QCOMPARE(queue.droppedFrames(), 2);
+    delete frame;
+
+    QVERIFY(!queue.dequeue());
+}
+
+void RtspStreamFrameQueueTestCase::testPaced()
+{
+    RtspStreamFrameQueue queue(RtspStreamFrameQueue::Paced, 4);
+    for (int i = 0; i < 6; ++i)
+        queue.enqueue(createFrame(i));
+
+    /* Frames beyond the limit are dropped on arrival; the rest come out in order */
+    for (int i = 0; i < 4; ++i)
+    {
+        RtspStreamFrame *frame = queue.dequeue();
+        QVERIFY(frame);
+        QCOMPARE(frame->pts(), qint64(i));
+        delete frame;
+    }
+
+    QVERIFY(!queue.dequeue());
+    QCOMPARE(queue.droppedFrames(), 2);
+}
+
+void RtspStreamFrameQueueTestCase::benchmarkHandoff_data()
+{
+    QTest::addColumn<bool>("lockFree");
+
+    QTest::newRow("mutex queue") << false;
+    QTest::newRow("lock-free mailbox") << true;
+}
+
+/* The GUI polls while the decoder hands over frames as fast as it can. The result is
+ * the longest the GUI thread waited in a single dequeue(), which is what stalls painting
+ * when the decoder holds the lock; total and producer-side waits are logged. */
+void RtspStreamFrameQueueTestCase::benchmarkHandoff()
+{
+    QFETCH(bool, lockFree);
+
+    QScopedPointer<FrameHandoff> handoff(lockFree ? static_cast<FrameHandoff *>(new LockFreeFrameHandoff)
+                                                  : static_cast<FrameHandoff *>(new MutexFrameHandoff));
+    FrameProducer producer(handoff.data(), 2000);
+
+    qint64 worstDequeue = 0;
+    qint64 totalDequeue = 0;
+    int polls = 0;
+    int frames = 0;
+    QElapsedTimer timer;
+
+    producer.start();
+    while (!producer.isFinished())
+    {
+        timer.start();
+        RtspStreamFrame *frame = handoff->dequeue();
+        qint64 elapsed = timer.nsecsElapsed();
+
+        worstDequeue = qMax(worstDequeue, elapsed);
+        totalDequeue += elapsed;
+        ++polls;
+
+        if (frame)
+        {
+            ++frames;
+            delete frame;
+        }
+    }
+    producer.wait();
+    delete handoff->dequeue();
+
+    qDebug() << "dequeue: worst" << worstDequeue / 1000 << "us, average" << totalDequeue / qMax(polls, 1)
+             << "ns over" << polls << "polls," << frames << "frames taken; enqueue: worst"
+             << producer.worstEnqueue() / 1000 << "us";
+    QTest::setBenchmarkResult(worstDequeue, QTest::WalltimeNanoseconds);
+}
+
+QTEST_MAIN(RtspStreamFrameQueueTestCase)
+
+#include "RtspStreamFrameQueueTestCase.moc"
@@ -0,0 +1,67 @@
+#include "utils/LatencyHistogram.h"
+#include <QtTest/QtTest>
+
+class LatencyHistogramTestCase : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testEmpty();
+    void testBuckets();
+    void testPercentiles();
+    void testNegativeIgnored();
+};
+
+void LatencyHistogramTestCase::testEmpty()
+{
+    LatencyHistogram histogram;
+    QCOMPARE(histogram.count(), 0);
+    QCOMPARE(histogram.mean(), qint64(0));
+    QCOMPARE(histogram.maximum(), qint64(0));
+    QCOMPARE(histogram.percentile(0.5), qint64(0));
+}
+
+void LatencyHistogramTestCase::testBuckets()
+{
+    LatencyHistogram histogram;
+    histogram.record(0);
+    histogram.record(5);
+    histogram.record(6);
+    histogram.record(100000);
+
+    QCOMPARE(histogram.count(), 4);
+    QCOMPARE(histogram.bucketCount(0), 2);
+    QCOMPARE(histogram.bucketCount(1), 1);
+    QCOMPARE(histogram.bucketCount(LatencyHistogram::BucketCount - 1), 1);
+    QCOMPARE(histogram.bucketUpperBound(LatencyHistogram::BucketCount - 1), qint64(-1));
+    QCOMPARE(histogram.maximum(), qint64(100000));
+
+    histogram.clear();
+    QCOMPARE(histogram.count(), 0);
+    QCOMPARE(histogram.bucketCount(0), 0);
+}
+
+void LatencyHistogramTestCase::testPercentiles()
+{
+    LatencyHistogram histogram;
+    for (int i = 0; i < 90; ++i)
+        histogram.record(40);
+    for (int i = 0; i < 10; ++i)
+        histogram.record(180);
+
+    QCOMPARE(histogram.mean(), qint64(54));
+    QCOMPARE(histogram.percentile(0.5), qint64(50));
+    QCOMPARE(histogram.percentile(0.9), qint64(50));
+    QCOMPARE(histogram.percentile(0.99), qint64(180));
+}
+
+void LatencyHistogramTestCase::testNegativeIgnored()
+{
+    LatencyHistogram histogram;
+    histogram.record(-20);
+    QCOMPARE(histogram.count(), 0);
+}
+
+QTEST_MAIN(LatencyHistogramTestCase)
+
+#include "LatencyHistogramTestCase.moc"
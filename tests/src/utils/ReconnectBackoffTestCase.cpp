@@ -0,0 +1,73 @@
+#include "utils/ReconnectBackoff.h"
+#include <QtTest/QtTest>
+
+class ReconnectBackoffTestCase : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testGrowth();
+    void testJitterRange();
+    void testReset();
+    void testStableConnection();
+};
+
+void ReconnectBackoffTestCase::testGrowth()
+{
+    ReconnectBackoff backoff(500, 4000);
+    QCOMPARE(backoff.nominalDelay(), 500);
+
+    backoff.nextDelay();
+    QCOMPARE(backoff.nominalDelay(), 1000);
+    backoff.nextDelay();
+    QCOMPARE(backoff.nominalDelay(), 2000);
+    backoff.nextDelay();
+    QCOMPARE(backoff.nominalDelay(), 4000);
+    backoff.nextDelay();
+    QCOMPARE(backoff.nominalDelay(), 4000);
+    QCOMPARE(backoff.attempts(), 4);
+}
+
+void ReconnectBackoffTestCase::testJitterRange()
+{
+    ReconnectBackoff backoff(500, 30000);
+    for (int i = 0; i < 100; ++i)
+    {
+        int nominal = backoff.nominalDelay();
+        int delay = backoff.nextDelay();
+        QVERIFY(delay >= nominal / 2);
+        QVERIFY(delay <= nominal);
+    }
+}
+
+void ReconnectBackoffTestCase::testReset()
+{
+    ReconnectBackoff backoff(500, 30000);
+    for (int i = 0; i < 10; ++i)
+        backoff.nextDelay();
+
+    backoff.reset();
+    QCOMPARE(backoff.attempts(), 0);
+    QVERIFY(backoff.nextDelay() <= 500);
+}
+
+void ReconnectBackoffTestCase::testStableConnection()
+{
+    ReconnectBackoff backoff(500, 30000, 0);
+    for (int i = 0; i < 10; ++i)
+        backoff.nextDelay();
+
+    backoff.connected();
+    QVERIFY(backoff.nextDelay() <= 500);
+
+    ReconnectBackoff flapping(500, 30000, 60000);
+    for (int i = 0; i < 3; ++i)
+        flapping.nextDelay();
+
+    flapping.connected();
+    QVERIFY(flapping.nextDelay() >= 2000);
+}
+
+QTEST_MAIN(ReconnectBackoffTestCase)
+
+#include "ReconnectBackoffTestCase.moc"
@@ -0,0 +1,58 @@
+#include "utils/StringUtils.h"
+#include <QtTest/QtTest>
+#include <QDebug>
+#include <algorithm>
+
+const char *jpegFormatName = "jpeg"; // hack
+
+class StringUtilsTestCase : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testWithSuffix();
+    void testCollationRanks();
+    void testCollationRanksEmpty();
+};
+
+void StringUtilsTestCase::testWithSuffix()
+{
+    QCOMPARE(withSuffix(QLatin1String("events"), QLatin1String(".dat")), QString::fromLatin1("events.dat"));
+    QCOMPARE(withSuffix(QLatin1String("events.dat"), QLatin1String(".dat")), QString::fromLatin1("events.dat"));
+}
+
+void StringUtilsTestCase::testCollationRanks()
+{
+    QStringList strings;
+    strings << QLatin1String("Parking") << QLatin1String("Entrance") << QLatin1String("Parking")
+            << QLatin1String("Lobby") << QString();
+
+    QVector<int> ranks = collationRanks(strings);
+    QCOMPARE(ranks.size(), strings.size());
+
+    /* Equal strings share a rank */
+    QCOMPARE(ranks[0], ranks[2]);
+
+    /* Ranks order the strings the same way as comparing them */
+    for (int i = 0; i < strings.size(); ++i)
+    {
+        for (int j = 0; j < strings.size(); ++j)
+        {
+            int compared = QString::localeAwareCompare(strings[i], strings[j]);
+            QCOMPARE(ranks[i] < ranks[j], compared < 0);
+            QCOMPARE(ranks[i] == ranks[j], compared == 0);
+        }
+    }
+
+    /* Ranks are dense */
+    QCOMPARE(*std::max_element(ranks.constBegin(), ranks.constEnd()), 3);
+}
+
+void StringUtilsTestCase::testCollationRanksEmpty()
+{
+    QVERIFY(collationRanks(QStringList()).isEmpty());
+}
+
+QTEST_MAIN(StringUtilsTestCase)
+
+#include "StringUtilsTestCase.moc"